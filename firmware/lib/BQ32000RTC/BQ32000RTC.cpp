@@ -5,6 +5,7 @@
 #include <Arduino.h>
 #include <pgmspace.h>
 #include "BQ32000RTC.h"
+#include <Metrics.h>
 
 BQ32000RTC::BQ32000RTC() {
     begin(D3, D4);
@@ -31,13 +32,13 @@ bool BQ32000RTC::read(tmElements_t &tm) {
     uint8_t sec;
     Wire.beginTransmission(BQ32000_ADDRESS);
     Wire.write((byte) 0);
-    if (Wire.endTransmission() != 0) {
+    if (endTransmission() != 0) {
         exists = false;
         return false;
     }
     exists = true;
     delayMicroseconds(60);
-    Wire.requestFrom(BQ32000_ADDRESS, 7);
+    requestFrom(7);
     sec = Wire.read();
     tm.Second = bcd2bin(sec & 0x7f);
     tm.Minute = bcd2bin(Wire.read());
@@ -61,7 +62,7 @@ bool BQ32000RTC::write(tmElements_t &tm) {
     Wire.write(bin2bcd(tm.Day));
     Wire.write(bin2bcd(tm.Month));
     Wire.write(bin2bcd(tm.Year));
-    if(Wire.endTransmission() != 0) {
+    if(endTransmission() != 0) {
         exists = false;
         return false;
     }
@@ -81,7 +82,7 @@ void BQ32000RTC::setIRQ(uint8_t state) {
         Wire.write(BQ32000_SFKEY1_VAL);
         Wire.write(BQ32000_SFKEY2_VAL);
         Wire.write((state == 1) ? BQ32000_FTF_1HZ : BQ32000_FTF_512HZ);
-        Wire.endTransmission();
+        endTransmission();
         delayMicroseconds(60);
     }
     value = readRegister(BQ32000_CAL_CFG1);
@@ -143,8 +144,8 @@ uint8_t BQ32000RTC::readRegister(uint8_t address) {
      */
     Wire.beginTransmission(BQ32000_ADDRESS);
     Wire.write((byte) address);
-    Wire.endTransmission();
-    Wire.requestFrom(BQ32000_ADDRESS, 1);
+    endTransmission();
+    requestFrom(1);
     // Get register state:
     return Wire.read();
 }
@@ -155,7 +156,7 @@ void BQ32000RTC::writeRegister(uint8_t address, uint8_t value) {
     Wire.beginTransmission(BQ32000_ADDRESS);
     Wire.write(address);
     Wire.write(value);
-    Wire.endTransmission();
+    endTransmission();
     delayMicroseconds(60);
 }
 
@@ -163,6 +164,31 @@ unsigned char BQ32000RTC::isRunning() {
     return !(readRegister(0x0)>>7);
 }
 
+// Counts the transaction, and an error if the chip didn't acknowledge.
+uint8_t BQ32000RTC::endTransmission() {
+    uint8_t status = Wire.endTransmission();
+    metrics.increment(transactionMetric);
+    if(status != 0) {
+        metrics.increment(errorMetric);
+    }
+    return status;
+}
+// Counts the transaction, and an error if fewer bytes came back.
+uint8_t BQ32000RTC::requestFrom(uint8_t quantity) {
+    uint8_t received = Wire.requestFrom((uint8_t)BQ32000_ADDRESS, quantity);
+    metrics.increment(transactionMetric);
+    if(received != quantity) {
+        metrics.increment(errorMetric);
+    }
+    return received;
+}
+void BQ32000RTC::setMetrics(int8_t transactions, int8_t errors) {
+    transactionMetric = transactions;
+    errorMetric = errors;
+}
+
 bool BQ32000RTC::exists = false;
+int8_t BQ32000RTC::transactionMetric = -1;
+int8_t BQ32000RTC::errorMetric = -1;
 
 BQ32000RTC RTC = BQ32000RTC();
\ No newline at end of file
@@ -62,9 +62,15 @@ public:
     // utility functions:
     static uint8_t readRegister(uint8_t address);
     static void writeRegister(uint8_t address, uint8_t value);
+    // Metrics ids that count the I2C transactions and the failed ones, -1 for none.
+    static void setMetrics(int8_t transactions, int8_t errors);
 
 private:
     static bool exists;
+    static int8_t transactionMetric;
+    static int8_t errorMetric;
+    static uint8_t endTransmission();
+    static uint8_t requestFrom(uint8_t quantity);
     static uint8_t bcd2bin (uint8_t val) { return val - 6 * (val >> 4); }
     static uint8_t bin2bcd (uint8_t val) { return val + 6 * (val / 10); }
 };
@@ -0,0 +1,172 @@
+#include "Config.h"
+#include "ConfigLog.h"
+#include <EEPROM.h>
+
+static_assert(sizeof(Config) <= CONFIG_LOG_BLOB_SIZE, "The config doesn't fit into the ConfigLog");
+
+// Addresses of the settings in the legacy layout, version 0.
+enum LegacyAddress : uint16_t {
+    LEGACY_SSID = 0,
+    LEGACY_PASSWORD = 50,
+    LEGACY_TARGET_SSID = 100,
+    LEGACY_TARGET_PW = 150,
+    LEGACY_WEATHER_KEY = 200,
+    LEGACY_WEATHER_FORMAT = 250,
+    LEGACY_WEATHER_ID = 251,
+    LEGACY_CRYPTO_KEY = 302,            // 49 bytes, the last one was overwritten by the crypto id.
+    LEGACY_CRYPTO_ID = 351,
+    LEGACY_MANUAL_TIME_FLAG = 381,
+    LEGACY_ENABLE_DATE = 382,
+    LEGACY_ENABLE_TIME = 383,
+    LEGACY_ENABLE_TEMP = 384,
+    LEGACY_ENABLE_CRYPTO = 385,
+    LEGACY_ENABLE_DST = 386,
+    LEGACY_ENABLE_24H = 387,
+    LEGACY_OFFSET = 388,
+    LEGACY_API_QUOTA = 400,
+    LEGACY_MQTT_HOST = 420,
+    LEGACY_MQTT_PORT = 460,
+    LEGACY_MQTT_TOPIC = 462,
+    LEGACY_NON_INIT = 500               // 0 once the defaults were written.
+};
+
+// Copies a legacy text. Settings that were never written read as 0xFF and keep their default.
+static void copyLegacyText(char *text, size_t size, const uint8_t *stored, uint16_t address, size_t length) {
+    if(stored[address] == 0xFF) {
+        return;
+    }
+    length = min(length, size - 1);
+    memcpy(text, stored + address, length);
+    text[length] = '\0';
+}
+static void copyLegacyFlag(uint8_t &flag, const uint8_t *stored, uint16_t address) {
+    if(stored[address] <= 1) {
+        flag = stored[address];
+    }
+}
+
+/*                                                                          *
+ *  Reads the config from the flash log, or from the EEPROM if the log is   *
+ *  still empty. The blob is checked where it is stored and then copied     *
+ *  with one memcpy(). If it can't be used, the defaults are loaded.        *
+ *  Nothing is written here, load() comes before the first frame. A config  *
+ *  that was migrated, or never saved, should be written with flush(true)   *
+ *  once the time is shown. A corrupt one is left as it is until the next   *
+ *  save, NixieTap runs on the defaults, with the default hotspot, so it    *
+ *  can be configured again.                                                *
+ *                                                                          */
+ConfigStatus Config::load() {
+    ConfigStatus status;
+    setDefaults();
+    if(configLog.begin() && configLog.getBlobSize() > 0) {
+        status = loadBlob(configLog.getBlob(), configLog.getBlobSize());
+    } else {
+        EEPROM.begin(CONFIG_EEPROM_SIZE);
+        const uint8_t *stored = EEPROM.getConstDataPtr();
+        status = loadBlob(stored, CONFIG_EEPROM_SIZE);
+        if(status == CONFIG_EMPTY && stored[LEGACY_NON_INIT] == 0) {
+            migrateLegacy(stored);
+            status = CONFIG_MIGRATED;
+        } else if(status == CONFIG_LOADED && configLog.isAvailable()) {
+            status = CONFIG_MIGRATED;   // Moved from the EEPROM to the log.
+        }
+        EEPROM.end();
+    }
+    return status;
+}
+// Schedules a write of the config, writes that follow shortly after are coalesced with it.
+void Config::save() {
+    configLog.requestWrite();
+}
+/*                                                                  *
+ *  Writes the config if a save is due, or right away if forced.    *
+ *  Returns true if it was written.                                 *
+ *                                                                  */
+bool Config::flush(bool force) {
+    if(!force && !configLog.isWriteDue()) {
+        return false;
+    }
+    magic = CONFIG_MAGIC;
+    version = CONFIG_VERSION;
+    size = sizeof(Config);
+    crc = crc32((const uint8_t *)this + CONFIG_HEADER_SIZE, sizeof(Config) - CONFIG_HEADER_SIZE);
+    return configLog.write((const uint8_t *)this, sizeof(Config));
+}
+void Config::setDefaults() {
+    memset(this, 0, sizeof(Config));
+    strcpy(ssid, "NixieTap");
+    strcpy(password, "NixieTap");
+    strcpy(mqtt_topic, "nixietap");
+    mqtt_port = MQTT_DEFAULT_PORT;
+    manual_time_flag = 1;
+    enable_time = 1;
+    enable_date = 1;
+}
+/*                                                                          *
+ *  Checks a stored blob and copies it. Fields are only ever appended, so   *
+ *  a blob of an older version is a prefix of this one.                     *
+ *                                                                          */
+ConfigStatus Config::loadBlob(const uint8_t *stored, size_t available) {
+    uint32_t storedMagic, storedCrc;
+    uint16_t storedVersion, storedSize;
+    memcpy(&storedMagic, stored + offsetof(Config, magic), sizeof(storedMagic));
+    memcpy(&storedVersion, stored + offsetof(Config, version), sizeof(storedVersion));
+    memcpy(&storedSize, stored + offsetof(Config, size), sizeof(storedSize));
+    memcpy(&storedCrc, stored + offsetof(Config, crc), sizeof(storedCrc));
+    if(storedMagic != CONFIG_MAGIC) {
+        return CONFIG_EMPTY;
+    }
+    if(storedSize < CONFIG_HEADER_SIZE || storedSize > available
+        || storedCrc != crc32(stored + CONFIG_HEADER_SIZE, storedSize - CONFIG_HEADER_SIZE)) {
+        return CONFIG_CORRUPT;
+    }
+    memcpy(this, stored, min((size_t)storedSize, sizeof(Config)));
+    return storedVersion == CONFIG_VERSION && storedSize == sizeof(Config) ? CONFIG_LOADED : CONFIG_MIGRATED;
+}
+// CRC-32 (IEEE 802.3), the same as zlib.crc32() on the host.
+uint32_t Config::crc32(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for(size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for(uint8_t bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+/*                                                                          *
+ *  Converts the legacy layout. The MQTT broker and the API quota were      *
+ *  added to it later, so on some devices they were never written.          *
+ *                                                                          */
+void Config::migrateLegacy(const uint8_t *stored) {
+    copyLegacyText(ssid, sizeof(ssid), stored, LEGACY_SSID, LEGACY_PASSWORD - LEGACY_SSID);
+    copyLegacyText(password, sizeof(password), stored, LEGACY_PASSWORD, LEGACY_TARGET_SSID - LEGACY_PASSWORD);
+    copyLegacyText(target_ssid, sizeof(target_ssid), stored, LEGACY_TARGET_SSID, LEGACY_TARGET_PW - LEGACY_TARGET_SSID);
+    copyLegacyText(target_pw, sizeof(target_pw), stored, LEGACY_TARGET_PW, LEGACY_WEATHER_KEY - LEGACY_TARGET_PW);
+    copyLegacyText(weather_key, sizeof(weather_key), stored, LEGACY_WEATHER_KEY, LEGACY_WEATHER_FORMAT - LEGACY_WEATHER_KEY);
+    copyLegacyText(weather_id, sizeof(weather_id), stored, LEGACY_WEATHER_ID, CONFIG_TEXT_LENGTH);
+    copyLegacyText(crypto_key, sizeof(crypto_key), stored, LEGACY_CRYPTO_KEY, LEGACY_CRYPTO_ID - LEGACY_CRYPTO_KEY);
+    copyLegacyText(crypto_id, sizeof(crypto_id), stored, LEGACY_CRYPTO_ID, LEGACY_MANUAL_TIME_FLAG - LEGACY_CRYPTO_ID);
+    copyLegacyText(mqtt_host, sizeof(mqtt_host), stored, LEGACY_MQTT_HOST, LEGACY_MQTT_PORT - LEGACY_MQTT_HOST);
+    copyLegacyText(mqtt_topic, sizeof(mqtt_topic), stored, LEGACY_MQTT_TOPIC, LEGACY_NON_INIT - LEGACY_MQTT_TOPIC);
+    copyLegacyFlag(weather_format, stored, LEGACY_WEATHER_FORMAT);
+    copyLegacyFlag(manual_time_flag, stored, LEGACY_MANUAL_TIME_FLAG);
+    copyLegacyFlag(enable_time, stored, LEGACY_ENABLE_TIME);
+    copyLegacyFlag(enable_date, stored, LEGACY_ENABLE_DATE);
+    copyLegacyFlag(enable_crypto, stored, LEGACY_ENABLE_CRYPTO);
+    copyLegacyFlag(enable_temp, stored, LEGACY_ENABLE_TEMP);
+    copyLegacyFlag(enable_24h, stored, LEGACY_ENABLE_24H);
+    copyLegacyFlag(enable_dst, stored, LEGACY_ENABLE_DST);
+    memcpy(&offset, stored + LEGACY_OFFSET, sizeof(offset));
+    uint16_t port;
+    memcpy(&port, stored + LEGACY_MQTT_PORT, sizeof(port));
+    if(port != 0 && port != 0xFFFF) {
+        mqtt_port = port;
+    }
+    if(stored[LEGACY_API_QUOTA] <= 12) {
+        memcpy(&quota, stored + LEGACY_API_QUOTA, sizeof(quota));
+        quota.year = 0;     // Was padding in the legacy layout.
+    }
+}
+
+Config config = Config();
@@ -0,0 +1,99 @@
+#ifndef _CONFIG_h   /* Include guard */
+#define _CONFIG_h
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <ProviderPolicy.h>
+#include <MqttLink.h>
+#include <FastConnect.h>
+
+#define CONFIG_MAGIC 0x4E43F1C0UL       // Stored as C0 F1 43 4E, 0xC0 never appears in text, so it can't be the start of a legacy SSID.
+#define CONFIG_VERSION 1
+#define CONFIG_HEADER_SIZE 12           // Magic, version, size and CRC, the CRC covers everything after them.
+#define CONFIG_EEPROM_SIZE 1024         // Size of the emulated EEPROM, used if there is no room for the ConfigLog.
+#define CONFIG_TEXT_LENGTH 50           // Sizes of the buffers, including the terminating null.
+#define CONFIG_CRYPTO_ID_LENGTH 30
+
+enum ConfigStatus : uint8_t {
+    CONFIG_LOADED = 0,      // Valid config of this version.
+    CONFIG_MIGRATED,        // Valid config of an older version or the legacy layout, converted, not saved yet.
+    CONFIG_EMPTY,           // Nothing was saved yet, the defaults are used and not saved yet.
+    CONFIG_CORRUPT          // The CRC doesn't match, the defaults are used until the config is saved again.
+};
+
+/*                                                                          *
+ *  All of the settings of NixieTap, stored as one blob in the ConfigLog    *
+ *  and read into RAM with a single copy.                                   *
+ *                                                                          *
+ *  The layout has no padding, every field is aligned and the offsets are   *
+ *  checked at compile time below. Fields are only ever appended: a blob    *
+ *  saved by an older version is a prefix of this one and the new fields    *
+ *  keep their defaults, a newer one is cut off. A field that changes its   *
+ *  meaning needs a new version and a step in load(). Version 0 is the      *
+ *  legacy layout, with one EEPROM address per setting.                     *
+ *                                                                          */
+class Config {
+public:
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                                  // sizeof(Config) of the firmware that saved it.
+    uint32_t crc;                                   // CRC-32 of the bytes after the header, up to size.
+    char ssid[CONFIG_TEXT_LENGTH];                  // Hotspot of the config portal.
+    char password[CONFIG_TEXT_LENGTH];
+    char target_ssid[CONFIG_TEXT_LENGTH];           // WiFi network NixieTap connects to.
+    char target_pw[CONFIG_TEXT_LENGTH];
+    char weather_key[CONFIG_TEXT_LENGTH];
+    char weather_id[CONFIG_TEXT_LENGTH];
+    char crypto_key[CONFIG_TEXT_LENGTH];
+    char crypto_id[CONFIG_CRYPTO_ID_LENGTH];
+    char mqtt_host[MQTT_HOST_LENGTH];
+    char mqtt_topic[MQTT_TOPIC_LENGTH];
+    uint16_t mqtt_port;
+    int16_t offset;                                 // Time zone offset in minutes.
+    uint8_t weather_format;                         // 1 is metric.
+    uint8_t manual_time_flag;
+    uint8_t enable_time;
+    uint8_t enable_date;
+    uint8_t enable_crypto;
+    uint8_t enable_temp;
+    uint8_t enable_24h;
+    uint8_t enable_dst;
+    QuotaState quota;                               // Monthly API request counters.
+    uint8_t power_save;                             // 1 turns the radio off between the network jobs.
+    uint8_t mqtt_config;                            // 1 accepts settings on <base>/config/<name>, the broker is trusted.
+    WifiLease wifi_lease;                           // AP and address of the last good WiFi connection.
+
+    ConfigStatus load();
+    void save();
+    bool flush(bool force = false);
+    void setDefaults();
+    static uint32_t crc32(const uint8_t *data, size_t length);
+private:
+    ConfigStatus loadBlob(const uint8_t *stored, size_t available);
+    void migrateLegacy(const uint8_t *stored);
+};
+
+static_assert(offsetof(Config, ssid) == CONFIG_HEADER_SIZE, "The header of the config has changed");
+static_assert(offsetof(Config, password) == 62, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, target_ssid) == 112, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, target_pw) == 162, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, weather_key) == 212, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, weather_id) == 262, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, crypto_key) == 312, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, crypto_id) == 362, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, mqtt_host) == 392, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, mqtt_topic) == 432, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, mqtt_port) == 470, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, offset) == 472, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, weather_format) == 474, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, enable_dst) == 481, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, quota) == 482, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, power_save) == 502, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, mqtt_config) == 503, "The config layout has changed, fields can only be appended");
+static_assert(offsetof(Config, wifi_lease) == 504, "The config layout has changed, fields can only be appended");
+static_assert(sizeof(Config) == 536, "The config has padding, or fields were added without updating the checks");
+static_assert(sizeof(Config) <= CONFIG_EEPROM_SIZE, "The config doesn't fit into the EEPROM");
+
+extern Config config;
+
+#endif // _CONFIG_h
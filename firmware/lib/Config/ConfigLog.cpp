@@ -0,0 +1,286 @@
+#include "ConfigLog.h"
+#include "Config.h"
+#include <EEPROM.h>
+#include <flash_hal.h>
+
+#define CONFIG_LOG_HEADER_SIZE 16
+#define CONFIG_LOG_RECORD_SIZE 8
+#define CONFIG_LOG_COMMIT 0x8000        // Set in the length of the last record of a write, the write is only applied up to it.
+
+struct ConfigLogRecord {
+    uint32_t crc;
+    uint16_t offset;
+    uint16_t length;
+};
+
+ConfigLog::ConfigLog() {
+}
+uint32_t ConfigLog::sectorAddress(uint8_t sector) {
+    return base + sector * CONFIG_LOG_SECTOR_SIZE;
+}
+bool ConfigLog::readHeader(uint8_t sector, uint32_t &sequence, uint32_t &eraseCount) {
+    uint32_t header[CONFIG_LOG_HEADER_SIZE / 4];
+    if(!ESP.flashRead(sectorAddress(sector), header, sizeof(header))) {
+        return false;
+    }
+    if(header[0] != CONFIG_LOG_MAGIC || header[3] != Config::crc32((const uint8_t *)header, 12)) {
+        return false;
+    }
+    sequence = header[1];
+    eraseCount = header[2];
+    return true;
+}
+/*                                                                          *
+ *  Finds the newest sector and replays its records. Returns false if       *
+ *  there is no filesystem region to keep the log in.                       *
+ *                                                                          */
+bool ConfigLog::begin() {
+    available = FS_PHYS_SIZE >= CONFIG_LOG_SECTORS * CONFIG_LOG_SECTOR_SIZE;
+    if(!available) {
+        return false;
+    }
+    base = FS_PHYS_ADDR + FS_PHYS_SIZE - CONFIG_LOG_SECTORS * CONFIG_LOG_SECTOR_SIZE;
+    bool found = false;
+    active = CONFIG_LOG_SECTORS - 1;    // The first snapshot goes into sector 0.
+    for(uint8_t i = 0; i < CONFIG_LOG_SECTORS; i++) {
+        uint32_t sectorSequence, eraseCount;
+        if(!readHeader(i, sectorSequence, eraseCount)) {
+            continue;
+        }
+        eraseCounts[i] = eraseCount;
+        if(!found || sectorSequence > sequence) {
+            found = true;
+            sequence = sectorSequence;
+            active = i;
+        }
+    }
+    blobSize = 0;
+    writeOffset = CONFIG_LOG_SECTOR_SIZE;   // No room, the first write starts a new sector.
+    if(found) {
+        replay();
+    }
+    return true;
+}
+/*                                                                          *
+ *  Reads and checks the record at the given offset of the active sector.   *
+ *  Returns its size, 0 if the flash there is erased or -1 if the record    *
+ *  is damaged.                                                             *
+ *                                                                          */
+int16_t ConfigLog::readRecord(uint16_t offset, uint32_t *buffer) {
+    ConfigLogRecord *record = (ConfigLogRecord *)buffer;
+    uint32_t address = sectorAddress(active) + offset;
+    if(offset + CONFIG_LOG_RECORD_SIZE > CONFIG_LOG_SECTOR_SIZE || !ESP.flashRead(address, buffer, CONFIG_LOG_RECORD_SIZE)) {
+        return -1;
+    }
+    if(buffer[0] == 0xFFFFFFFF && buffer[1] == 0xFFFFFFFF) {
+        return 0;
+    }
+    uint16_t length = record->length & ~CONFIG_LOG_COMMIT;
+    uint16_t padded = (length + 3) & ~3;
+    if(length == 0 || record->offset + length > CONFIG_LOG_BLOB_SIZE || offset + CONFIG_LOG_RECORD_SIZE + padded > CONFIG_LOG_SECTOR_SIZE
+        || (offset == CONFIG_LOG_HEADER_SIZE && record->offset != 0)) {
+        return -1;      // The first record must be a snapshot.
+    }
+    if(!ESP.flashRead(address + CONFIG_LOG_RECORD_SIZE, buffer + CONFIG_LOG_RECORD_SIZE / 4, padded)
+        || record->crc != Config::crc32((const uint8_t *)buffer + 4, 4 + length)) {
+        return -1;
+    }
+    return CONFIG_LOG_RECORD_SIZE + padded;
+}
+/*                                                                          *
+ *  Applies the records of the active sector to the shadow blob. The first  *
+ *  pass only checks the records and finds the end of the last complete     *
+ *  write, the second one applies them up to there.                         *
+ *                                                                          */
+void ConfigLog::replay() {
+    uint32_t buffer[(CONFIG_LOG_RECORD_SIZE + CONFIG_LOG_BLOB_SIZE) / 4];
+    ConfigLogRecord *record = (ConfigLogRecord *)buffer;
+    uint16_t offset = CONFIG_LOG_HEADER_SIZE, committedEnd = CONFIG_LOG_HEADER_SIZE;
+    bool damaged = false;
+    while(offset + CONFIG_LOG_RECORD_SIZE <= CONFIG_LOG_SECTOR_SIZE) {
+        int16_t size = readRecord(offset, buffer);
+        if(size <= 0) {
+            damaged = size < 0;
+            break;
+        }
+        offset += size;
+        if(record->length & CONFIG_LOG_COMMIT) {
+            committedEnd = offset;
+        }
+    }
+    damaged = damaged || committedEnd != offset;    // A write that was cut off.
+
+    for(offset = CONFIG_LOG_HEADER_SIZE; offset < committedEnd; ) {
+        int16_t size = readRecord(offset, buffer);
+        if(size <= 0) {
+            damaged = true;
+            break;
+        }
+        uint16_t length = record->length & ~CONFIG_LOG_COMMIT;
+        memcpy(shadow + record->offset, buffer + CONFIG_LOG_RECORD_SIZE / 4, length);
+        if(offset == CONFIG_LOG_HEADER_SIZE) {
+            blobSize = length;
+        }
+        offset += size;
+    }
+    // Nothing can be appended after a damaged record, the next write starts a new sector.
+    writeOffset = damaged ? CONFIG_LOG_SECTOR_SIZE : committedEnd;
+    if(damaged) {
+        stats.damaged++;
+    }
+}
+bool ConfigLog::append(uint16_t offset, const uint8_t *data, uint16_t length) {
+    uint32_t buffer[(CONFIG_LOG_RECORD_SIZE + CONFIG_LOG_BLOB_SIZE) / 4];
+    ConfigLogRecord *record = (ConfigLogRecord *)buffer;
+    uint16_t dataLength = length & ~CONFIG_LOG_COMMIT;
+    uint16_t padded = (dataLength + 3) & ~3;
+    record->offset = offset;
+    record->length = length;
+    memcpy(buffer + CONFIG_LOG_RECORD_SIZE / 4, data, dataLength);
+    memset((uint8_t *)buffer + CONFIG_LOG_RECORD_SIZE + dataLength, 0xFF, padded - dataLength);
+    record->crc = Config::crc32((const uint8_t *)buffer + 4, 4 + dataLength);
+    if(!ESP.flashWrite(sectorAddress(active) + writeOffset, buffer, CONFIG_LOG_RECORD_SIZE + padded)) {
+        writeOffset = CONFIG_LOG_SECTOR_SIZE;
+        return false;
+    }
+    writeOffset += CONFIG_LOG_RECORD_SIZE + padded;
+    stats.records++;
+    stats.bytes += CONFIG_LOG_RECORD_SIZE + padded;
+    memmove(shadow + offset, data, dataLength);
+    return true;
+}
+/*                                                                          *
+ *  Starts the next sector with a snapshot of the blob. The header is       *
+ *  written last, until then the old sector is still the newest one.        *
+ *                                                                          */
+bool ConfigLog::compact(const uint8_t *blob, uint16_t size) {
+    uint8_t next = (active + 1) % CONFIG_LOG_SECTORS;
+    if(!ESP.flashEraseSector(sectorAddress(next) / CONFIG_LOG_SECTOR_SIZE)) {
+        return false;
+    }
+    stats.erases++;
+    eraseCounts[next]++;
+    active = next;
+    writeOffset = CONFIG_LOG_HEADER_SIZE;
+    if(!append(0, blob, size | CONFIG_LOG_COMMIT)) {
+        return false;
+    }
+    uint32_t header[CONFIG_LOG_HEADER_SIZE / 4] = {CONFIG_LOG_MAGIC, sequence + 1, eraseCounts[next], 0};
+    header[3] = Config::crc32((const uint8_t *)header, 12);
+    if(!ESP.flashWrite(sectorAddress(next), header, sizeof(header))) {
+        writeOffset = CONFIG_LOG_SECTOR_SIZE;
+        return false;
+    }
+    stats.bytes += sizeof(header);
+    stats.compactions++;
+    sequence++;
+    blobSize = size;
+    return true;
+}
+bool ConfigLog::compact() {
+    return blobSize > 0 && compact(shadow, blobSize);
+}
+const uint8_t *ConfigLog::getBlob() {
+    return shadow;
+}
+uint16_t ConfigLog::getBlobSize() {
+    return blobSize;
+}
+/*                                                                  *
+ *  Marks the blob as changed. It is written once the first change  *
+ *  is CONFIG_WRITE_WINDOW ms old, together with the later ones.    *
+ *                                                                  */
+void ConfigLog::requestWrite() {
+    stats.saves++;
+    if(!writePending) {
+        writePending = true;
+        writeRequested = millis();
+    }
+}
+bool ConfigLog::isWriteDue() {
+    return writePending && millis() - writeRequested >= CONFIG_WRITE_WINDOW;
+}
+/*                                                                          *
+ *  Writes the bytes of the blob that differ from the flash, nearby runs    *
+ *  of them merged into one record. If they don't fit into the sector, a    *
+ *  snapshot is written into the next one instead.                          *
+ *                                                                          */
+bool ConfigLog::write(const uint8_t *blob, uint16_t size) {
+    writePending = false;
+    stats.writes++;
+    if(!available) {
+        uint16_t changed = 0;
+        EEPROM.begin(CONFIG_EEPROM_SIZE);
+        for(uint16_t i = 0; i < size; i++) {
+            if(EEPROM.read(i) != blob[i]) {
+                EEPROM.write(i, blob[i]);
+                changed++;
+            }
+        }
+        bool saved = EEPROM.commit();
+        EEPROM.end();
+        if(changed > 0) {
+            stats.erases++;
+        } else {
+            stats.unchanged++;
+        }
+        return saved;
+    }
+    if(size > CONFIG_LOG_BLOB_SIZE) {
+        return false;
+    }
+    if(size != blobSize) {
+        return compact(blob, size);
+    }
+
+    // Changed runs, as [start, end) pairs. Two passes, so a write is either appended as a whole or compacted.
+    uint16_t needed = 0, runs = 0;
+    uint16_t last = 0, start = 0, end = 0;
+    for(uint8_t pass = 0; pass < 2; pass++) {
+        bool open = false;
+        for(uint16_t i = 0; i <= size; i++) {
+            bool differs = i < size && blob[i] != shadow[i];
+            if(differs && !open) {
+                open = true;
+                start = i;
+            }
+            if(differs) {
+                end = i + 1;
+            }
+            if(open && (i == size || i - end >= CONFIG_LOG_MERGE_GAP)) {
+                open = false;
+                if(pass == 0) {
+                    needed += CONFIG_LOG_RECORD_SIZE + ((end - start + 3) & ~3);
+                    runs++;
+                    last = start;
+                } else if(!append(start, blob + start, (end - start) | (start == last ? CONFIG_LOG_COMMIT : 0))) {
+                    return false;
+                }
+            }
+        }
+        if(pass == 0 && runs == 0) {
+            stats.unchanged++;
+            return true;
+        }
+        if(pass == 0 && writeOffset + needed > CONFIG_LOG_SECTOR_SIZE) {
+            return compact(blob, size);
+        }
+    }
+    return true;
+}
+// The sector is getting full, it is better to compact it now than in the middle of a write.
+bool ConfigLog::needsCompaction() {
+    return available && blobSize > 0 && !writePending && CONFIG_LOG_SECTOR_SIZE - writeOffset < CONFIG_LOG_SPARE;
+}
+bool ConfigLog::isAvailable() {
+    return available;
+}
+// Erases of a sector over its lifetime, kept in its header. A sector whose header was lost counts from 0 again.
+uint32_t ConfigLog::getEraseCount(uint8_t sector) {
+    return sector < CONFIG_LOG_SECTORS ? eraseCounts[sector] : 0;
+}
+const ConfigLogStats &ConfigLog::getStats() {
+    return stats;
+}
+
+ConfigLog configLog = ConfigLog();
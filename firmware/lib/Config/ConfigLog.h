@@ -0,0 +1,79 @@
+#ifndef _CONFIGLOG_h   /* Include guard */
+#define _CONFIGLOG_h
+
+#include <Arduino.h>
+
+#define CONFIG_LOG_SECTORS 4            // Sectors at the end of the filesystem region, used one after another.
+#define CONFIG_LOG_SECTOR_SIZE 4096
+#define CONFIG_LOG_MAGIC 0x474C434EUL   // "NCLG"
+#define CONFIG_LOG_BLOB_SIZE 640        // Largest blob the log can hold.
+#define CONFIG_LOG_SPARE 1024           // A sector with less free space than this is compacted in the background.
+#define CONFIG_LOG_MERGE_GAP 12         // Changed runs closer than this are written as one record, a record costs 8 bytes.
+#define CONFIG_WRITE_WINDOW 3000        // Saves within this many ms are written to the flash together.
+
+struct ConfigLogStats {
+    uint32_t saves;             // Calls of requestWrite(), each one used to be a sector erase.
+    uint32_t writes;            // Coalesced writes that reached the flash.
+    uint32_t unchanged;         // Writes that found nothing changed.
+    uint32_t records;
+    uint32_t bytes;             // Bytes written to the flash, headers included.
+    uint32_t compactions;
+    uint32_t erases;            // Sectors erased since the start.
+    uint32_t damaged;           // Logs found damaged at the start, usually a write cut off by a power loss.
+};
+
+/*                                                                          *
+ *  Append-only log of the config blob, spread over CONFIG_LOG_SECTORS      *
+ *  flash sectors so they wear evenly.                                      *
+ *                                                                          *
+ *  sector  header, then records, the rest is erased (0xFF)                 *
+ *  header  magic, sequence number, erase count, CRC-32 of the three        *
+ *  record  CRC-32 of the rest, offset in the blob, length, the data        *
+ *          padded to 4 bytes                                               *
+ *                                                                          *
+ *  Only the sector with the highest sequence number is used. Its first     *
+ *  record is a snapshot of the whole blob, the others are the bytes that   *
+ *  changed since. When a sector fills up, a snapshot is written into the   *
+ *  next one and only then its header, so a power loss at any point leaves  *
+ *  a valid log behind. A record that was cut off fails its CRC and is      *
+ *  ignored, with everything after it.                                      *
+ *                                                                          *
+ *  The filesystem region is not used by NixieTap otherwise. Without one    *
+ *  the blob is written to the emulated EEPROM, as before.                  *
+ *                                                                          */
+class ConfigLog {
+    bool available = false;
+    uint32_t base = 0;                  // Flash address of the first sector.
+    uint8_t active = 0;                 // Sector the records are appended to.
+    uint32_t sequence = 0;
+    uint32_t eraseCounts[CONFIG_LOG_SECTORS] = {};
+    uint16_t writeOffset = CONFIG_LOG_SECTOR_SIZE;
+    uint8_t shadow[CONFIG_LOG_BLOB_SIZE];   // The blob as it is in the flash.
+    uint16_t blobSize = 0;
+    bool writePending = false;
+    uint32_t writeRequested = 0;
+    ConfigLogStats stats = {};
+    uint32_t sectorAddress(uint8_t sector);
+    bool readHeader(uint8_t sector, uint32_t &sequence, uint32_t &eraseCount);
+    int16_t readRecord(uint16_t offset, uint32_t *buffer);
+    void replay();
+    bool append(uint16_t offset, const uint8_t *data, uint16_t length);
+    bool compact(const uint8_t *blob, uint16_t size);
+public:
+    ConfigLog();
+    bool begin();
+    const uint8_t *getBlob();
+    uint16_t getBlobSize();
+    void requestWrite();
+    bool isWriteDue();
+    bool write(const uint8_t *blob, uint16_t size);
+    bool needsCompaction();
+    bool compact();
+    bool isAvailable();
+    uint32_t getEraseCount(uint8_t sector);
+    const ConfigLogStats &getStats();
+};
+
+extern ConfigLog configLog;
+
+#endif // _CONFIGLOG_h
@@ -0,0 +1,144 @@
+#include "DisplaySlot.h"
+#include <JobScheduler.h>
+#include <Logger.h>
+
+// An idle interval of 0 refreshes the slot at the same rate, whether it is shown or not.
+DisplaySlot::DisplaySlot(const char *name, uint32_t refreshInterval, uint32_t refreshDeadline, uint32_t idleInterval) {
+    this->name = name;
+    this->refreshInterval = refreshInterval;
+    this->refreshDeadline = refreshDeadline;
+    this->idleInterval = idleInterval > 0 ? idleInterval : refreshInterval;
+}
+
+SlotRegistry::SlotRegistry() {
+}
+/*                                                                          *
+ *  Adds a slot at the end of the rotation. Slots that fetch data get a     *
+ *  background job, so their data is refreshed whichever slot is shown.     *
+ *  Returns the index of the slot, or -1 if there is no room (MAX_SLOTS).   *
+ *                                                                          */
+int8_t SlotRegistry::add(DisplaySlot *slot) {
+    if(slotCount >= MAX_SLOTS) {
+        LOG_ERROR(LOG_DISPLAY, "SlotRegistry: No room for the slot %s!", slot->name);
+        return -1;
+    }
+    if(slot->refreshInterval > 0) {
+        slot->job = jobScheduler.addJob(slot->name, refreshJob, slotCount == current ? slot->refreshInterval : slot->idleInterval,
+            slot->refreshDeadline, true, slot);
+        jobScheduler.setEnabled(slot->job, slot->isEnabled());
+    }
+    slots[slotCount] = slot;
+    return slotCount++;
+}
+/*                                                                          *
+ *  Background job of a slot. The time of every refresh is measured, so     *
+ *  the cost of each data source can be compared.                           *
+ *                                                                          */
+bool SlotRegistry::refreshJob(void *context) {
+    DisplaySlot *slot = (DisplaySlot *)context;
+    unsigned long start = millis();
+    bool done = slot->refresh();
+    slot->stats.lastRefreshTime = millis() - start;
+    if(slot->stats.lastRefreshTime > slot->stats.maxRefreshTime) {
+        slot->stats.maxRefreshTime = slot->stats.lastRefreshTime;
+    }
+    slot->stats.refreshes++;
+    return done;
+}
+/*                                                                          *
+ *  Makes the slot with the given index the current one. If the index is    *
+ *  past the last slot, the rotation starts from the first one. Disabled    *
+ *  slots and slots that have no data to show yet are skipped.              *
+ *  Returns the index of the slot that is now current.                      *
+ *                                                                          */
+uint8_t SlotRegistry::select(uint8_t index) {
+    if(slotCount == 0) {
+        return 0;
+    }
+    if(index >= slotCount) {
+        index = 0;
+    }
+    for(uint8_t i = 0; i < slotCount; i++) {
+        uint8_t candidate = (index + i) % slotCount;
+        if(slots[candidate]->isEnabled() && slots[candidate]->isReady()) {
+            show(candidate);
+            return current;
+        }
+    }
+    show(index);    // Nothing is enabled, the display stays on the requested slot.
+    return current;
+}
+/*                                                                      *
+ *  Makes the slot the current one. Its data is refreshed at its        *
+ *  refreshInterval from now on, and at once if it is older than that,  *
+ *  the slot that was shown before goes back to its idleInterval.       *
+ *                                                                      */
+void SlotRegistry::show(uint8_t index) {
+    if(index == current) {
+        return;
+    }
+    if(slots[current]->job >= 0) {
+        jobScheduler.setInterval(slots[current]->job, slots[current]->idleInterval);
+    }
+    if(slots[index]->job >= 0) {
+        jobScheduler.setInterval(slots[index]->job, slots[index]->refreshInterval);
+    }
+    current = index;
+}
+/*                                                          *
+ *  Draws the current slot and measures how long it took.  *
+ *                                                          */
+void SlotRegistry::render(time_t frame) {
+    if(slotCount == 0 || !slots[current]->isEnabled() || !slots[current]->isReady()) {
+        return;
+    }
+    DisplaySlot *slot = slots[current];
+    unsigned long start = micros();
+    slot->render(frame);
+    slot->stats.lastRenderTime = micros() - start;
+    if(slot->stats.lastRenderTime > slot->stats.maxRenderTime) {
+        slot->stats.maxRenderTime = slot->stats.lastRenderTime;
+    }
+    slot->stats.renders++;
+}
+/*                                                                  *
+ *  Enables the background jobs of the enabled slots only. Should   *
+ *  be called after the settings have been changed.                 *
+ *                                                                  */
+void SlotRegistry::updateJobs() {
+    for(uint8_t i = 0; i < slotCount; i++) {
+        if(slots[i]->job >= 0) {
+            jobScheduler.setEnabled(slots[i]->job, slots[i]->isEnabled());
+        }
+    }
+}
+/*                                                                          *
+ *  Refreshes the data of the next enabled slots a little before it         *
+ *  expires, while the current slot is still on the display. When the       *
+ *  touch button moves to one of them, it is shown from a warm cache        *
+ *  instead of waiting for a request.                                       *
+ *                                                                          */
+void SlotRegistry::prefetch(uint8_t count, uint32_t window) {
+    uint8_t found = 0;
+    for(uint8_t i = 1; i < slotCount && found < count; i++) {
+        DisplaySlot *slot = slots[(current + i) % slotCount];
+        if(!slot->isEnabled()) {
+            continue;
+        }
+        found++;
+        if(slot->job >= 0) {
+            jobScheduler.prefetch(slot->job, window);
+        }
+    }
+}
+uint8_t SlotRegistry::getSlotCount() {
+    return slotCount;
+}
+uint8_t SlotRegistry::getCurrent() {
+    return current;
+}
+DisplaySlot *SlotRegistry::getSlot(uint8_t index) {
+    return index < slotCount ? slots[index] : NULL;
+}
+
+SlotRegistry slotRegistry = SlotRegistry();
@@ -0,0 +1,61 @@
+#ifndef _DISPLAYSLOT_h   /* Include guard */
+#define _DISPLAYSLOT_h
+
+#include <Arduino.h>
+#include <TimeLib.h>
+
+#define MAX_SLOTS 8
+
+struct SlotStats {
+    uint32_t renders;
+    uint32_t lastRenderTime;    // Duration of the last render() call (us).
+    uint32_t maxRenderTime;
+    uint32_t refreshes;
+    uint32_t lastRefreshTime;   // Duration of the last refresh() call (ms).
+    uint32_t maxRefreshTime;
+};
+
+/*                                                                          *
+ *  A slot is one of the screens NixieTap rotates through with the touch    *
+ *  button. Fetching the data and showing it are kept apart: refresh() is   *
+ *  called from a background job and may wait for the network, render()     *
+ *  is called on every pass of loop() and must only draw what is cached.    *
+ *                                                                          */
+class DisplaySlot {
+public:
+    const char *name;
+    uint32_t refreshInterval;   // Time between two background refreshes while the slot is shown (ms), 0 if it has nothing to fetch.
+    uint32_t idleInterval;      // The same while another slot is shown, longer for the data sources with a quota.
+    uint32_t refreshDeadline;   // The refresh should start at most this many ms after it is due.
+    int8_t job = -1;            // Background job of the slot, assigned by the registry.
+    SlotStats stats = {};
+
+    DisplaySlot(const char *name, uint32_t refreshInterval = 0, uint32_t refreshDeadline = 0, uint32_t idleInterval = 0);
+    virtual ~DisplaySlot() {}
+    virtual bool isEnabled() = 0;
+    virtual bool isReady() { return true; }
+    virtual bool refresh() { return true; }
+    virtual void render(time_t frame) = 0;
+};
+
+class SlotRegistry {
+    DisplaySlot *slots[MAX_SLOTS];
+    uint8_t slotCount = 0;
+    uint8_t current = 0;
+    static bool refreshJob(void *context);
+    void show(uint8_t index);
+public:
+    SlotRegistry();
+    int8_t add(DisplaySlot *slot);
+    uint8_t select(uint8_t index);
+    void render(time_t frame);
+    void updateJobs();
+    void prefetch(uint8_t count, uint32_t window);
+    uint8_t getSlotCount();
+    uint8_t getCurrent();
+    DisplaySlot *getSlot(uint8_t index);
+};
+
+extern SlotRegistry slotRegistry;
+
+#endif // _DISPLAYSLOT_h
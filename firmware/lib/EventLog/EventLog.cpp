@@ -0,0 +1,408 @@
+#include "EventLog.h"
+#include <Config.h>
+#include <ConfigLog.h>
+#include <FastConnect.h>
+#include <flash_hal.h>
+extern "C" {
+#include <user_interface.h>
+}
+
+#define EVENT_LOG_HEADER_SIZE 16
+#define EVENT_LOG_RECORD_SIZE 8
+#define EVENT_LOG_PAYLOAD_SIZE 255
+#define EVENT_LOG_RTC_MAGIC 0x52474C4EUL    // "NLGR"
+#define EVENT_LOG_CRASH_MAGIC 0x48535243UL  // "CRSH"
+#define EVENT_LOG_RTC_HEADER 0              // RTC user memory blocks (4 bytes each) of the header, the crash and the ring.
+#define EVENT_LOG_RTC_CRASH 4
+#define EVENT_LOG_RTC_RING 14
+#define EVENT_LOG_RTC_SIZE ((EVENT_LOG_RTC_RING + EVENT_LOG_RTC_EVENTS * 2) * 4)
+#define EVENT_LOG_RECORD_RESET 1
+#define EVENT_LOG_RECORD_EVENTS 2
+
+struct EventLogRtcHeader {
+    uint32_t magic;
+    uint16_t boot;
+    uint8_t head;
+    uint8_t pending;
+    uint32_t uptime;        // Seconds since the start, updated by tick(), so the next boot knows when the run ended.
+    uint32_t crc;
+};
+struct EventLogRtcCrash {
+    uint32_t magic;
+    uint16_t boot;
+    uint16_t count;
+    uint32_t stack[EVENT_LOG_STACK_DEPTH];
+};
+struct EventLogRecord {
+    uint32_t crc;
+    uint16_t boot;
+    uint8_t type;
+    uint8_t length;
+};
+
+static_assert(sizeof(EventLogRtcHeader) == (EVENT_LOG_RTC_CRASH - EVENT_LOG_RTC_HEADER) * 4, "The RTC header is 4 blocks");
+static_assert(sizeof(EventLogRtcCrash) <= (EVENT_LOG_RTC_RING - EVENT_LOG_RTC_CRASH) * 4, "The saved crash overlaps the ring");
+static_assert(EVENT_LOG_RTC_SIZE <= FAST_CONNECT_RTC_OFFSET * 4, "The ring overlaps the cached lease of FastConnect");
+static_assert(sizeof(LoggedEventRecord) == 8, "An event is 2 RTC blocks");
+static_assert(sizeof(EventLogReset) <= EVENT_LOG_PAYLOAD_SIZE, "The reset doesn't fit into a record");
+static_assert(EVENT_LOG_RTC_EVENTS * sizeof(LoggedEventRecord) <= EVENT_LOG_PAYLOAD_SIZE, "The ring doesn't fit into a record");
+
+// Called by the core when it reports an exception, a panic or a software WDT, before it restarts.
+extern "C" void custom_crash_callback(struct rst_info *info, uint32_t stack, uint32_t stackEnd) {
+    eventLog.saveCrash(stack, stackEnd);
+}
+
+static bool isCodeAddress(uint32_t address) {
+    return (address >= 0x40100000 && address < 0x40108000) || (address >= 0x40200000 && address < 0x40300000);   // IRAM or the mapped flash.
+}
+
+EventLog::EventLog() {
+}
+uint32_t EventLog::sectorAddress(uint8_t sector) {
+    return base + sector * EVENT_LOG_SECTOR_SIZE;
+}
+bool EventLog::readHeader(uint8_t sector, uint32_t &sequence, uint16_t &firstBoot) {
+    uint32_t header[EVENT_LOG_HEADER_SIZE / 4];
+    if(!ESP.flashRead(sectorAddress(sector), header, sizeof(header))) {
+        return false;
+    }
+    if(header[0] != EVENT_LOG_MAGIC || header[3] != Config::crc32((const uint8_t *)header, 12)) {
+        return false;
+    }
+    sequence = header[1];
+    firstBoot = header[2];
+    return true;
+}
+/*                                                                          *
+ *  Reads and checks the record at the given offset of the active sector.   *
+ *  Returns its size, 0 if the flash there is erased or -1 if the record    *
+ *  is damaged.                                                             *
+ *                                                                          */
+int16_t EventLog::readRecord(uint16_t offset, uint32_t *buffer) {
+    EventLogRecord *record = (EventLogRecord *)buffer;
+    uint32_t address = sectorAddress(active) + offset;
+    if(offset + EVENT_LOG_RECORD_SIZE > EVENT_LOG_SECTOR_SIZE || !ESP.flashRead(address, buffer, EVENT_LOG_RECORD_SIZE)) {
+        return -1;
+    }
+    if(buffer[0] == 0xFFFFFFFF && buffer[1] == 0xFFFFFFFF) {
+        return 0;
+    }
+    uint16_t padded = (record->length + 3) & ~3;
+    if(record->length == 0 || offset + EVENT_LOG_RECORD_SIZE + padded > EVENT_LOG_SECTOR_SIZE) {
+        return -1;
+    }
+    if(!ESP.flashRead(address + EVENT_LOG_RECORD_SIZE, buffer + EVENT_LOG_RECORD_SIZE / 4, padded)
+        || record->crc != Config::crc32((const uint8_t *)buffer + 4, 4 + record->length)) {
+        return -1;
+    }
+    return EVENT_LOG_RECORD_SIZE + padded;
+}
+/*                                                                          *
+ *  Finds the newest sector and the end of its records, and the last boot   *
+ *  that was logged.                                                        *
+ *                                                                          */
+void EventLog::scan() {
+    bool found = false;
+    active = EVENT_LOG_SECTORS - 1;     // The first record goes into sector 0.
+    for(uint8_t i = 0; i < EVENT_LOG_SECTORS; i++) {
+        uint32_t sectorSequence;
+        uint16_t firstBoot;
+        if(!readHeader(i, sectorSequence, firstBoot)) {
+            continue;
+        }
+        if(!found || sectorSequence > sequence) {
+            found = true;
+            sequence = sectorSequence;
+            active = i;
+            boot = firstBoot;
+        }
+    }
+    writeOffset = EVENT_LOG_SECTOR_SIZE;    // No room, the first record starts a new sector.
+    if(!found) {
+        return;
+    }
+    uint32_t buffer[(EVENT_LOG_RECORD_SIZE + EVENT_LOG_PAYLOAD_SIZE + 1) / 4];
+    EventLogRecord *record = (EventLogRecord *)buffer;
+    uint16_t offset = EVENT_LOG_HEADER_SIZE;
+    int16_t size;
+    while((size = readRecord(offset, buffer)) > 0) {
+        boot = max(boot, record->boot);
+        offset += size;
+    }
+    // Nothing can be appended after a damaged record, the next one starts a new sector.
+    if(size < 0) {
+        stats.damaged++;
+    } else {
+        writeOffset = offset;
+    }
+}
+/*                                                                          *
+ *  Takes the ring and the uptime the previous run left in the RTC memory.  *
+ *  Returns false if they are lost, after a power loss, and clears them.    *
+ *                                                                          */
+bool EventLog::loadRtc(uint32_t &uptime) {
+    EventLogRtcHeader header;
+    ESP.rtcUserMemoryRead(EVENT_LOG_RTC_HEADER, (uint32_t *)&header, sizeof(header));
+    if(header.magic == EVENT_LOG_RTC_MAGIC && header.crc == Config::crc32((const uint8_t *)&header, 12)
+        && header.head < EVENT_LOG_RTC_EVENTS && header.pending <= EVENT_LOG_RTC_EVENTS) {
+        ESP.rtcUserMemoryRead(EVENT_LOG_RTC_RING, (uint32_t *)ring, sizeof(ring));
+        boot = header.boot;
+        head = header.head;
+        pending = header.pending;
+        uptime = header.uptime;
+        return true;
+    }
+    memset(ring, 0, sizeof(ring));
+    ESP.rtcUserMemoryWrite(EVENT_LOG_RTC_RING, (uint32_t *)ring, sizeof(ring));
+    head = 0;
+    pending = 0;
+    uptime = 0;
+    return false;
+}
+void EventLog::saveHeader(uint32_t uptime) {
+    EventLogRtcHeader header = {EVENT_LOG_RTC_MAGIC, boot, head, pending, uptime, 0};
+    header.crc = Config::crc32((const uint8_t *)&header, 12);
+    ESP.rtcUserMemoryWrite(EVENT_LOG_RTC_HEADER, (uint32_t *)&header, sizeof(header));
+}
+/*                                                                          *
+ *  Writes the events the previous run didn't flush, then the reason of     *
+ *  this reset, with the exception frame and the code addresses the crash   *
+ *  callback found on the stack. Call it before anything is recorded.       *
+ *                                                                          */
+void EventLog::begin(uint32_t version) {
+    available = FS_PHYS_SIZE >= (CONFIG_LOG_SECTORS + EVENT_LOG_SECTORS) * EVENT_LOG_SECTOR_SIZE;
+    if(available) {
+        base = FS_PHYS_ADDR + FS_PHYS_SIZE - (CONFIG_LOG_SECTORS + EVENT_LOG_SECTORS) * EVENT_LOG_SECTOR_SIZE;
+        scan();
+    }
+    uint16_t lastBoot = boot;
+    uint32_t uptime;
+    bool intact = loadRtc(uptime);
+    if(intact) {
+        flushEvents(boot);
+        lastBoot = max(lastBoot, boot);
+    }
+    pending = 0;
+
+    const struct rst_info *info = ESP.getResetInfoPtr();
+    reset = {info->reason, info->exccause, info->epc1, info->epc2, info->epc3, info->excvaddr, info->depc, uptime, version,
+        intact ? EVENT_LOG_RTC_INTACT : 0u, {}};
+    uint8_t depth = 0;
+    EventLogRtcCrash crash;
+    ESP.rtcUserMemoryRead(EVENT_LOG_RTC_CRASH, (uint32_t *)&crash, sizeof(crash));
+    if(intact && crash.magic == EVENT_LOG_CRASH_MAGIC && crash.boot == boot && crash.count <= EVENT_LOG_STACK_DEPTH) {
+        depth = crash.count;
+        memcpy(reset.stack, crash.stack, depth * sizeof(uint32_t));
+        reset.flags |= EVENT_LOG_STACK_SAVED;
+    }
+    crash.magic = 0;
+    ESP.rtcUserMemoryWrite(EVENT_LOG_RTC_CRASH, (uint32_t *)&crash, sizeof(crash));
+
+    boot = lastBoot + 1;
+    saveHeader(0);
+    append(EVENT_LOG_RECORD_RESET, boot, &reset, offsetof(EventLogReset, stack) + depth * sizeof(uint32_t));
+}
+/*                                                                          *
+ *  Records an event into the RTC memory, 24 bytes are written there and    *
+ *  nothing else. If the ring is full of events that were not flushed yet,  *
+ *  the oldest one is lost.                                                 *
+ *                                                                          */
+void EventLog::record(LoggedEvent code, uint16_t value) {
+    uint32_t start = ESP.getCycleCount();
+    uint32_t now = millis();
+    LoggedEventRecord &event = ring[head];
+    event.time = now;
+    event.code = code;
+    event.value = value;
+    ESP.rtcUserMemoryWrite(EVENT_LOG_RTC_RING + head * 2, (uint32_t *)&event, sizeof(event));
+    head = (head + 1) % EVENT_LOG_RTC_EVENTS;
+    if(available) {
+        if(pending < EVENT_LOG_RTC_EVENTS) {
+            pending++;
+        } else {
+            stats.lost++;
+        }
+    }
+    saveHeader(now / 1000);
+    stats.events++;
+    stats.lastRecordCycles = ESP.getCycleCount() - start;
+    stats.maxRecordCycles = max(stats.maxRecordCycles, stats.lastRecordCycles);
+}
+// Called once per second by a job: notes the uptime for the next boot and flushes the events when it is time.
+void EventLog::tick() {
+    if(!flush()) {
+        saveHeader(millis() / 1000);
+    }
+}
+/*                                                                          *
+ *  Writes the pending events to the flash, once there are                  *
+ *  EVENT_LOG_FLUSH_COUNT of them or the oldest one is EVENT_LOG_FLUSH_AGE  *
+ *  ms old, or right away if forced. A full sector costs an erase here,     *
+ *  so it is only called by a job in the background.                        *
+ *                                                                          */
+bool EventLog::flush(bool force) {
+    if(!available || pending == 0) {
+        return false;
+    }
+    const LoggedEventRecord &oldest = ring[(head + EVENT_LOG_RTC_EVENTS - pending) % EVENT_LOG_RTC_EVENTS];
+    if(!force && pending < EVENT_LOG_FLUSH_COUNT && millis() - oldest.time < EVENT_LOG_FLUSH_AGE) {
+        return false;
+    }
+    bool flushed = flushEvents(boot);
+    saveHeader(millis() / 1000);
+    return flushed;
+}
+// Appends the pending events of the ring as one record, the oldest first.
+bool EventLog::flushEvents(uint16_t boot) {
+    if(pending == 0) {
+        return true;
+    }
+    LoggedEventRecord events[EVENT_LOG_RTC_EVENTS];
+    for(uint8_t i = 0; i < pending; i++) {
+        events[i] = ring[(head + EVENT_LOG_RTC_EVENTS - pending + i) % EVENT_LOG_RTC_EVENTS];
+    }
+    if(!append(EVENT_LOG_RECORD_EVENTS, boot, events, pending * sizeof(LoggedEventRecord))) {
+        return false;
+    }
+    pending = 0;
+    stats.flushes++;
+    return true;
+}
+bool EventLog::append(uint8_t type, uint16_t boot, const void *data, uint8_t length) {
+    if(!available) {
+        return false;
+    }
+    uint16_t padded = (length + 3) & ~3;
+    if(writeOffset + EVENT_LOG_RECORD_SIZE + padded > EVENT_LOG_SECTOR_SIZE && !startSector(boot)) {
+        return false;
+    }
+    uint32_t buffer[(EVENT_LOG_RECORD_SIZE + EVENT_LOG_PAYLOAD_SIZE + 1) / 4];
+    EventLogRecord *record = (EventLogRecord *)buffer;
+    record->boot = boot;
+    record->type = type;
+    record->length = length;
+    memcpy(buffer + EVENT_LOG_RECORD_SIZE / 4, data, length);
+    memset((uint8_t *)buffer + EVENT_LOG_RECORD_SIZE + length, 0xFF, padded - length);
+    record->crc = Config::crc32((const uint8_t *)buffer + 4, 4 + length);
+    if(!ESP.flashWrite(sectorAddress(active) + writeOffset, buffer, EVENT_LOG_RECORD_SIZE + padded)) {
+        writeOffset = EVENT_LOG_SECTOR_SIZE;
+        return false;
+    }
+    writeOffset += EVENT_LOG_RECORD_SIZE + padded;
+    stats.bytes += EVENT_LOG_RECORD_SIZE + padded;
+    return true;
+}
+/*                                                                          *
+ *  Erases the oldest sector and makes it the newest one. If the erase is   *
+ *  cut off, its header is missing and the old sector is still the newest.  *
+ *                                                                          */
+bool EventLog::startSector(uint16_t firstBoot) {
+    uint8_t next = (active + 1) % EVENT_LOG_SECTORS;
+    if(!ESP.flashEraseSector(sectorAddress(next) / EVENT_LOG_SECTOR_SIZE)) {
+        return false;
+    }
+    stats.erases++;
+    uint32_t header[EVENT_LOG_HEADER_SIZE / 4] = {EVENT_LOG_MAGIC, sequence + 1, firstBoot, 0};
+    header[3] = Config::crc32((const uint8_t *)header, 12);
+    if(!ESP.flashWrite(sectorAddress(next), header, sizeof(header))) {
+        return false;
+    }
+    stats.bytes += sizeof(header);
+    active = next;
+    sequence++;
+    writeOffset = EVENT_LOG_HEADER_SIZE;
+    return true;
+}
+/*                                                                          *
+ *  Keeps the code addresses found on the stack of a crash in the RTC       *
+ *  memory, begin() adds them to the reset on the next boot. Only reads     *
+ *  memory and writes the RTC memory, it runs in the crash handler.         *
+ *                                                                          */
+void EventLog::saveCrash(uint32_t stack, uint32_t stackEnd) {
+    EventLogRtcCrash crash = {EVENT_LOG_CRASH_MAGIC, boot, 0, {}};
+    for(uint32_t address = stack; address + 4 <= stackEnd && crash.count < EVENT_LOG_STACK_DEPTH; address += 4) {
+        uint32_t word = *(const uint32_t *)address;
+        if(isCodeAddress(word)) {
+            crash.stack[crash.count++] = word;
+        }
+    }
+    ESP.rtcUserMemoryWrite(EVENT_LOG_RTC_CRASH, (uint32_t *)&crash, sizeof(crash));
+}
+uint16_t EventLog::getBoot() {
+    return boot;
+}
+const EventLogReset &EventLog::getReset() {
+    return reset;
+}
+// The last reset was a WDT or an exception, not a restart or a power on.
+bool EventLog::wasCrash() {
+    return reset.reason == REASON_WDT_RST || reset.reason == REASON_EXCEPTION_RST || reset.reason == REASON_SOFT_WDT_RST;
+}
+// Copies up to count of the last events, the oldest first. Returns how many there are.
+uint8_t EventLog::getEvents(LoggedEventRecord *events, uint8_t count) {
+    uint8_t n = 0;
+    for(uint8_t i = 0; i < EVENT_LOG_RTC_EVENTS && n < count; i++) {
+        const LoggedEventRecord &event = ring[(head + i) % EVENT_LOG_RTC_EVENTS];
+        if(event.code != 0) {
+            events[n++] = event;
+        }
+    }
+    return n;
+}
+// Bytes that read() returns: the flash region and the RTC memory.
+uint32_t EventLog::getSize() {
+    return (available ? EVENT_LOG_SECTORS * EVENT_LOG_SECTOR_SIZE : 0) + EVENT_LOG_RTC_SIZE;
+}
+/*                                                                          *
+ *  Reads the raw log for a download: the sectors in their order in the     *
+ *  flash, then the RTC memory with the events that were not flushed.       *
+ *                                                                          */
+size_t EventLog::read(uint32_t offset, uint8_t *buffer, size_t length) {
+    uint32_t flashSize = getSize() - EVENT_LOG_RTC_SIZE;
+    if(offset >= getSize()) {
+        return 0;
+    }
+    length = min<size_t>(length, getSize() - offset);
+    uint32_t words[64];
+    size_t done = 0;
+    while(done < length) {
+        uint32_t at = offset + done;
+        uint32_t aligned = at & ~3;
+        size_t chunk;
+        if(aligned < flashSize) {
+            chunk = min<size_t>(sizeof(words), flashSize - aligned);
+            if(!ESP.flashRead(base + aligned, words, chunk)) {
+                return done;
+            }
+        } else {
+            chunk = min<size_t>(sizeof(words), getSize() - aligned);
+            ESP.rtcUserMemoryRead((aligned - flashSize) / 4, words, chunk);
+        }
+        size_t n = min<size_t>(chunk - (at - aligned), length - done);
+        memcpy(buffer + done, (const uint8_t *)words + (at - aligned), n);
+        done += n;
+    }
+    return done;
+}
+bool EventLog::isAvailable() {
+    return available;
+}
+// Bytes used of the active sector.
+uint16_t EventLog::getUsed() {
+    return available ? writeOffset : 0;
+}
+const EventLogStats &EventLog::getStats() {
+    return stats;
+}
+const char *EventLog::getEventName(uint16_t code) {
+    static const char *const names[] = {"wifi_up", "wifi_down", "radio_off", "radio_on", "ntp_sync", "mqtt_up", "mqtt_down",
+        "portal_open", "portal_closed", "config_write", "overrun", "low_heap", "restart"};
+    static_assert(sizeof(names) / sizeof(names[0]) == LOGGED_EVENTS - 1, "A LoggedEvent has no name");
+    return code >= 1 && code < LOGGED_EVENTS ? names[code - 1] : "?";
+}
+const char *EventLog::getReasonName(uint32_t reason) {
+    static const char *const names[] = {"power on", "hardware WDT", "exception", "software WDT", "restart", "deep sleep wake", "external reset"};
+    return reason < sizeof(names) / sizeof(names[0]) ? names[reason] : "?";
+}
+
+EventLog eventLog = EventLog();
@@ -0,0 +1,129 @@
+#ifndef _EVENTLOG_h   /* Include guard */
+#define _EVENTLOG_h
+
+#include <Arduino.h>
+
+#define EVENT_LOG_SECTORS 4             // Sectors right before the ConfigLog ones, used one after another.
+#define EVENT_LOG_SECTOR_SIZE 4096
+#define EVENT_LOG_MAGIC 0x474C454EUL    // "NELG"
+#define EVENT_LOG_RTC_EVENTS 24         // Events kept in the RTC memory, the last ones survive any reset but a power loss.
+#define EVENT_LOG_STACK_DEPTH 8         // Code addresses taken from the stack when an exception is reported.
+#define EVENT_LOG_FLUSH_COUNT 16        // Events that are written to the flash at once,
+#define EVENT_LOG_FLUSH_AGE 600000      // or after this long (ms), so a power loss loses little.
+
+enum LoggedEvent : uint16_t {
+    LOGGED_WIFI_UP = 1,     // Value: RSSI (dBm, negative).
+    LOGGED_WIFI_DOWN,
+    LOGGED_RADIO_OFF,
+    LOGGED_RADIO_ON,
+    LOGGED_NTP_SYNC,        // Value: the NTPSyncEvent_t, 0 is a successful sync.
+    LOGGED_MQTT_UP,
+    LOGGED_MQTT_DOWN,
+    LOGGED_PORTAL_OPEN,
+    LOGGED_PORTAL_CLOSED,
+    LOGGED_CONFIG_WRITE,
+    LOGGED_OVERRUN,         // Value: the id of the job.
+    LOGGED_LOW_HEAP,        // Value: free heap (bytes).
+    LOGGED_RESTART,         // A restart that was asked for, e.g. with the reboot command.
+    LOGGED_EVENTS
+};
+
+struct LoggedEventRecord {
+    uint32_t time;          // millis() when it was recorded.
+    uint16_t code;
+    uint16_t value;
+};
+
+// Why the last reset happened, with the exception frame of the core and the state of the previous run.
+struct EventLogReset {
+    uint32_t reason;        // rst_info: REASON_DEFAULT_RST, REASON_WDT_RST, REASON_EXCEPTION_RST...
+    uint32_t exccause;
+    uint32_t epc1;
+    uint32_t epc2;
+    uint32_t epc3;
+    uint32_t excvaddr;
+    uint32_t depc;
+    uint32_t uptime;        // How long the previous run lasted (s), 0 if the RTC memory was lost.
+    uint32_t version;       // Firmware version.
+    uint32_t flags;         // EVENT_LOG_RTC_INTACT, EVENT_LOG_STACK_SAVED.
+    uint32_t stack[EVENT_LOG_STACK_DEPTH];
+};
+#define EVENT_LOG_RTC_INTACT 0x01       // The RTC memory survived, a power-on reset with it is likely a brownout.
+#define EVENT_LOG_STACK_SAVED 0x02      // The crash callback ran, stack holds code addresses from the stack.
+
+struct EventLogStats {
+    uint32_t events;            // Events recorded since the start.
+    uint32_t lost;              // Events overwritten in the RTC memory before they were flushed.
+    uint32_t flushes;
+    uint32_t bytes;             // Bytes written to the flash, headers included.
+    uint32_t erases;
+    uint32_t damaged;           // Logs found damaged at the start, usually a write cut off by a power loss.
+    uint32_t lastRecordCycles;  // CPU cycles record() took, the cost of an event in the caller.
+    uint32_t maxRecordCycles;
+};
+
+/*                                                                          *
+ *  Event log that survives a crash. record() only writes the event into    *
+ *  a ring in the RTC memory, a few words at a bounded cost, so it can be   *
+ *  called next to the display. The RTC memory survives a WDT or an         *
+ *  exception, begin() writes what the previous run left there, with the    *
+ *  reset reason and the exception frame, into the flash on the next boot.  *
+ *  A job flushes the events to the flash now and then, too.                *
+ *                                                                          *
+ *  RTC     header: magic, boot, head, pending, uptime (s), CRC-32          *
+ *          crash:  magic, boot, count, code addresses from the stack       *
+ *          ring:   EVENT_LOG_RTC_EVENTS events of 8 bytes                  *
+ *  flash   EVENT_LOG_SECTORS sectors, the newest one has the highest       *
+ *          sequence number and the oldest one is erased when it is full    *
+ *  sector  header: magic, sequence number, first boot, CRC-32 of the three *
+ *  record  CRC-32 of the rest, boot, type, length, the data padded to 4    *
+ *          bytes: an EventLogReset or a run of LoggedEventRecords          *
+ *                                                                          *
+ *  read() returns the flash region followed by the RTC memory, that is     *
+ *  what is downloaded and what tools/event_log.py decodes. The RTC         *
+ *  blocks from FAST_CONNECT_RTC_OFFSET on are left to FastConnect.         *
+ *                                                                          */
+class EventLog {
+    bool available = false;
+    uint32_t base = 0;                  // Flash address of the first sector.
+    uint8_t active = 0;
+    uint32_t sequence = 0;
+    uint16_t writeOffset = EVENT_LOG_SECTOR_SIZE;
+    uint16_t boot = 0;
+    uint8_t head = 0;                   // Next event of the ring.
+    uint8_t pending = 0;                // Events of the ring that are not in the flash yet.
+    LoggedEventRecord ring[EVENT_LOG_RTC_EVENTS];
+    EventLogReset reset = {};
+    EventLogStats stats = {};
+    uint32_t sectorAddress(uint8_t sector);
+    bool readHeader(uint8_t sector, uint32_t &sequence, uint16_t &firstBoot);
+    int16_t readRecord(uint16_t offset, uint32_t *buffer);
+    void scan();
+    bool loadRtc(uint32_t &uptime);
+    void saveHeader(uint32_t uptime);
+    bool append(uint8_t type, uint16_t boot, const void *data, uint8_t length);
+    bool startSector(uint16_t firstBoot);
+    bool flushEvents(uint16_t boot);
+public:
+    EventLog();
+    void begin(uint32_t version);
+    void record(LoggedEvent code, uint16_t value = 0);
+    void tick();
+    bool flush(bool force = false);
+    void saveCrash(uint32_t stack, uint32_t stackEnd);
+    uint16_t getBoot();
+    const EventLogReset &getReset();
+    bool wasCrash();
+    uint8_t getEvents(LoggedEventRecord *events, uint8_t count);
+    uint32_t getSize();
+    size_t read(uint32_t offset, uint8_t *buffer, size_t length);
+    bool isAvailable();
+    uint16_t getUsed();
+    const EventLogStats &getStats();
+    static const char *getEventName(uint16_t code);
+    static const char *getReasonName(uint32_t reason);
+};
+
+extern EventLog eventLog;
+
+#endif // _EVENTLOG_h
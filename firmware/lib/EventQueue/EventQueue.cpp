@@ -0,0 +1,48 @@
+#include "EventQueue.h"
+
+EventQueue::EventQueue() {
+}
+// Called from interrupts only, everything it touches is in RAM.
+bool EventQueue::push(EventType type, uint8_t data) {
+    uint8_t depth = (uint8_t)(head - tail) % EVENT_QUEUE_SIZE;
+    if(depth == EVENT_QUEUE_SIZE - 1) {
+        stats.dropped[type]++;
+        return false;
+    }
+    Event &event = events[head];
+    event.time = micros();
+    event.type = type;
+    event.data = data;
+    __asm__ __volatile__("" ::: "memory");     // The event is written before it is published.
+    head = (head + 1) % EVENT_QUEUE_SIZE;
+    stats.pushed++;
+    if(depth + 1 > stats.maxDepth) {
+        stats.maxDepth = depth + 1;
+    }
+    return true;
+}
+/*                                                                  *
+ *  Takes the oldest event. Returns false if the queue is empty.    *
+ *                                                                  */
+bool EventQueue::pop(Event &event) {
+    uint8_t current = tail;
+    if(current == head) {
+        return false;
+    }
+    event = events[current];
+    __asm__ __volatile__("" ::: "memory");     // The event is read before its entry is handed back.
+    tail = (current + 1) % EVENT_QUEUE_SIZE;
+    return true;
+}
+uint8_t EventQueue::getDepth() {
+    return (uint8_t)(head - tail) % EVENT_QUEUE_SIZE;
+}
+// A copy, the interrupts may change the counters meanwhile.
+EventQueueStats EventQueue::getStats() {
+    noInterrupts();
+    EventQueueStats copy = stats;
+    interrupts();
+    return copy;
+}
+
+EventQueue eventQueue = EventQueue();
@@ -0,0 +1,55 @@
+#ifndef _EVENTQUEUE_h   /* Include guard */
+#define _EVENTQUEUE_h
+
+#include <Arduino.h>
+
+#define EVENT_QUEUE_SIZE 32         // Power of two, enough for a few seconds of a busy loop().
+
+enum EventType : uint8_t {
+    EVENT_TOUCH = 0,    // Edge of the touch button, data is the new level.
+    EVENT_RTC_TICK,     // Interrupt of the RTC, once per second.
+    EVENT_TYPES
+};
+
+struct Event {
+    uint32_t time;      // micros() when the interrupt fired.
+    EventType type;
+    uint8_t data;
+};
+
+struct EventQueueStats {
+    uint32_t pushed;
+    uint32_t dropped[EVENT_TYPES];  // Events lost because the queue was full, per type.
+    uint8_t maxDepth;               // Most events that were waiting at once.
+};
+
+/*                                                                          *
+ *  Ring of events from the interrupt handlers to loop(), without locks.    *
+ *                                                                          *
+ *  push() is only called from interrupts. On the ESP8266 the GPIO and      *
+ *  timer interrupts run at the same level and don't preempt each other,    *
+ *  so the producers are already serialized and only the head is written    *
+ *  by them. pop() is only called from loop() and only writes the tail.     *
+ *  The head is moved after the event is written, the tail after it is      *
+ *  read, so each side sees whole events, in the order they were pushed.    *
+ *  A full queue drops the new event and counts it, the older ones are      *
+ *  kept.                                                                   *
+ *                                                                          */
+class EventQueue {
+    Event events[EVENT_QUEUE_SIZE];
+    volatile uint8_t head = 0;      // Next free entry, written by push().
+    volatile uint8_t tail = 0;      // Oldest event, written by pop().
+    EventQueueStats stats = {};     // Written by push(), read with the interrupts off.
+public:
+    EventQueue();
+    ICACHE_RAM_ATTR bool push(EventType type, uint8_t data = 0);
+    bool pop(Event &event);
+    uint8_t getDepth();
+    EventQueueStats getStats();
+};
+
+static_assert((EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) == 0 && EVENT_QUEUE_SIZE < 256, "EVENT_QUEUE_SIZE must be a power of two below 256");
+
+extern EventQueue eventQueue;
+
+#endif // _EVENTQUEUE_h
@@ -0,0 +1,224 @@
+#include "FastConnect.h"
+#include <Config.h>
+#include <TimeLib.h>
+#include <lwip/netif.h>
+#include <lwip/dhcp.h>
+
+struct RtcLease {
+    uint32_t crc;           // CRC-32 of the lease, RTC memory is random after a power loss.
+    WifiLease lease;
+};
+
+FastConnect::FastConnect() {
+}
+/*                                                                          *
+ *  Takes the network to connect to and the lease kept in the Config. The   *
+ *  lease in RTC memory is preferred, it is the newer one after a reset.    *
+ *  The SDK doesn't save the station config or reconnect by itself, the     *
+ *  fast path would otherwise write the flash on every connect.             *
+ *                                                                          */
+void FastConnect::begin(const char *ssid, const char *password, WifiLease &stored) {
+    this->ssid = ssid;
+    this->password = password;
+    this->stored = &stored;
+    if(!readRtc()) {
+        lease = stored;
+    }
+    gotIpHandler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP &event) {
+        gotIp = true;
+    });
+    disconnectedHandler = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected &event) {
+        disconnected = true;
+    });
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false);
+}
+// Connects to the cached AP if there is a lease that isn't due for renewal, otherwise scans.
+void FastConnect::connect() {
+    if(lease.channel == 0 || ssid == NULL || ssid[0] == '\0') {
+        startFull();
+    } else if(isLeaseDue()) {
+        stats.expired++;
+        startFull();
+    } else {
+        startFast();
+    }
+}
+void FastConnect::startFast() {
+    stats.fastAttempts++;
+    state = STATE_FAST;
+    attemptStart = millis();
+    WiFi.config(IPAddress(lease.ip), IPAddress(lease.gateway), IPAddress(lease.mask), IPAddress(lease.dns));
+    WiFi.begin(ssid, password, lease.channel, lease.bssid);
+}
+void FastConnect::startFull() {
+    stats.fullAttempts++;
+    state = STATE_FULL;
+    attemptStart = millis();
+    WiFi.disconnect();
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());    // Back to DHCP.
+    if(ssid != NULL && ssid[0] != '\0') {
+        WiFi.begin(ssid, password);
+    } else {
+        WiFi.begin();   // The network saved in the SDK, by an older firmware.
+    }
+}
+/*                                                                          *
+ *  Applies the WiFi events and the timeouts, should be called every 100 ms *
+ *  or so. A fast connect that times out falls back to a scan, a scan that  *
+ *  times out starts over. A connection that drops is reconnected the fast  *
+ *  way, the AP is most likely still the same one.                          *
+ *                                                                          */
+void FastConnect::poll() {
+    if(gotIp) {
+        gotIp = false;
+        connected();
+    }
+    if(disconnected) {
+        disconnected = false;
+        if((state == STATE_CONNECTED || state == STATE_RENEWING) && WiFi.status() != WL_CONNECTED) {
+            stats.disconnects++;
+            connect();
+        }
+    }
+    uint32_t elapsed = millis() - attemptStart;
+    if(state == STATE_FAST && elapsed >= FAST_CONNECT_TIMEOUT) {
+        stats.fastFailures++;
+        startFull();
+    } else if(state == STATE_FULL && elapsed >= FULL_CONNECT_TIMEOUT) {
+        stats.fullFailures++;
+        connect();
+    } else if(state == STATE_RENEWING && elapsed >= FULL_CONNECT_TIMEOUT) {
+        stats.fullFailures++;
+        startFull();
+    } else if(state == STATE_CONNECTED && usingCached && isLeaseDue()) {
+        renew();
+    }
+}
+/*                                                                          *
+ *  The cached address came due while connected. The DHCP client is started *
+ *  on the running connection, it asks for the address again and the lease  *
+ *  is kept with the new times once it is bound. If no answer comes the     *
+ *  connection is started over with a scan.                                 *
+ *                                                                          */
+void FastConnect::renew() {
+    stats.renewals++;
+    state = STATE_RENEWING;
+    usingCached = false;
+    attemptStart = millis();
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());    // Starts the DHCP client.
+}
+/*                                                                          *
+ *  True if the cached address was obtained longer ago than its renewal     *
+ *  time, or the time is unknown. A clock that went back counts as due too. *
+ *                                                                          */
+bool FastConnect::isLeaseDue() {
+    if(lease.obtained == 0 || timeStatus() == timeNotSet) {
+        return true;
+    }
+    uint32_t current = now();
+    return current < lease.obtained || current - lease.obtained >= lease.renewTime;
+}
+// T1 of the lease the DHCP client got, half the lease time if the server didn't send it.
+uint32_t FastConnect::getRenewTime() {
+    struct dhcp *dhcp = netif_default != NULL ? netif_dhcp_data(netif_default) : NULL;
+    if(dhcp == NULL) {
+        return FAST_CONNECT_RENEW_DEFAULT;
+    }
+    if(dhcp->offered_t1_renew != 0) {
+        return dhcp->offered_t1_renew;
+    }
+    return dhcp->offered_t0_lease != 0 ? dhcp->offered_t0_lease / 2 : FAST_CONNECT_RENEW_DEFAULT;
+}
+/*                                                                          *
+ *  Counts the connect time and keeps the lease, if it changed. An address  *
+ *  from DHCP starts a new renewal time, the cached one keeps its times.    *
+ *                                                                          */
+void FastConnect::connected() {
+    if(state == STATE_FAST || state == STATE_FULL) {
+        stats.lastConnectTime = millis() - attemptStart;
+        count(state == STATE_FAST ? stats.fastTimes : stats.fullTimes, stats.lastConnectTime);
+    }
+    usingCached = state == STATE_FAST || (state == STATE_CONNECTED && usingCached);
+    state = STATE_CONNECTED;
+    WifiLease current = {};
+    memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+    current.channel = WiFi.channel();
+    current.ip = WiFi.localIP();
+    current.gateway = WiFi.gatewayIP();
+    current.mask = WiFi.subnetMask();
+    current.dns = WiFi.dnsIP();
+    if(usingCached) {
+        current.obtained = lease.obtained;
+        current.renewTime = lease.renewTime;
+    } else {
+        current.obtained = timeStatus() != timeNotSet ? now() : 0;
+        current.renewTime = getRenewTime();
+    }
+    if(memcmp(&current, &lease, sizeof(WifiLease)) != 0) {
+        lease = current;
+        writeRtc();
+    }
+    if(stored != NULL && memcmp(&lease, stored, sizeof(WifiLease)) != 0) {
+        *stored = lease;
+        leaseChanged = true;
+    }
+}
+void FastConnect::count(uint16_t *histogram, uint32_t time) {
+    uint8_t bucket = 0;
+    for(uint32_t limit = 250; bucket < FAST_CONNECT_BUCKETS - 1 && time >= limit; limit *= 2) {
+        bucket++;
+    }
+    if(histogram[bucket] < UINT16_MAX) {
+        histogram[bucket]++;
+    }
+}
+/*                                                                  *
+ *  Drops the lease, e.g. when a new network was entered in the     *
+ *  config portal. The next connection is found with a scan.        *
+ *                                                                  */
+void FastConnect::forget() {
+    memset(&lease, 0, sizeof(WifiLease));
+    writeRtc();
+    if(stored != NULL && stored->channel != 0) {
+        memset(stored, 0, sizeof(WifiLease));
+        leaseChanged = true;
+    }
+    state = STATE_IDLE;
+}
+// Disconnects on purpose, e.g. before the radio is turned off. Nothing is reconnected until connect().
+void FastConnect::stop() {
+    state = STATE_IDLE;
+    WiFi.disconnect();
+}
+bool FastConnect::readRtc() {
+    RtcLease saved;
+    if(!ESP.rtcUserMemoryRead(FAST_CONNECT_RTC_OFFSET, (uint32_t *)&saved, sizeof(saved))) {
+        return false;
+    }
+    if(saved.crc != Config::crc32((const uint8_t *)&saved.lease, sizeof(WifiLease))) {
+        return false;
+    }
+    lease = saved.lease;
+    return true;
+}
+void FastConnect::writeRtc() {
+    RtcLease saved;
+    saved.lease = lease;
+    saved.crc = Config::crc32((const uint8_t *)&saved.lease, sizeof(WifiLease));
+    ESP.rtcUserMemoryWrite(FAST_CONNECT_RTC_OFFSET, (uint32_t *)&saved, sizeof(saved));
+}
+// True once after the lease in the Config was changed, it should be saved.
+bool FastConnect::takeLeaseChanged() {
+    bool changed = leaseChanged;
+    leaseChanged = false;
+    return changed;
+}
+bool FastConnect::isConnected() {
+    return state == STATE_CONNECTED || state == STATE_RENEWING;
+}
+const FastConnectStats &FastConnect::getStats() {
+    return stats;
+}
+
+FastConnect fastConnect;
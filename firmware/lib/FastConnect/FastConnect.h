@@ -0,0 +1,90 @@
+#ifndef _FASTCONNECT_h   /* Include guard */
+#define _FASTCONNECT_h
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#define FAST_CONNECT_TIMEOUT 3000       // A connection to the cached AP that takes longer than this falls back to a scan (ms).
+#define FULL_CONNECT_TIMEOUT 20000      // A scan and DHCP that take longer than this are started over (ms).
+#define FAST_CONNECT_RTC_OFFSET 64      // RTC user memory block (4 bytes each) of the cached lease, the blocks before it are left to others.
+#define FAST_CONNECT_BUCKETS 7          // Connect time histogram: <250, <500, <1000, <2000, <4000, <8000, more (ms).
+#define FAST_CONNECT_RENEW_DEFAULT 1800 // The cached address is used this long if DHCP didn't tell the renewal time (s).
+
+/*                                                                          *
+ *  The AP and the DHCP lease of the last good connection. With them the    *
+ *  station skips the scan and DHCP, it connects straight to the known AP   *
+ *  on its channel and uses the address it had. Also kept in the Config,    *
+ *  so it survives a power loss, RTC memory doesn't. The address is only    *
+ *  used until the server wants the lease renewed (T1), after that it is    *
+ *  asked for again with DHCP, so it can't outlive the lease.               *
+ *                                                                          */
+struct WifiLease {
+    uint8_t bssid[6];
+    uint8_t channel;            // 0 if there is no lease.
+    uint8_t reserved;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t mask;
+    uint32_t dns;
+    uint32_t obtained;          // RTC time of the DHCP answer, 0 if unknown.
+    uint32_t renewTime;         // The address is used this many seconds after it was obtained.
+};
+
+struct FastConnectStats {
+    uint32_t fastAttempts;      // Connections to the cached AP with the cached address.
+    uint32_t fastFailures;      // Of those, the ones that timed out and fell back to a scan.
+    uint32_t fullAttempts;      // Connections with a scan and DHCP.
+    uint32_t fullFailures;
+    uint32_t disconnects;
+    uint32_t expired;           // Connections with a scan and DHCP because the cached address was due for renewal.
+    uint32_t renewals;          // Fast connections whose address came due while connected, renewed with DHCP.
+    uint32_t lastConnectTime;   // ms from the start of the attempt to the IP address.
+    uint16_t fastTimes[FAST_CONNECT_BUCKETS];
+    uint16_t fullTimes[FAST_CONNECT_BUCKETS];
+};
+
+class FastConnect {
+    enum State : uint8_t {
+        STATE_IDLE = 0,
+        STATE_FAST,             // Connecting to the cached AP.
+        STATE_FULL,             // Scanning, then DHCP.
+        STATE_CONNECTED,
+        STATE_RENEWING          // Connected with the cached address, DHCP asks for it again.
+    };
+    State state = STATE_IDLE;
+    const char *ssid = NULL;
+    const char *password = NULL;
+    WifiLease *stored = NULL;   // The copy in the Config.
+    WifiLease lease = {};
+    uint32_t attemptStart = 0;
+    volatile bool gotIp = false;
+    volatile bool disconnected = false;
+    bool leaseChanged = false;
+    bool usingCached = false;   // Connected with the cached address, there is no DHCP client running.
+    WiFiEventHandler gotIpHandler;
+    WiFiEventHandler disconnectedHandler;
+    FastConnectStats stats = {};
+    bool readRtc();
+    void writeRtc();
+    void startFast();
+    void startFull();
+    void renew();
+    bool isLeaseDue();
+    static uint32_t getRenewTime();
+    void connected();
+    void count(uint16_t *histogram, uint32_t time);
+public:
+    FastConnect();
+    void begin(const char *ssid, const char *password, WifiLease &stored);
+    void connect();
+    void poll();
+    void forget();
+    void stop();
+    bool takeLeaseChanged();
+    bool isConnected();
+    const FastConnectStats &getStats();
+};
+
+extern FastConnect fastConnect;
+
+#endif // _FASTCONNECT_h
@@ -0,0 +1,78 @@
+#include "FrameReceiver.h"
+#include <Logger.h>
+
+FrameReceiver::FrameReceiver() {
+}
+bool FrameReceiver::begin(uint16_t port) {
+    if(started) {
+        return true;
+    }
+    if(!udp.listen(port)) {
+        LOG_ERROR(LOG_NET, "FrameReceiver: Unable to listen on port %u!", port);
+        return false;
+    }
+    udp.onPacket([](void *arg, AsyncUDPPacket &packet) {
+        ((FrameReceiver *)arg)->receive(packet.data(), packet.length());
+    }, this);
+    started = true;
+    return true;
+}
+/*                                                                          *
+ *  Validates the packet and keeps the frame until loop() takes it. The     *
+ *  packet is decoded in place, nothing is allocated. Packets that arrive   *
+ *  over the serial link are passed here as well. A frame that is older     *
+ *  than the last accepted one is dropped, the sequence number wraps        *
+ *  around, so "older" means up to half of the range behind.                *
+ *                                                                          */
+void FrameReceiver::receive(const uint8_t *data, size_t length) {
+    if(length != FRAME_PACKET_SIZE || data[0] != FRAME_MAGIC || data[1] != FRAME_VERSION) {
+        stats.malformed++;
+        return;
+    }
+    uint16_t sequence = (data[2] << 8) | data[3];
+    bool restart = !hasSequence || (data[9] & FRAME_FLAG_RESET) || millis() - lastFrameTime > FRAME_SEQUENCE_TIMEOUT;
+    if(!restart) {
+        int16_t distance = (int16_t)(sequence - lastSequence);
+        if(distance <= 0) {
+            stats.outOfOrder++;
+            return;
+        }
+        stats.lost += distance - 1;
+    }
+    hasSequence = true;
+    lastSequence = sequence;
+    lastFrameTime = millis();
+
+    if(frameReady) {
+        stats.superseded++;
+    }
+    frame.digits[0] = data[4] >> 4;
+    frame.digits[1] = data[4] & 0x0F;
+    frame.digits[2] = data[5] >> 4;
+    frame.digits[3] = data[5] & 0x0F;
+    frame.dots = data[6];
+    frame.brightness = data[7];
+    frame.transition = data[8];
+    frameReady = true;
+    stats.received++;
+}
+/*                                                                          *
+ *  Copies the newest frame, if one arrived since the last call. Only the   *
+ *  newest one is kept, a display can't show frames faster than loop().     *
+ *                                                                          */
+bool FrameReceiver::takeFrame(NixieFrame &frame) {
+    if(!frameReady) {
+        return false;
+    }
+    frame = this->frame;
+    frameReady = false;
+    return true;
+}
+void FrameReceiver::countApplied() {
+    stats.applied++;
+}
+const FrameStats &FrameReceiver::getStats() {
+    return stats;
+}
+
+FrameReceiver frameReceiver = FrameReceiver();
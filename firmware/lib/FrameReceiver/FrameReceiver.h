@@ -0,0 +1,57 @@
+#ifndef _FRAMERECEIVER_h   /* Include guard */
+#define _FRAMERECEIVER_h
+
+#include <Arduino.h>
+#include <ESPAsyncUDP.h>
+#include <nixie.h>
+
+#define FRAME_RECEIVER_PORT 8266
+#define FRAME_PACKET_SIZE 10
+#define FRAME_MAGIC 'N'
+#define FRAME_VERSION 1
+#define FRAME_FLAG_RESET 0x01           // Sender restarted, the sequence number starts over.
+#define FRAME_SEQUENCE_TIMEOUT 5000     // After this many ms without a frame, any sequence number is accepted.
+
+/*                                                                          *
+ *  Frame packet, all of it in one UDP datagram:                            *
+ *                                                                          *
+ *  byte 0      magic, 'N'                                                  *
+ *  byte 1      protocol version, FRAME_VERSION                             *
+ *  byte 2-3    sequence number, big endian, increases by one per frame     *
+ *  byte 4-5    digits H1 H0 M1 M0, one per nibble, 0xA-0xF is off          *
+ *  byte 6      dots, same encoding as in Nixie::write()                    *
+ *  byte 7      brightness, reserved                                        *
+ *  byte 8      transition, NIXIE_TRANSITION_...                            *
+ *  byte 9      flags, FRAME_FLAG_...                                       *
+ *                                                                          */
+
+struct FrameStats {
+    uint32_t received;      // Valid frames, in order.
+    uint32_t applied;       // Frames that were written to the tubes.
+    uint32_t superseded;    // Frames replaced by a newer one before loop() could show them.
+    uint32_t outOfOrder;    // Frames older than the last accepted one, dropped.
+    uint32_t lost;          // Gaps in the sequence numbers, frames that never arrived.
+    uint32_t malformed;     // Wrong size, magic or version.
+};
+
+class FrameReceiver {
+    AsyncUDP udp;
+    NixieFrame frame = {};
+    bool frameReady = false;
+    bool started = false;
+    bool hasSequence = false;
+    uint16_t lastSequence = 0;
+    uint32_t lastFrameTime = 0;
+    FrameStats stats = {};
+public:
+    FrameReceiver();
+    bool begin(uint16_t port = FRAME_RECEIVER_PORT);
+    void receive(const uint8_t *data, size_t length);
+    bool takeFrame(NixieFrame &frame);
+    void countApplied();
+    const FrameStats &getStats();
+};
+
+extern FrameReceiver frameReceiver;
+
+#endif // _FRAMERECEIVER_h
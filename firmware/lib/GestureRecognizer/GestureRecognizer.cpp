@@ -0,0 +1,117 @@
+#include "GestureRecognizer.h"
+
+static const GestureConfig defaultConfig = {
+    GESTURE_DEBOUNCE_TIME, GESTURE_TAP_TIME, GESTURE_DOUBLE_TAP_GAP, GESTURE_LONG_PRESS_TIME, GESTURE_REPEAT_INTERVAL
+};
+
+GestureRecognizer::GestureRecognizer() : config(defaultConfig) {
+}
+GestureRecognizer::GestureRecognizer(const GestureConfig &config) : config(config) {
+}
+void GestureRecognizer::setConfig(const GestureConfig &config) {
+    this->config = config;
+}
+/*                                                                      *
+ *  Sets the level the button had at the start. A button that is        *
+ *  already held counts as pressed at the given time, e.g. at power on. *
+ *                                                                      */
+void GestureRecognizer::begin(bool pressed, uint32_t time) {
+    level = pressed;
+    pending = false;
+    tapWaiting = false;
+    longFired = false;
+    pressTime = time;
+    queueCount = 0;
+}
+/*                                                                      *
+ *  Records an edge, the new level and when it happened. An edge that   *
+ *  is followed by another one within the debounce time was a bounce.   *
+ *                                                                      */
+void GestureRecognizer::edge(bool pressed, uint32_t time) {
+    if(pending && time - pendingTime >= config.debounce) {
+        apply(pendingLevel, pendingTime);
+    }
+    pending = true;
+    pendingLevel = pressed;
+    pendingTime = time;
+}
+void GestureRecognizer::update(uint32_t now) {
+    if(pending && now - pendingTime >= config.debounce) {
+        pending = false;
+        apply(pendingLevel, pendingTime);
+    }
+    if(level && !longFired && now - pressTime >= config.longPress) {
+        if(tapWaiting) {
+            tapWaiting = false;
+            emit(GESTURE_TAP);      // The first tap of what turned out not to be a double tap.
+        }
+        longFired = true;
+        nextRepeat = pressTime + config.longPress + config.repeatInterval;
+        emit(GESTURE_LONG_PRESS);
+    }
+    if(level && longFired && config.repeatInterval > 0 && (int32_t)(now - nextRepeat) >= 0) {
+        nextRepeat += config.repeatInterval;
+        emit(GESTURE_HOLD_REPEAT);
+    }
+    if(tapWaiting && !level && now - releaseTime > config.doubleTapGap) {
+        tapWaiting = false;
+        emit(GESTURE_TAP);
+    }
+}
+void GestureRecognizer::apply(bool pressed, uint32_t time) {
+    if(pressed == level) {
+        return;
+    }
+    level = pressed;
+    if(pressed) {
+        pressTime = time;
+        longFired = false;
+        return;
+    }
+    releaseTime = time;
+    if(longFired || time - pressTime > config.tapMax) {
+        return;
+    }
+    if(tapWaiting) {
+        tapWaiting = false;
+        emit(GESTURE_DOUBLE_TAP);
+    } else if(config.doubleTapGap == 0) {
+        emit(GESTURE_TAP);
+    } else {
+        tapWaiting = true;
+    }
+}
+// A full queue drops the oldest gesture.
+void GestureRecognizer::emit(Gesture gesture) {
+    if(queueCount == GESTURE_QUEUE_SIZE) {
+        queueHead = (queueHead + 1) % GESTURE_QUEUE_SIZE;
+        queueCount--;
+    }
+    queue[(queueHead + queueCount) % GESTURE_QUEUE_SIZE] = gesture;
+    queueCount++;
+}
+/*                                                                  *
+ *  Returns the oldest recognized gesture, GESTURE_NONE if there    *
+ *  is none.                                                        *
+ *                                                                  */
+Gesture GestureRecognizer::takeGesture() {
+    if(queueCount == 0) {
+        return GESTURE_NONE;
+    }
+    Gesture gesture = queue[queueHead];
+    queueHead = (queueHead + 1) % GESTURE_QUEUE_SIZE;
+    queueCount--;
+    return gesture;
+}
+bool GestureRecognizer::isPressed() {
+    return level;
+}
+const char *GestureRecognizer::getName(Gesture gesture) {
+    switch(gesture) {
+        case GESTURE_TAP: return "tap";
+        case GESTURE_DOUBLE_TAP: return "double tap";
+        case GESTURE_LONG_PRESS: return "long press";
+        case GESTURE_HOLD_REPEAT: return "hold repeat";
+        default: return "none";
+    }
+}
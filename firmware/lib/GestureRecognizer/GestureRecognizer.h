@@ -0,0 +1,75 @@
+#ifndef _GESTURERECOGNIZER_h   /* Include guard */
+#define _GESTURERECOGNIZER_h
+
+#include <stdint.h>
+
+#define GESTURE_QUEUE_SIZE 4
+
+// Default thresholds (us).
+#define GESTURE_DEBOUNCE_TIME 20000     // A level must be stable this long to count.
+#define GESTURE_TAP_TIME 350000         // Longest press that is still a tap.
+#define GESTURE_DOUBLE_TAP_GAP 300000   // Longest pause between the two taps of a double tap, 0 turns double taps off.
+#define GESTURE_LONG_PRESS_TIME 800000  // Press that is reported as a long press.
+#define GESTURE_REPEAT_INTERVAL 400000  // Held after a long press, it repeats this often, 0 turns the repeats off.
+
+enum Gesture : uint8_t {
+    GESTURE_NONE = 0,
+    GESTURE_TAP,
+    GESTURE_DOUBLE_TAP,
+    GESTURE_LONG_PRESS,
+    GESTURE_HOLD_REPEAT
+};
+
+struct GestureConfig {
+    uint32_t debounce;
+    uint32_t tapMax;
+    uint32_t doubleTapGap;
+    uint32_t longPress;
+    uint32_t repeatInterval;
+};
+
+/*                                                                          *
+ *  Turns the edges of a button into gestures, by their timestamps only,    *
+ *  so the result doesn't depend on how often it is polled. The edges       *
+ *  come from an interrupt or from polling, with micros() of the moment     *
+ *  they happened. update() fires the gestures that are decided by a        *
+ *  timeout (tap after the double tap gap, long press, repeats) and should  *
+ *  be called at least every few tens of ms.                                *
+ *                                                                          *
+ *  A press shorter than tapMax is a tap, or the second half of a double    *
+ *  tap. A press held for longPress is a long press, then a hold repeat     *
+ *  every repeatInterval until it is released. A press in between is        *
+ *  ignored. Bounces shorter than the debounce time are dropped.            *
+ *                                                                          *
+ *  It has no Arduino dependencies, so it can be run on the host against    *
+ *  recorded edge traces.                                                   *
+ *                                                                          */
+class GestureRecognizer {
+    GestureConfig config;
+    bool level = false;             // Debounced level, true is pressed.
+    bool pending = false;           // An edge that is waiting for the debounce time.
+    bool pendingLevel = false;
+    uint32_t pendingTime = 0;
+    uint32_t pressTime = 0;
+    uint32_t releaseTime = 0;
+    uint32_t nextRepeat = 0;
+    bool longFired = false;
+    bool tapWaiting = false;        // A tap that may become a double tap.
+    Gesture queue[GESTURE_QUEUE_SIZE];
+    uint8_t queueHead = 0;
+    uint8_t queueCount = 0;
+    void apply(bool pressed, uint32_t time);
+    void emit(Gesture gesture);
+public:
+    GestureRecognizer();
+    GestureRecognizer(const GestureConfig &config);
+    void setConfig(const GestureConfig &config);
+    void begin(bool pressed, uint32_t time);
+    void edge(bool pressed, uint32_t time);
+    void update(uint32_t now);
+    Gesture takeGesture();
+    bool isPressed();
+    static const char *getName(Gesture gesture);
+};
+
+#endif // _GESTURERECOGNIZER_h
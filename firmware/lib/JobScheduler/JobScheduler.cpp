@@ -0,0 +1,246 @@
+#include "JobScheduler.h"
+#include <Logger.h>
+
+JobScheduler::JobScheduler() {
+}
+/*                                                                          *
+ *  Registers a periodic job. The job is due right away, so every job       *
+ *  runs once soon after it is added. Returns the id of the job, or -1      *
+ *  if there is no more room in the job table (see MAX_JOBS).               *
+ *                                                                          */
+int8_t JobScheduler::addJob(const char *name, JobFunction function, uint32_t interval, uint32_t deadline, bool heavy, void *context) {
+    if(jobCount >= MAX_JOBS) {
+        LOG_ERROR(LOG_JOBS, "addJob: No room for the job %s!", name);
+        return -1;
+    }
+    Job &job = jobs[jobCount];
+    job.name = name;
+    job.function = function;
+    job.context = context;
+    job.interval = interval;
+    job.deadline = deadline;
+    job.nextRun = millis();
+    job.lastRun = job.nextRun;
+    job.pulled = false;
+    job.heavy = heavy;
+    job.fixedRate = false;
+    job.enabled = true;
+    job.added = job.nextRun;
+    memset(&job.stats, 0, sizeof(JobStats));
+    return jobCount++;
+}
+/*                                                                          *
+ *  Registers a job that runs at a fixed rate, like the display or the      *
+ *  input polling. Its runs are due at multiples of the interval, a late    *
+ *  run doesn't move the ones after it. A run that is late by more than     *
+ *  the interval skips the periods it missed, they are counted as missed.   *
+ *                                                                          */
+int8_t JobScheduler::addFixedRateJob(const char *name, JobFunction function, uint32_t interval, uint32_t deadline, void *context) {
+    int8_t id = addJob(name, function, interval, deadline, false, context);
+    if(id >= 0) {
+        jobs[id].fixedRate = true;
+    }
+    return id;
+}
+void JobScheduler::setEnabled(int8_t id, bool enabled) {
+    if(id < 0 || id >= jobCount || jobs[id].enabled == enabled) {
+        return;
+    }
+    jobs[id].enabled = enabled;
+    if(enabled) {
+        jobs[id].nextRun = millis();    // A job that was just enabled has no fresh data, so it is due at once.
+        jobs[id].pulled = false;
+    }
+}
+/*                                                                  *
+ *  Changes the interval of a job. Its next run is planned from the *
+ *  last one with the new interval, unless it was planned sooner.   *
+ *                                                                  */
+void JobScheduler::setInterval(int8_t id, uint32_t interval) {
+    if(id < 0 || id >= jobCount) {
+        return;
+    }
+    Job &job = jobs[id];
+    job.interval = interval;
+    if(job.stats.runs > 0 && (int32_t)(job.lastRun + interval - job.nextRun) < 0) {
+        job.nextRun = job.lastRun + interval;
+    }
+}
+/*                                                          *
+ *  Makes the job due at once, for example after one of     *
+ *  its parameters has been changed.                        *
+ *                                                          */
+void JobScheduler::runNow(int8_t id) {
+    if(id >= 0 && id < jobCount) {
+        jobs[id].nextRun = millis();
+        jobs[id].pulled = false;
+    }
+}
+/*                                                              *
+ *  Makes the job due after the given delay instead of its      *
+ *  interval, for example to back off after a failed attempt.   *
+ *                                                              */
+void JobScheduler::runIn(int8_t id, uint32_t delay) {
+    if(id >= 0 && id < jobCount) {
+        jobs[id].nextRun = millis() + delay;
+        jobs[id].pulled = false;
+    }
+}
+/*                                                                          *
+ *  If the job would be due within the given window, it is made due now,    *
+ *  so its data is refreshed before it expires. Used to warm up the data    *
+ *  of a slot before it is shown. The runs after it keep their phase, so    *
+ *  the interval doesn't shrink. Returns true if the job was pulled         *
+ *  forward.                                                                *
+ *                                                                          */
+bool JobScheduler::prefetch(int8_t id, uint32_t window) {
+    if(id < 0 || id >= jobCount || !jobs[id].enabled) {
+        return false;
+    }
+    int32_t remaining = (int32_t)(jobs[id].nextRun - millis());
+    if(remaining <= 0 || (uint32_t)remaining > window) {
+        return false;   // Already due, or not close enough to its expiry.
+    }
+    pullForward(id, millis());
+    jobs[id].stats.prefetches++;
+    return true;
+}
+// Makes a job that is not due yet due now, it remembers when it was planned for.
+void JobScheduler::pullForward(uint8_t id, uint32_t now) {
+    if(!jobs[id].pulled) {
+        jobs[id].plannedRun = jobs[id].nextRun;
+        jobs[id].pulled = true;
+    }
+    jobs[id].nextRun = now;
+}
+bool JobScheduler::isDue(uint8_t id, uint32_t now) {
+    return jobs[id].enabled && (int32_t)(now - jobs[id].nextRun) >= 0;
+}
+void JobScheduler::runJob(uint8_t id, uint32_t now) {
+    Job &job = jobs[id];
+    JobStats &stats = job.stats;
+    stats.lastLatency = now - job.nextRun;
+    job.lastRun = now;
+    if(stats.lastLatency > stats.maxLatency) {
+        stats.maxLatency = stats.lastLatency;
+    }
+    if(stats.lastLatency > job.deadline) {
+        stats.overruns++;
+    }
+    if(job.fixedRate) {
+        uint32_t skipped = stats.lastLatency / job.interval;
+        stats.missed += skipped;
+        job.nextRun += (skipped + 1) * job.interval;
+    } else if(job.pulled && (int32_t)(job.plannedRun - now) > 0) {
+        // Pulled forward, the next run is planned from the time this one was planned for, not from now.
+        job.nextRun = job.plannedRun + job.interval;
+    } else {
+        // The next run is planned from the moment the job started, so a late job does not run twice in a row.
+        job.nextRun = now + job.interval;
+    }
+    job.pulled = false;
+    uint32_t start = micros();
+    if(!job.function(job.context) && !job.fixedRate && job.interval > JOB_RETRY_INTERVAL) {
+        job.nextRun = millis() + JOB_RETRY_INTERVAL;
+    }
+    stats.lastDuration = micros() - start;
+    if(stats.lastDuration > stats.maxDuration) {
+        stats.maxDuration = stats.lastDuration;
+    }
+    stats.totalTime += stats.lastDuration;
+    stats.runs++;
+}
+/*                                                                          *
+ *  Runs the jobs that are due. It should be called from loop().            *
+ *  All of the due light jobs are run, the one with the earliest deadline   *
+ *  first, but only one heavy (network) job per call, the one that is       *
+ *  closest to missing its deadline. Heavy jobs that would be due within    *
+ *  JOB_COALESCE_WINDOW are pulled forward, so they run right after it      *
+ *  while the connection is still warm, instead of waking the network       *
+ *  again a few seconds later. The WiFi stack gets to run after each job.   *
+ *                                                                          */
+void JobScheduler::run() {
+    uint32_t now = millis();
+    uint16_t done = 0;      // Jobs that already ran in this call, a job that was made due again waits for the next one.
+    int8_t heavyJob = -1;
+    int32_t heavySlack = 0;
+    while(true) {
+        int8_t lightJob = -1;
+        int32_t lightSlack = 0;
+        heavyJob = -1;
+        for(uint8_t i = 0; i < jobCount; i++) {
+            if((done & (1 << i)) || !isDue(i, now)) {
+                continue;
+            }
+            int32_t slack = (int32_t)(jobs[i].nextRun + jobs[i].deadline - now);
+            if(!jobs[i].heavy && (lightJob == -1 || slack < lightSlack)) {
+                lightJob = i;
+                lightSlack = slack;
+            } else if(jobs[i].heavy && (heavyJob == -1 || slack < heavySlack)) {
+                heavyJob = i;
+                heavySlack = slack;
+            }
+        }
+        if(lightJob == -1) {
+            break;
+        }
+        done |= 1 << lightJob;
+        runJob(lightJob, now);
+        yield();
+        now = millis();
+    }
+    if(heavyJob == -1) {
+        return;
+    }
+    runJob(heavyJob, now);
+    yield();
+    now = millis();
+    for(uint8_t i = 0; i < jobCount; i++) {
+        if(i != heavyJob && jobs[i].enabled && jobs[i].heavy && (int32_t)(jobs[i].nextRun - now) <= JOB_COALESCE_WINDOW && (int32_t)(jobs[i].nextRun - now) > 0) {
+            pullForward(i, now);
+        }
+    }
+}
+uint8_t JobScheduler::getJobCount() {
+    return jobCount;
+}
+const char *JobScheduler::getName(int8_t id) {
+    return (id >= 0 && id < jobCount) ? jobs[id].name : "unknown";
+}
+bool JobScheduler::isEnabled(int8_t id) {
+    return id >= 0 && id < jobCount && jobs[id].enabled;
+}
+/*                                                              *
+ *  Returns the number of ms until the job is due, 0 if it is   *
+ *  already due.                                                *
+ *                                                              */
+uint32_t JobScheduler::getTimeUntilDue(int8_t id) {
+    if(id < 0 || id >= jobCount) {
+        return UINT32_MAX;
+    }
+    int32_t remaining = (int32_t)(jobs[id].nextRun - millis());
+    return remaining > 0 ? remaining : 0;
+}
+// Time until the next enabled heavy job is due (ms), UINT32_MAX if there is none.
+uint32_t JobScheduler::getTimeUntilHeavy() {
+    uint32_t next = UINT32_MAX;
+    for(uint8_t i = 0; i < jobCount; i++) {
+        if(jobs[i].enabled && jobs[i].heavy) {
+            next = min(next, getTimeUntilDue(i));
+        }
+    }
+    return next;
+}
+const JobStats &JobScheduler::getStats(int8_t id) {
+    return jobs[(id >= 0 && id < jobCount) ? id : 0].stats;
+}
+// Share of the time spent in the job since it was added, in per mille.
+uint16_t JobScheduler::getLoad(int8_t id) {
+    if(id < 0 || id >= jobCount) {
+        return 0;
+    }
+    uint32_t elapsed = millis() - jobs[id].added;
+    return elapsed > 0 ? jobs[id].stats.totalTime / elapsed : 0;
+}
+
+JobScheduler jobScheduler = JobScheduler();
@@ -0,0 +1,69 @@
+#ifndef _JOBSCHEDULER_h   /* Include guard */
+#define _JOBSCHEDULER_h
+
+#include <Arduino.h>
+
+#define MAX_JOBS 16             // At most 16, run() keeps one bit per job.
+#define JOB_COALESCE_WINDOW 5000    // A heavy job that is due within this many ms of another heavy job is run right after it.
+#define JOB_RETRY_INTERVAL 5000     // A job that could not do its work (e.g. no WiFi) is retried after this many ms.
+
+// Returns false if the job could not do its work, so it is retried sooner than its interval.
+// The context is the pointer given to addJob().
+typedef bool (*JobFunction)(void *context);
+
+struct JobStats {
+    uint32_t runs;
+    uint32_t overruns;      // Number of runs that started later than the deadline of the job.
+    uint32_t lastLatency;   // Time from the moment the job was due, to the moment it started (ms).
+    uint32_t maxLatency;
+    uint32_t lastDuration;  // How long the last run took (us).
+    uint32_t maxDuration;
+    uint32_t prefetches;    // Number of runs that were pulled forward by prefetch().
+    uint32_t missed;        // Periods a fixed rate job skipped, because it was late by more than its interval.
+    uint64_t totalTime;     // Time spent in the job since it was added (us).
+};
+
+class JobScheduler {
+    struct Job {
+        const char *name;
+        JobFunction function;
+        void *context;
+        uint32_t interval;  // Time between two runs (ms).
+        uint32_t deadline;  // The job should start at most this many ms after it is due.
+        uint32_t nextRun;   // millis() when the job is due.
+        uint32_t lastRun;   // millis() when it last started.
+        uint32_t plannedRun;    // When a run was pulled forward, the time it was planned for, the runs after it keep that phase.
+        bool pulled;
+        bool heavy;         // Heavy jobs use the network, only one of them is run per pass.
+        bool fixedRate;     // Runs at a fixed rate, a late run doesn't move the ones after it.
+        bool enabled;
+        uint32_t added;     // millis() when the job was added.
+        JobStats stats;
+    };
+    Job jobs[MAX_JOBS];
+    uint8_t jobCount = 0;
+    bool isDue(uint8_t id, uint32_t now);
+    void runJob(uint8_t id, uint32_t now);
+    void pullForward(uint8_t id, uint32_t now);
+public:
+    JobScheduler();
+    int8_t addJob(const char *name, JobFunction function, uint32_t interval, uint32_t deadline, bool heavy, void *context = NULL);
+    int8_t addFixedRateJob(const char *name, JobFunction function, uint32_t interval, uint32_t deadline, void *context = NULL);
+    void setEnabled(int8_t id, bool enabled);
+    void setInterval(int8_t id, uint32_t interval);
+    void runNow(int8_t id);
+    void runIn(int8_t id, uint32_t delay);
+    bool prefetch(int8_t id, uint32_t window);
+    void run();
+    uint8_t getJobCount();
+    const char *getName(int8_t id);
+    bool isEnabled(int8_t id);
+    uint32_t getTimeUntilDue(int8_t id);
+    uint32_t getTimeUntilHeavy();
+    const JobStats &getStats(int8_t id);
+    uint16_t getLoad(int8_t id);
+};
+
+extern JobScheduler jobScheduler;
+
+#endif // _JOBSCHEDULER_h
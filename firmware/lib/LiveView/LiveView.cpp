@@ -0,0 +1,278 @@
+#include "LiveView.h"
+#include <Hash.h>
+
+static const char websocketGuid[] PROGMEM = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static const char responseSwitching[] PROGMEM =
+    "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n";
+static const char responseBadRequest[] PROGMEM = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+static const char responseNotFound[] PROGMEM = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n";
+static const char base64Digits[] PROGMEM = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void putUint32(uint8_t *buffer, uint32_t value) {
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+static void encodeBase64(const uint8_t *data, size_t length, char *out) {
+    for(size_t i = 0; i < length; i += 3) {
+        uint32_t group = (uint32_t)data[i] << 16 | (i + 1 < length ? data[i + 1] << 8 : 0) | (i + 2 < length ? data[i + 2] : 0);
+        for(uint8_t j = 0; j < 4; j++) {
+            *out++ = i + j <= length ? pgm_read_byte(base64Digits + (group >> (18 - 6 * j) & 0x3F)) : '=';
+        }
+    }
+    *out = '\0';
+}
+
+LiveView::LiveView() {
+}
+void LiveView::begin() {
+    if(server != NULL) {
+        return;
+    }
+    server = new AsyncServer(LIVEVIEW_PORT);
+    server->onClient(onClient, this);
+    server->begin();
+}
+// Takes a free entry for the new connection, connections over the limit are closed at once, every client costs a send buffer.
+void LiveView::onClient(void *arg, AsyncClient *client) {
+    LiveView *self = (LiveView *)arg;
+    client->onDisconnect(onDisconnect, arg);
+    LiveViewClient *entry = self->findClient(NULL);
+    if(entry == NULL) {
+        client->close();
+        return;
+    }
+    memset(entry, 0, sizeof(LiveViewClient));
+    entry->client = client;
+    client->setRxTimeout(LIVEVIEW_RX_TIMEOUT);
+    client->setNoDelay(true);
+    client->onData(onData, arg);
+}
+void LiveView::onDisconnect(void *arg, AsyncClient *client) {
+    LiveViewClient *entry = ((LiveView *)arg)->findClient(client);
+    if(entry != NULL) {
+        entry->client = NULL;
+    }
+    delete client;
+}
+void LiveView::onData(void *arg, AsyncClient *client, void *data, size_t len) {
+    LiveView *self = (LiveView *)arg;
+    LiveViewClient *entry = self->findClient(client);
+    if(entry == NULL || len == 0) {
+        return;
+    }
+    if(entry->state != LIVEVIEW_OPEN) {
+        self->handshake(*entry, (const char *)data, len);
+    } else if((((const uint8_t *)data)[0] & 0x0F) == 0x08) {
+        client->close();    // A close frame, the rest of the messages of the client are ignored.
+    }
+}
+LiveViewClient *LiveView::findClient(AsyncClient *client) {
+    for(uint8_t i = 0; i < LIVEVIEW_MAX_CLIENTS; i++) {
+        if(clients[i].client == client) {
+            return &clients[i];
+        }
+    }
+    return NULL;
+}
+// Splits the request into lines, across as many segments as it takes.
+void LiveView::handshake(LiveViewClient &client, const char *data, size_t len) {
+    for(size_t i = 0; i < len && client.client != NULL && client.state != LIVEVIEW_OPEN; i++) {
+        if(data[i] == '\n') {
+            client.line[client.lineLength] = '\0';
+            if(!handleLine(client)) {
+                return;
+            }
+            client.lineLength = 0;
+            client.lineTooLong = false;
+        } else if(data[i] == '\r') {
+            continue;
+        } else if(client.lineLength < LIVEVIEW_LINE_LENGTH - 1) {
+            client.line[client.lineLength++] = data[i];
+        } else {
+            client.lineTooLong = true;
+        }
+    }
+}
+/*                                                                          *
+ *  Checks the request line, keeps the key and answers at the empty line    *
+ *  after the headers. Returns false if the client was rejected.            *
+ *                                                                          */
+bool LiveView::handleLine(LiveViewClient &client) {
+    if(client.state == LIVEVIEW_REQUEST) {
+        if(client.lineTooLong || strncmp(client.line, "GET ", 4) != 0) {
+            reject(client, responseBadRequest);
+            return false;
+        }
+        if(strncmp(client.line + 4, LIVEVIEW_PATH " ", strlen(LIVEVIEW_PATH) + 1) != 0) {
+            reject(client, responseNotFound);
+            return false;
+        }
+        client.state = LIVEVIEW_HEADERS;
+    } else if(client.lineLength == 0 && !client.lineTooLong) {
+        if(client.key[0] == '\0') {
+            reject(client, responseBadRequest);
+            return false;
+        }
+        accept(client);
+    } else if(!client.lineTooLong && strncasecmp(client.line, "Sec-WebSocket-Key:", 18) == 0) {
+        const char *key = client.line + 18;
+        while(*key == ' ') {
+            key++;
+        }
+        if(strlen(key) == LIVEVIEW_KEY_LENGTH) {
+            memcpy(client.key, key, LIVEVIEW_KEY_LENGTH + 1);
+        }
+    }
+    return true;
+}
+// Answers with the hash of the key, from now on the client only listens.
+void LiveView::accept(LiveViewClient &client) {
+    uint8_t input[LIVEVIEW_KEY_LENGTH + sizeof(websocketGuid) - 1];
+    memcpy(input, client.key, LIVEVIEW_KEY_LENGTH);
+    memcpy_P(input + LIVEVIEW_KEY_LENGTH, websocketGuid, sizeof(websocketGuid) - 1);
+    uint8_t hash[20];
+    sha1(input, sizeof(input), hash);
+    char key[29];
+    encodeBase64(hash, sizeof(hash), key);
+    char response[160];
+    int length = snprintf_P(response, sizeof(response), responseSwitching, key);
+    client.client->setRxTimeout(0);
+    client.client->write(response, min((size_t)max(length, 0), sizeof(response) - 1));
+    client.state = LIVEVIEW_OPEN;
+    client.namesSent = false;
+}
+void LiveView::reject(LiveViewClient &client, const char *response) {
+    char buffer[64];
+    size_t length = min(strlen_P(response), sizeof(buffer));
+    memcpy_P(buffer, response, length);
+    client.client->write(buffer, length);
+    client.client->close();
+    client.client = NULL;
+}
+bool LiveView::hasClients() {
+    for(uint8_t i = 0; i < LIVEVIEW_MAX_CLIENTS; i++) {
+        if(clients[i].client != NULL && clients[i].state == LIVEVIEW_OPEN) {
+            return true;
+        }
+    }
+    return false;
+}
+/*                                                                          *
+ *  Queues one unmasked binary message, FIN set, if the send buffer of the  *
+ *  connection takes all of it. A slow client misses the message instead    *
+ *  of the display waiting for it.                                          *
+ *                                                                          */
+bool LiveView::send(LiveViewClient &client, const uint8_t *payload, size_t length) {
+    uint8_t header[4] = {0x82, (uint8_t)length};
+    size_t headerLength = 2;
+    if(length >= 126) {
+        header[1] = 126;
+        header[2] = length >> 8;
+        header[3] = length;
+        headerLength = 4;
+    }
+    if(client.client->space() < headerLength + length) {
+        stats.dropped++;
+        return false;
+    }
+    client.client->add((const char *)header, headerLength);
+    client.client->add((const char *)payload, length);
+    client.client->send();
+    return true;
+}
+/*                                                                          *
+ *  Stores a frame that has just been written to the tubes. It is called    *
+ *  from the display path, so it only copies a few bytes into the ring.     *
+ *                                                                          */
+void LiveView::commit(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_t digit4, uint8_t dots) {
+    stats.frames++;
+    if(!hasClients()) {
+        return;
+    }
+    if(ringCount == LIVEVIEW_RING_SIZE) {
+        ringStart = (ringStart + 1) % LIVEVIEW_RING_SIZE;   // The oldest frame is overwritten.
+        ringCount--;
+        stats.overwritten++;
+    }
+    uint8_t *record = ring[(ringStart + ringCount) % LIVEVIEW_RING_SIZE];
+    putUint32(record, millis());
+    record[4] = (min(digit1, (uint8_t)15) << 4) | min(digit2, (uint8_t)15);
+    record[5] = (min(digit3, (uint8_t)15) << 4) | min(digit4, (uint8_t)15);
+    record[6] = dots;
+    record[7] = 0;
+    ringCount++;
+}
+/*                                                          *
+ *  Sends the frames stored since the last call as one      *
+ *  message. It should be called periodically from a job.   *
+ *                                                          */
+void LiveView::sendFrames() {
+    if(ringCount == 0) {
+        return;
+    }
+    uint8_t message[2 + LIVEVIEW_RING_SIZE * LIVEVIEW_RECORD_SIZE];
+    message[0] = LIVEVIEW_MSG_FRAMES;
+    message[1] = ringCount;
+    for(uint8_t i = 0; i < ringCount; i++) {
+        memcpy(message + 2 + i * LIVEVIEW_RECORD_SIZE, ring[(ringStart + i) % LIVEVIEW_RING_SIZE], LIVEVIEW_RECORD_SIZE);
+    }
+    size_t length = 2 + ringCount * LIVEVIEW_RECORD_SIZE;
+    ringStart = 0;
+    ringCount = 0;
+    stats.batches++;
+    for(uint8_t i = 0; i < LIVEVIEW_MAX_CLIENTS; i++) {
+        if(clients[i].client != NULL && clients[i].state == LIVEVIEW_OPEN) {
+            send(clients[i], message, length);
+        }
+    }
+}
+/*                                                                          *
+ *  Sends the change of every metric since the last call. A new client      *
+ *  first gets the names and the current values, the deltas that follow     *
+ *  are applied on top of them. Metrics must always be given in the same    *
+ *  order, only the first LIVEVIEW_MAX_METRICS are sent.                    *
+ *                                                                          */
+void LiveView::sendMetrics(const char *const *names, const uint32_t *values, uint8_t count) {
+    count = min(count, (uint8_t)LIVEVIEW_MAX_METRICS);
+    uint8_t deltas[2 + LIVEVIEW_MAX_METRICS * 5];
+    uint8_t changed = 0;
+    for(uint8_t i = 0; i < count; i++) {
+        if(values[i] != lastMetrics[i]) {
+            deltas[2 + changed * 5] = i;
+            putUint32(deltas + 3 + changed * 5, values[i] - lastMetrics[i]);
+            changed++;
+        }
+    }
+    deltas[0] = LIVEVIEW_MSG_METRICS;
+    deltas[1] = changed;
+
+    for(uint8_t i = 0; i < LIVEVIEW_MAX_CLIENTS; i++) {
+        if(clients[i].client == NULL || clients[i].state != LIVEVIEW_OPEN) {
+            continue;
+        }
+        if(!clients[i].namesSent) {
+            uint8_t message[2 + LIVEVIEW_MAX_METRICS * 24];
+            size_t length = 2;
+            message[0] = LIVEVIEW_MSG_NAMES;
+            message[1] = count;
+            for(uint8_t j = 0; j < count; j++) {
+                putUint32(message + length, values[j]);
+                size_t nameLength = min(strlen(names[j]), (size_t)19);
+                memcpy(message + length + 4, names[j], nameLength);
+                message[length + 4 + nameLength] = '\0';
+                length += 5 + nameLength;
+            }
+            clients[i].namesSent = send(clients[i], message, length);
+        } else if(changed > 0 && !send(clients[i], deltas, 2 + changed * 5)) {
+            clients[i].namesSent = false;   // The deltas would not add up anymore, the client starts over from the current values.
+        }
+    }
+    memcpy(lastMetrics, values, count * sizeof(uint32_t));
+}
+const LiveViewStats &LiveView::getStats() {
+    return stats;
+}
+
+LiveView liveView;  // Not copy initialized, the event handler keeps the address of the instance.
@@ -0,0 +1,93 @@
+#ifndef _LIVEVIEW_h   /* Include guard */
+#define _LIVEVIEW_h
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+
+#define LIVEVIEW_PORT 81
+#define LIVEVIEW_PATH "/live"
+#define LIVEVIEW_MAX_CLIENTS 3
+#define LIVEVIEW_RING_SIZE 32           // Frames kept between two batches, older ones are dropped.
+#define LIVEVIEW_MAX_METRICS 16
+#define LIVEVIEW_RECORD_SIZE 8
+#define LIVEVIEW_LINE_LENGTH 64         // Longest request line or header that is read, longer ones are skipped.
+#define LIVEVIEW_KEY_LENGTH 24          // Sec-WebSocket-Key, 16 bytes in base64.
+#define LIVEVIEW_RX_TIMEOUT 3           // A client that does not finish the handshake within this many seconds is dropped.
+
+#define LIVEVIEW_MSG_FRAMES 'F'         // 'F', count, count x record
+#define LIVEVIEW_MSG_NAMES 'N'          // 'N', count, count x (value uint32, null terminated name)
+#define LIVEVIEW_MSG_METRICS 'M'        // 'M', count, count x (index uint8, delta int32)
+
+/*                                                                          *
+ *  Frame record, little endian:                                            *
+ *                                                                          *
+ *  byte 0-3    millis() when the frame was committed to the tubes          *
+ *  byte 4      digits H1 H0, one per nibble, 0xA and above is off          *
+ *  byte 5      digits M1 M0                                                *
+ *  byte 6      dots, same encoding as in Nixie::write()                    *
+ *  byte 7      reserved, 0                                                 *
+ *                                                                          */
+
+enum LiveViewState : uint8_t {
+    LIVEVIEW_REQUEST = 0,   // Waiting for "GET /live HTTP/1.1".
+    LIVEVIEW_HEADERS,       // Looking for the key, up to the empty line.
+    LIVEVIEW_OPEN           // Handshake done, the client gets the messages.
+};
+
+struct LiveViewClient {
+    AsyncClient *client;
+    LiveViewState state;
+    bool namesSent;
+    bool lineTooLong;
+    uint8_t lineLength;
+    char line[LIVEVIEW_LINE_LENGTH];
+    char key[LIVEVIEW_KEY_LENGTH + 1];
+};
+
+struct LiveViewStats {
+    uint32_t frames;        // Frames committed to the tubes.
+    uint32_t overwritten;   // Frames lost because the ring was full before the batch was sent.
+    uint32_t batches;       // Messages sent to all of the clients.
+    uint32_t dropped;       // Messages not sent to a client, because its queue was full.
+};
+
+/*                                                                          *
+ *  WebSocket stream of what the tubes show, on ws://<ip>:81/live.          *
+ *  The display path only stores the frame in a ring buffer, it never       *
+ *  waits for the network. The frames are sent in batches, and a client     *
+ *  that can't keep up loses whole batches instead of slowing NixieTap.     *
+ *  The handshake and the frames are served from a plain AsyncServer, like  *
+ *  the PushServer, the headers are read line by line as they arrive and    *
+ *  only the key is kept. The messages of the client are not read, except   *
+ *  for a close.                                                            *
+ *                                                                          */
+class LiveView {
+    AsyncServer *server = NULL;
+    LiveViewClient clients[LIVEVIEW_MAX_CLIENTS] = {};
+    uint8_t ring[LIVEVIEW_RING_SIZE][LIVEVIEW_RECORD_SIZE];
+    uint8_t ringStart = 0;
+    uint8_t ringCount = 0;
+    uint32_t lastMetrics[LIVEVIEW_MAX_METRICS] = {};
+    LiveViewStats stats = {};
+    static void onClient(void *arg, AsyncClient *client);
+    static void onData(void *arg, AsyncClient *client, void *data, size_t len);
+    static void onDisconnect(void *arg, AsyncClient *client);
+    LiveViewClient *findClient(AsyncClient *client);
+    void handshake(LiveViewClient &client, const char *data, size_t len);
+    bool handleLine(LiveViewClient &client);
+    void accept(LiveViewClient &client);
+    void reject(LiveViewClient &client, const char *response);
+    bool send(LiveViewClient &client, const uint8_t *payload, size_t length);
+public:
+    LiveView();
+    void begin();
+    bool hasClients();
+    void commit(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_t digit4, uint8_t dots);
+    void sendFrames();
+    void sendMetrics(const char *const *names, const uint32_t *values, uint8_t count);
+    const LiveViewStats &getStats();
+};
+
+extern LiveView liveView;
+
+#endif // _LIVEVIEW_h
@@ -0,0 +1,261 @@
+#include "Logger.h"
+
+#define LOG_ARGS_SIZE 128           // Arguments of one record.
+#define LOG_SPEC_CHARACTERS "-+ #0123456789.lhz"   // Flags, width, precision and length of a conversion.
+#define LOG_SPEC_LENGTH 12
+
+struct LogRecord {
+    uint32_t time;      // millis() when it was logged.
+    PGM_P format;
+    uint8_t level;
+    uint8_t module;
+    uint16_t size;      // Bytes of arguments after the record.
+};
+
+static bool isDouble(char conversion) {
+    return conversion != '\0' && strchr("eEfFgGaA", conversion) != NULL;
+}
+static bool isInteger(char conversion) {
+    return conversion != '\0' && strchr("diouxXc", conversion) != NULL;
+}
+
+Logger::Logger() {
+}
+/*                                                                          *
+ *  Queues a record with a copy of the arguments. The format is only        *
+ *  scanned for the types of its conversions, printf() isn't called.        *
+ *                                                                          */
+void Logger::write(uint8_t level, uint8_t module, PGM_P format, ...) {
+    uint32_t start = ESP.getCycleCount();
+    uint8_t args[LOG_ARGS_SIZE];
+    uint16_t size = 0;
+    bool truncated = false;
+    va_list list;
+    va_start(list, format);
+    for(PGM_P p = format; ; ) {
+        char c = pgm_read_byte(p++);
+        if(c == '\0') {
+            break;
+        }
+        if(c != '%') {
+            continue;
+        }
+        uint8_t longs = 0;
+        do {
+            c = pgm_read_byte(p++);
+            longs += c == 'l';
+        } while(c != '\0' && strchr(LOG_SPEC_CHARACTERS, c) != NULL);
+        if(c == '%') {
+            continue;
+        }
+        if(c == 's') {
+            const char *text = va_arg(list, const char *);
+            if(text == NULL) {
+                text = "(null)";
+            }
+            uint16_t length = strnlen(text, LOG_STRING_LENGTH - 1);
+            truncated = truncated || text[length] != '\0';
+            if(size + length + 1 > LOG_ARGS_SIZE) {
+                truncated = true;
+                break;
+            }
+            memcpy(args + size, text, length);
+            args[size + length] = '\0';
+            size += length + 1;
+            continue;
+        }
+        union {
+            double real;
+            unsigned long long wide;
+            unsigned long word;
+            unsigned int value;
+            void *pointer;
+        } arg;
+        uint8_t argSize;
+        if(isDouble(c)) {
+            arg.real = va_arg(list, double);
+            argSize = sizeof(double);
+        } else if(c == 'p') {
+            arg.pointer = va_arg(list, void *);
+            argSize = sizeof(void *);
+        } else if(isInteger(c) && longs >= 2) {
+            arg.wide = va_arg(list, unsigned long long);
+            argSize = sizeof(unsigned long long);
+        } else if(isInteger(c) && longs == 1) {
+            arg.word = va_arg(list, unsigned long);
+            argSize = sizeof(unsigned long);
+        } else if(isInteger(c)) {
+            arg.value = va_arg(list, unsigned int);
+            argSize = sizeof(unsigned int);
+        } else {
+            truncated = true;   // '*' or an unknown conversion, the rest of the format isn't printed.
+            break;
+        }
+        if(size + argSize > LOG_ARGS_SIZE) {
+            truncated = true;
+            break;
+        }
+        memcpy(args + size, &arg, argSize);
+        size += argSize;
+    }
+    va_end(list);
+
+    LogRecord record = {(uint32_t)millis(), format, level, module, size};
+    uint16_t total = sizeof(record) + size;
+    if(LOG_BUFFER_SIZE - used < total) {
+        stats.stalls++;
+        while(LOG_BUFFER_SIZE - used < total) {
+            if(lineLength == 0) {
+                formatNext();
+            }
+            Serial.write((const uint8_t *)line, lineLength);
+            lineLength = 0;
+        }
+    }
+    put(&record, sizeof(record));
+    put(args, size);
+    stats.records++;
+    stats.truncated += truncated;
+    stats.maxDepth = max(stats.maxDepth, used);
+    stats.lastWriteCycles = ESP.getCycleCount() - start;
+    stats.maxWriteCycles = max(stats.maxWriteCycles, stats.lastWriteCycles);
+    stats.totalWriteCycles += stats.lastWriteCycles;
+}
+void Logger::put(const void *data, uint16_t size) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint16_t first = min<uint16_t>(size, LOG_BUFFER_SIZE - head);
+    memcpy(buffer + head, bytes, first);
+    memcpy(buffer, bytes + first, size - first);
+    head = (head + size) % LOG_BUFFER_SIZE;
+    used += size;
+}
+void Logger::get(void *data, uint16_t size) {
+    uint8_t *bytes = (uint8_t *)data;
+    uint16_t tail = (head + LOG_BUFFER_SIZE - used) % LOG_BUFFER_SIZE;
+    uint16_t first = min<uint16_t>(size, LOG_BUFFER_SIZE - tail);
+    memcpy(bytes, buffer + tail, first);
+    memcpy(bytes + first, buffer, size - first);
+    used -= size;
+}
+/*                                                                          *
+ *  Takes the oldest record and formats it into the line, one conversion    *
+ *  at a time with the copied argument. Returns false if there is none.     *
+ *                                                                          */
+bool Logger::formatNext() {
+    if(used == 0) {
+        return false;
+    }
+    LogRecord record;
+    uint8_t args[LOG_ARGS_SIZE];
+    get(&record, sizeof(record));
+    get(args, record.size);
+
+    const size_t end = LOG_LINE_LENGTH - 2;     // Room for "\r\n".
+    int length = snprintf(line, end, "%lu.%03lu %c %s: ", (unsigned long)(record.time / 1000), (unsigned long)(record.time % 1000),
+        "-EWID"[record.level <= LOG_LEVEL_DEBUG ? record.level : 0], getModuleName(record.module));
+    size_t n = min((size_t)max(length, 0), end - 1);
+    uint16_t offset = 0;
+    for(PGM_P p = record.format; n < end - 1; ) {
+        char c = pgm_read_byte(p++);
+        if(c == '\0') {
+            break;
+        }
+        if(c != '%') {
+            line[n++] = c;
+            continue;
+        }
+        char spec[LOG_SPEC_LENGTH];
+        uint8_t specLength = 0, longs = 0;
+        spec[specLength++] = '%';
+        do {
+            c = pgm_read_byte(p++);
+            longs += c == 'l';
+            if(specLength < LOG_SPEC_LENGTH - 1) {
+                spec[specLength++] = c;
+            }
+        } while(c != '\0' && strchr(LOG_SPEC_CHARACTERS, c) != NULL);
+        spec[specLength] = '\0';
+        if(c == '%') {
+            line[n++] = '%';
+            continue;
+        }
+        char *out = line + n;
+        size_t room = end - n;
+        int written = -1;
+        if(c == 's' && offset < record.size) {
+            const char *text = (const char *)args + offset;
+            offset += strlen(text) + 1;
+            written = snprintf(out, room, spec, text);
+        } else if(isDouble(c) && offset + sizeof(double) <= record.size) {
+            double value;
+            memcpy(&value, args + offset, sizeof(value));
+            offset += sizeof(value);
+            written = snprintf(out, room, spec, value);
+        } else if(c == 'p' && offset + sizeof(void *) <= record.size) {
+            void *value;
+            memcpy(&value, args + offset, sizeof(value));
+            offset += sizeof(value);
+            written = snprintf(out, room, spec, value);
+        } else if(isInteger(c) && longs >= 2 && offset + sizeof(unsigned long long) <= record.size) {
+            unsigned long long value;
+            memcpy(&value, args + offset, sizeof(value));
+            offset += sizeof(value);
+            written = snprintf(out, room, spec, value);
+        } else if(isInteger(c) && longs == 1 && offset + sizeof(unsigned long) <= record.size) {
+            unsigned long value;
+            memcpy(&value, args + offset, sizeof(value));
+            offset += sizeof(value);
+            written = snprintf(out, room, spec, value);
+        } else if(isInteger(c) && longs == 0 && offset + sizeof(unsigned int) <= record.size) {
+            unsigned int value;
+            memcpy(&value, args + offset, sizeof(value));
+            offset += sizeof(value);
+            written = snprintf(out, room, spec, value);
+        }
+        if(written < 0) {
+            break;      // The arguments ran out, write() stopped here.
+        }
+        if((size_t)written >= room) {
+            stats.truncated++;
+        }
+        n += min((size_t)written, room - 1);
+    }
+    line[n++] = '\r';
+    line[n++] = '\n';
+    lineLength = n;
+    return true;
+}
+/*                                                                  *
+ *  Prints the queued records, as long as the UART can take them    *
+ *  without blocking. Called by a job with a low priority.          *
+ *                                                                  */
+void Logger::drain() {
+    while(lineLength > 0 || formatNext()) {
+        if(Serial.availableForWrite() < lineLength) {
+            return;
+        }
+        Serial.write((const uint8_t *)line, lineLength);
+        lineLength = 0;
+    }
+}
+// Prints everything that is queued and waits for it, e.g. before a restart.
+void Logger::flush() {
+    while(lineLength > 0 || formatNext()) {
+        Serial.write((const uint8_t *)line, lineLength);
+        lineLength = 0;
+    }
+    Serial.flush();
+}
+// Bytes queued.
+uint16_t Logger::getDepth() {
+    return used;
+}
+const LogStats &Logger::getStats() {
+    return stats;
+}
+const char *Logger::getModuleName(uint8_t module) {
+    static const char *const names[] = {"main", "api", "display", "net", "jobs", "config"};
+    return module < LOG_MODULES_COUNT ? names[module] : "?";
+}
+
+Logger logger = Logger();
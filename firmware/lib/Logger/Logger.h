@@ -0,0 +1,93 @@
+#ifndef _LOGGER_h   /* Include guard */
+#define _LOGGER_h
+
+#include <Arduino.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Messages above this level are not compiled in at all, e.g. build_flags = -D LOG_LEVEL=4 for a debug build.
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif // LOG_LEVEL
+// Bit mask of the modules that log, bit n is LogModule n. E.g. -D LOG_MODULES=0x02 only keeps the API.
+#ifndef LOG_MODULES
+#define LOG_MODULES 0xFFFF
+#endif // LOG_MODULES
+
+#define LOG_BUFFER_SIZE 1024        // Queued records, a record is 12 bytes plus its arguments.
+#define LOG_STRING_LENGTH 48        // %s arguments are copied when they are logged and cut to this length, with the null.
+#define LOG_LINE_LENGTH 128         // Longest printed line, the UART FIFO holds 128 bytes.
+
+enum LogModule : uint8_t {
+    LOG_MAIN = 0,       // NixieTap.cpp, setup and the config portal.
+    LOG_API,            // NixieAPI and the ProviderPolicy.
+    LOG_DISPLAY,        // The tubes, the RTC and the slots.
+    LOG_NET,            // WiFi, the push server, UDP frames, MQTT and the radio.
+    LOG_JOBS,
+    LOG_CONFIG,
+    LOG_MODULES_COUNT
+};
+
+#define LOG_ENABLED(level, module) ((level) <= LOG_LEVEL && ((LOG_MODULES >> (module)) & 1))
+// The format stays in flash, a disabled level or module compiles to nothing.
+#define LOG_AT(level, module, format, ...) do { \
+        if(LOG_ENABLED(level, module)) { \
+            logger.write(level, module, PSTR(format), ##__VA_ARGS__); \
+        } \
+    } while(0)
+#define LOG_ERROR(module, format, ...) LOG_AT(LOG_LEVEL_ERROR, module, format, ##__VA_ARGS__)
+#define LOG_WARN(module, format, ...) LOG_AT(LOG_LEVEL_WARN, module, format, ##__VA_ARGS__)
+#define LOG_INFO(module, format, ...) LOG_AT(LOG_LEVEL_INFO, module, format, ##__VA_ARGS__)
+#define LOG_DEBUG(module, format, ...) LOG_AT(LOG_LEVEL_DEBUG, module, format, ##__VA_ARGS__)
+
+struct LogStats {
+    uint32_t records;
+    uint32_t stalls;            // Records that found the buffer full and printed the oldest ones first, blocking.
+    uint32_t truncated;         // Records with more or longer arguments than fit, or lines that were cut.
+    uint16_t maxDepth;          // Most bytes that were queued at once.
+    uint32_t lastWriteCycles;   // CPU cycles write() took, the cost of a log in the caller.
+    uint32_t maxWriteCycles;
+    uint64_t totalWriteCycles;
+};
+
+/*                                                                          *
+ *  Deferred logging. write() only copies the arguments next to the flash   *
+ *  address of the format, nothing is formatted or printed in the caller.   *
+ *  The log job formats the records later and prints as many lines as the   *
+ *  UART can take without blocking.                                         *
+ *                                                                          *
+ *  record  time (ms), format (flash), level, module, size of the args      *
+ *  args    one entry per conversion of the format: 4 bytes for integers,   *
+ *          8 for doubles and %ll, %s is copied with its null               *
+ *                                                                          *
+ *  %s arguments are copied, so a temporary String is fine, but they are    *
+ *  cut to LOG_STRING_LENGTH. '*' widths are not supported. A full buffer   *
+ *  prints the oldest records right away, nothing is lost.                  *
+ *                                                                          */
+class Logger {
+    uint8_t buffer[LOG_BUFFER_SIZE];
+    uint16_t head = 0;              // Next free byte.
+    uint16_t used = 0;
+    char line[LOG_LINE_LENGTH];     // Formatted record that didn't fit into the UART yet.
+    uint8_t lineLength = 0;
+    LogStats stats = {};
+    void put(const void *data, uint16_t size);
+    void get(void *data, uint16_t size);
+    bool formatNext();
+public:
+    Logger();
+    void write(uint8_t level, uint8_t module, PGM_P format, ...) __attribute__((format(printf, 4, 5)));
+    void drain();
+    void flush();
+    uint16_t getDepth();
+    const LogStats &getStats();
+    static const char *getModuleName(uint8_t module);
+};
+
+extern Logger logger;
+
+#endif // _LOGGER_h
@@ -0,0 +1,175 @@
+#include "Metrics.h"
+
+static const char *const typeNames[] = {"counter", "gauge", "histogram"};
+
+Metrics::Metrics() {
+}
+// Registers a counter or a gauge. Returns its id, or -1 if the registry is full.
+int8_t Metrics::add(MetricType type, const char *name, const char *help, uint32_t scale, const char *labelName, const char *labelValue) {
+    if(count >= METRICS_MAX || type == METRIC_HISTOGRAM) {
+        stats.rejected++;
+        return -1;
+    }
+    metrics[count] = {name, help, labelName, labelValue, type, -1, scale, 0};
+    return count++;
+}
+// Registers a histogram with the given upper bounds, in the unit of the observations. The bounds must stay valid.
+int8_t Metrics::addHistogram(const char *name, const char *help, const uint32_t *bounds, uint8_t boundCount, uint32_t scale,
+    const char *labelName, const char *labelValue) {
+    if(count >= METRICS_MAX || histogramCount >= METRICS_HISTOGRAMS || boundCount > METRICS_BUCKETS) {
+        stats.rejected++;
+        return -1;
+    }
+    histograms[histogramCount] = {bounds, boundCount, {}, 0, 0};
+    metrics[count] = {name, help, labelName, labelValue, METRIC_HISTOGRAM, (int8_t)histogramCount++, scale, 0};
+    return count++;
+}
+void Metrics::increment(int8_t id, uint32_t n) {
+    if(id < 0 || id >= count) {
+        return;
+    }
+    uint32_t savedState = xt_rsil(15);     // Not noInterrupts(), that would turn them back on in an interrupt.
+    metrics[id].value = (int32_t)((uint32_t)metrics[id].value + n);
+    xt_wsr_ps(savedState);
+}
+// A store of 32 bits is atomic, no need to mask the interrupts.
+void Metrics::set(int8_t id, int32_t value) {
+    if(id < 0 || id >= count) {
+        return;
+    }
+    metrics[id].value = value;
+}
+void Metrics::observe(int8_t id, uint32_t value) {
+    if(id < 0 || id >= count || metrics[id].histogram < 0) {
+        return;
+    }
+    Histogram &histogram = histograms[metrics[id].histogram];
+    uint8_t bucket = 0;
+    while(bucket < histogram.boundCount && value > histogram.bounds[bucket]) {
+        bucket++;
+    }
+    uint32_t savedState = xt_rsil(15);
+    histogram.buckets[bucket]++;
+    histogram.count++;
+    histogram.sum += value;
+    xt_wsr_ps(savedState);
+}
+// Called by rewind(), before a scrape, to update the gauges that are only sampled, e.g. the free heap.
+void Metrics::onCollect(void (*collect)()) {
+    this->collect = collect;
+}
+// Starts rendering from the first metric again.
+void Metrics::rewind() {
+    cursor = 0;
+    cursorLine = 0;
+    stats.scrapes++;
+    if(collect != NULL) {
+        collect();
+    }
+}
+/*                                                                          *
+ *  Renders as many whole lines as fit into the buffer, continuing where    *
+ *  the last call stopped. Returns the bytes written, 0 once everything     *
+ *  was rendered.                                                           *
+ *                                                                          */
+size_t Metrics::render(char *buffer, size_t length) {
+    size_t used = 0;
+    while(cursor < count) {
+        char line[METRICS_LINE_LENGTH];
+        int n = formatLine(cursor, cursorLine, line, sizeof(line));
+        if(n < 0) {
+            cursor++;
+            cursorLine = 0;
+            continue;
+        }
+        n = min(n, (int)sizeof(line) - 1);
+        if(used + n > length) {
+            break;
+        }
+        memcpy(buffer + used, line, n);
+        used += n;
+        cursorLine++;
+    }
+    stats.bytes += used;
+    return used;
+}
+/*                                                                          *
+ *  Formats the given line of a metric: HELP and TYPE for the first one of  *
+ *  its name, then the value, or the buckets, the sum and the count of a    *
+ *  histogram. Returns -1 after the last line.                              *
+ *                                                                          */
+int Metrics::formatLine(uint8_t index, uint8_t line, char *out, size_t size) {
+    const Metric &metric = metrics[index];
+    if(index == 0 || strcmp(metrics[index - 1].name, metric.name) != 0) {
+        if(line == 0) {
+            return snprintf(out, size, "# HELP %s %s\n", metric.name, metric.help);
+        }
+        if(line == 1) {
+            return snprintf(out, size, "# TYPE %s %s\n", metric.name, typeNames[metric.type]);
+        }
+        line -= 2;
+    }
+    if(metric.type != METRIC_HISTOGRAM) {
+        if(line > 0) {
+            return -1;
+        }
+        int64_t value = metric.type == METRIC_COUNTER ? (int64_t)(uint32_t)metric.value : (int64_t)metric.value;
+        return formatSample(out, size, metric, "", NULL, value, metric.scale);
+    }
+    if(line == 0) {
+        uint32_t savedState = xt_rsil(15);
+        snapshot = histograms[metric.histogram];
+        xt_wsr_ps(savedState);
+    }
+    if(line <= snapshot.boundCount) {
+        uint32_t cumulative = 0;
+        for(uint8_t i = 0; i <= line; i++) {
+            cumulative += snapshot.buckets[i];
+        }
+        char le[24] = "+Inf";
+        if(line < snapshot.boundCount) {
+            formatScaled(le, sizeof(le), snapshot.bounds[line], metric.scale);
+        }
+        return formatSample(out, size, metric, "_bucket", le, cumulative, 1);
+    }
+    if(line == snapshot.boundCount + 1) {
+        return formatSample(out, size, metric, "_sum", NULL, (int64_t)snapshot.sum, metric.scale);
+    }
+    if(line == snapshot.boundCount + 2) {
+        return formatSample(out, size, metric, "_count", NULL, snapshot.count, 1);
+    }
+    return -1;
+}
+// One sample line: name, suffix, labels and the value.
+int Metrics::formatSample(char *out, size_t size, const Metric &metric, const char *suffix, const char *le, int64_t value, uint32_t scale) {
+    char number[24];
+    formatScaled(number, sizeof(number), value, scale);
+    if(metric.labelName != NULL && le != NULL) {
+        return snprintf(out, size, "%s%s{%s=\"%s\",le=\"%s\"} %s\n", metric.name, suffix, metric.labelName, metric.labelValue, le, number);
+    } else if(metric.labelName != NULL) {
+        return snprintf(out, size, "%s%s{%s=\"%s\"} %s\n", metric.name, suffix, metric.labelName, metric.labelValue, number);
+    } else if(le != NULL) {
+        return snprintf(out, size, "%s%s{le=\"%s\"} %s\n", metric.name, suffix, le, number);
+    }
+    return snprintf(out, size, "%s%s %s\n", metric.name, suffix, number);
+}
+// Divides by the scale in integers, e.g. 1500 with a scale of 1000 is "1.500".
+int Metrics::formatScaled(char *out, size_t size, int64_t value, uint32_t scale) {
+    if(scale <= 1) {
+        return snprintf(out, size, "%lld", (long long)value);
+    }
+    int digits = 0;
+    for(uint32_t s = scale; s > 1; s /= 10) {
+        digits++;
+    }
+    unsigned long long magnitude = value < 0 ? -(unsigned long long)value : (unsigned long long)value;
+    return snprintf(out, size, "%s%llu.%0*llu", value < 0 ? "-" : "", magnitude / scale, digits, magnitude % scale);
+}
+uint8_t Metrics::getCount() {
+    return count;
+}
+const MetricsStats &Metrics::getStats() {
+    return stats;
+}
+
+Metrics metrics = Metrics();
@@ -0,0 +1,89 @@
+#ifndef _METRICS_h   /* Include guard */
+#define _METRICS_h
+
+#include <Arduino.h>
+
+#define METRICS_MAX 32              // Metrics that can be registered, the storage is fixed.
+#define METRICS_HISTOGRAMS 12       // Of them histograms, each one keeps its own buckets.
+#define METRICS_BUCKETS 8           // Upper bounds of a histogram, the +Inf bucket is added.
+#define METRICS_LINE_LENGTH 160     // Longest rendered line, render() needs at least this much room.
+
+enum MetricType : uint8_t {
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+};
+
+struct MetricsStats {
+    uint32_t scrapes;
+    uint32_t bytes;             // Bytes rendered since the start.
+    uint32_t rejected;          // Registrations that didn't fit.
+};
+
+/*                                                                          *
+ *  Registry of counters, gauges and histograms, exported in the            *
+ *  Prometheus text format. The storage is fixed: add...() returns the id   *
+ *  of a metric, or -1 if the registry is full, and an update of the id -1  *
+ *  does nothing, so the libraries don't have to check for it.              *
+ *                                                                          *
+ *  The updates are in IRAM and mask the interrupts while they change the   *
+ *  values, so they can be called from an interrupt, a callback of the      *
+ *  network stack or a job. Values are integers, divided by the scale of    *
+ *  the metric when they are rendered, e.g. microseconds with a scale of    *
+ *  1000000 come out as seconds. A scale must be a power of 10.             *
+ *                                                                          *
+ *  render() continues where the last call stopped and only writes whole    *
+ *  lines, so the response is streamed in chunks, and a histogram is        *
+ *  copied when its first line is rendered, so its lines agree. Metrics     *
+ *  with the same name, and different labels, are registered one after     *
+ *  the other and share the HELP and TYPE lines.                            *
+ *                                                                          */
+class Metrics {
+    struct Metric {
+        const char *name;
+        const char *help;
+        const char *labelName;      // One label at most, NULL without.
+        const char *labelValue;
+        MetricType type;
+        int8_t histogram;           // Index of the buckets of a histogram.
+        uint32_t scale;
+        int32_t value;              // Counters wrap around as unsigned.
+    };
+    struct Histogram {
+        const uint32_t *bounds;     // In the unit of the observations, ascending.
+        uint8_t boundCount;
+        uint32_t buckets[METRICS_BUCKETS + 1];  // Observations per bucket, not cumulative, the last one is +Inf.
+        uint32_t count;
+        uint64_t sum;
+    };
+    Metric metrics[METRICS_MAX];
+    Histogram histograms[METRICS_HISTOGRAMS];
+    uint8_t count = 0;
+    uint8_t histogramCount = 0;
+    void (*collect)() = NULL;
+    uint8_t cursor = 0;             // Metric and line that render() continues with.
+    uint8_t cursorLine = 0;
+    Histogram snapshot;
+    MetricsStats stats = {};
+    int formatLine(uint8_t index, uint8_t line, char *out, size_t size);
+    int formatSample(char *out, size_t size, const Metric &metric, const char *suffix, const char *le, int64_t value, uint32_t scale);
+    static int formatScaled(char *out, size_t size, int64_t value, uint32_t scale);
+public:
+    Metrics();
+    int8_t add(MetricType type, const char *name, const char *help, uint32_t scale = 1,
+        const char *labelName = NULL, const char *labelValue = NULL);
+    int8_t addHistogram(const char *name, const char *help, const uint32_t *bounds, uint8_t boundCount, uint32_t scale = 1,
+        const char *labelName = NULL, const char *labelValue = NULL);
+    ICACHE_RAM_ATTR void increment(int8_t id, uint32_t n = 1);
+    ICACHE_RAM_ATTR void set(int8_t id, int32_t value);
+    ICACHE_RAM_ATTR void observe(int8_t id, uint32_t value);
+    void onCollect(void (*collect)());
+    void rewind();
+    size_t render(char *buffer, size_t length);
+    uint8_t getCount();
+    const MetricsStats &getStats();
+};
+
+extern Metrics metrics;
+
+#endif // _METRICS_h
@@ -0,0 +1,198 @@
+#include "MqttLink.h"
+#include <Logger.h>
+
+MqttLink::MqttLink() : client(wifiClient) {
+    client.setCallback([this](char *topic, uint8_t *payload, unsigned int length) { onMessage(topic, payload, length); });
+    client.setBufferSize(MQTT_BUFFER_SIZE);
+    client.setSocketTimeout(MQTT_SOCKET_TIMEOUT);
+    wifiClient.setTimeout(MQTT_SOCKET_TIMEOUT * 1000);
+}
+/*                                                                  *
+ *  Sets the broker and the base topic. An empty host turns MQTT    *
+ *  off. The client reconnects with the new settings. A host or a   *
+ *  topic that isn't plain text, like the 0xFF of a setting that    *
+ *  was never written, turns MQTT off as well.                      *
+ *                                                                  */
+void MqttLink::configure(const char *host, uint16_t port, const char *baseTopic) {
+    if(client.connected()) {
+        client.disconnect();
+    }
+    strncpy(this->host, host, MQTT_HOST_LENGTH - 1);
+    this->host[MQTT_HOST_LENGTH - 1] = '\0';
+    strncpy(this->baseTopic, baseTopic, MQTT_TOPIC_LENGTH - 1);
+    this->baseTopic[MQTT_TOPIC_LENGTH - 1] = '\0';
+    if(!isValidHost(this->host) || !isValidTopic(this->baseTopic)) {
+        LOG_WARN(LOG_NET, "MqttLink: Invalid broker or topic, MQTT is off.");
+        this->host[0] = '\0';
+        this->baseTopic[0] = '\0';
+    }
+    this->port = port != 0 ? port : MQTT_DEFAULT_PORT;
+    client.setServer(this->host, this->port);
+    failures = 0;
+}
+// Letters, digits, '.', '-' and '_', a host name or an IPv4 address.
+bool MqttLink::isValidHost(const char *host) {
+    for(const char *c = host; *c != '\0'; c++) {
+        if(!isalnum((uint8_t)*c) && *c != '.' && *c != '-' && *c != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+// Printable ASCII without spaces and without the wildcards '+' and '#'.
+bool MqttLink::isValidTopic(const char *topic) {
+    for(const char *c = topic; *c != '\0'; c++) {
+        if((uint8_t)*c <= ' ' || (uint8_t)*c > '~' || *c == '+' || *c == '#') {
+            return false;
+        }
+    }
+    return true;
+}
+/*                                                                  *
+ *  Sets the handler of <base>/config/<name>, NULL doesn't          *
+ *  subscribe to these topics at all. It takes effect on the next   *
+ *  connect, configure() reconnects.                                *
+ *                                                                  */
+void MqttLink::onConfig(MqttConfigHandler handler) {
+    configHandler = handler;
+}
+bool MqttLink::isConfigured() {
+    return host[0] != '\0' && baseTopic[0] != '\0';
+}
+bool MqttLink::connected() {
+    return client.connected();
+}
+/*                                                                          *
+ *  Connects to the broker and subscribes to the topics of NixieTap.        *
+ *  Returns true if the client is connected. It blocks for at most          *
+ *  MQTT_SOCKET_TIMEOUT, so it should be called from a heavy job.           *
+ *                                                                          */
+bool MqttLink::connect() {
+    if(client.connected()) {
+        return true;
+    }
+    if(!isConfigured()) {
+        return false;
+    }
+    char clientId[20];
+    char statusTopic[MQTT_TOPIC_LENGTH + 8];
+    snprintf(clientId, sizeof(clientId), "NixieTap-%06x", ESP.getChipId());
+    snprintf(statusTopic, sizeof(statusTopic), "%s/status", baseTopic);
+    if(!client.connect(clientId, statusTopic, 0, true, "offline")) {
+        if(failures < 255) {
+            failures++;
+        }
+        stats.connectFailures++;
+        LOG_WARN(LOG_NET, "MqttLink: Unable to connect to %s:%u, state %d.", host, port, client.state());
+        return false;
+    }
+    failures = 0;
+    stats.connects++;
+    subscribe("value");
+    subscribe("slot");
+    if(configHandler != NULL) {
+        subscribe("config/+");
+    }
+    publish("status", "online", true);
+    LOG_INFO(LOG_NET, "MqttLink: Connected to %s:%u.", host, port);
+    return true;
+}
+bool MqttLink::subscribe(const char *subtopic) {
+    char topic[MQTT_TOPIC_LENGTH + 10];
+    snprintf(topic, sizeof(topic), "%s/%s", baseTopic, subtopic);
+    return client.subscribe(topic, 0);
+}
+/*                                                                          *
+ *  Returns the time until the next connection attempt should be made.      *
+ *  After a failed attempt it grows exponentially, with a random jitter     *
+ *  so that many displays don't reconnect to a restarted broker at once.    *
+ *                                                                          */
+uint32_t MqttLink::getRetryDelay() {
+    if(client.connected() || failures == 0) {
+        return MQTT_CHECK_INTERVAL;
+    }
+    uint32_t delayMs = MQTT_BACKOFF_MAX_MS;
+    if(failures <= 16 && (MQTT_BACKOFF_BASE_MS << (failures - 1)) < MQTT_BACKOFF_MAX_MS) {
+        delayMs = MQTT_BACKOFF_BASE_MS << (failures - 1);
+    }
+    return delayMs - delayMs / 4 + random(delayMs / 2 + 1);
+}
+/*                                                              *
+ *  Receives the waiting messages and keeps the connection      *
+ *  alive. It does not block, it should be called from loop().  *
+ *                                                              */
+void MqttLink::loop() {
+    if(client.connected()) {
+        client.loop();
+    }
+}
+bool MqttLink::publish(const char *subtopic, const char *payload, bool retained) {
+    char topic[MQTT_TOPIC_LENGTH + 10];
+    snprintf(topic, sizeof(topic), "%s/%s", baseTopic, subtopic);
+    if(!client.connected() || !client.publish(topic, payload, retained)) {
+        return false;
+    }
+    stats.published++;
+    return true;
+}
+/*                                                                          *
+ *  Handles a message that has arrived on one of the subscribed topics.     *
+ *  The topic and the payload point into the buffer of the client, they     *
+ *  are only compared in place and only the accepted values are copied.     *
+ *                                                                          */
+void MqttLink::onMessage(char *topic, uint8_t *payload, unsigned int length) {
+    stats.messages++;
+    size_t baseLength = strlen(baseTopic);
+    if(strncmp(topic, baseTopic, baseLength) != 0 || topic[baseLength] != '/') {
+        stats.rejected++;
+        return;
+    }
+    const char *name = topic + baseLength + 1;
+    const char *text = (const char *)payload;
+    if(strcmp(name, "value") == 0) {
+        if(length == 0 || length > MQTT_VALUE_LENGTH || !Nixie::isNumber(text, length)) {
+            stats.rejected++;
+            return;
+        }
+        memcpy(value, text, length);
+        value[length] = '\0';
+        valueUpdated = true;
+    } else if(strcmp(name, "slot") == 0) {
+        if(length == 0 || length > 2 || !isdigit(text[0]) || (length == 2 && !isdigit(text[1]))) {
+            stats.rejected++;
+            return;
+        }
+        requestedSlot = length == 2 ? (text[0] - '0') * 10 + text[1] - '0' : text[0] - '0';
+    } else if(strncmp(name, "config/", 7) == 0 && configHandler != NULL && length <= MQTT_CONFIG_LENGTH) {
+        char config[MQTT_CONFIG_LENGTH + 1];
+        memcpy(config, text, length);
+        config[length] = '\0';
+        configHandler(name + 7, config);
+    } else {
+        stats.rejected++;
+    }
+}
+bool MqttLink::hasValue() {
+    return value[0] != '\0';
+}
+const char *MqttLink::getValue() {
+    return value;
+}
+/*                                                      *
+ *  Returns true once for every newly received value.   *
+ *                                                      */
+bool MqttLink::takeValue() {
+    bool updated = valueUpdated;
+    valueUpdated = false;
+    return updated;
+}
+int8_t MqttLink::takeSlot() {
+    int8_t slot = requestedSlot;
+    requestedSlot = -1;
+    return slot;
+}
+const MqttStats &MqttLink::getStats() {
+    return stats;
+}
+
+MqttLink mqttLink;    // Not copy initialized, the callback of the client keeps the address of the instance.
@@ -0,0 +1,81 @@
+#ifndef _MQTTLINK_h   /* Include guard */
+#define _MQTTLINK_h
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>
+#include <nixie.h>
+
+#define MQTT_DEFAULT_PORT 1883
+#define MQTT_HOST_LENGTH 40         // Sizes of the buffers, including the terminating null.
+#define MQTT_TOPIC_LENGTH 38
+#define MQTT_VALUE_LENGTH 15        // Longest value that can be shown, without the terminating null.
+#define MQTT_CONFIG_LENGTH 49       // Longest value of a config message, without the terminating null.
+#define MQTT_BUFFER_SIZE 256        // Largest MQTT packet that can be sent or received.
+#define MQTT_SOCKET_TIMEOUT 2       // The broker should answer within this many seconds.
+#define MQTT_CHECK_INTERVAL 5000    // Interval of the connection check while connected (ms).
+#define MQTT_BACKOFF_BASE_MS 2000UL     // Reconnect delay after the first failed attempt.
+#define MQTT_BACKOFF_MAX_MS 300000UL    // Reconnect delay is never longer than 5 minutes.
+
+// Called with the part of the topic after "<base>/config/" and the payload of the message.
+typedef void (*MqttConfigHandler)(const char *name, const char *value);
+
+struct MqttStats {
+    uint32_t connects;
+    uint32_t connectFailures;
+    uint32_t messages;
+    uint32_t rejected;      // Messages with an unknown topic or an invalid payload.
+    uint32_t published;
+};
+
+/*                                                                          *
+ *  MQTT 3.1.1 client, all of the topics are below one base topic:          *
+ *                                                                          *
+ *  <base>/value        subscribed, a number to show in the MQTT slot       *
+ *  <base>/slot         subscribed, index of the slot to show               *
+ *  <base>/config/<n>   subscribed only with a handler, see onConfig(),     *
+ *                      sets the parameter <n>                              *
+ *  <base>/status       published, retained "online", or "offline" as the   *
+ *                      last will when the connection is lost               *
+ *  <base>/health       published, JSON with the health of the device       *
+ *                                                                          *
+ *  Everything is subscribed with QoS 0, messages are parsed straight from  *
+ *  the receive buffer of the client. loop() must be called on every pass,  *
+ *  connect() from a background job, rescheduled with getRetryDelay().      *
+ *                                                                          */
+class MqttLink {
+    WiFiClient wifiClient;
+    PubSubClient client;
+    char host[MQTT_HOST_LENGTH] = "";
+    uint16_t port = MQTT_DEFAULT_PORT;
+    char baseTopic[MQTT_TOPIC_LENGTH] = "";
+    char value[MQTT_VALUE_LENGTH + 1] = "";
+    bool valueUpdated = false;
+    int8_t requestedSlot = -1;
+    uint8_t failures = 0;       // Consecutive failed connection attempts.
+    MqttConfigHandler configHandler = NULL;
+    MqttStats stats = {};
+    void onMessage(char *topic, uint8_t *payload, unsigned int length);
+    bool subscribe(const char *subtopic);
+    static bool isValidHost(const char *host);
+    static bool isValidTopic(const char *topic);
+public:
+    MqttLink();
+    void configure(const char *host, uint16_t port, const char *baseTopic);
+    void onConfig(MqttConfigHandler handler);
+    bool isConfigured();
+    bool connected();
+    bool connect();
+    uint32_t getRetryDelay();
+    void loop();
+    bool publish(const char *subtopic, const char *payload, bool retained);
+    bool hasValue();
+    const char *getValue();
+    bool takeValue();
+    int8_t takeSlot();
+    const MqttStats &getStats();
+};
+
+extern MqttLink mqttLink;
+
+#endif // _MQTTLINK_h
@@ -1,45 +1,34 @@
 #include "NixieAPI.h"
 #include <WiFiClientSecure.h>
+#include <Logger.h>
+#include <Metrics.h>
 
 NixieAPI::NixieAPI() {
 }
 void NixieAPI::applyKey(String key, uint8_t selectAPI) {
-    #ifdef DEBUG
-        Serial.println("---------------------------------------------------------------------------------------------");
-    #endif // DEBUG
     switch(selectAPI) {
         case 0 : 
                 timezonedbKey = key;
-                #ifdef DEBUG
-                    Serial.println("applyKey successful, timezonedb key is: " + timezonedbKey);
-                #endif // DEBUG
+                LOG_DEBUG(LOG_API, "timezonedb key applied.");
                 break;
         case 1 : 
                 ipStackKey = key;
-                #ifdef DEBUG
-                    Serial.println("applyKey successful, ipstack key is:  " + ipStackKey);
-                #endif // DEBUG
+                LOG_DEBUG(LOG_API, "ipstack key applied.");
                 break;
         case 2 : 
                 googleLocKey = key;
-                #ifdef DEBUG
-                    Serial.println("applyKey successful, Google location key is:  " + googleLocKey);
-                #endif // DEBUG
+                LOG_DEBUG(LOG_API, "Google location key applied.");
                 break;
         case 3 : 
                 googleTimeZoneKey = key;
-                #ifdef DEBUG
-                    Serial.println("applyKey successful, Google timezone key is:  " + googleTimeZoneKey);
-                #endif // DEBUG
+                LOG_DEBUG(LOG_API, "Google timezone key applied.");
                 break;
         case 4 : 
                 openWeaterMapKey = key;
-                #ifdef DEBUG
-                    Serial.println("applyKey successful, OpenWeaterMap key is:  " + openWeaterMapKey);
-                #endif // DEBUG
+                LOG_DEBUG(LOG_API, "OpenWeatherMap key applied.");
                 break;
         default: 
-                Serial.println("Unknown value of selectAPI!");
+                LOG_ERROR(LOG_API, "Unknown value of selectAPI!");
                 break;
     }
 }
@@ -55,10 +44,7 @@ String NixieAPI::MACtoString(uint8_t* macAddress) {
 String NixieAPI::getSurroundingWiFiJson() {
     String wifiArray = "[\n";
     int8_t numWifi = WiFi.scanNetworks();
-    #ifdef DEBUG
-        Serial.println("---------------------------------------------------------------------------------------------");
-        Serial.println(String(numWifi) + " WiFi networks found.");
-    #endif // DEBUG
+    LOG_DEBUG(LOG_API, "%d WiFi networks found.", numWifi);
     for(uint8_t i = 0; i < numWifi; i++) {
         // Serial.print("WiFi.BSSID(i) = ");
         // Serial.println((char *)WiFi.BSSID(i));
@@ -71,118 +57,149 @@ String NixieAPI::getSurroundingWiFiJson() {
     }
     WiFi.scanDelete();
     wifiArray += "]";
-    #ifdef DEBUG
-        Serial.println("WiFi list :\n" + wifiArray);
-    #endif // DEBUG
     return wifiArray;
 }
-/*                                                        *
- *  Calls the ipify API to get a public IP address.       *
- *  If that fails, it tries the same with the seeip API.  * 
- *  https://www.ipify.org/   https://seeip.org/           *
- *                                                        */
-String NixieAPI::getPublicIP() {
-    // If the IP does not exist or more than an hour has passed since the last request, ip will be re-requested from the API service.
-    if(ip == "" || ip == "0" || ((millis() - prevObtainedIpTime) >= 3600000)) {
-        prevObtainedIpTime = millis();
-        WiFiClient client;
-        String headers = "", body = "";
-        bool finishedHeaders = false, currentLineIsBlank = false, gotResponse = false, bodyStarts = false, bodyEnds = false;
-        long timeout;
-        #ifdef DEBUG
-            Serial.println("---------------------------------------------------------------------------------------------");
-        #endif // DEBUG
-        if(client.connect("api.ipify.org", 80)) {
-            #ifdef DEBUG
-                Serial.println("Connected to ipify.org!");
-            #endif // DEBUG
-            client.print("GET /?format=json HTTP/1.1\r\nHost: api.ipify.org\r\n\r\n");
-            timeout = millis() + MAX_CONNECTION_TIMEOUT;
-            // checking the timeout
-            while(client.available() == 0) {
-                if(timeout - millis() < 0) {
-                    #ifdef DEBUG
-                        Serial.println("Client Timeout!");
-                    #endif // DEBUG
-                    client.stop();
-                    break;
-                }
+static void onHedgeConnect(void *arg, AsyncClient *client) {
+    HedgeRequest *request = (HedgeRequest *)arg;
+    request->connected = true;
+    client->write(request->request.c_str(), request->request.length());
+}
+static void onHedgeData(void *arg, AsyncClient *client, void *data, size_t len) {
+    HedgeRequest *request = (HedgeRequest *)arg;
+    for(size_t i = 0; i < len && request->response.length() < HEDGE_MAX_RESPONSE; i++) {
+        request->response += ((const char *)data)[i];
+    }
+}
+static void onHedgeDisconnect(void *arg, AsyncClient *client) {
+    ((HedgeRequest *)arg)->closed = true;
+}
+static void onHedgeError(void *arg, AsyncClient *client, int8_t error) {
+    ((HedgeRequest *)arg)->error = true;
+}
+/*                                                                          *
+ *  Sends a GET request to the primary service. If it has not answered      *
+ *  within its median latency, the same request is also sent to the         *
+ *  backup service, so both connections are open at the same time.          *
+ *  The first complete answer with HTTP status 200 wins and the other       *
+ *  request is canceled. Returns the index of the service that answered     *
+ *  (its body is stored in the body argument), or -1 if both failed.        *
+ *                                                                          *
+ *  The requests are AsyncClients, their DNS lookup and connect don't       *
+ *  block, so the backup is sent on time even if the primary is still       *
+ *  connecting. The callbacks only fill in the HedgeRequest, this loop      *
+ *  decides, and yields to the network stack in between. The clients are    *
+ *  members, a DNS answer that arrives after a request was given up must    *
+ *  not find a freed client.                                                *
+ *                                                                          */
+int8_t NixieAPI::hedgedGet(const HedgeTarget *targets, String &body) {
+    bool started[2] = {false, false}, failed[2] = {false, false};
+    unsigned long startedAt[2] = {0, 0};
+    int8_t winner = -1;
+    unsigned long hedgeDelay = providerPolicy.getLatencyP50(targets[0].provider);
+    if(hedgeDelay < HEDGE_MIN_DELAY) {
+        hedgeDelay = HEDGE_MIN_DELAY;
+    } else if(hedgeDelay > MAX_CONNECTION_TIMEOUT) {
+        hedgeDelay = MAX_CONNECTION_TIMEOUT;
+    }
+    unsigned long begin = millis();
+    while(winner < 0 && !(failed[0] && failed[1])) {
+        for(uint8_t i = 0; i < 2; i++) {
+            // The primary request is sent at once, the backup after the hedge delay or as soon as the primary has failed.
+            if(started[i] || failed[i] || (i == 1 && !failed[0] && millis() - begin < hedgeDelay)) {
+                continue;
             }
-            if(client.available()) {
-                //marking we got a response
-                gotResponse = true;
+            if(!providerPolicy.allow(targets[i].provider)) {
+                failed[i] = true;
+                continue;
             }
-        } 
-        if(!gotResponse && client.connect("ip.seeip.org", 80)) {
-            #ifdef DEBUG
-                Serial.println("Failed to fetch public IP address from ipify.org! Now trying with seeip.org.");
-                Serial.println("Connected to seeip.org!");
-            #endif // DEBUG
-            client.print("GET /json HTTP/1.1\r\nHost: ip.seeip.org\r\n\r\n");
-            timeout = millis() + MAX_CONNECTION_TIMEOUT;
-            // checking the timeout
-            while(client.available() == 0) {
-                if(timeout - millis() < 0) {
-                    #ifdef DEBUG
-                        Serial.println("Client Timeout!");
-                    #endif // DEBUG
-                    client.stop();
-                    return "0";
-                }
+            HedgeRequest &request = hedgeRequests[i];
+            request.request = "GET " + targets[i].path + " HTTP/1.0\r\nHost: " + String(targets[i].host) + "\r\nUser-Agent: " + UserAgent + "\r\nConnection: close\r\n\r\n";
+            request.response = "";
+            request.connected = request.closed = request.error = false;
+            request.client.onConnect(onHedgeConnect, &request);
+            request.client.onData(onHedgeData, &request);
+            request.client.onDisconnect(onHedgeDisconnect, &request);
+            request.client.onError(onHedgeError, &request);
+            started[i] = true;
+            startedAt[i] = millis();
+            if(!request.client.connect(targets[i].host, 80)) {
+                failed[i] = true;
+                providerPolicy.reportFailure(targets[i].provider);
             }
-            if(client.available()) {
-                //marking we got a response
-                gotResponse = true;
+        }
+        for(uint8_t i = 0; i < 2 && winner < 0; i++) {
+            if(!started[i] || failed[i]) {
+                continue;
             }
-        } 
-        if(gotResponse) {
-            while(client.available()) {
-                char c = client.read();
-                if(finishedHeaders) {   // Separate json file from rest of the received response.
-                    if(c == '{') {      // If this additional filtering is not performed. seeip.org json response will not be accepted by ArduinoJson lib.
-                        bodyStarts = true;
-                    }
-                    if(bodyStarts && !bodyEnds) {
-                        body = body + c;
-                    }
-                    if(c == '}') {
-                        bodyEnds = true;
-                    }
+            HedgeRequest &request = hedgeRequests[i];
+            if(request.error) {
+                LOG_WARN(LOG_API, "hedgedGet: %s failed to connect!", targets[i].host);
+                failed[i] = true;
+                providerPolicy.reportFailure(targets[i].provider);
+            } else if(request.closed) {     // The server closed the connection, the whole response is here.
+                int bodyStart = request.response.indexOf("\r\n\r\n");
+                if(request.response.startsWith("HTTP/1.") && request.response.substring(9, 12) == "200" && bodyStart != -1) {
+                    body = request.response.substring(bodyStart + 4);
+                    winner = i;
                 } else {
-                    if(currentLineIsBlank && c == '\n') {
-                        finishedHeaders = true;
-                    }
-                    else {
-                        headers = headers + c;
-                    }
-                }
-                if(c == '\n') {
-                    currentLineIsBlank = true;
-                } else if(c != '\r') {
-                    currentLineIsBlank = false;
+                    failed[i] = true;
+                    providerPolicy.reportFailure(targets[i].provider);
                 }
+            } else if(millis() - startedAt[i] >= MAX_CONNECTION_TIMEOUT) {
+                LOG_WARN(LOG_API, "hedgedGet: %s timed out%s!", targets[i].host, request.connected ? "" : " while connecting");
+                failed[i] = true;
+                request.client.close(true);
+                providerPolicy.reportFailure(targets[i].provider);
             }
+        }
+        yield();
+    }
+    for(uint8_t i = 0; i < 2; i++) {
+        if(started[i] && i != winner && !hedgeRequests[i].closed) {
+            hedgeRequests[i].client.close(true);    // Cancel the slower request.
+        }
+        hedgeRequests[i].request = "";
+        hedgeRequests[i].response = "";
+    }
+    if(winner >= 0) {
+        LOG_DEBUG(LOG_API, "hedgedGet: %s answered first after %lu ms.", targets[winner].host, millis() - begin);
+    }
+    return winner;
+}
+/*                                                        *
+ *  Calls the ipify API to get a public IP address.       *
+ *  If it does not answer in time, the same request is    *
+ *  also sent to the seeip API, whichever answers first   *
+ *  is used. https://www.ipify.org/   https://seeip.org/  *
+ *                                                        */
+String NixieAPI::getPublicIP() {
+    // If the IP does not exist or more than an hour has passed since the last request, ip will be re-requested from the API service.
+    if(ip == "" || ip == "0" || ((millis() - prevObtainedIpTime) >= 3600000)) {
+        prevObtainedIpTime = millis();
+        String body = "";
+        const HedgeTarget targets[2] = {
+            {PROVIDER_IPIFY, "api.ipify.org", "/?format=json"},
+            {PROVIDER_SEEIP, "ip.seeip.org", "/json"}
+        };
+        int8_t winner = hedgedGet(targets, body);
+        if(winner >= 0) {
+            // Only the json part of the body is kept, otherwise seeip.org response will not be accepted by ArduinoJson lib.
+            body = body.substring(body.indexOf('{'), body.lastIndexOf('}') + 1);
             DynamicJsonDocument doc(1024);
             DeserializationError error = deserializeJson(doc, body);
-            if(!error) {
+            if(!error && !doc["ip"].isNull()) {
+                providerPolicy.reportSuccess(targets[winner].provider);
                 ip = doc["ip"].as<String>();
-                #ifdef DEBUG
-                    Serial.println("Your Public IP location is: " + ip);
-                #endif // DEBUG
+                LOG_INFO(LOG_API, "Your public IP address is %s.", ip.c_str());
                 return ip;
             } else {
-                #ifdef DEBUG
-                    Serial.print("Failed to deserialize JSON, error code: ");
-                    Serial.println(error.c_str());
-                #endif // DEBUG
-                return "0";
+                LOG_WARN(LOG_API, "getPublicIP: Failed to deserialize JSON, error code: %s", error.c_str());
+                providerPolicy.reportFailure(targets[winner].provider);
+                return ip != "" ? ip : "0";
             }
         } else {
-            #ifdef DEBUG
-                Serial.println("Failed to fetch public IP address from ipify.org!");
-                Serial.println("Failed to obtain a public IP address from any API!");
-            #endif // DEBUG
-            return "0";
+            LOG_WARN(LOG_API, "Failed to obtain a public IP address from any API!");
+            return ip != "" ? ip : "0";   // The last known IP is still better than nothing.
         }
     }
     return ip;
@@ -196,6 +213,9 @@ String NixieAPI::getPublicIP() {
  *  https://ipstack.com/                              *
  *                                                    */
 String NixieAPI::getLocFromIpstack(String publicIP) {
+    if(!providerPolicy.allow(PROVIDER_IPSTACK)) {
+        return lastLocation();
+    }
     WiFiClient client;
     HTTPClient http;
     String payload = "";
@@ -204,54 +224,31 @@ String NixieAPI::getLocFromIpstack(String publicIP) {
     }
     String URL = "http://api.ipstack.com/" + publicIP + "?access_key=" + ipStackKey + "&output=json&fields=country_name,region_name,city,latitude,longitude";
     http.setUserAgent(UserAgent);
-    #ifdef DEBUG
-        Serial.println("---------------------------------------------------------------------------------------------");
-    #endif // DEBUG
     if(!http.begin(client, URL)) {
-        #ifdef DEBUG
-            Serial.println(F("getLocFromIpstack: Connection failed!"));
-        #endif // DEBUG
-        return "0";
+        LOG_WARN(LOG_API, "getLocFromIpstack: Connection failed!");
+        providerPolicy.reportFailure(PROVIDER_IPSTACK);
+        return lastLocation();
     } else {
-        #ifdef DEBUG
-            Serial.println("Connected to api.ipstack.com!");
-        #endif // DEBUG
+        LOG_DEBUG(LOG_API, "Connected to api.ipstack.com.");
         int stat = http.GET();
         if(stat > 0) {
             if(stat == HTTP_CODE_OK) {
                 payload = http.getString();
-                DynamicJsonDocument doc(1024);
-                DeserializationError error = deserializeJson(doc, payload);
-                if(!error) {
-                    String country = doc["country_name"];
-                    String region = doc["region_name"];
-                    String city = doc["city"];
-                    String lat = doc["latitude"];
-                    String lng = doc["longitude"];
-                    location = lat + "," + lng;
-                    #ifdef DEBUG
-                        Serial.print("Your IP location is: " + country + ", " + region + ", " + city + ". ");
-                        Serial.println("With coordinates: latitude: " + lat + ", " + "longitude: " + lng);
-                    #endif // DEBUG
+                if(parseIpLocation(PROVIDER_IPSTACK, payload)) {
+                    providerPolicy.reportSuccess(PROVIDER_IPSTACK);
                 } else {
-                    #ifdef DEBUG
-                        Serial.println(F("getLocFromIpstack: JSON deserialization failed, error code: "));
-                        Serial.println(error.c_str());
-                        Serial.println(payload);
-                    #endif // DEBUG
-                    return "0";
+                    providerPolicy.reportFailure(PROVIDER_IPSTACK);
+                    return lastLocation();
                 }
             } else {
-                #ifdef DEBUG
-                    Serial.printf("getLocFromIpstack: [HTTP] GET reply %d\r\n", stat);
-                #endif // DEBUG
-                return "0";
+                LOG_WARN(LOG_API, "getLocFromIpstack: [HTTP] GET reply %d", stat);
+                providerPolicy.reportFailure(PROVIDER_IPSTACK);
+                return lastLocation();
             }
         } else {
-            #ifdef DEBUG
-                Serial.printf("getLocFromIpstack: [HTTP] GET failed: %s\r\n", http.errorToString(stat).c_str());
-            #endif // DEBUG
-            return "0";
+            LOG_WARN(LOG_API, "getLocFromIpstack: [HTTP] GET failed: %s", http.errorToString(stat).c_str());
+            providerPolicy.reportFailure(PROVIDER_IPSTACK);
+            return lastLocation();
         }
     }
     http.end();
@@ -265,29 +262,24 @@ String NixieAPI::getLocFromIpstack(String publicIP) {
  *  https://developers.google.com/maps/documentation/geolocation/intro *
  *                                                                     */
 String NixieAPI::getLocFromGoogle() {
-    WiFiClientSecure client;
+    if(!providerPolicy.allow(PROVIDER_GOOGLE_LOCATION)) {
+        return lastLocation();
+    }
+    TimedTlsClient client;
     String lat = "", lng = "", accuracy = "";
     String headers = "", hull = "", response = "";
     bool finishedHeaders = false, currentLineIsBlank = false, gotResponse = false;
     const char* googleLocApiHost = "www.googleapis.com";
     const char* googleLocApiUrl = "/geolocation/v1/geolocate";
-    #ifdef DEBUG
-        Serial.println("---------------------------------------------------------------------------------------------");
-    #endif // DEBUG
     if(client.connect(googleLocApiHost, 443)) {
-        #ifdef DEBUG
-            Serial.println("Connected to Google Location API endpoint!");
-        #endif // DEBUG
+        LOG_DEBUG(LOG_API, "Connected to the Google Location API.");
     } else {
-        #ifdef DEBUG
-            Serial.println("getLocFromGoogle: HTTPS error!");
-        #endif // DEBUG
-        return "0";
+        LOG_WARN(LOG_API, "getLocFromGoogle: HTTPS error!");
+        providerPolicy.reportFailure(PROVIDER_GOOGLE_LOCATION);
+        return lastLocation();
     }
     String body = "{\"wifiAccessPoints\":" + getSurroundingWiFiJson() + "}";
-    #ifdef DEBUG
-        Serial.println("requesting URL: " + String(googleLocApiUrl) + "?key=" + googleLocKey);
-    #endif // DEBUG
+    LOG_DEBUG(LOG_API, "getLocFromGoogle: Requesting %s", googleLocApiUrl);
     String request = String("POST ") + String(googleLocApiUrl);
     if(googleLocKey != "") 
         request += "?key=" + googleLocKey;
@@ -298,21 +290,15 @@ String NixieAPI::getLocFromGoogle() {
     request += "Content-Length:" + String(body.length()) + "\r\n";
     request += "Connection: close\r\n\r\n";
     request += body;
-    #ifdef DEBUG
-        Serial.println("Request: \n" + request);
-    #endif // DEBUG
+    LOG_DEBUG(LOG_API, "getLocFromGoogle: %u bytes of WiFi networks.", body.length());
     client.println(request);
-    #ifdef DEBUG
-        Serial.println("getLocFromGoogle: Request sent!");
-    #endif // DEBUG
+    LOG_DEBUG(LOG_API, "getLocFromGoogle: Request sent.");
     // Wait for response
     long timeout = millis() + MAX_CONNECTION_TIMEOUT;
     // checking the timeout
     while(client.available() == 0) {
         if(timeout - millis() < 0) {
-            #ifdef DEBUG
-                Serial.println("getLocFromGoogle: Client Timeout!");
-            #endif // DEBUG
+            LOG_WARN(LOG_API, "getLocFromGoogle: Client timeout!");
             client.stop();
             break;
         }
@@ -344,16 +330,16 @@ String NixieAPI::getLocFromGoogle() {
             lat = doc["location"]["lat"].as<String>(); 
             lng = doc["location"]["lng"].as<String>();
             location = lat + "," + lng;
-            #ifdef DEBUG
-                Serial.println("Your location is: " + location + " \nThe accuracy of the estimated location is: " + accuracy + "m");
-            #endif // DEBUG
+            providerPolicy.reportSuccess(PROVIDER_GOOGLE_LOCATION);
+            LOG_INFO(LOG_API, "Your location is %s, accurate to %s m.", location.c_str(), accuracy.c_str());
         } else {
-            #ifdef DEBUG
-                Serial.println("getLocFromGoogle: Failed to deserialize JSON, error code: ");
-                Serial.println(error.c_str());
-            #endif // DEBUG
-            return "0";
+            LOG_WARN(LOG_API, "getLocFromGoogle: Failed to deserialize JSON, error code: %s", error.c_str());
+            providerPolicy.reportFailure(PROVIDER_GOOGLE_LOCATION);
+            return lastLocation();
         }
+    } else {
+        providerPolicy.reportFailure(PROVIDER_GOOGLE_LOCATION);
+        return lastLocation();
     }
     return location;
 }
@@ -364,84 +350,147 @@ String NixieAPI::getLocFromGoogle() {
  *  http://ip-api.com/                                 *
  *                                                     */
 String NixieAPI::getLocFromIpapi(String publicIP) {
+    if(!providerPolicy.allow(PROVIDER_IPAPI)) {
+        return lastLocation();
+    }
     WiFiClient client;
     HTTPClient http;
     String payload = "";
     String URL = "http://ip-api.com/json/" + publicIP;
     http.setUserAgent(UserAgent);
-    #ifdef DEBUG
-        Serial.println("---------------------------------------------------------------------------------------------");
-    #endif // DEBUG
     if(!http.begin(client, URL)) {
-        #ifdef DEBUG
-            Serial.println(F("getLocFromIpapi: Connection failed!"));
-        #endif // DEBUG
-        return "0";
+        LOG_WARN(LOG_API, "getLocFromIpapi: Connection failed!");
+        providerPolicy.reportFailure(PROVIDER_IPAPI);
+        return lastLocation();
     } else {
-        #ifdef DEBUG
-            Serial.println("Connected to ip-api.com!");
-        #endif // DEBUG
+        LOG_DEBUG(LOG_API, "Connected to ip-api.com.");
         int stat = http.GET();
         if(stat > 0) {
             if(stat == HTTP_CODE_OK) {
                 payload = http.getString();
-                DynamicJsonDocument doc(1024);
-                DeserializationError error = deserializeJson(doc, payload);
-                if(!error) {
-                    String country = doc["country"];
-                    String region = doc["region"];
-                    String city = doc["city"];
-                    String lat = doc["lat"];
-                    String lng = doc["lon"];
-                    location = lat + "," + lng;
-                    #ifdef DEBUG
-                        Serial.print("Your IP location is: " + country + ", " + region + ", " + city + ". ");
-                        Serial.println("With coordinates: latitude: " + lat + ", " + "longitude: " + lng);
-                    #endif // DEBUG
+                if(parseIpLocation(PROVIDER_IPAPI, payload)) {
+                    providerPolicy.reportSuccess(PROVIDER_IPAPI);
                 } else {
-                    #ifdef DEBUG
-                        Serial.println(F("getLocFromIpapi: JSON deserialization failed, error code: "));
-                        Serial.println(error.c_str());
-                        Serial.println(payload);
-                    #endif // DEBUG 
-                    return "0";
+                    providerPolicy.reportFailure(PROVIDER_IPAPI);
+                    return lastLocation();
                 }
             } else {
-                #ifdef DEBUG
-                    Serial.printf("getLocFromIpapi: [HTTP] GET reply %d\r\n", stat);
-                #endif // DEBUG
-                return "0";
+                LOG_WARN(LOG_API, "getLocFromIpapi: [HTTP] GET reply %d", stat);
+                providerPolicy.reportFailure(PROVIDER_IPAPI);
+                return lastLocation();
             }
         } else {
-            #ifdef DEBUG
-                Serial.printf("getLocFromIpapi: [HTTP] GET failed: %s\r\n", http.errorToString(stat).c_str());
-            #endif // DEBUG
-            return "0";
+            LOG_WARN(LOG_API, "getLocFromIpapi: [HTTP] GET failed: %s", http.errorToString(stat).c_str());
+            providerPolicy.reportFailure(PROVIDER_IPAPI);
+            return lastLocation();
         }
     }
     http.end();
 
     return location;
 }
+/*                                                                      *
+ *  Reads the coordinates from the answer of ipstack or ip-api.         *
+ *  Both services answer with a similar JSON, only the names of the     *
+ *  fields differ. Returns true if the location has been updated.       *
+ *                                                                      */
+bool NixieAPI::parseIpLocation(ApiProvider provider, const String &payload) {
+    bool isIpstack = (provider == PROVIDER_IPSTACK);
+    DynamicJsonDocument doc(1024);
+    DeserializationError error = deserializeJson(doc, payload);
+    if(error || doc[isIpstack ? "latitude" : "lat"].isNull()) {
+        LOG_WARN(LOG_API, "parseIpLocation: %s JSON deserialization failed, error code: %s", ProviderPolicy::getName(provider), error.c_str());
+        LOG_DEBUG(LOG_API, "parseIpLocation: %s", payload.c_str());
+        return false;
+    }
+    String lat = doc[isIpstack ? "latitude" : "lat"];
+    String lng = doc[isIpstack ? "longitude" : "lon"];
+    location = lat + "," + lng;
+    LOG_INFO(LOG_API, "Your IP location is %s, %s, %s.", doc[isIpstack ? "country_name" : "country"].as<const char *>(),
+        doc[isIpstack ? "region_name" : "region"].as<const char *>(), doc["city"].as<const char *>());
+    LOG_INFO(LOG_API, "With coordinates: latitude: %s, longitude: %s", lat.c_str(), lng.c_str());
+    return true;
+}
+/*                                                                      *
+ *  Requests the location from ipstack and ip-api as a hedged request.  *
+ *  The cheaper service is asked first, the other one only if the       *
+ *  first is slower than usual. Both services detect the public IP on   *
+ *  their own, so no extra request for the IP is needed.                *
+ *                                                                      */
+String NixieAPI::getLocFromIpHedged() {
+    HedgeTarget targets[2] = {
+        {PROVIDER_IPSTACK, "api.ipstack.com", "/check?access_key=" + ipStackKey + "&output=json&fields=country_name,region_name,city,latitude,longitude"},
+        {PROVIDER_IPAPI, "ip-api.com", "/json/"}
+    };
+    if(providerPolicy.getExpectedCost(PROVIDER_IPAPI) < providerPolicy.getExpectedCost(PROVIDER_IPSTACK)) {
+        HedgeTarget first = targets[0];
+        targets[0] = targets[1];
+        targets[1] = first;
+    }
+    String body;
+    int8_t winner = hedgedGet(targets, body);
+    if(winner < 0) {
+        return lastLocation();
+    }
+    if(parseIpLocation(targets[winner].provider, body)) {
+        providerPolicy.reportSuccess(targets[winner].provider);
+        return location;
+    }
+    providerPolicy.reportFailure(targets[winner].provider);
+    return lastLocation();
+}
+// The location of the last successful request, "0" if there was none, returned when a request fails or is denied.
+String NixieAPI::lastLocation() {
+    return location != "" ? location : "0";
+}
 /*                                                                         *
  *   This function combines all API services to get location parameters.   *
+ *   The services are tried from the one with the lowest expected cost     *
+ *   (average latency / success rate) to the highest, services with an     *
+ *   open circuit breaker are skipped.                                     *
  *   After it receives the location, it will no longer call API services   *
  *   untill NixieTap is restarted.                                         *
  *                                                                         */
 String NixieAPI::getLocation() {
-    if(googleLocKey != "" && googleLocKey != "0" && (location == "" || location == "0")) {
-        getLocFromGoogle();
+    if(location != "" && location != "0") {
+        return location;
     }
-    if(ipStackKey != "" && ipStackKey != "0" && (location == "" || location == "0")) {
-        getLocFromIpstack(getPublicIP());
+    ApiProvider chain[3];
+    uint8_t chainLength = 0;
+    if(googleLocKey != "" && googleLocKey != "0") {
+        chain[chainLength++] = PROVIDER_GOOGLE_LOCATION;
     }
-    if(location == "" || location == "0") {
-        getLocFromIpapi(getPublicIP());
+    if(ipStackKey != "" && ipStackKey != "0") {
+        chain[chainLength++] = PROVIDER_IPSTACK;
+    }
+    chain[chainLength++] = PROVIDER_IPAPI;
+    providerPolicy.sortByCost(chain, chainLength);
+    for(uint8_t i = 0; i < chainLength && (location == "" || location == "0"); i++) {
+        if(!providerPolicy.isAvailable(chain[i])) {
+            continue;
+        }
+        switch(chain[i]) {
+            case PROVIDER_GOOGLE_LOCATION:
+                getLocFromGoogle();
+                break;
+            case PROVIDER_IPSTACK:
+            case PROVIDER_IPAPI:
+                if(i + 1 < chainLength && (chain[i + 1] == PROVIDER_IPSTACK || chain[i + 1] == PROVIDER_IPAPI) && providerPolicy.isAvailable(chain[i + 1])) {
+                    // The next service in the chain is the other IP based one, both are asked with one hedged request.
+                    getLocFromIpHedged();
+                    i++;
+                } else if(chain[i] == PROVIDER_IPSTACK) {
+                    getLocFromIpstack(getPublicIP());
+                } else {
+                    getLocFromIpapi(getPublicIP());
+                }
+                break;
+            default:
+                break;
+        }
     }
     if(location == "" || location == "0") {
-        #ifdef DEBUG
-            Serial.println("getLocation: Failed to get any location from the API servers.");
-        #endif // DEBUG
+        LOG_WARN(LOG_API, "getLocation: Failed to get any location from the API servers.");
         return "0";
     }
     return location;
@@ -455,6 +504,9 @@ String NixieAPI::getLocation() {
  *  to buy their services.  https://ipstack.com/              *
  *                                                            */
 int NixieAPI::getTimeZoneOffsetFromIpstack(time_t now, String publicIP, uint8_t *dst) {
+    if(!providerPolicy.allow(PROVIDER_IPSTACK)) {
+        return 22;
+    }
     WiFiClient client;
     HTTPClient http;
     int tz = 0;
@@ -463,19 +515,12 @@ int NixieAPI::getTimeZoneOffsetFromIpstack(time_t now, String publicIP, uint8_t
     }
     String URL = "http://api.ipstack.com/" + publicIP + "?access_key=" + ipStackKey + "&output=json&fields=time_zone.id,time_zone.gmt_offset,time_zone.is_daylight_saving";
     String payload, tzname;
-    #ifdef DEBUG
-        Serial.println("---------------------------------------------------------------------------------------------");
-    #endif // DEBUG
     http.setUserAgent(UserAgent);
     if(!http.begin(client, URL)) {
         tz = 22;    // 22 is set as a time zone error
-        #ifdef DEBUG
-            Serial.println(F("getIpstackTimeZoneOffset: Connection failed!"));
-        #endif // DEBUG
+        LOG_WARN(LOG_API, "getTimeZoneOffsetFromIpstack: Connection failed!");
     } else {
-        #ifdef DEBUG
-            Serial.println("Connected to api.ipstack.com!");
-        #endif // DEBUG
+        LOG_DEBUG(LOG_API, "Connected to api.ipstack.com.");
         int stat = http.GET();
         if(stat > 0) {
             if(stat == HTTP_CODE_OK) {
@@ -486,33 +531,27 @@ int NixieAPI::getTimeZoneOffsetFromIpstack(time_t now, String publicIP, uint8_t
                     tz = ((doc["gmt_offset"].as<int>()) / 60);  // Time Zone offset in minutes.
                     *dst = doc["is_daylight_saving"].as<int>(); // DST ih hours.
                     tzname = doc["id"].as<String>();
-                    #ifdef DEBUG
-                        Serial.println("Your Time Zone name is:" + tzname + " (Offset from UTC: " + String(tz) + ")");
-                        Serial.printf("Is DST(Daylight saving time) active at your location: %s\n", *dst == 1 ? "Yes (+1 hour)" : "No (+0 hour)");
-                    #endif // DEBUG
+                    LOG_INFO(LOG_API, "Your time zone is %s (offset from UTC: %d), DST: %s", tzname.c_str(), tz, *dst == 1 ? "yes (+1 hour)" : "no (+0 hour)");
                 } else {
                     tz = 22;
-                    #ifdef DEBUG
-                        Serial.println(F("getTimeZoneOffset: JSON deserialization failed!, error code: "));
-                        Serial.println(error.c_str());
-                        Serial.println(payload);
-                    #endif // DEBUG
+                    LOG_WARN(LOG_API, "getTimeZoneOffsetFromIpstack: JSON deserialization failed, error code: %s", error.c_str());
+                    LOG_DEBUG(LOG_API, "getTimeZoneOffsetFromIpstack: %s", payload.c_str());
                 }
             } else {
                 tz = 22;
-                #ifdef DEBUG
-                    Serial.printf("getTimeZoneOffset: [HTTP] GET reply %d\r\n", stat);
-                #endif // DEBUG
+                LOG_WARN(LOG_API, "getTimeZoneOffsetFromIpstack: [HTTP] GET reply %d", stat);
             }
         } else {
             tz = 22;
-            #ifdef DEBUG
-                Serial.printf("getTimeZoneOffset: [HTTP] GET failed: %s\r\n", http.errorToString(stat).c_str());
-            #endif // DEBUG
+            LOG_WARN(LOG_API, "getTimeZoneOffsetFromIpstack: [HTTP] GET failed: %s", http.errorToString(stat).c_str());
         }
     }
     http.end();
-
+    if(tz == 22) {
+        providerPolicy.reportFailure(PROVIDER_IPSTACK);
+    } else {
+        providerPolicy.reportSuccess(PROVIDER_IPSTACK);
+    }
     return tz;
 }
 /*                                                                     *
@@ -521,23 +560,21 @@ int NixieAPI::getTimeZoneOffsetFromIpstack(time_t now, String publicIP, uint8_t
  *  https://developers.google.com/maps/documentation/timezone/start    *
  *                                                                     */
 int NixieAPI::getTimeZoneOffsetFromGoogle(time_t now, String location, uint8_t *dst) {
-    std::unique_ptr<BearSSL::WiFiClientSecure>client(new BearSSL::WiFiClientSecure);
+    if(!providerPolicy.allow(PROVIDER_GOOGLE_TIMEZONE)) {
+        return 22;
+    }
+    std::unique_ptr<TimedTlsClient>client(new TimedTlsClient);
     client->setFingerprint(googleTimeZoneCrt);
     HTTPClient https;
     int tz = 0;
     String URL = "https://maps.googleapis.com/maps/api/timezone/json?location=" + location + "&timestamp=" + String(now) + "&key=" + googleTimeZoneKey;
-    #ifdef DEBUG
-        Serial.println("---------------------------------------------------------------------------------------------");
-        Serial.println("Requesting URL: " + URL);
-    #endif // DEBUG
+    LOG_DEBUG(LOG_API, "Requesting the time zone from maps.googleapis.com.");
     String payload, tzName, tzId;
     // http.setInsecure();   // https://github.com/esp8266/Arduino/pull/2821
     https.setUserAgent(UserAgent);
     if(!https.begin(*client, URL)) {
         tz = 22;    // 22 is set as a time zone error
-        #ifdef DEBUG
-            Serial.println(F("getTimeZoneOffset: [HTTP] connect failed!"));
-        #endif // DEBUG
+        LOG_WARN(LOG_API, "getTimeZoneOffsetFromGoogle: [HTTP] connect failed!");
     } else {
         int stat = https.GET();
         if(stat > 0) {
@@ -550,33 +587,27 @@ int NixieAPI::getTimeZoneOffsetFromGoogle(time_t now, String location, uint8_t *
                     *dst = ((doc["dstOffset"].as<int>()) / 3600); // DST ih hours.
                     tzName = doc["timeZoneName"].as<String>();
                     tzId = doc["timeZoneId"].as<String>();
-                    #ifdef DEBUG
-                        Serial.println("Your Time Zone name is: " + tzName + " (Offset from UTC: " + String(tz) + ") at location: " + tzId);
-                        Serial.printf("Is DST(Daylight saving time) active at your location: %s\n", *dst == 1 ? "Yes (+1 hour)" : "No (+0 hour)");     
-                    #endif // DEBUG
+                    LOG_INFO(LOG_API, "Your time zone is %s (offset from UTC: %d) at %s, DST: %s", tzName.c_str(), tz, tzId.c_str(), *dst == 1 ? "yes (+1 hour)" : "no (+0 hour)");
                 } else {
                     tz = 22;
-                    #ifdef DEBUG
-                        Serial.println(F("getTimeZoneOffset: JSON deserialization failed, error code: "));
-                        Serial.println(error.c_str());
-                        Serial.println(payload);
-                    #endif // DEBUG
+                    LOG_WARN(LOG_API, "getTimeZoneOffsetFromGoogle: JSON deserialization failed, error code: %s", error.c_str());
+                    LOG_DEBUG(LOG_API, "getTimeZoneOffsetFromGoogle: %s", payload.c_str());
                 }
             } else {
                 tz = 22;
-                #ifdef DEBUG
-                    Serial.printf("getTimeZoneOffset: [HTTP] GET reply %d\r\n", stat);
-                #endif // DEBUG
+                LOG_WARN(LOG_API, "getTimeZoneOffsetFromGoogle: [HTTP] GET reply %d", stat);
             }
         } else {
             tz = 22;
-            #ifdef DEBUG
-            Serial.printf("getTimeZoneOffset: [HTTP] GET failed: %s\r\n", https.errorToString(stat).c_str());
-            #endif // DEBUG
+            LOG_WARN(LOG_API, "getTimeZoneOffsetFromGoogle: [HTTP] GET failed: %s", https.errorToString(stat).c_str());
         }
     }
     https.end();
-
+    if(tz == 22) {
+        providerPolicy.reportFailure(PROVIDER_GOOGLE_TIMEZONE);
+    } else {
+        providerPolicy.reportSuccess(PROVIDER_GOOGLE_TIMEZONE);
+    }
     return tz;
 }
 /*                                                                      *
@@ -589,6 +620,9 @@ int NixieAPI::getTimeZoneOffsetFromGoogle(time_t now, String location, uint8_t *
  *  https://timezonedb.com/                                             *
  *                                                                      */
 int NixieAPI::getTimeZoneOffsetFromTimezonedb(time_t now, String location, String ip, uint8_t *dst) {
+    if(!providerPolicy.allow(PROVIDER_TIMEZONEDB)) {
+        return 22;
+    }
     WiFiClient client;
     HTTPClient http;
     int tz = 0;
@@ -598,19 +632,12 @@ int NixieAPI::getTimeZoneOffsetFromTimezonedb(time_t now, String location, Strin
         URL = "http://api.timezonedb.com/v2/get-time-zone?key=" + timezonedbKey + "&format=json&by=position&position&lat=" + location + "&time=" + String(now) + "&fields=zoneName,gmtOffset,dst";
     else 
         URL = "http://api.timezonedb.com/v2/get-time-zone?key=" + timezonedbKey + "&format=json&by=ip&ip=" + ip + "&time=" + String(now) + "&fields=zoneName,gmtOffset,dst";
-    #ifdef DEBUG
-        Serial.println("---------------------------------------------------------------------------------------------");
-    #endif // DEBUG
     http.setUserAgent(UserAgent);
     if(!http.begin(client, URL)) {
         tz = 22;    // 22 is set as a time zone error
-        #ifdef DEBUG
-            Serial.println(F("getTimeZoneOffsetFromTimezonedb: Connection failed!"));
-        #endif // DEBUG
+        LOG_WARN(LOG_API, "getTimeZoneOffsetFromTimezonedb: Connection failed!");
     } else {
-        #ifdef DEBUG
-            Serial.println("Connected to api.timezonedb.com!");
-        #endif // DEBUG
+        LOG_DEBUG(LOG_API, "Connected to api.timezonedb.com.");
         int stat = http.GET();
         if(stat > 0) {
             if(stat == HTTP_CODE_OK) {
@@ -624,60 +651,85 @@ int NixieAPI::getTimeZoneOffsetFromTimezonedb(time_t now, String location, Strin
                         tz -= 60;
                     }
                     tzname = doc["zoneName"].as<String>();
-                    #ifdef DEBUG
-                        Serial.println("Your Time Zone name is: " + tzname + " (Offset from UTC: " + String(tz) + ")");
-                        Serial.printf("Is DST(Daylight saving time) active at your location: %s\n", *dst == 1 ? "Yes (+1 hour)" : "No (+0 hour)");
-                    #endif // DEBUG
+                    LOG_INFO(LOG_API, "Your time zone is %s (offset from UTC: %d), DST: %s", tzname.c_str(), tz, *dst == 1 ? "yes (+1 hour)" : "no (+0 hour)");
                 } else {
                     tz = 22;
-                    #ifdef DEBUG
-                        Serial.println(F("getTimeZoneOffsetFromTimezonedb: JSON deserialization failed, error code: "));
-                        Serial.println(error.c_str());
-                        Serial.println(payload);
-                    #endif // DEBUG
+                    LOG_WARN(LOG_API, "getTimeZoneOffsetFromTimezonedb: JSON deserialization failed, error code: %s", error.c_str());
+                    LOG_DEBUG(LOG_API, "getTimeZoneOffsetFromTimezonedb: %s", payload.c_str());
                 }
             } else {
                 tz = 22;
-                #ifdef DEBUG
-                    Serial.printf("getTimeZoneOffsetFromTimezonedb: [HTTP] GET reply %d\r\n", stat);
-                #endif // DEBUG
+                LOG_WARN(LOG_API, "getTimeZoneOffsetFromTimezonedb: [HTTP] GET reply %d", stat);
             }
         } else {
             tz = 22;
-            #ifdef DEBUG
-                Serial.printf("getTimeZoneOffsetFromTimezonedb: [HTTP] GET failed: %s\r\n", http.errorToString(stat).c_str());
-            #endif // DEBUG
+            LOG_WARN(LOG_API, "getTimeZoneOffsetFromTimezonedb: [HTTP] GET failed: %s", http.errorToString(stat).c_str());
         }
     }
     http.end();
-
+    if(tz == 22) {
+        providerPolicy.reportFailure(PROVIDER_TIMEZONEDB);
+    } else {
+        providerPolicy.reportSuccess(PROVIDER_TIMEZONEDB);
+    }
     return tz;
 }
 /*                                                                          *
  *   This function combines all API services to get time zone parameters.   *
+ *   Like in getLocation(), the services are tried in the order of their    *
+ *   expected cost. The location is only requested if the chosen service    *
+ *   needs it.                                                              *
  *                                                                          */
 int NixieAPI::getTimezoneOffset(time_t now, uint8_t *dst) {
-    int tz = 22;
-    String loc = getLocation();
-    if(googleTimeZoneKey != "" && googleTimeZoneKey != "0" && loc != "" && loc != "0") {
-        tz = getTimeZoneOffsetFromGoogle(now, loc, dst);
-    }
-    if(timezonedbKey != "" && timezonedbKey != "0" && tz == 22) {   // 22 is set as a time zone error
-        if (loc != "" && loc != "0") {
-            tz = getTimeZoneOffsetFromTimezonedb(now, loc, "", dst);
-        } else {
-            tz = getTimeZoneOffsetFromTimezonedb(now, "", getPublicIP(), dst);
+    int tz = 22;    // 22 is set as a time zone error
+    ApiProvider chain[3];
+    uint8_t chainLength = 0;
+    if(googleTimeZoneKey != "" && googleTimeZoneKey != "0") {
+        chain[chainLength++] = PROVIDER_GOOGLE_TIMEZONE;
+    }
+    if(timezonedbKey != "" && timezonedbKey != "0") {
+        chain[chainLength++] = PROVIDER_TIMEZONEDB;
+    }
+    if(ipStackKey != "" && ipStackKey != "0") {
+        chain[chainLength++] = PROVIDER_IPSTACK;
+    }
+    providerPolicy.sortByCost(chain, chainLength);
+    for(uint8_t i = 0; i < chainLength && tz == 22; i++) {
+        if(!providerPolicy.isAvailable(chain[i])) {
+            continue;
+        }
+        switch(chain[i]) {
+            case PROVIDER_GOOGLE_TIMEZONE: {
+                String loc = getLocation();
+                if(loc != "" && loc != "0") {
+                    tz = getTimeZoneOffsetFromGoogle(now, loc, dst);
+                }
+                break;
+            }
+            case PROVIDER_TIMEZONEDB:
+                if(location != "" && location != "0") {
+                    tz = getTimeZoneOffsetFromTimezonedb(now, location, "", dst);
+                } else {
+                    tz = getTimeZoneOffsetFromTimezonedb(now, "", getPublicIP(), dst);
+                }
+                break;
+            default:
+                tz = getTimeZoneOffsetFromIpstack(now, getPublicIP(), dst);
+                break;
         }
     }
-    if(ipStackKey != "" && ipStackKey != "0" && tz == 22) {
-        tz = getTimeZoneOffsetFromIpstack(now, getPublicIP(), dst);
-    } 
-    if(tz == 22) {
+    if(tz == 22 && lastTimezoneOffset != 22) {
+        // None of the services answered (or they are rate limited), the last detected time zone is used.
+        tz = lastTimezoneOffset;
+        *dst = lastDst;
+        LOG_WARN(LOG_API, "The time zone could not be detected, using the last known time zone.");
+    } else if(tz == 22) {
         tz = 0;
         *dst = 0;
-        #ifdef DEBUG
-            Serial.println("The time zone could not be detected. There are no keys for any of API service.");
-        #endif // DEBUG
+        LOG_WARN(LOG_API, "The time zone could not be detected. There are no keys for any of the API services.");
+    } else {
+        lastTimezoneOffset = tz;
+        lastDst = *dst;
     }
     return tz;
 }
@@ -687,61 +739,135 @@ int NixieAPI::getTimezoneOffset(time_t now, uint8_t *dst) {
  *  https://coinmarketcap.com/api/#endpoint_listings                *
  *                                                                  */
 String NixieAPI::getCryptoPrice(char * crypto_key, char * currencyID) {
-    std::unique_ptr<BearSSL::WiFiClientSecure>client(new BearSSL::WiFiClientSecure);
+    if(getCryptoPrices(crypto_key, currencyID) == 0) {
+        return "0";
+    }
+    return String(cryptoQuotes[0].price);
+}
+/*                                                                      *
+ *  Parses a comma separated list of Coinmarketcap IDs ("1,1027,52")    *
+ *  into the quote table. Quotes of the currencies that are still       *
+ *  in the list are kept, so they can be shown until the next fetch.    *
+ *                                                                      */
+void NixieAPI::setCryptoIDs(const char * currencyIDs) {
+    CryptoQuote newQuotes[MAX_CRYPTO_ASSETS];
+    uint8_t newCount = 0;
+    const char * p = currencyIDs;
+    while(*p != '\0' && newCount < MAX_CRYPTO_ASSETS) {
+        char * end;
+        uint32_t id = strtoul(p, &end, 10);
+        if(end == p) {  // Skip separators and any other garbage.
+            p++;
+            continue;
+        }
+        p = end;
+        newQuotes[newCount].id = id;
+        strcpy(newQuotes[newCount].price, "0");
+        newQuotes[newCount].updated = 0;
+        for(uint8_t i = 0; i < cryptoQuoteCount; i++) {
+            if(cryptoQuotes[i].id == id) {
+                newQuotes[newCount] = cryptoQuotes[i];
+                break;
+            }
+        }
+        newCount++;
+    }
+    memcpy(cryptoQuotes, newQuotes, sizeof(CryptoQuote) * newCount);
+    cryptoQuoteCount = newCount;
+}
+/*                                                                      *
+ *  Calls Coinmarketcap API once for all of the currencies given as     *
+ *  a comma separated list of IDs, so only one TLS handshake is paid    *
+ *  for up to MAX_CRYPTO_ASSETS currencies. Results are stored in the   *
+ *  quote table, the function returns the number of updated quotes.     *
+ *                                                                      */
+uint8_t NixieAPI::getCryptoPrices(char * crypto_key, char * currencyIDs) {
+    setCryptoIDs(currencyIDs);
+    if(cryptoQuoteCount == 0) {
+        LOG_WARN(LOG_API, "getCryptoPrices: No valid currency ID is given.");
+        return 0;
+    }
+    String ids = "";
+    for(uint8_t i = 0; i < cryptoQuoteCount; i++) {
+        if(i > 0) ids += ",";
+        ids += String(cryptoQuotes[i].id);
+    }
+    if(!providerPolicy.allow(PROVIDER_COINMARKETCAP)) {
+        return 0;   // The quote table still holds the last fetched prices.
+    }
+    std::unique_ptr<TimedTlsClient>client(new TimedTlsClient);
     client->setFingerprint(crypto_cert);
     HTTPClient https;
-    String URL = "https://pro-api.coinmarketcap.com/v1/cryptocurrency/quotes/latest?CMC_PRO_API_KEY="+(String)crypto_key+"&id="+(String)currencyID;
-	float price;
-    String payload, priceString, cryptoName;
-    #ifdef DEBUG
-        Serial.println("---------------------------------------------------------------------------------------------");
-        Serial.println("Requesting price of a selected currency from: " + URL);
-    #endif // DEBUG
-    //http.setInsecure();   // https://github.com/esp8266/Arduino/pull/2821
+    String URL = "https://pro-api.coinmarketcap.com/v1/cryptocurrency/quotes/latest?CMC_PRO_API_KEY="+(String)crypto_key+"&id="+ids;
+    uint8_t updated = 0;
+    LOG_DEBUG(LOG_API, "Requesting the prices of %s from pro-api.coinmarketcap.com.", ids.c_str());
+    https.useHTTP10(true);  // Avoids chunked transfer encoding, so the JSON can be parsed directly from the stream.
     if (!https.begin(*client, URL))
     {
-        #ifdef DEBUG
-            Serial.println(F("CMC failed to connect!"));
-        #endif // DEBUG
-        return "0";
-    } else {
-        int stat = https.GET();
-        if(stat > 0) {
-            if(stat == HTTP_CODE_OK) {
-                payload = https.getString();
-                DynamicJsonDocument doc(1024);
-                DeserializationError error = deserializeJson(doc, payload);
-                if(!error) {
-                    price = doc["data"][(String)currencyID]["quote"]["USD"]["price"];
-					priceString = String(price, 1);// round to 1 decimal place
-                    cryptoName = doc["data"][(String)currencyID]["name"].as<String>();
-                    #ifdef DEBUG
-                        Serial.println("The current price of " + cryptoName + " is: " + price);
-                    #endif // DEBUG
-                } else {
-                    #ifdef DEBUG
-                        Serial.println(F("CMC deserialization failed, error code: "));
-                        Serial.println(error.c_str());
-                        Serial.println(payload);
-                    #endif // DEBUG
-                    return "0";
+        LOG_WARN(LOG_API, "CMC failed to connect!");
+        providerPolicy.reportFailure(PROVIDER_COINMARKETCAP);
+        return 0;
+    }
+    int stat = https.GET();
+    if(stat == HTTP_CODE_OK) {
+        // Only the price of the requested currencies is kept from the response, everything else is dropped while parsing.
+        StaticJsonDocument<CRYPTO_FILTER_SIZE> filter;
+        for(uint8_t i = 0; i < cryptoQuoteCount; i++) {
+            filter["data"][String(cryptoQuotes[i].id)]["quote"]["USD"]["price"] = true;
+        }
+        if(filter.overflowed()) {
+            LOG_WARN(LOG_API, "CMC: the filter is too small, some prices are dropped.");
+        }
+        DynamicJsonDocument doc(128 + 96 * cryptoQuoteCount);
+        DeserializationError error = deserializeJson(doc, https.getStream(), DeserializationOption::Filter(filter));
+        if(!error && doc.overflowed()) {
+            LOG_WARN(LOG_API, "CMC: the response did not fit, some prices are dropped.");
+        }
+        if(!error) {
+            time_t fetchTime = now();
+            for(uint8_t i = 0; i < cryptoQuoteCount; i++) {
+                JsonVariant price = doc["data"][String(cryptoQuotes[i].id)]["quote"]["USD"]["price"];
+                if(price.isNull()) {
+                    continue;
                 }
-            } else {
-                #ifdef DEBUG
-                    Serial.printf("CMC: [HTTP] GET reply %d\r\n", stat);
-                #endif // DEBUG
-                return "0";
+                String priceString = String(price.as<float>(), 1); // round to 1 decimal place
+                strncpy(cryptoQuotes[i].price, priceString.c_str(), sizeof(cryptoQuotes[i].price) - 1);
+                cryptoQuotes[i].price[sizeof(cryptoQuotes[i].price) - 1] = '\0';
+                cryptoQuotes[i].updated = fetchTime;
+                updated++;
+                LOG_DEBUG(LOG_API, "The current price of the currency with ID %u is %s.", cryptoQuotes[i].id, cryptoQuotes[i].price);
             }
         } else {
-            #ifdef DEBUG
-            Serial.printf("CMC: [HTTP] GET failed: %s\r\n", https.errorToString(stat).c_str());
-            #endif // DEBUG
-            return "0";
+            LOG_WARN(LOG_API, "CMC deserialization failed, error code: %s", error.c_str());
         }
+    } else if(stat > 0) {
+        LOG_WARN(LOG_API, "CMC: [HTTP] GET reply %d", stat);
+    } else {
+        LOG_WARN(LOG_API, "CMC: [HTTP] GET failed: %s", https.errorToString(stat).c_str());
     }
     https.end();
-
-    return priceString;
+    if(updated > 0) {
+        providerPolicy.reportSuccess(PROVIDER_COINMARKETCAP);
+    } else {
+        providerPolicy.reportFailure(PROVIDER_COINMARKETCAP);
+    }
+    return updated;
+}
+uint8_t NixieAPI::getCryptoQuoteCount() {
+    return cryptoQuoteCount;
+}
+const CryptoQuote &NixieAPI::getCryptoQuote(uint8_t index) {
+    return cryptoQuotes[index < cryptoQuoteCount ? index : 0];
+}
+/*                                                                    *
+ *  Returns the number of seconds since the quote was last fetched.   *
+ *  If the quote was never fetched, -1 is returned.                   *
+ *                                                                    */
+time_t NixieAPI::getCryptoQuoteAge(uint8_t index) {
+    if(index >= cryptoQuoteCount || cryptoQuotes[index].updated == 0) {
+        return -1;
+    }
+    return now() - cryptoQuotes[index].updated;
 }
 /*                                                                            *
  *  Calls OpenWeatherMap API, to get the temperature for the given location.  *
@@ -750,24 +876,20 @@ String NixieAPI::getCryptoPrice(char * crypto_key, char * currencyID) {
  *  https://openweathermap.org/api                                            *
  *                                                                            */
 String NixieAPI::getTempAtMyLocation(String location, uint8_t format) {
+    if(!providerPolicy.allow(PROVIDER_OPENWEATHERMAP)) {
+        return lastTemperature;
+    }
     WiFiClient client;
     HTTPClient http;
     String payload, temperature;
     String formatType = (format == 1) ? "metric" : "imperial";
     String URL = "http://api.openweathermap.org/data/2.5/weather?id=" + location + "&units=" + formatType + "&APPID=" + openWeaterMapKey;
-    #ifdef DEBUG
-        Serial.println("---------------------------------------------------------------------------------------------");
-        Serial.println("Requesting temperature for my location from: " + URL);
-    #endif // DEBUG
+    LOG_DEBUG(LOG_API, "Requesting the temperature of %s from api.openweathermap.org.", location.c_str());
     http.setUserAgent(UserAgent);
     if(!http.begin(client, URL)) {
-        #ifdef DEBUG
-            Serial.println(F("getTempAtMyLocation: Connection failed!"));
-        #endif // DEBUG
+        LOG_WARN(LOG_API, "getTempAtMyLocation: Connection failed!");
     } else {
-        #ifdef DEBUG
-            Serial.println("Connected to api.openweathermap.org!");
-        #endif // DEBUG
+        LOG_DEBUG(LOG_API, "Connected to api.openweathermap.org.");
         int stat = http.GET();
         if(stat > 0) {
             if(stat == HTTP_CODE_OK) {
@@ -781,31 +903,41 @@ String NixieAPI::getTempAtMyLocation(String location, uint8_t format) {
                     if(dotPos != -1) {
                         temperature.remove(dotPos);
                     }
-                    #ifdef DEBUG
-                        String degreeType = (format == 1) ? "celsius" : "fahrenheit";
-                        Serial.printf("Temperature at your location is %s degrees %s.\n", temperature.c_str(), degreeType.c_str());
-                    #endif // DEBUG
+                    LOG_DEBUG(LOG_API, "Temperature at your location is %s degrees %s.", temperature.c_str(), format == 1 ? "celsius" : "fahrenheit");
                 } else {
-                    #ifdef DEBUG
-                        Serial.println(F("getTempAtMyLocation: JSON deserialization failed, error code: "));
-                        Serial.println(error.c_str());
-                        Serial.println(payload);
-                    #endif // DEBUG
+                    LOG_WARN(LOG_API, "getTempAtMyLocation: JSON deserialization failed, error code: %s", error.c_str());
+                    LOG_DEBUG(LOG_API, "getTempAtMyLocation: %s", payload.c_str());
                 }
             } else {
-                #ifdef DEBUG
-                    Serial.printf("getTempAtMyLocation: [HTTP] GET reply %d\r\n", stat);
-                #endif // DEBUG
+                LOG_WARN(LOG_API, "getTempAtMyLocation: [HTTP] GET reply %d", stat);
             }
         } else {
-            #ifdef DEBUG
-                Serial.printf("getTempAtMyLocation: [HTTP] GET failed: %s\r\n", http.errorToString(stat).c_str());
-            #endif // DEBUG
+            LOG_WARN(LOG_API, "getTempAtMyLocation: [HTTP] GET failed: %s", http.errorToString(stat).c_str());
         }
     }
     http.end();
-
+    if(temperature != "") {
+        providerPolicy.reportSuccess(PROVIDER_OPENWEATHERMAP);
+        lastTemperature = temperature;
+    } else {
+        providerPolicy.reportFailure(PROVIDER_OPENWEATHERMAP);
+        return lastTemperature;
+    }
     return temperature;
 }
 
+int8_t TimedTlsClient::handshakeMetric = -1;
+
+int TimedTlsClient::connect(const char *host, uint16_t port) {
+    uint32_t start = millis();
+    int connected = BearSSL::WiFiClientSecure::connect(host, port);
+    if(connected) {
+        metrics.observe(handshakeMetric, millis() - start);
+    }
+    return connected;
+}
+void TimedTlsClient::setMetric(int8_t id) {
+    handshakeMetric = id;
+}
+
 NixieAPI nixieTapAPI = NixieAPI();
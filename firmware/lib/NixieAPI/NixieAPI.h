@@ -8,13 +8,51 @@
 #include <ESP8266WiFi.h>
 #include <WiFiUdp.h>
 #include <WiFiClientSecure.h>
+#include <ESPAsyncTCP.h>
 #include <TimeLib.h>
+#include "ProviderPolicy.h"
 
 #define MAX_CONNECTION_TIMEOUT 5000
+#define HEDGE_MIN_DELAY 150         // The backup of a hedged request is never sent sooner than this (ms).
+#define HEDGE_MAX_RESPONSE 1024     // Longer answers to a hedged request are cut, the services used answer with a short JSON.
+#define MAX_CRYPTO_ASSETS 8         // Maximum number of currencies fetched with a single Coinmarketcap request.
+// Filter of the Coinmarketcap response: data.<id>.quote.USD.price of every currency, the IDs (up to 10 digits) are copied into it.
+#define CRYPTO_FILTER_SIZE (JSON_OBJECT_SIZE(1) + JSON_OBJECT_SIZE(MAX_CRYPTO_ASSETS) + MAX_CRYPTO_ASSETS * (3 * JSON_OBJECT_SIZE(1) + 11))
 
-#ifndef DEBUG
-#define DEBUG
-#endif // DEBUG
+struct CryptoQuote {
+    uint32_t id;        // Coinmarketcap currency ID.
+    char price[16];     // Last price in USD, rounded to 1 decimal place.
+    time_t updated;     // Time of the last successful fetch, 0 if the price was never fetched.
+};
+
+struct HedgeTarget {
+    ApiProvider provider;
+    const char *host;   // Plain HTTP server, port 80.
+    String path;
+};
+
+// One request of hedgedGet(), the callbacks of its client fill in the rest.
+struct HedgeRequest {
+    AsyncClient client;
+    String request;
+    String response;        // Headers and body, cut at HEDGE_MAX_RESPONSE.
+    bool connected;
+    bool closed;            // The server closed the connection, after the whole response.
+    bool error;             // DNS lookup or connect failed.
+};
+
+/*                                                                      *
+ *  TLS client that times its connections, the TCP connect and the      *
+ *  handshake, into the histogram set with setMetric(). HTTPClient      *
+ *  connects through it too, so its requests are timed as well.         *
+ *                                                                      */
+class TimedTlsClient : public BearSSL::WiFiClientSecure {
+    static int8_t handshakeMetric;
+public:
+    using BearSSL::WiFiClientSecure::connect;
+    int connect(const char *host, uint16_t port) override;
+    static void setMetric(int8_t id);
+};
 
 class NixieAPI {
     String UserAgent = "NixieTap";
@@ -29,7 +67,14 @@ class NixieAPI {
     String location; // This allows us to save our location so that we can reuse it in the code, without the need to requesting it again from the server.
     String ip;
     unsigned long int prevObtainedIpTime;
+    CryptoQuote cryptoQuotes[MAX_CRYPTO_ASSETS] = {};
+    uint8_t cryptoQuoteCount = 0;
+    String lastTemperature = "";    // Last successfully fetched values, returned when a request can not be sent.
+    int lastTimezoneOffset = 22;
+    uint8_t lastDst = 0;
+    HedgeRequest hedgeRequests[2];
 public:
+    ProviderPolicy providerPolicy;  // Rate limits, backoff and monthly quotas of the API services.
 
     NixieAPI();
     void applyKey(String key, uint8_t selectAPI);
@@ -38,11 +83,16 @@ public:
     String getPublicIP();
     
     String getCryptoPrice(char * crypto_key, char * currencyID);
+    uint8_t getCryptoPrices(char * crypto_key, char * currencyIDs);
+    uint8_t getCryptoQuoteCount();
+    const CryptoQuote &getCryptoQuote(uint8_t index);
+    time_t getCryptoQuoteAge(uint8_t index);
     String getTempAtMyLocation(String location, uint8_t format);
     
     String getLocFromIpstack(String publicIP);
     String getLocFromGoogle();
     String getLocFromIpapi(String publicIP);
+    String getLocFromIpHedged();
     String getLocation();
 
     int getTimeZoneOffsetFromGoogle(time_t now, String location, uint8_t *dst);
@@ -52,6 +102,10 @@ public:
     
 protected: 
     String MACtoString(uint8_t* macAddress);
+    void setCryptoIDs(const char * currencyIDs);
+    int8_t hedgedGet(const HedgeTarget *targets, String &body);
+    bool parseIpLocation(ApiProvider provider, const String &payload);
+    String lastLocation();
 };
 
 extern NixieAPI nixieTapAPI;
@@ -0,0 +1,264 @@
+#include "ProviderPolicy.h"
+#include <TimeLib.h>
+#include <Logger.h>
+#include <Metrics.h>
+
+/*                                                                          *
+ *  Request limits of the API services, as documented by the providers.     *
+ *  {burst, refill interval in ms, monthly quota}                           *
+ *                                                                          */
+const ProviderLimits ProviderPolicy::limits[PROVIDER_COUNT] = {
+    {3, 1000, 0},       // ipify
+    {3, 1000, 0},       // seeip
+    {2, 60000, 10000},  // ipstack, 10.000 requests per month on the free plan.
+    {5, 400, 0},        // ip-api, 150 requests per minute.
+    {5, 1000, 0},       // Google Location API
+    {5, 1000, 0},       // Google Timezone API
+    {1, 1000, 0},       // timezonedb, 1 request per second.
+    {2, 2000, 0},       // Coinmarketcap, 30 requests per minute.
+    {5, 1000, 0}        // OpenWeatherMap, 60 requests per minute.
+};
+
+static const char *providerNames[PROVIDER_COUNT] = {
+    "ipify", "seeip", "ipstack", "ip-api", "google-location", "google-timezone", "timezonedb", "coinmarketcap", "openweathermap"
+};
+
+ProviderPolicy::ProviderPolicy() {
+    for(uint8_t i = 0; i < PROVIDER_COUNT; i++) {
+        state[i].tokens = limits[i].burst;
+        state[i].lastRefill = 0;
+        state[i].failures = 0;
+        state[i].retryAt = 0;
+        state[i].requestStart = 0;
+        state[i].successRate = 1000;
+        state[i].latency = HEALTH_INITIAL_LATENCY_MS;
+        state[i].latencyP50 = HEALTH_INITIAL_LATENCY_MS;
+        state[i].breaker = BREAKER_CLOSED;
+        state[i].breakerOpenedAt = 0;
+        quota.used[i] = 0;
+    }
+    quota.month = 0;
+    quota.year = 0;
+}
+/*                                                                    *
+ *  Adds the tokens that were earned since the last refill, without   *
+ *  going over the burst size of the provider.                        *
+ *                                                                    */
+void ProviderPolicy::refill(ApiProvider provider) {
+    ProviderState &s = state[provider];
+    uint32_t nowMs = millis();
+    uint32_t earned = (nowMs - s.lastRefill) / limits[provider].refillInterval;
+    if(earned > 0) {
+        s.lastRefill += earned * limits[provider].refillInterval;
+        s.tokens = (s.tokens + earned >= limits[provider].burst) ? limits[provider].burst : s.tokens + earned;
+    }
+    if(s.tokens == limits[provider].burst) {
+        s.lastRefill = nowMs;
+    }
+}
+/*                                                                    *
+ *  Monthly counters are cleared when the calendar month changes.     *
+ *  Until the time is known, the counters of the saved month are kept.*
+ *  Counters saved without a year are taken as this year's.           *
+ *                                                                    */
+void ProviderPolicy::checkMonth() {
+    if(timeStatus() == timeNotSet) {
+        return;
+    }
+    uint8_t currentMonth = month();
+    uint8_t currentYear = CalendarYrToTm(year());
+    if(quota.year == 0 && quota.month == currentMonth) {
+        quota.year = currentYear;
+        quotaDirty = true;
+    }
+    if(quota.month != currentMonth || quota.year != currentYear) {
+        quota.month = currentMonth;
+        quota.year = currentYear;
+        for(uint8_t i = 0; i < PROVIDER_COUNT; i++) {
+            quota.used[i] = 0;
+        }
+        quotaDirty = true;
+    }
+}
+/*                                                                          *
+ *  Returns true if a request to the provider can be sent right now.        *
+ *  A request is denied if the provider is backing off after an error,      *
+ *  if its monthly quota is used up, or if its rate limit is reached.       *
+ *  When a request is allowed, it is counted against all of the limits.     *
+ *                                                                          */
+bool ProviderPolicy::allow(ApiProvider provider) {
+    ProviderState &s = state[provider];
+    if(!isAvailable(provider)) {
+        LOG_DEBUG(LOG_API, "%s: circuit breaker is open, request denied.", getName(provider));
+        return false;
+    }
+    if(s.failures > 0 && (int32_t)(millis() - s.retryAt) < 0) {
+        LOG_DEBUG(LOG_API, "%s: backing off for another %u ms.", getName(provider), (uint32_t)(s.retryAt - millis()));
+        return false;
+    }
+    checkMonth();
+    if(limits[provider].monthlyQuota != 0 && quota.used[provider] >= limits[provider].monthlyQuota) {
+        LOG_WARN(LOG_API, "%s: monthly quota of %u requests is used up.", getName(provider), limits[provider].monthlyQuota);
+        return false;
+    }
+    refill(provider);
+    if(s.tokens == 0) {
+        LOG_DEBUG(LOG_API, "%s: rate limit reached, request denied.", getName(provider));
+        return false;
+    }
+    s.tokens--;
+    s.requestStart = millis();
+    if(s.breaker == BREAKER_OPEN) {
+        s.breaker = BREAKER_HALF_OPEN;  // This is the trial request after the cooldown.
+    }
+    if(limits[provider].monthlyQuota != 0) {
+        quota.used[provider]++;
+        quotaDirty = true;
+    }
+    return true;
+}
+void ProviderPolicy::reportSuccess(ApiProvider provider) {
+    updateHealth(provider, true);
+    state[provider].failures = 0;
+    state[provider].breaker = BREAKER_CLOSED;
+}
+/*                                                                          *
+ *  Every consecutive failure doubles the time until the next request is    *
+ *  allowed, up to BACKOFF_MAX_MS. The delay is randomized by +-25%, so     *
+ *  retries of different providers (and devices) do not line up.            *
+ *                                                                          */
+void ProviderPolicy::reportFailure(ApiProvider provider) {
+    ProviderState &s = state[provider];
+    updateHealth(provider, false);
+    if(s.failures < 255) {
+        s.failures++;
+    }
+    if(s.breaker == BREAKER_HALF_OPEN || (s.breaker == BREAKER_CLOSED && s.failures >= BREAKER_THRESHOLD)) {
+        s.breaker = BREAKER_OPEN;
+        s.breakerOpenedAt = millis();
+        LOG_WARN(LOG_API, "%s: circuit breaker opened for %lu ms.", getName(provider), BREAKER_COOLDOWN_MS);
+    }
+    uint32_t delayMs = BACKOFF_MAX_MS;
+    if(s.failures <= 16 && (BACKOFF_BASE_MS << (s.failures - 1)) < BACKOFF_MAX_MS) {
+        delayMs = BACKOFF_BASE_MS << (s.failures - 1);
+    }
+    delayMs = delayMs - delayMs / 4 + random(delayMs / 2 + 1);
+    s.retryAt = millis() + delayMs;
+    LOG_INFO(LOG_API, "%s: request failed %u time(s) in a row, next attempt in %u ms.", getName(provider), s.failures, delayMs);
+}
+/*                                                                      *
+ *  Updates the moving averages of the success rate and the latency     *
+ *  of the provider with the request that has just finished.            *
+ *  Each new sample has a weight of 1/4. The median of successful       *
+ *  requests is tracked by moving the estimate 1/8 towards every        *
+ *  sample, which needs no sample history.                              *
+ *                                                                      */
+void ProviderPolicy::updateHealth(ApiProvider provider, bool success) {
+    ProviderState &s = state[provider];
+    uint32_t elapsed = millis() - s.requestStart;
+    metrics.observe(latencyMetric >= 0 ? latencyMetric + provider : -1, elapsed);
+    s.successRate = (s.successRate * 3 + (success ? 1000 : 0)) / 4;
+    s.latency = (s.latency * 3 + elapsed) / 4;
+    if(success) {
+        uint32_t step = s.latencyP50 / 8 + 1;
+        if(elapsed > s.latencyP50) {
+            s.latencyP50 += (elapsed - s.latencyP50 < step) ? elapsed - s.latencyP50 : step;
+        } else {
+            s.latencyP50 -= (s.latencyP50 - elapsed < step) ? s.latencyP50 - elapsed : step;
+        }
+    }
+}
+/*                                                                      *
+ *  Returns false while the circuit breaker of the provider is open.    *
+ *  Once the cooldown has passed, the provider is available again for   *
+ *  a single trial request.                                             *
+ *                                                                      */
+bool ProviderPolicy::isAvailable(ApiProvider provider) {
+    ProviderState &s = state[provider];
+    if(s.breaker == BREAKER_OPEN) {
+        return (millis() - s.breakerOpenedAt) >= BREAKER_COOLDOWN_MS;
+    }
+    return true;
+}
+uint16_t ProviderPolicy::getSuccessRate(ApiProvider provider) {
+    return state[provider].successRate;
+}
+uint32_t ProviderPolicy::getLatency(ApiProvider provider) {
+    return state[provider].latency;
+}
+uint32_t ProviderPolicy::getLatencyP50(ApiProvider provider) {
+    return state[provider].latencyP50;
+}
+/*                                                                          *
+ *  Expected time in ms to get an answer from the provider: its average     *
+ *  latency divided by its success rate, so a fast provider that often      *
+ *  fails is tried after a slower but reliable one.                         *
+ *                                                                          */
+uint32_t ProviderPolicy::getExpectedCost(ApiProvider provider) {
+    uint16_t rate = state[provider].successRate;
+    if(rate < 50) {
+        rate = 50;  // Keeps the cost finite, so a recovered provider can still move up the list.
+    }
+    return state[provider].latency * 1000 / rate;
+}
+BreakerState ProviderPolicy::getBreakerState(ApiProvider provider) {
+    return state[provider].breaker;
+}
+/*                                                                          *
+ *  Orders a chain of providers from the cheapest to the most expensive.    *
+ *  Providers with an open circuit breaker are moved to the end. The sort   *
+ *  is stable, so the given order decides between providers of equal cost.  *
+ *                                                                          */
+void ProviderPolicy::sortByCost(ApiProvider *providers, uint8_t count) {
+    for(uint8_t i = 1; i < count; i++) {
+        ApiProvider current = providers[i];
+        uint32_t currentCost = isAvailable(current) ? getExpectedCost(current) : UINT32_MAX;
+        int8_t j = i - 1;
+        while(j >= 0) {
+            uint32_t cost = isAvailable(providers[j]) ? getExpectedCost(providers[j]) : UINT32_MAX;
+            if(cost <= currentCost) {
+                break;
+            }
+            providers[j + 1] = providers[j];
+            j--;
+        }
+        providers[j + 1] = current;
+    }
+}
+uint16_t ProviderPolicy::getMonthlyUsage(ApiProvider provider) {
+    return quota.used[provider];
+}
+/*                                                                    *
+ *  Returns the number of ms until the provider can be called again   *
+ *  after a failure, 0 if it is not backing off.                      *
+ *                                                                    */
+uint32_t ProviderPolicy::getRetryDelay(ApiProvider provider) {
+    ProviderState &s = state[provider];
+    if(s.failures == 0 || (int32_t)(millis() - s.retryAt) >= 0) {
+        return 0;
+    }
+    return s.retryAt - millis();
+}
+void ProviderPolicy::restoreQuota(const QuotaState &saved) {
+    if(saved.month < 1 || saved.month > 12) {
+        return; // Nothing valid was saved yet.
+    }
+    quota = saved;
+    quotaDirty = false;
+}
+const QuotaState &ProviderPolicy::getQuota() {
+    return quota;
+}
+bool ProviderPolicy::isQuotaDirty() {
+    return quotaDirty;
+}
+void ProviderPolicy::clearQuotaDirty() {
+    quotaDirty = false;
+}
+// The request durations (ms) go into PROVIDER_COUNT histograms of the Metrics, one per provider, from this id on.
+void ProviderPolicy::setLatencyMetric(int8_t first) {
+    latencyMetric = first;
+}
+const char *ProviderPolicy::getName(ApiProvider provider) {
+    return provider < PROVIDER_COUNT ? providerNames[provider] : "unknown";
+}
@@ -0,0 +1,87 @@
+#ifndef _PROVIDERPOLICY_h   /* Include guard */
+#define _PROVIDERPOLICY_h
+
+#include <Arduino.h>
+
+#define BACKOFF_BASE_MS 5000UL          // Retry delay after the first failed request.
+#define BACKOFF_MAX_MS 1800000UL        // Retry delay is never longer than 30 minutes.
+#define BREAKER_THRESHOLD 3             // Consecutive failures that open the circuit breaker of a provider.
+#define BREAKER_COOLDOWN_MS 300000UL    // An open provider gets one trial request after 5 minutes.
+#define HEALTH_INITIAL_LATENCY_MS 1000  // Latency assumed for a provider that was never called.
+
+enum BreakerState : uint8_t {
+    BREAKER_CLOSED = 0,     // Provider is healthy, requests are sent.
+    BREAKER_OPEN,           // Provider failed repeatedly, requests are denied until the cooldown passes.
+    BREAKER_HALF_OPEN       // Cooldown passed, one trial request decides if the breaker closes again.
+};
+
+enum ApiProvider : uint8_t {
+    PROVIDER_IPIFY = 0,
+    PROVIDER_SEEIP,
+    PROVIDER_IPSTACK,
+    PROVIDER_IPAPI,
+    PROVIDER_GOOGLE_LOCATION,
+    PROVIDER_GOOGLE_TIMEZONE,
+    PROVIDER_TIMEZONEDB,
+    PROVIDER_COINMARKETCAP,
+    PROVIDER_OPENWEATHERMAP,
+    PROVIDER_COUNT
+};
+
+struct ProviderLimits {
+    uint8_t burst;              // Maximum number of requests that can be sent back to back.
+    uint32_t refillInterval;    // One request is added to the bucket every refillInterval ms.
+    uint32_t monthlyQuota;      // Maximum number of requests per calendar month, 0 is unlimited.
+};
+
+// Monthly request counters, persisted by the caller so they survive a restart.
+struct QuotaState {
+    uint8_t month;              // Calendar month (1-12) the counters belong to, 0 if unknown.
+    uint8_t year;               // Its year since 1970, like tmElements_t, 0 if it was saved without one.
+    uint16_t used[PROVIDER_COUNT];
+};
+
+class ProviderPolicy {
+    struct ProviderState {
+        uint8_t tokens;
+        uint32_t lastRefill;
+        uint8_t failures;       // Consecutive failed requests.
+        uint32_t retryAt;       // Requests are denied until millis() reaches this value.
+        uint32_t requestStart;  // millis() when the last allowed request was sent.
+        uint16_t successRate;   // Moving average of successful requests, in per mille.
+        uint32_t latency;       // Moving average of the request duration in ms, failed requests included.
+        uint32_t latencyP50;    // Running estimate of the median duration of successful requests in ms.
+        BreakerState breaker;
+        uint32_t breakerOpenedAt;
+    };
+    static const ProviderLimits limits[PROVIDER_COUNT];
+    ProviderState state[PROVIDER_COUNT];
+    QuotaState quota;
+    bool quotaDirty = false;
+    int8_t latencyMetric = -1;  // Histogram of the first provider, the others follow in the order of ApiProvider.
+    void refill(ApiProvider provider);
+    void checkMonth();
+    void updateHealth(ApiProvider provider, bool success);
+public:
+    ProviderPolicy();
+    bool allow(ApiProvider provider);
+    void reportSuccess(ApiProvider provider);
+    void reportFailure(ApiProvider provider);
+    uint16_t getMonthlyUsage(ApiProvider provider);
+    uint32_t getRetryDelay(ApiProvider provider);
+    bool isAvailable(ApiProvider provider);
+    uint16_t getSuccessRate(ApiProvider provider);
+    uint32_t getLatency(ApiProvider provider);
+    uint32_t getLatencyP50(ApiProvider provider);
+    uint32_t getExpectedCost(ApiProvider provider);
+    BreakerState getBreakerState(ApiProvider provider);
+    void sortByCost(ApiProvider *providers, uint8_t count);
+    void restoreQuota(const QuotaState &saved);
+    const QuotaState &getQuota();
+    bool isQuotaDirty();
+    void clearQuotaDirty();
+    void setLatencyMetric(int8_t first);
+    static const char *getName(ApiProvider provider);
+};
+
+#endif // _PROVIDERPOLICY_h
@@ -0,0 +1,98 @@
+#include "PowerManager.h"
+#include <ESP8266WiFi.h>
+#include <FastConnect.h>
+
+PowerManager::PowerManager() {
+}
+void PowerManager::begin() {
+    lastTick = millis();
+    lastActivity = lastTick;
+}
+// Turning power saving off wakes the radio for good.
+void PowerManager::setEnabled(bool enabled) {
+    this->enabled = enabled;
+    if(!enabled && !radioOn) {
+        wake(WAKE_NEEDED);
+    }
+}
+/*                                                                          *
+ *  Called once per second with the time until the next network job is     *
+ *  due and whether something needs the network right now. Counts the       *
+ *  radio-on time and turns the radio on or off.                            *
+ *                                                                          */
+void PowerManager::tick(uint32_t untilNetwork, bool networkNeeded) {
+    uint32_t now = millis();
+    uint32_t elapsed = now - lastTick;
+    lastTick = now;
+    stats.totalTime += elapsed;
+    if(radioOn) {
+        stats.radioOnTime += elapsed;
+    }
+
+    if(!enabled || networkNeeded) {
+        if(!radioOn) {
+            wake(WAKE_NEEDED);
+        }
+        keepAwake();
+        return;
+    }
+    if(!radioOn) {
+        if(untilNetwork <= POWER_WAKE_AHEAD) {
+            wake(WAKE_SCHEDULE);
+        }
+        return;
+    }
+    if(reason == WAKE_SCHEDULE && untilNetwork == 0 && !lateCounted && !fastConnect.isConnected()) {
+        lateCounted = true;
+        stats.late++;
+    }
+    if(now - lastActivity >= POWER_IDLE_TIME && untilNetwork > POWER_MIN_SLEEP) {
+        sleep();
+    }
+}
+/*                                                                  *
+ *  Drops the connection and turns the radio off. FastConnect is    *
+ *  stopped first, so it doesn't reconnect on the disconnect.       *
+ *                                                                  */
+void PowerManager::sleep() {
+    fastConnect.stop();
+    WiFi.mode(WIFI_OFF);
+    WiFi.forceSleepBegin();
+    radioOn = false;
+    sleepStart = millis();
+    stats.sleeps++;
+}
+// Turns the radio on and reconnects, with the cached lease that takes a few hundred ms.
+void PowerManager::wake(WakeReason reason) {
+    keepAwake();
+    if(radioOn) {
+        return;
+    }
+    WiFi.forceSleepWake();
+    WiFi.mode(WIFI_STA);
+    fastConnect.connect();
+    radioOn = true;
+    this->reason = reason;
+    lateCounted = false;
+    stats.lastSleepTime = millis() - sleepStart;
+    stats.wakes[reason]++;
+}
+// Keeps the radio on for another POWER_IDLE_TIME ms.
+void PowerManager::keepAwake() {
+    lastActivity = millis();
+}
+bool PowerManager::isRadioOn() {
+    return radioOn;
+}
+// Share of the time the radio was on since begin(), in per mille.
+uint16_t PowerManager::getDutyCycle() {
+    if(stats.totalTime == 0) {
+        return 1000;
+    }
+    return stats.radioOnTime * 1000 / stats.totalTime;
+}
+const PowerStats &PowerManager::getStats() {
+    return stats;
+}
+
+PowerManager powerManager = PowerManager();
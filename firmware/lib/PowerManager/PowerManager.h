@@ -0,0 +1,60 @@
+#ifndef _POWERMANAGER_h   /* Include guard */
+#define _POWERMANAGER_h
+
+#include <Arduino.h>
+
+#define POWER_WAKE_AHEAD 5000           // The radio is woken this long before the next network job is due, to connect first (ms).
+#define POWER_MIN_SLEEP 20000           // The radio is only turned off if the next network job is due later than this (ms).
+#define POWER_IDLE_TIME 10000           // The radio stays on at least this long after it was woken, a touch or a push (ms).
+
+enum WakeReason : uint8_t {
+    WAKE_SCHEDULE = 0,      // A network job is about to be due.
+    WAKE_TOUCH,             // The touch button, the user may look at fetched data.
+    WAKE_NEEDED,            // Something needs the network all the time (MQTT, live view, portal, NTP) or power saving was turned off.
+    WAKE_REASONS
+};
+
+struct PowerStats {
+    uint32_t sleeps;
+    uint32_t wakes[WAKE_REASONS];
+    uint32_t late;              // Scheduled wakes that were not connected yet when the job was due.
+    uint32_t lastSleepTime;     // How long the radio was off the last time (ms).
+    uint64_t radioOnTime;       // Time the radio was on since begin() (ms).
+    uint64_t totalTime;
+};
+
+/*                                                                          *
+ *  Turns the radio off (forced modem sleep) between the network jobs,      *
+ *  the tubes, the RTC and the button keep running. tick() is driven by     *
+ *  the 1 Hz interrupt of the RTC: it wakes the radio POWER_WAKE_AHEAD ms   *
+ *  before the next network job, so the data is fetched on time, and       *
+ *  turns it off again once nothing is due for a while. A touch wakes it    *
+ *  too. While the radio is off, the push API, the UDP frames and the       *
+ *  live view can't be reached, so it is only used if power saving is      *
+ *  enabled.                                                                *
+ *                                                                          */
+class PowerManager {
+    bool enabled = false;
+    bool radioOn = true;
+    bool lateCounted = false;
+    WakeReason reason = WAKE_NEEDED;
+    uint32_t lastTick = 0;
+    uint32_t lastActivity = 0;
+    uint32_t sleepStart = 0;
+    PowerStats stats = {};
+    void sleep();
+public:
+    PowerManager();
+    void begin();
+    void setEnabled(bool enabled);
+    void tick(uint32_t untilNetwork, bool networkNeeded);
+    void wake(WakeReason reason);
+    void keepAwake();
+    bool isRadioOn();
+    uint16_t getDutyCycle();
+    const PowerStats &getStats();
+};
+
+extern PowerManager powerManager;
+
+#endif // _POWERMANAGER_h
@@ -0,0 +1,284 @@
+#include "PushServer.h"
+#include <Logger.h>
+
+// Complete HTTP responses, so answering a request is a single copy from flash.
+static const char responseOk[] PROGMEM =
+    "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 3\r\nConnection: close\r\n\r\nOK\n";
+static const char responseBadRequest[] PROGMEM =
+    "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\nContent-Length: 12\r\nConnection: close\r\n\r\nBad request\n";
+static const char responseNotFound[] PROGMEM =
+    "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\nConnection: close\r\n\r\nNot found\n";
+static const char responseBusy[] PROGMEM =
+    "HTTP/1.1 503 Service Unavailable\r\nContent-Type: text/plain\r\nContent-Length: 5\r\nConnection: close\r\n\r\nBusy\n";
+static const char responseNotImplemented[] PROGMEM =
+    "HTTP/1.1 501 Not Implemented\r\nContent-Type: text/plain\r\nContent-Length: 16\r\nConnection: close\r\n\r\nNot implemented\n";
+
+static bool pathIs(const char *path, size_t length, const char *name) {
+    return length == strlen(name) && memcmp(path, name, length) == 0;
+}
+PushServer::PushServer() {
+}
+void PushServer::begin(uint16_t port) {
+    if(server != NULL) {
+        return;
+    }
+    server = new AsyncServer(port);
+    server->onClient(onClient, this);
+    server->begin();
+    LOG_INFO(LOG_NET, "PushServer: Listening on port %u.", port);
+}
+// Serves GET <path> with the data of read(). The path must stay valid, it isn't copied.
+bool PushServer::addDownload(const char *path, const char *contentType, PushReader read) {
+    if(downloadCount >= PUSH_DOWNLOADS) {
+        return false;
+    }
+    downloads[downloadCount++] = {path, contentType, read};
+    return true;
+}
+void PushServer::onClient(void *arg, AsyncClient *client) {
+    client->setRxTimeout(PUSH_RX_TIMEOUT);
+    client->setNoDelay(true);   // The response is sent at once, instead of waiting for more data to fill the segment.
+    client->onData(onData, arg);
+    client->onDisconnect(onDisconnect, arg);
+}
+void PushServer::onDisconnect(void *arg, AsyncClient *client) {
+    PushServer *self = (PushServer *)arg;
+    if(client == self->downloadClient) {
+        self->downloadClient = NULL;
+    }
+    PushPending *pending = self->findPending(client);
+    if(pending != NULL) {
+        pending->client = NULL;
+    }
+    delete client;
+}
+void PushServer::onData(void *arg, AsyncClient *client, void *data, size_t len) {
+    PushServer *self = (PushServer *)arg;
+    if(client == self->downloadClient) {
+        return;     // Headers of the download request, it was answered already.
+    }
+    self->receive(client, (const char *)data, len);
+}
+/*                                                                          *
+ *  Finds the end of the request line. If it is in the first segment, the   *
+ *  line is parsed where it is, otherwise the segments are copied until     *
+ *  the '\n' arrives. A client is answered and closed after its request     *
+ *  line, so the segments after it are never seen.                          *
+ *                                                                          */
+void PushServer::receive(AsyncClient *client, const char *data, size_t len) {
+    PushPending *pending = findPending(client);
+    const char *lineEnd = (const char *)memchr(data, '\n', len);
+    if(pending == NULL && lineEnd != NULL) {
+        handleLine(client, data, lineEnd - data);
+        return;
+    }
+    if(pending == NULL) {
+        pending = findPending(NULL);
+        if(pending == NULL) {
+            stats.rejected++;
+            respond(client, responseBusy);
+            return;
+        }
+        pending->client = client;
+        pending->length = 0;
+    }
+    size_t length = lineEnd != NULL ? lineEnd - data : len;
+    if(pending->length + length > PUSH_LINE_LENGTH) {
+        pending->client = NULL;
+        stats.rejected++;
+        respond(client, responseBadRequest);
+        return;
+    }
+    memcpy(pending->line + pending->length, data, length);
+    pending->length += length;
+    if(lineEnd != NULL) {
+        pending->client = NULL;     // Free again, the line is parsed before this returns.
+        handleLine(client, pending->line, pending->length);
+    }
+}
+PushPending *PushServer::findPending(AsyncClient *client) {
+    for(uint8_t i = 0; i < PUSH_PENDING; i++) {
+        if(pending[i].client == client) {
+            return &pending[i];
+        }
+    }
+    return NULL;
+}
+// Answers one complete request line, without the '\n'.
+void PushServer::handleLine(AsyncClient *client, const char *line, size_t len) {
+    unsigned long start = micros();
+    handleRequest(client, line, len);
+    stats.lastParseTime = micros() - start;
+    if(stats.lastParseTime > stats.maxParseTime) {
+        stats.maxParseTime = stats.lastParseTime;
+    }
+    stats.requests++;
+}
+/*                                                                          *
+ *  Parses the request line "<METHOD> <path>?<query> HTTP/1.x" in place.    *
+ *  The headers and the body are ignored, the parameters are always taken   *
+ *  from the query, for GET and POST alike.                                 *
+ *                                                                          */
+void PushServer::handleRequest(AsyncClient *client, const char *request, size_t len) {
+    const char *end = request + len;
+    const char *path = (const char *)memchr(request, ' ', len);
+    if(path == NULL || !((path - request == 3 && memcmp(request, "GET", 3) == 0) || (path - request == 4 && memcmp(request, "POST", 4) == 0))) {
+        stats.rejected++;
+        respond(client, responseBadRequest);
+        return;
+    }
+    path++;
+    const char *target = (const char *)memchr(path, ' ', end - path);
+    if(target == NULL) {
+        stats.rejected++;
+        respond(client, responseBadRequest);
+        return;
+    }
+    const char *query = (const char *)memchr(path, '?', target - path);
+    size_t pathLength = (query != NULL ? query : target) - path;
+    query = query != NULL ? query + 1 : target;
+
+    size_t length;
+    const char *parameter;
+    if(pathIs(path, pathLength, "/value")) {
+        parameter = findParameter(query, target, 'v', &length);
+        if(parameter == NULL || length == 0 || length > PUSH_VALUE_LENGTH || !Nixie::isNumber(parameter, length)) {
+            stats.rejected++;
+            respond(client, responseBadRequest);
+            return;
+        }
+        memcpy(value, parameter, length);
+        value[length] = '\0';
+        valueUpdated = true;
+    } else if(pathIs(path, pathLength, "/slot")) {
+        parameter = findParameter(query, target, 'n', &length);
+        if(parameter == NULL || length == 0 || length > 2 || !isdigit(parameter[0]) || (length == 2 && !isdigit(parameter[1]))) {
+            stats.rejected++;
+            respond(client, responseBadRequest);
+            return;
+        }
+        requestedSlot = length == 2 ? (parameter[0] - '0') * 10 + parameter[1] - '0' : parameter[0] - '0';
+    } else if(pathIs(path, pathLength, "/animation")) {
+        parameter = findParameter(query, target, 'v', &length);
+        if(parameter == NULL || length != 1 || (parameter[0] != '0' && parameter[0] != '1')) {
+            stats.rejected++;
+            respond(client, responseBadRequest);
+            return;
+        }
+        requestedAnimation = parameter[0] - '0';
+    } else if(pathIs(path, pathLength, "/brightness")) {
+        // The anode supply of the tubes is fixed, there is nothing to dim.
+        respond(client, responseNotImplemented);
+        return;
+    } else {
+        for(uint8_t i = 0; i < downloadCount; i++) {
+            if(pathIs(path, pathLength, downloads[i].path)) {
+                startDownload(client, downloads[i]);
+                return;
+            }
+        }
+        stats.rejected++;
+        respond(client, responseNotFound);
+        return;
+    }
+    respond(client, responseOk);
+}
+/*                                                                          *
+ *  Sends the headers and the first chunks of a download. The rest is sent  *
+ *  from onAck(), so only a few chunks are in memory at any time. Without   *
+ *  a Content-Length, the end of the data is when the connection closes.    *
+ *                                                                          */
+void PushServer::startDownload(AsyncClient *client, const PushDownload &download) {
+    if(downloadClient != NULL) {
+        respond(client, responseBusy);
+        return;
+    }
+    char header[128];
+    int length = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nConnection: close\r\n\r\n", download.contentType);
+    downloadClient = client;
+    this->download = &download;
+    downloadOffset = 0;
+    stats.downloads++;
+    client->onAck(onAck, this);
+    client->add(header, min((size_t)max(length, 0), sizeof(header) - 1));
+    sendDownload();
+}
+void PushServer::onAck(void *arg, AsyncClient *client, size_t len, uint32_t time) {
+    PushServer *self = (PushServer *)arg;
+    if(client == self->downloadClient) {
+        self->sendDownload();
+    }
+}
+// Queues as many chunks as the send buffer of the connection takes, and closes it after the last one.
+void PushServer::sendDownload() {
+    uint8_t buffer[PUSH_CHUNK_SIZE];
+    while(downloadClient->space() >= PUSH_CHUNK_SIZE) {
+        size_t length = download->read(downloadOffset, buffer, sizeof(buffer));
+        if(length == 0) {
+            downloadClient->send();
+            downloadClient->close();
+            downloadClient = NULL;
+            return;
+        }
+        downloadClient->add((const char *)buffer, length);
+        downloadOffset += length;
+        stats.downloadedBytes += length;
+    }
+    downloadClient->send();
+}
+/*                                                                      *
+ *  Finds the one letter parameter in the query "a=1&b=2". Returns a    *
+ *  pointer to its value in the receive buffer and its length, or NULL  *
+ *  if the parameter is missing.                                        *
+ *                                                                      */
+const char *PushServer::findParameter(const char *query, const char *end, char name, size_t *length) {
+    for(const char *p = query; p + 1 < end; p++) {
+        if((p == query || p[-1] == '&') && p[0] == name && p[1] == '=') {
+            const char *value = p + 2;
+            const char *valueEnd = (const char *)memchr(value, '&', end - value);
+            *length = (valueEnd != NULL ? valueEnd : end) - value;
+            return value;
+        }
+    }
+    return NULL;
+}
+void PushServer::respond(AsyncClient *client, const char *response) {
+    char buffer[128];
+    size_t length = min(strlen_P(response), sizeof(buffer));
+    memcpy_P(buffer, response, length);
+    client->write(buffer, length);
+    client->close();
+}
+bool PushServer::hasValue() {
+    return value[0] != '\0';
+}
+const char *PushServer::getValue() {
+    return value;
+}
+/*                                                      *
+ *  Returns true once for every newly pushed value.     *
+ *                                                      */
+bool PushServer::takeValue() {
+    bool updated = valueUpdated;
+    valueUpdated = false;
+    return updated;
+}
+/*                                                          *
+ *  Returns the slot requested with /slot, or -1 if there   *
+ *  was no new request.                                     *
+ *                                                          */
+int8_t PushServer::takeSlot() {
+    int8_t slot = requestedSlot;
+    requestedSlot = -1;
+    return slot;
+}
+int8_t PushServer::takeAnimation() {
+    int8_t animation = requestedAnimation;
+    requestedAnimation = -1;
+    return animation;
+}
+const PushStats &PushServer::getStats() {
+    return stats;
+}
+
+PushServer pushServer = PushServer();
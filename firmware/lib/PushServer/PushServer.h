@@ -0,0 +1,98 @@
+#ifndef _PUSHSERVER_h   /* Include guard */
+#define _PUSHSERVER_h
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+#include <nixie.h>
+
+#define PUSH_SERVER_PORT 8080       // Port 80 is left to the WiFiManager config portal.
+#define PUSH_VALUE_LENGTH 15        // Longest value that can be pushed, without the terminating null.
+#define PUSH_RX_TIMEOUT 3           // A client that does not send its request within this many seconds is dropped.
+#define PUSH_DOWNLOADS 2            // Paths that stream data out, e.g. the event log.
+#define PUSH_CHUNK_SIZE 512         // Bytes of a download that are read and queued at once.
+#define PUSH_LINE_LENGTH 96         // Longest request line that is split across segments, the rest is parsed in place.
+#define PUSH_PENDING 2              // Request lines that can be waiting for their next segment at the same time.
+
+// Reads the bytes of a download from the given offset, returns how many there were, 0 at the end.
+typedef size_t (*PushReader)(uint32_t offset, uint8_t *buffer, size_t length);
+
+struct PushDownload {
+    const char *path;
+    const char *contentType;
+    PushReader read;
+};
+
+// Start of a request line that didn't fit into one segment, kept until its '\n' arrives.
+struct PushPending {
+    AsyncClient *client;
+    uint8_t length;
+    char line[PUSH_LINE_LENGTH];
+};
+
+struct PushStats {
+    uint32_t requests;
+    uint32_t rejected;          // Requests with an unknown path or an invalid parameter.
+    uint32_t lastParseTime;     // Time from the arrival of the request to the queued response (us).
+    uint32_t maxParseTime;
+    uint32_t downloads;
+    uint32_t downloadedBytes;
+};
+
+/*                                                                          *
+ *  Small HTTP server that lets other devices on the local network push     *
+ *  values to the tubes, instead of NixieTap pulling them from the web.     *
+ *                                                                          *
+ *  GET or POST /value?v=<number>     Shows the number in the push slot.    *
+ *  GET or POST /slot?n=<index>       Moves the display to the given slot.  *
+ *  GET or POST /animation?v=<0|1>    Rolls the digits on the next change.  *
+ *  GET or POST /brightness           Not implemented, there is no dimming. *
+ *  GET <path> of addDownload()       Streams the data, as the client       *
+ *                                    acknowledges it. One at a time.       *
+ *                                                                          *
+ *  Requests are parsed in the receive buffer without copying it, and all   *
+ *  of the responses are serialized at compile time. Only a request line    *
+ *  that is split across TCP segments is copied, until its end arrives.     *
+ *  The headers are ignored, whatever segments they come in. The callbacks  *
+ *  between two passes of loop(), so they only store what was requested     *
+ *  and loop() applies it with the take...() functions.                     *
+ *                                                                          */
+class PushServer {
+    AsyncServer *server = NULL;
+    char value[PUSH_VALUE_LENGTH + 1] = "";
+    bool valueUpdated = false;
+    int8_t requestedSlot = -1;
+    int8_t requestedAnimation = -1;
+    PushStats stats = {};
+    PushDownload downloads[PUSH_DOWNLOADS];
+    uint8_t downloadCount = 0;
+    AsyncClient *downloadClient = NULL;     // Client of the download in progress.
+    const PushDownload *download = NULL;
+    uint32_t downloadOffset = 0;
+    PushPending pending[PUSH_PENDING] = {};
+    static void onClient(void *arg, AsyncClient *client);
+    static void onData(void *arg, AsyncClient *client, void *data, size_t len);
+    static void onAck(void *arg, AsyncClient *client, size_t len, uint32_t time);
+    static void onDisconnect(void *arg, AsyncClient *client);
+    void receive(AsyncClient *client, const char *data, size_t len);
+    PushPending *findPending(AsyncClient *client);
+    void handleLine(AsyncClient *client, const char *line, size_t len);
+    void handleRequest(AsyncClient *client, const char *request, size_t len);
+    static const char *findParameter(const char *query, const char *end, char name, size_t *length);
+    static void respond(AsyncClient *client, const char *response);
+    void startDownload(AsyncClient *client, const PushDownload &download);
+    void sendDownload();
+public:
+    PushServer();
+    void begin(uint16_t port = PUSH_SERVER_PORT);
+    bool addDownload(const char *path, const char *contentType, PushReader read);
+    bool hasValue();
+    const char *getValue();
+    bool takeValue();
+    int8_t takeSlot();
+    int8_t takeAnimation();
+    const PushStats &getStats();
+};
+
+extern PushServer pushServer;
+
+#endif // _PUSHSERVER_h
@@ -0,0 +1,197 @@
+#include "SerialLink.h"
+
+SerialLink::SerialLink() {
+}
+void SerialLink::begin(unsigned long baud) {
+    Serial.setRxBufferSize(SERIAL_RX_BUFFER);
+    Serial.begin(baud);
+}
+void SerialLink::onLine(SerialLineHandler handler) {
+    lineHandler = handler;
+}
+void SerialLink::onFrame(SerialFrameHandler handler) {
+    frameHandler = handler;
+}
+/*                                                                          *
+ *  Reads the bytes that have already arrived, it never waits for more.     *
+ *  A partial line or frame is kept until the rest of it arrives. Text is   *
+ *  edited as it is typed: backspace removes the last character, Ctrl+C     *
+ *  discards the line and escape sequences are ignored.                     *
+ *                                                                          */
+void SerialLink::poll() {
+    if(inFrame && afterFrame && frameLength > 0 && millis() - frameStart >= SERIAL_TEXT_TIMEOUT) {
+        // No frame followed the last one, the bytes were typed. What didn't fit into the frame buffer is lost.
+        inFrame = false;
+        for(uint8_t i = 0; i < frameLength; i++) {
+            receiveText(frame[i]);
+        }
+        frameLength = 0;
+        frameOverflow = false;
+    }
+    for(uint16_t budget = SERIAL_POLL_BUDGET; budget > 0 && Serial.available() > 0; budget--) {
+        uint8_t c = Serial.read();
+        if(c == 0x00) {
+            // A delimiter ends the frame in progress and starts the next one.
+            if(inFrame && frameLength > 0) {
+                receiveFrame();
+                afterFrame = true;
+            } else {
+                afterFrame = false;
+            }
+            inFrame = true;
+            frameLength = 0;
+            frameOverflow = false;
+            lineLength = 0;     // A frame in the middle of a line means the line was cut.
+            escape = SERIAL_ESCAPE_NONE;
+            continue;
+        }
+        if(inFrame) {
+            if(frameLength == 0) {
+                frameStart = millis();
+            }
+            if(frameLength < SERIAL_FRAME_LENGTH) {
+                frame[frameLength++] = c;
+            } else {
+                frameOverflow = true;
+            }
+            continue;
+        }
+        receiveText(c);
+    }
+}
+void SerialLink::receiveText(uint8_t c) {
+    if(escape != SERIAL_ESCAPE_NONE) {
+        // Escape sequences, like the arrow keys of a terminal, are skipped.
+        if(escape == SERIAL_ESCAPE_START && c == '[') {
+            escape = SERIAL_ESCAPE_CSI;
+        } else if(escape == SERIAL_ESCAPE_START || (c >= 0x40 && c <= 0x7E)) {
+            escape = SERIAL_ESCAPE_NONE;
+        }
+        return;
+    }
+    if(c == '\n') {
+        if(lineOverflow) {
+            stats.overflows++;
+        } else if(lineLength > 0) {
+            line[lineLength] = '\0';
+            stats.lines++;
+            if(lineHandler != NULL) {
+                lineHandler(line);
+            }
+        }
+        lineLength = 0;
+        lineOverflow = false;
+    } else if(c == '\b' || c == 0x7F) {
+        if(lineLength > 0 && !lineOverflow) lineLength--;
+    } else if(c == 0x03) {
+        // Ctrl+C discards the line.
+        lineLength = 0;
+        lineOverflow = false;
+    } else if(c == 0x1B) {
+        escape = SERIAL_ESCAPE_START;
+    } else if(c != '\r') {
+        if(lineLength < SERIAL_LINE_LENGTH - 1) {
+            line[lineLength++] = c;
+        } else {
+            lineOverflow = true;
+        }
+    }
+}
+void SerialLink::receiveFrame() {
+    uint8_t decoded[SERIAL_FRAME_LENGTH];
+    size_t length = frameOverflow ? 0 : cobsDecode(frame, frameLength, decoded);
+    if(length < 3) {
+        stats.framingErrors++;
+        return;
+    }
+    uint16_t crc = decoded[length - 2] | (decoded[length - 1] << 8);
+    if(crc != crc16(decoded, length - 2)) {
+        stats.crcErrors++;
+        return;
+    }
+    stats.frames++;
+    if(frameHandler != NULL) {
+        frameHandler(decoded[0], decoded + 1, length - 3);
+    }
+}
+/*                                                              *
+ *  Sends a frame to the host. Returns false if the payload     *
+ *  does not fit into one frame.                                *
+ *                                                              */
+bool SerialLink::sendFrame(uint8_t type, const uint8_t *payload, size_t length) {
+    uint8_t raw[SERIAL_FRAME_LENGTH];
+    uint8_t encoded[SERIAL_FRAME_LENGTH + SERIAL_FRAME_LENGTH / 254 + 3];
+    if(length + 3 > SERIAL_FRAME_LENGTH) {
+        return false;
+    }
+    raw[0] = type;
+    memcpy(raw + 1, payload, length);
+    uint16_t crc = crc16(raw, length + 1);
+    raw[length + 1] = crc;
+    raw[length + 2] = crc >> 8;
+    encoded[0] = 0x00;
+    size_t encodedLength = cobsEncode(raw, length + 3, encoded + 1);
+    encoded[encodedLength + 1] = 0x00;
+    Serial.write(encoded, encodedLength + 2);
+    return true;
+}
+const SerialLinkStats &SerialLink::getStats() {
+    return stats;
+}
+// CRC-16/CCITT-FALSE, polynomial 0x1021, initial value 0xFFFF.
+uint16_t SerialLink::crc16(const uint8_t *data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for(size_t i = 0; i < length; i++) {
+        crc ^= data[i] << 8;
+        for(uint8_t bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+/*                                                                          *
+ *  Consistent Overhead Byte Stuffing. The output has no 0x00 bytes and     *
+ *  is at most one byte per started 254 bytes longer than the input.        *
+ *                                                                          */
+size_t SerialLink::cobsEncode(const uint8_t *data, size_t length, uint8_t *output) {
+    size_t codeIndex = 0, written = 1;
+    uint8_t code = 1;
+    for(size_t i = 0; i < length; i++) {
+        if(data[i] == 0x00) {
+            output[codeIndex] = code;
+            codeIndex = written++;
+            code = 1;
+            continue;
+        }
+        output[written++] = data[i];
+        if(++code == 0xFF) {
+            output[codeIndex] = code;
+            codeIndex = written++;
+            code = 1;
+        }
+    }
+    output[codeIndex] = code;
+    return written;
+}
+/*                                                              *
+ *  Reverses cobsEncode(). Returns the decoded length, or 0 if  *
+ *  the data is not valid COBS.                                 *
+ *                                                              */
+size_t SerialLink::cobsDecode(const uint8_t *data, size_t length, uint8_t *output) {
+    size_t read = 0, written = 0;
+    while(read < length) {
+        uint8_t code = data[read++];
+        if(code == 0x00 || read + code - 1 > length) {
+            return 0;
+        }
+        for(uint8_t i = 1; i < code; i++) {
+            output[written++] = data[read++];
+        }
+        if(code != 0xFF && read < length) {
+            output[written++] = 0x00;
+        }
+    }
+    return written;
+}
+
+SerialLink serialLink = SerialLink();
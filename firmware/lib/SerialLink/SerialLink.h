@@ -0,0 +1,81 @@
+#ifndef _SERIALLINK_h   /* Include guard */
+#define _SERIALLINK_h
+
+#include <Arduino.h>
+
+#define SERIAL_BAUD 921600
+#define SERIAL_RX_BUFFER 1024       // Holds about 10 ms of data at full speed, while loop() is busy.
+#define SERIAL_LINE_LENGTH 96       // Longest text command, including the terminating null.
+#define SERIAL_FRAME_LENGTH 64      // Longest encoded frame, without the delimiters.
+#define SERIAL_POLL_BUDGET 256      // Bytes processed per call of poll(), so loop() is never held up for long.
+#define SERIAL_TEXT_TIMEOUT 50      // Bytes after a frame that no 0x00 closes within this time are text (ms).
+
+#define SERIAL_FRAME_DISPLAY 'F'    // Payload is a FrameReceiver packet.
+#define SERIAL_FRAME_COMMAND 'C'    // Payload is a text command, without the line ending.
+#define SERIAL_FRAME_STATS 'S'      // Request for the statistics, answered with an 'S' frame.
+
+#define SERIAL_ESCAPE_NONE 0
+#define SERIAL_ESCAPE_START 1       // ESC received.
+#define SERIAL_ESCAPE_CSI 2         // "ESC [" received, the sequence ends with a byte from 0x40 to 0x7E.
+
+// Called with a complete text line, without "\r\n".
+typedef void (*SerialLineHandler)(const char *line);
+// Called with a frame that has passed the CRC check.
+typedef void (*SerialFrameHandler)(uint8_t type, const uint8_t *payload, size_t length);
+
+struct SerialLinkStats {
+    uint32_t frames;
+    uint32_t crcErrors;
+    uint32_t framingErrors;     // Frames that were too long or not valid COBS.
+    uint32_t lines;
+    uint32_t overflows;         // Text lines that were too long and were dropped.
+};
+
+/*                                                                          *
+ *  Non-blocking serial protocol. Text commands and binary frames share     *
+ *  the port:                                                               *
+ *                                                                          *
+ *  text    "<command>\n", "\r" before the "\n" is ignored                  *
+ *  frame   0x00, COBS(<type> <payload> <CRC16 little endian>), 0x00        *
+ *                                                                          *
+ *  COBS removes every 0x00 from the frame, so 0x00 always marks the start  *
+ *  and the end of a frame and a lost byte only costs one frame. The 0x00   *
+ *  that ends a frame also starts the next one, so back-to-back frames      *
+ *  need only one 0x00 between them, two work as well. If no 0x00 follows   *
+ *  within SERIAL_TEXT_TIMEOUT, the bytes after a frame are taken as text,  *
+ *  a command typed after a stream isn't lost. The CRC is CRC-16/CCITT-     *
+ *  FALSE over the type and the payload. Frames are sent back to the host   *
+ *  in the same way.                                                        *
+ *                                                                          */
+class SerialLink {
+    char line[SERIAL_LINE_LENGTH];
+    uint8_t lineLength = 0;
+    bool lineOverflow = false;
+    uint8_t escape = SERIAL_ESCAPE_NONE;
+    uint8_t frame[SERIAL_FRAME_LENGTH];
+    uint8_t frameLength = 0;
+    bool inFrame = false;
+    bool frameOverflow = false;
+    bool afterFrame = false;    // The frame was started by the 0x00 that ended the previous one, it may be text.
+    uint32_t frameStart = 0;    // millis() of its first byte.
+    SerialLineHandler lineHandler = NULL;
+    SerialFrameHandler frameHandler = NULL;
+    SerialLinkStats stats = {};
+    void receiveFrame();
+    void receiveText(uint8_t c);
+public:
+    SerialLink();
+    void begin(unsigned long baud = SERIAL_BAUD);
+    void onLine(SerialLineHandler handler);
+    void onFrame(SerialFrameHandler handler);
+    void poll();
+    bool sendFrame(uint8_t type, const uint8_t *payload, size_t length);
+    const SerialLinkStats &getStats();
+    static uint16_t crc16(const uint8_t *data, size_t length);
+    static size_t cobsEncode(const uint8_t *data, size_t length, uint8_t *output);
+    static size_t cobsDecode(const uint8_t *data, size_t length, uint8_t *output);
+};
+
+extern SerialLink serialLink;
+
+#endif // _SERIALLINK_h
@@ -0,0 +1,100 @@
+#include "SerialShell.h"
+
+SerialShell::SerialShell() {
+}
+/*                                                                          *
+ *  Runs one line of input. Returns false if the line was rejected or the   *
+ *  command is unknown, the reason is printed to out.                       *
+ *                                                                          */
+bool SerialShell::execute(const char *input, size_t length, Print &out) {
+    if(length >= SHELL_LINE_LENGTH) {
+        stats.rejected++;
+        out.println("Command is too long.");
+        return false;
+    }
+    for(size_t i = 0; i < length; i++) {
+        char c = input[i];
+        if(c == '\t') {
+            c = ' ';
+        } else if((uint8_t)c < 0x20 || c == 0x7F) {
+            stats.rejected++;
+            out.println("Command contains invalid characters.");
+            return false;
+        }
+        line[i] = c;
+    }
+    line[length] = '\0';
+
+    uint32_t start = micros();
+    char *argv[SHELL_MAX_ARGS + 1];
+    uint8_t argc = split(line, argv, 2);     // The name and the rest of the line.
+    if(argc == 0) {
+        return true;    // Empty line.
+    }
+    for(uint8_t i = 0; i < commandCount; i++) {
+        const ShellCommand &command = commands[i];
+        if(strcmp(argv[0], command.name) != 0) {
+            continue;
+        }
+        char *arguments = argv[1];
+        uint8_t maxArgs = command.maxArgs < SHELL_MAX_ARGS ? command.maxArgs : SHELL_MAX_ARGS - 1;
+        argc = 1 + (arguments != NULL ? split(arguments, argv + 1, maxArgs) : 0);
+        if(argc - 1 < command.minArgs || (maxArgs == 0 && arguments != NULL)) {
+            stats.unknown++;
+            out.printf("Usage: %s %s\n", command.name, command.usage);
+            return false;
+        }
+        command.run(out, argc, argv);
+        stats.commands++;
+        stats.lastRunTime = micros() - start;
+        if(stats.lastRunTime > stats.maxRunTime) {
+            stats.maxRunTime = stats.lastRunTime;
+        }
+        return true;
+    }
+    stats.unknown++;
+    out.println("Unknown command, type help for the list of commands.");
+    return false;
+}
+void SerialShell::printHelp(Print &out) {
+    for(uint8_t i = 0; i < commandCount; i++) {
+        char usage[40];
+        snprintf(usage, sizeof(usage), "%s %s", commands[i].name, commands[i].usage);
+        out.printf("%-32s %s\n", usage, commands[i].help);
+    }
+}
+const ShellStats &SerialShell::getStats() {
+    return stats;
+}
+/*                                                                          *
+ *  Splits the line at spaces, in place. At most maxArgs arguments are      *
+ *  split off, the last one keeps the rest of the line, spaces included.    *
+ *  Unused entries of argv are set to NULL, so argv must have room for      *
+ *  maxArgs + 1 entries.                                                    *
+ *                                                                          */
+uint8_t SerialShell::split(char *line, char **argv, uint8_t maxArgs) {
+    uint8_t argc = 0;
+    while(argc < maxArgs) {
+        while(*line == ' ') line++;
+        if(*line == '\0') {
+            break;
+        }
+        argv[argc++] = line;
+        if(argc == maxArgs) {
+            break;
+        }
+        while(*line != ' ' && *line != '\0') line++;
+        if(*line == ' ') {
+            *line++ = '\0';
+        }
+    }
+    // The last argument may end with spaces that were not split off.
+    if(argc > 0 && argc == maxArgs) {
+        char *end = argv[argc - 1] + strlen(argv[argc - 1]);
+        while(end > argv[argc - 1] && end[-1] == ' ') *--end = '\0';
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+SerialShell serialShell = SerialShell();
@@ -0,0 +1,55 @@
+#ifndef _SERIALSHELL_h   /* Include guard */
+#define _SERIALSHELL_h
+
+#include <Arduino.h>
+
+#define SHELL_LINE_LENGTH 96        // Longest command, including the terminating null.
+#define SHELL_MAX_ARGS 4            // Command name included, the last argument keeps the rest of the line.
+
+// Runs a command, argv[0] is the name of the command. The output goes to out, so commands can be run on host as well.
+typedef void (*ShellHandler)(Print &out, uint8_t argc, char **argv);
+
+struct ShellCommand {
+    const char *name;
+    const char *usage;          // Arguments, as shown by help.
+    const char *help;
+    uint8_t minArgs;            // Arguments after the name.
+    uint8_t maxArgs;
+    ShellHandler run;
+};
+
+struct ShellStats {
+    uint32_t commands;
+    uint32_t unknown;           // Commands that are not in the table, or have a wrong number of arguments.
+    uint32_t rejected;          // Lines that are too long or contain control characters.
+    uint32_t lastRunTime;       // Time from the parsing of the line to the end of the command (us).
+    uint32_t maxRunTime;
+};
+
+/*                                                                          *
+ *  Dispatches text commands through a table of commands, usually a         *
+ *  constexpr array defined next to the functions it calls. The line is     *
+ *  copied into a static buffer and split in place, nothing is allocated.   *
+ *  The input doesn't have to be null terminated, a line that contains a    *
+ *  null or any other control character is rejected as a whole.             *
+ *                                                                          */
+class SerialShell {
+    const ShellCommand *commands = NULL;
+    uint8_t commandCount = 0;
+    char line[SHELL_LINE_LENGTH];
+    ShellStats stats = {};
+public:
+    SerialShell();
+    template<size_t N> void begin(const ShellCommand (&commands)[N]) {
+        this->commands = commands;
+        commandCount = N;
+    }
+    bool execute(const char *input, size_t length, Print &out);
+    void printHelp(Print &out);
+    const ShellStats &getStats();
+    static uint8_t split(char *line, char **argv, uint8_t maxArgs);
+};
+
+extern SerialShell serialShell;
+
+#endif // _SERIALSHELL_h
@@ -1,4 +1,6 @@
 #include "nixie.h"
+#include <Logger.h>
+#include <Metrics.h>
 
 Nixie::Nixie() {
     begin();
@@ -6,10 +8,6 @@ Nixie::Nixie() {
 
 void Nixie::begin()
 {
-    // Fire up the serial if DEBUG is defined.
-    #ifdef DEBUG
-        Serial.begin(115200);
-    #endif // DEBUG
     // Turn off the Nixie tubes. If this is not called nixies might show some random stuff on startup.
     write(11, 11, 11, 11, 0);
     // Set SPI chip select as output
@@ -85,6 +83,16 @@ void Nixie::writeLowLevel(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_
     SPI.transfer(part6);
     digitalWrite(SPI_CS, HIGH);
     SPI.endTransaction();
+    metrics.increment(frameMetric);
+    // The same state is written on every pass of loop(), only the changes are reported.
+    if(commitListener != NULL && (digit1 != committed[0] || digit2 != committed[1] || digit3 != committed[2] || digit4 != committed[3] || dots != committed[4])) {
+        commitListener(digit1, digit2, digit3, digit4, dots);
+    }
+    committed[0] = digit1;
+    committed[1] = digit2;
+    committed[2] = digit3;
+    committed[3] = digit4;
+    committed[4] = dots;
 }
 
 
@@ -121,17 +129,12 @@ void Nixie::writeNumber(String newNumber, unsigned int movingSpeed) {
         k = 0; // Reset the number position.
         oldNumber = newNumber;
         String number = newNumber;
-        #ifdef DEBUG
-            Serial.println("---------------------------------------------------------------------------------------------");
-            Serial.println("Number to display is: " + number);
-        #endif // DEBUG
+        LOG_DEBUG(LOG_DISPLAY, "Number to display is %s.", number.c_str());
         number.trim(); // Get a version of the string with any leading and trailing whitespace removed.
         if(number.startsWith("-")) {
             numIsNeg = 1;
             number.remove(0, 1); // Remove minus from string.
-            #ifdef DEBUG
-                Serial.println("Number is negative!");
-            #endif // DEBUG
+            LOG_DEBUG(LOG_DISPLAY, "Number is negative.");
         } else numIsNeg = 0;
         numberSize = number.length() + 8; // For a simplicity of showing numbers on Nixies, we add four NULL(number 10 in this case) numbers before and after the real number.
         dotPos = number.indexOf('.');
@@ -139,11 +142,7 @@ void Nixie::writeNumber(String newNumber, unsigned int movingSpeed) {
             numberSize = numberSize - 1;
             dotPos = dotPos + 4; // But we will remember the exact position where the point was.
         }
-        #ifdef DEBUG
-            Serial.println("Number after trimming: " + number);
-            Serial.printf("Size of a number(including dot(if exists) and 8 added numbers) is: %d", numberSize);
-            Serial.printf("\nDot position is(-1 = dot does not exists): %d\n", dotPos);
-        #endif // DEBUG
+        LOG_DEBUG(LOG_DISPLAY, "Number after trimming: %s, size with the 8 blanks: %d, dot position: %d", number.c_str(), numberSize, dotPos);
         for(int i = 0; i < numberSize; i++) {
             if(i >= 0 && i < 4) {
                 numberArray[i] = 10;
@@ -155,30 +154,18 @@ void Nixie::writeNumber(String newNumber, unsigned int movingSpeed) {
                         numberArray[i] = int(number.charAt(i - 3)) - 48; // this way we skip the dot place and replace it with the next number.
                     }
                 } else {
-                    #ifdef DEBUG
-                        Serial.println("Error in the function writeNumber! Reason: Given string is not a number.");
-                    #endif // DEBUG
+                    LOG_WARN(LOG_DISPLAY, "writeNumber: %s is not a number.", number.c_str());
                     break;
                 }
             } else {
                 numberArray[i] = 10;
             }  
         }
-        #ifdef DEBUG
-            Serial.println("An array of numbers is created from a string:");
-            for(int i = 0; i < numberSize; i++) {
-                Serial.printf("%d: %d\t", i + 1, numberArray[i]);
-            }
-            Serial.println();
-        #endif // DEBUG
     }
     if(k < (numberSize - 4)) { // Since we, in the function write(), display four digits at the same time, we have to make up for it by reducing nuber k.
         if(movingSpeed > 0) {
             if(millis() - previousMillis >= movingSpeed) { // Determining how fast the number will scroll.
                 previousMillis = millis();
-                #ifdef DEBUG
-                    // Serial.printf("\nNow writting this digits on Nixies: \n1. -> %d, 2. -> %d, 3. -> %d, 4. -> %d \n", numberArray[k], numberArray[k + 1], numberArray[k + 2], numberArray[k + 3]);
-                #endif // DEBUG
                 if((dotPos - k >= 0)  && (dotPos - k <= 3)) { //If the number is decimal, the decimal point will be displayed when these factors are met.
                     write(numberArray[k], numberArray[k + 1], numberArray[k + 2], numberArray[k + 3], (0b1 << (dotPos - k + 1)) | (((0b1 & numIsNeg) * ((k + 4 > 4 )&&(k + 4 < 9))) << (5 - k)));
                 } else {
@@ -188,15 +175,11 @@ void Nixie::writeNumber(String newNumber, unsigned int movingSpeed) {
             }
         } else if(movingSpeed == 0) {
             if(numberSize > 12) {
-                #ifdef DEBUG
-                    Serial.println("Number is longer than 4 digits! It can not be completely displayed on the nixie screen.");
-                #endif // DEBUG
+                LOG_WARN(LOG_DISPLAY, "writeNumber: %s is longer than 4 digits, it can't be shown without scrolling.", oldNumber.c_str());
             } else
                 write(numberArray[4], numberArray[5], numberArray[6], numberArray[7], (0b1 << (dotPos - 3)) | (0b10 * numIsNeg));
         } else {
-            #ifdef DEBUG
-                Serial.println("Wrong value of movingSpeed. Speed of movement is not recognized.");
-            #endif // DEBUG
+            LOG_WARN(LOG_DISPLAY, "writeNumber: Unknown moving speed %u.", movingSpeed);
         }
     }
     if(k >= (numberSize - 4)) k = 0;
@@ -325,7 +308,41 @@ void Nixie::antiPoison(time_t local, bool timeFormat) {
 }
 
 void Nixie::setAnimation(bool animate) {
-	animate = animate;
+	this->animate = animate;
+}
+/*                                                                      *
+ *  Checks if the text is a number writeNumber() can show, an optional  *
+ *  minus, digits and at most one decimal point.                        *
+ *                                                                      */
+bool Nixie::isNumber(const char *text, size_t length) {
+    bool digit = false, dot = false;
+    for(size_t i = 0; i < length; i++) {
+        if(text[i] >= '0' && text[i] <= '9') {
+            digit = true;
+        } else if(text[i] == '.' && !dot) {
+            dot = true;
+        } else if(!(text[i] == '-' && i == 0)) {
+            return false;
+        }
+    }
+    return digit;
+}
+void Nixie::setCommitListener(CommitListener listener) {
+	commitListener = listener;
+}
+// Metrics id that counts the frames sent over SPI, -1 for none.
+void Nixie::setFrameMetric(int8_t id) {
+	frameMetric = id;
+}
+/*                                                                      *
+ *  Writes a complete frame, used for the values streamed over UDP.     *
+ *  Digits outside 0-9 turn the tube off.                               *
+ *                                                                      */
+void Nixie::writeFrame(const NixieFrame &frame) {
+	if(frame.transition == NIXIE_TRANSITION_ROLL) animate = true;
+	write(frame.digits[0] > 9 ? 10 : frame.digits[0], frame.digits[1] > 9 ? 10 : frame.digits[1],
+		frame.digits[2] > 9 ? 10 : frame.digits[2], frame.digits[3] > 9 ? 10 : frame.digits[3], frame.dots);
+	k = 0; // Reset the number position in the writeNumber function.
 }
 
 void Nixie::write(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_t digit4, uint8_t dots)
@@ -336,7 +353,7 @@ void Nixie::write(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_t digit4
 
 	if(animate) {
 		animate=false;
-		Serial.println("animiramo");
+		LOG_DEBUG(LOG_DISPLAY, "Animating the digits.");
 		for(uint8_t i=0; i<10; i++) if(orderedDigits[i] == oldDigit4) indexM1 = i;
 		for(uint8_t i=0; i<10; i++) if(orderedDigits[i] == oldDigit3) indexM0 = i;
 		for(uint8_t i=0; i<10; i++) if(orderedDigits[i] == oldDigit2) indexH1 = i;
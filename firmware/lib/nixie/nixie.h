@@ -13,9 +13,19 @@
 #define TOUCH_BUTTON D2
 #define CONFIG_BUTTON D0
 
-#ifndef DEBUG
-    #define DEBUG
-#endif // DEBUG
+#define NIXIE_TRANSITION_CUT 0      // Digits change at once.
+#define NIXIE_TRANSITION_ROLL 1     // Digits roll through the other numbers, like after the touch button.
+
+// Called with every new state of the tubes, right after it was sent to the display.
+typedef void (*CommitListener)(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_t digit4, uint8_t dots);
+
+// Complete state of the display, it can be written without any String or heap allocation.
+struct NixieFrame {
+    uint8_t digits[4];      // H1, H0, M1, M0. 0-9, 10 is off.
+    uint8_t dots;           // Same encoding as in Nixie::write().
+    uint8_t brightness;     // Reserved, the tubes can not be dimmed.
+    uint8_t transition;     // NIXIE_TRANSITION_...
+};
 
 class Nixie {
     
@@ -42,6 +52,9 @@ class Nixie {
 	uint8_t autoPoisonDoneOnMinute = 0;
 	uint8_t oldDigit1, oldDigit2, oldDigit3, oldDigit4;
 	bool animate = false;
+	uint8_t committed[5] = {11, 11, 11, 11, 0};	// Digits and dots last sent to the display.
+	CommitListener commitListener = NULL;
+	int8_t frameMetric = -1;
 
 public:
     Nixie();
@@ -53,6 +66,10 @@ public:
     uint8_t checkDate(uint16_t y, uint8_t m, uint8_t d, uint8_t h, uint8_t mm);
 	void antiPoison(time_t local, bool timeFormat);
 	void setAnimation(bool animate);
+	void writeFrame(const NixieFrame &frame);
+	static bool isNumber(const char *text, size_t length);
+	void setCommitListener(CommitListener listener);
+	void setFrameMetric(int8_t id);
 private:
     void writeLowLevel(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_t digit4, uint8_t dots);
 
@@ -1,139 +1,354 @@
 #include <Arduino.h>
 #include <nixie.h>
 #include <NixieAPI.h>
+#include <JobScheduler.h>
+#include <DisplaySlot.h>
+#include <PushServer.h>
+#include <FrameReceiver.h>
+#include <MqttLink.h>
+#include <LiveView.h>
+#include <SerialLink.h>
+#include <SerialShell.h>
+#include <EventQueue.h>
+#include <GestureRecognizer.h>
+#include <FastConnect.h>
+#include <PowerManager.h>
+#include <Logger.h>
+#include <EventLog.h>
+#include <Metrics.h>
+#include <Config.h>
+#include <ConfigLog.h>
 #include <BQ32000RTC.h>
 #include <NtpClientLib.h> 
 #include <TimeLib.h>
 #include <WiFiManager.h> 
-#include <EEPROM.h>
-#include <Ticker.h>
-#include <map>
+#include "Shell.h"
 
-ICACHE_RAM_ATTR void irq_1Hz_int();         // Interrupt function for changing the dot state every 1 second.
-ICACHE_RAM_ATTR void touchButtonPressed();   // Interrupt function when button is pressed.
-ICACHE_RAM_ATTR void scrollDots();          // Interrupt function for scrolling dots.
+#define CRYPTO_ROTATE_INTERVAL 10   // Seconds each of the selected currencies is shown in the crypto slot.
+#define CRYPTO_STALE_AGE 300        // Prices older than this (in seconds) are shown blinking.
+#define CRYPTO_REFRESH_INTERVAL 60000       // Refresh interval of the crypto prices while they are shown (ms).
+#define CRYPTO_IDLE_INTERVAL 900000         // And while another slot is shown, 96 requests a day (ms).
+#define WEATHER_REFRESH_INTERVAL 300000     // Background refresh interval of the temperature (ms).
+#define QUOTA_SAVE_INTERVAL 3600000         // Monthly API request counters are saved at most once per hour, to spare the flash.
+#define PREFETCH_WINDOW 15000       // Data of the upcoming slots is refreshed if it would expire within this many ms.
+#define PREFETCH_SLOTS 2            // Number of upcoming enabled slots that are kept warm.
+#define MQTT_HEALTH_INTERVAL 60000  // Interval of the health messages published over MQTT (ms).
+#define LIVEVIEW_BATCH_INTERVAL 50      // Frames shown on the tubes are streamed to the live view in batches, this often (ms).
+#define LIVEVIEW_METRICS_INTERVAL 1000  // Interval of the metrics sent to the live view (ms).
+#define CONFIG_FLUSH_INTERVAL 1000      // Pending config saves are checked this often (ms).
+#define WIFI_POLL_INTERVAL 100          // The WiFi connection is checked this often (ms).
+#define PORTAL_POLL_INTERVAL 10         // The config portal serves its clients this often while it is open (ms).
+#define PORTAL_TIMEOUT 1800             // The config portal closes after this many seconds without a client.
+#define INPUT_INTERVAL 10               // The serial port, the button and the received values are polled at 100 Hz (ms).
+#define DISPLAY_INTERVAL 20             // The current slot is rendered at 50 Hz (ms).
+#define CONFIG_HOLD_TIME 3000000        // Holding the config button this long, also from power on, opens the config portal (us).
+#define PREFETCH_INTERVAL 1000          // The upcoming slots are checked for data that is about to expire this often (ms).
+#define LOG_DRAIN_INTERVAL 10           // Queued log lines are printed this often, at 921600 baud the UART FIFO empties in about 1.4 ms.
+#define EVENT_WATCH_INTERVAL 1000       // The connections and the jobs are checked for events to log this often (ms).
+#define EVENT_LOW_HEAP 4096             // Less free heap than this is logged (bytes).
+
+ICACHE_RAM_ATTR void irq_1Hz_int();         // Interrupt function of the RTC, once per second.
+ICACHE_RAM_ATTR void touchButtonPressed();   // Interrupt function when the button is touched or released.
 void processSyncEvent(NTPSyncEvent_t ntpEvent);
 void enableSecDot();
-void disableSecDot();
-void startPortalManually();    
+void startPortalManually();
+bool pollPortal(void *context);
+bool pollWifi(void *context);
+bool pollInput(void *context);
+bool renderDisplay(void *context);
+bool prefetchSlots(void *context);
 void updateParameters();
-void readParameters();
-void cryptoRefresh();
-void weatherRefresh();
+bool updateText(char *text, size_t size, const char *key);
+void readParameters(ConfigStatus status);
+bool saveApiQuota(void *context);
+bool flushConfig(void *context);
+bool drainLog(void *context);
+bool watchEvents(void *context);
+void registerMetrics();
+void collectMetrics();
+bool mqttConnect(void *context);
+bool publishHealth(void *context);
+void applyMqttConfig(const char *name, const char *value);
+void updateMqttJobs();
+bool sendLiveFrames(void *context);
+bool sendLiveMetrics(void *context);
 void updateTime();
-void readAndParseSerial();
+void updatePower();
+void handleSerialFrame(uint8_t type, const uint8_t *payload, size_t length);
 void resetEepromToDefault(); 
 void readButton();
-void firstRunInit();
+void handleEvents();
+void handleGestures();
 
 uint8_t fwVersion = 1.1;
-volatile bool dot_state = LOW;
-bool stopDef = false, secDotDef = false;
+bool dot_state = LOW;
+bool secDotDef = false;
 bool wifiFirstConnected = true;
 bool syncEventTriggered = false; // True if a time event has been triggered.
+bool portalConnect = false;      // A network was entered in the config portal, the wifi job connects to it while the portal is open.
 
-uint8_t configButton = 0;
-volatile uint8_t state = 0, dotPosition = 0b10, weatherRefreshFlag = 1, cryptoRefreshFlag = 1;
-char buttonCounter;
-uint16_t buttonPressedCounter;
-bool buttonPressed = false;
-String cryptoCurrencyPrice = "", temperature = "", loc = "";
-Ticker movingDot, priceRefresh, temperatureRefresh; // Initializing software timer interrupt called movingDot and priceRefresh.
+/*                                                                      *
+ *  Milestones of the boot, since the reset. The RTC time is shown      *
+ *  first, everything else is started after it.                         *
+ *                                                                      */
+struct BootTimes {
+    uint32_t firstFrame;    // The time from the RTC is on the tubes (us).
+    uint32_t setupDone;     // setup() returned, the jobs start running (us).
+    uint32_t networkReady;  // Connected and got an IP address (ms), 0 until then.
+};
+BootTimes bootTimes = {};
+WiFiEventHandler gotIpHandler;
+bool configButton = false;
+uint8_t state = 0;
+GestureRecognizer touchGestures;
+GestureRecognizer configGestures({GESTURE_DEBOUNCE_TIME, 0, 0, CONFIG_HOLD_TIME, 0});  // Only the long hold is used.
+String loc = "";
 NTPSyncEvent_t ntpEvent;    // Last triggered event.
 WiFiManager wifiManager;
 time_t t;
-String serialCommand = "";
 
-time_t last_temp;
-time_t last_crypto;
+/*                                                                      *
+ *  Ids of the metrics that main sets itself, the loop time when it     *
+ *  runs and the gauges when /metrics is read, see collectMetrics().    *
+ *                                                                      */
+struct MetricIds {
+    int8_t loopTime, heapFree, heapFragmentation, heapMaxBlock, rssi, wifiConnected, uptime, radioDuty, overruns;
+};
+MetricIds metricIds = {-1, -1, -1, -1, -1, -1, -1, -1, -1};
+const uint32_t loopTimeBounds[] = {50, 200, 1000, 5000, 20000, 100000, 500000, 2000000};   // us
+const uint32_t requestTimeBounds[] = {100, 250, 500, 1000, 2000, 5000, 10000};             // ms
+
+int8_t quotaJob, mqttJob, healthJob, portalJob, pushSlotIndex, frameSlotIndex, mqttSlotIndex;
 
 uint8 timeRefreshFlag;
 uint8 dateRefreshFlag;
 
 char _time[6] = "00:00";
 char date[11] = "1970-01-01";
-char SSID[50] = "NixieTap";
-char password[50] = "nixietap";
-char target_SSID[50] = "none";
-char target_pw[50] = "none";
-uint8 enable_time = 1;
-uint8 enable_date = 1;
-uint8 enable_crypto = 0;
-uint8 enable_temp = 0;
-uint8 manual_time_flag = 1;
-uint8 enable_DST = 0;
-uint8 weather_format = 0;
-uint8 enable_24h = 1;
-int16_t offset = 0;
-char weather_key[50];
-char weather_id[50];
-char crypto_key[50];
-char crypto_id[30];
-
-std::map<String, int> mem_map;
 
+/*                                                                      *
+ *  Display slots, shown one after another with the touch button.      *
+ *  To show a new kind of data, write a new DisplaySlot and add it to   *
+ *  slotRegistry in setup(), loop() does not need to be changed.        *
+ *                                                                      */
+class TimeSlot : public DisplaySlot {
+public:
+    TimeSlot() : DisplaySlot("time") {}
+    bool isEnabled() { return config.enable_time; }
+    void render(time_t frame) { nixieTap.writeTime(frame, dot_state, config.enable_24h); }
+} timeSlot;
 
-void setup() {
-    mem_map["SSID"] = 0;
-    mem_map["password"] = 50;
-    mem_map["target_ssid"] = 100;
-    mem_map["target_pw"] = 150;
-    mem_map["weather_key"] = 200;
-    mem_map["weather_format"] = 250;
-    mem_map["weather_id"] = 251;
-    mem_map["crypto_key"] = 302;
-    mem_map["crypto_id"] = 351;
-    mem_map["manual_time_flag"] = 381;
-    mem_map["enable_date"] = 382;
-    mem_map["enable_time"] = 383;
-    mem_map["enable_temp"] = 384;
-    mem_map["enable_crypto"] = 385;
-    mem_map["enable_dst"] = 386;
-    mem_map["enable_24h"] = 387;
-    mem_map["offset"] = 388;
-    mem_map["non_init"] = 500;
-    // This line prevents the ESP from making spurious WiFi networks (ESP_XXXXX)
-	WiFi.mode(WIFI_STA);
-	nixieTap.write(10,10,10,10,0b10); // progress bar 25%
+class DateSlot : public DisplaySlot {
+public:
+    DateSlot() : DisplaySlot("date") {}
+    bool isEnabled() { return config.enable_date; }
+    void render(time_t frame) { nixieTap.writeDate(frame, 1); }
+} dateSlot;
 
-    // Touch button interrupt.
-    attachInterrupt(digitalPinToInterrupt(TOUCH_BUTTON), touchButtonPressed, RISING);
+class CryptoSlot : public DisplaySlot {
+    uint8_t index = 0;          // Index of the currency currently shown.
+    time_t lastRotate = 0;
+public:
+    CryptoSlot() : DisplaySlot("crypto", CRYPTO_REFRESH_INTERVAL, 10000, CRYPTO_IDLE_INTERVAL) {}
+    bool isEnabled() { return config.enable_crypto && config.crypto_key[0] != '\0'; }
+    bool isReady() { return nixieTapAPI.getCryptoQuoteCount() > 0; }
+    bool refresh() {
+        if(WiFi.status() != WL_CONNECTED) {
+            return false;
+        }
+        nixieTapAPI.getCryptoPrices(config.crypto_key, config.crypto_id);    // One request for all of the selected currencies.
+        return true;
+    }
+    void render(time_t frame) {
+        // Rotate through the fetched currencies without any additional requests.
+        uint8_t quoteCount = nixieTapAPI.getCryptoQuoteCount();
+        if(frame - lastRotate >= CRYPTO_ROTATE_INTERVAL) {
+            lastRotate = frame;
+            index++;
+        }
+        if(index >= quoteCount) index = 0;
+        // A price that is too old (or was never fetched) blinks with the second dot, so it is not mistaken for a fresh one.
+        time_t age = nixieTapAPI.getCryptoQuoteAge(index);
+        if((age < 0 || age >= CRYPTO_STALE_AGE) && !dot_state) {
+            nixieTap.write(10, 10, 10, 10, 0);
+        } else {
+            nixieTap.writeNumber(nixieTapAPI.getCryptoQuote(index).price, 250);
+        }
+    }
+} cryptoSlot;
 
+class WeatherSlot : public DisplaySlot {
+    String temperature = "";
+public:
+    WeatherSlot() : DisplaySlot("weather", WEATHER_REFRESH_INTERVAL, 30000) {}
+    bool isEnabled() { return config.enable_temp && config.weather_key[0] != '\0'; }
+    bool isReady() { return temperature != ""; }
+    bool refresh() {
+        if(WiFi.status() != WL_CONNECTED) {
+            return false;
+        }
+        temperature = nixieTapAPI.getTempAtMyLocation(config.weather_id, config.weather_format);
+        return true;
+    }
+    void render(time_t frame) { nixieTap.writeNumber(temperature, 0); }
+} weatherSlot;
+
+// Shows the last value pushed to the PushServer, it stays hidden until the first value arrives.
+class PushSlot : public DisplaySlot {
+public:
+    PushSlot() : DisplaySlot("push") {}
+    bool isEnabled() { return pushServer.hasValue(); }
+    void render(time_t frame) { nixieTap.writeNumber(pushServer.getValue(), 0); }
+} pushSlot;
 
-    if(digitalRead(CONFIG_BUTTON)) {
-		delay(5000);
-		Serial.println("NIXIE TAP");
-		Serial.print("Firmware version: ");
-		Serial.println(fwVersion);
-	}
+// Shows the last frame streamed to the FrameReceiver, it stays hidden until the first frame arrives.
+class FrameSlot : public DisplaySlot {
+    NixieFrame frame = {};
+    bool received = false;
+    bool fresh = false;         // Not written to the tubes yet.
+public:
+    FrameSlot() : DisplaySlot("frame") {}
+    bool isEnabled() { return received; }
+    void update(const NixieFrame &newFrame) {
+        frame = newFrame;
+        received = true;
+        fresh = true;
+    }
+    void render(time_t frame) {
+        nixieTap.writeFrame(this->frame);
+        this->frame.transition = NIXIE_TRANSITION_CUT;  // The transition is played only once, when the frame is new.
+        if(fresh) {
+            fresh = false;
+            frameReceiver.countApplied();   // Only the first write, the display job repeats the frame until the next one.
+        }
+    }
+} frameSlot;
 
-	nixieTap.write(10,10,10,10,0b110); // progress bar 50%
+// Shows the last value received on the <base>/value MQTT topic, it stays hidden until the first value arrives.
+class MqttSlot : public DisplaySlot {
+public:
+    MqttSlot() : DisplaySlot("mqtt") {}
+    bool isEnabled() { return mqttLink.hasValue(); }
+    void render(time_t frame) { nixieTap.writeNumber(mqttLink.getValue(), 0); }
+} mqttSlot;
 
-	firstRunInit(); 
-    readParameters();           // Read all stored parameters from EEPROM.
 
-	nixieTap.write(10,10,10,10,0b1110); // progress bar 75%
 
+void setup() {
+    // The RTC time is painted first, only the format comes from the config, which is a short read from the flash.
     setSyncProvider(RTC.get);   // the function to get the time from the RTC
+    ConfigStatus configStatus = config.load();
+    nixieTap.writeTime(now(), dot_state, config.enable_24h);
+    bootTimes.firstFrame = micros();
+    // A sector erase and write, only now that the time is shown.
+    if(configStatus == CONFIG_MIGRATED || configStatus == CONFIG_EMPTY) {
+        config.flush(true);
+    }
+    // What the previous run left in the RTC memory goes to the flash, before anything new is recorded.
+    eventLog.begin(fwVersion);
+
+    // This line prevents the ESP from making spurious WiFi networks (ESP_XXXXX). The connection is made in the background.
+    gotIpHandler = WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP &event) {
+        if(bootTimes.networkReady == 0) bootTimes.networkReady = millis();
+    });
+	WiFi.mode(WIFI_STA);
+    fastConnect.begin(config.target_ssid, config.target_pw, config.wifi_lease);
+    fastConnect.connect();
+
+    serialLink.begin();
+    beginShell();
+    serialLink.onLine([](const char *line) { serialShell.execute(line, strlen(line), Serial); });
+    serialLink.onFrame(handleSerialFrame);
+
+    // Touch button interrupt.
+    touchGestures.begin(digitalRead(TOUCH_BUTTON), micros());
+    attachInterrupt(digitalPinToInterrupt(TOUCH_BUTTON), touchButtonPressed, CHANGE);
+    // A config button that is held at power on counts from then, it is recognized once the loop runs.
+    configButton = digitalRead(CONFIG_BUTTON);
+    configGestures.begin(configButton, 0);
+
+    LOG_INFO(LOG_MAIN, "NIXIE TAP, firmware version: %u", fwVersion);
+    if(timeStatus() != timeSet) {
+        LOG_ERROR(LOG_DISPLAY, "Unable to sync with the RTC!");
+    } else {
+        LOG_INFO(LOG_DISPLAY, "RTC has set the system time.");
+    }
+
+    readParameters(configStatus);
+
+    // Slots are shown in the order they are added. Their data is refreshed in the background, whichever slot is on the display.
+    slotRegistry.add(&timeSlot);
+    slotRegistry.add(&dateSlot);
+    slotRegistry.add(&cryptoSlot);
+    slotRegistry.add(&weatherSlot);
+    pushSlotIndex = slotRegistry.add(&pushSlot);
+    frameSlotIndex = slotRegistry.add(&frameSlot);
+    mqttSlotIndex = slotRegistry.add(&mqttSlot);
+    registerMetrics();
+    pushServer.begin();
+    pushServer.addDownload("/events", "application/octet-stream",
+        [](uint32_t offset, uint8_t *buffer, size_t length) { return eventLog.read(offset, buffer, length); });
+    // Rendered a chunk at a time while the response is sent, a new request starts from the first metric.
+    pushServer.addDownload("/metrics", "text/plain; version=0.0.4",
+        [](uint32_t offset, uint8_t *buffer, size_t length) {
+            if(offset == 0) metrics.rewind();
+            return metrics.render((char *)buffer, length);
+        });
+    frameReceiver.begin();
+    jobScheduler.addFixedRateJob("input", pollInput, INPUT_INTERVAL, INPUT_INTERVAL);
+    jobScheduler.addFixedRateJob("display", renderDisplay, DISPLAY_INTERVAL, DISPLAY_INTERVAL);
+    jobScheduler.addJob("prefetch", prefetchSlots, PREFETCH_INTERVAL, PREFETCH_INTERVAL, false);
+    quotaJob = jobScheduler.addJob("quota", saveApiQuota, QUOTA_SAVE_INTERVAL, 60000, false);
+    mqttJob = jobScheduler.addJob("mqtt", mqttConnect, MQTT_CHECK_INTERVAL, 10000, true);
+    healthJob = jobScheduler.addJob("health", publishHealth, MQTT_HEALTH_INTERVAL, 10000, false);
+    updateMqttJobs();
+    jobScheduler.addJob("liveframe", sendLiveFrames, LIVEVIEW_BATCH_INTERVAL, LIVEVIEW_BATCH_INTERVAL, false);
+    jobScheduler.addJob("livemetric", sendLiveMetrics, LIVEVIEW_METRICS_INTERVAL, LIVEVIEW_METRICS_INTERVAL, false);
+    jobScheduler.addJob("config", flushConfig, CONFIG_FLUSH_INTERVAL, CONFIG_FLUSH_INTERVAL, false);
+    jobScheduler.addJob("wifi", pollWifi, WIFI_POLL_INTERVAL, WIFI_POLL_INTERVAL, false);
+    jobScheduler.addJob("log", drainLog, LOG_DRAIN_INTERVAL, 1000, false);
+    jobScheduler.addJob("events", watchEvents, EVENT_WATCH_INTERVAL, 10000, false);
+    portalJob = jobScheduler.addJob("portal", pollPortal, PORTAL_POLL_INTERVAL, 100, false);
+    jobScheduler.setEnabled(portalJob, false);
+    nixieTap.setCommitListener([](uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_t digit4, uint8_t dots) {
+        liveView.commit(digit1, digit2, digit3, digit4, dots);
+    });
+    liveView.begin();
+    powerManager.begin();
+    powerManager.setEnabled(config.power_save);
+
     enableSecDot();
-	// Serial debug message
-	if(timeStatus()!= timeSet)
-		Serial.println("Unable to sync with the RTC!");
-	else
-		Serial.println("RTC has set the system time!");
-	
-	nixieTap.write(10,10,10,10,0b11110); // progress bar 100%
+    bootTimes.setupDone = micros();
+    LOG_INFO(LOG_MAIN, "Boot: time shown after %u ms, setup done after %u ms, free heap %u bytes.", bootTimes.firstFrame / 1000,
+        bootTimes.setupDone / 1000, ESP.getFreeHeap());
+    const EventLogReset &reset = eventLog.getReset();
+    if(eventLog.wasCrash()) {
+        LOG_WARN(LOG_MAIN, "Boot %u after a crash: %s, cause %u at 0x%08x, after %u s. See the events command.", eventLog.getBoot(),
+            EventLog::getReasonName(reset.reason), reset.exccause, reset.epc1, reset.uptime);
+    }
 }
+/*                                                                      *
+ *  Everything runs as a job of the scheduler: the input polling and    *
+ *  the display at a fixed rate, the rest in the background, earliest   *
+ *  deadline first. See setup() for the list.                           *
+ *                                                                      */
 void loop() {
-	// Polling functions
-	readAndParseSerial();
+    uint32_t start = micros();
+    jobScheduler.run();
+    metrics.observe(metricIds.loopTime, micros() - start);
+}
+/*                                                                      *
+ *  Polls the serial port and the config button, and takes the values   *
+ *  that arrived over the network and the NTP events.                   *
+ *                                                                      */
+bool pollInput(void *context) {
+	serialLink.poll();
+    handleEvents();
 	readButton();
-
-	// Mandatory functions to be executed every cycle
-    t = now(); // update date and time variable
+    handleGestures();
 
     // If time is configured to be set semi-auto or auto and NixiTap is just started, the NTP request is created.
-    if(manual_time_flag == 0 && wifiFirstConnected && WiFi.status() == WL_CONNECTED) {
+    if(config.manual_time_flag == 0 && wifiFirstConnected && WiFi.status() == WL_CONNECTED) {
         NTP.onNTPSyncEvent([](NTPSyncEvent_t event) {ntpEvent = event; syncEventTriggered = true;});
         NTP.begin();
         wifiFirstConnected = false;
@@ -142,102 +357,105 @@ void loop() {
         processSyncEvent(ntpEvent);
         syncEventTriggered = false;
     }
-    
-	// State machine
-    if(state > 3) state = 0;
-
-	// Slot 0 - time
-    if(state == 0 && enable_time) {
-        nixieTap.writeTime(t, dot_state, enable_24h);
-    } 
-	else if(!enable_time && state == 0) state++;
-
-	// Slot 1 - date 
-	if(state == 1 && enable_date) {
-		nixieTap.writeDate(t, 1);
-	} 
-	else if(!enable_date && state == 1) state++;
-
-	// Slot 2 - crypto price
-	if(state == 2 && enable_crypto) {
-        if(cryptoRefreshFlag) {
-            cryptoRefreshFlag = 0;
-            cryptoCurrencyPrice = nixieTapAPI.getCryptoPrice(crypto_key, crypto_id);
-            last_crypto = now();
-        }
-        if (now() - last_crypto >= 60){
-            cryptoRefreshFlag = 1;
-        }
-        nixieTap.writeNumber(cryptoCurrencyPrice, 250);
-	}
-	else if(!enable_crypto && state == 2) state++;
-	
-	// Slot 3 - temperature
-	if(state == 3 && enable_temp) {
-		if(weather_key[0] != '\0') {
-			if(weatherRefreshFlag) {
-				weatherRefreshFlag = 0;
-                temperature = nixieTapAPI.getTempAtMyLocation(weather_id, weather_format);
-                last_temp = now();
-			}
-            // Checking local temp every 5 minutes
-            if (now() - last_temp >= 300){ 
-                weatherRefreshFlag = 1;
-            }
-			nixieTap.writeNumber(temperature, 0);
-		} else state++;
-	}
-	else if(!enable_temp && state == 3) state++;
 
-    // Here you can add new functions for displaying numbers on NixieTap, just follow the basic writing principle from above.
+    // A pushed value is shown at once, whichever slot is on the display.
+    if(pushServer.takeValue()) state = pushSlotIndex;
+    mqttLink.loop();
+    if(mqttLink.takeValue()) state = mqttSlotIndex;
+    int8_t mqttRequestedSlot = mqttLink.takeSlot();
+    if(mqttRequestedSlot >= 0) state = mqttRequestedSlot;
+    NixieFrame frame;
+    if(frameReceiver.takeFrame(frame)) {
+        frameSlot.update(frame);
+        state = frameSlotIndex;
+        // Shown at once, the display job only runs at 50 Hz and a streamed frame would wait for it or be replaced.
+        renderDisplay(NULL);
+    }
+    int8_t pushedSlot = pushServer.takeSlot();
+    if(pushedSlot >= 0) state = pushedSlot;
+    int8_t pushedAnimation = pushServer.takeAnimation();
+    if(pushedAnimation >= 0) nixieTap.setAnimation(pushedAnimation);
+    return true;
+}
+bool renderDisplay(void *context) {
+    t = now(); // update date and time variable
+    // The touch button interrupt moves the state to the next slot, disabled slots are skipped.
+    state = slotRegistry.select(state);
+    slotRegistry.render(t);
+    return true;
+}
+// Not while the radio is off, a job pulled forward then would be due before the PowerManager wakes the radio for it.
+bool prefetchSlots(void *context) {
+    if(!powerManager.isRadioOn()) {
+        return true;
+    }
+    slotRegistry.prefetch(PREFETCH_SLOTS, PREFETCH_WINDOW);
+    return true;
 }
 
+/*                                                                      *
+ *  By pressing the button on the back of the device you can start the  *
+ *  WiFi Manager and access its settings. The portal doesn't block, it  *
+ *  is served by the portal job, so the clock keeps running meanwhile.  *
+ *                                                                      */
 void startPortalManually() {
-    // By pressing the button on the back of the device you can manually start the WiFi Manager and access it's settings.
-    nixieTap.write(10, 10, 10, 10, 0);
-    disableSecDot(); // If the dots are not disabled, precisely the RTC_IRQ_PIN interrupt, ConfigPortal will chrach.
-    movingDot.attach(0.2, scrollDots);
-	Serial.println("---------------------------------------------------------------------------------------------");
-    wifiManager.setConfigPortalTimeout(1800);
-    // This will run a new config portal if the SSID and PW are valid.
-    if(!wifiManager.startConfigPortal(SSID, password)) {
-		Serial.println("Failed to connect and hit timeout!");
+    if(wifiManager.getConfigPortalActive()) {
+        return;
+    }
+    LOG_INFO(LOG_MAIN, "Starting the config portal on %s.", config.ssid);
+    powerManager.wake(WAKE_NEEDED);
+    wifiManager.setConfigPortalBlocking(false);
+    wifiManager.setConfigPortalTimeout(PORTAL_TIMEOUT);
+    wifiManager.startConfigPortal(config.ssid, config.password);
+    jobScheduler.setEnabled(portalJob, true);
+    jobScheduler.runNow(portalJob);
+}
+/*                                                                      *
+ *  Serves the clients of the config portal. Parameters are applied as  *
+ *  soon as they are submitted, the portal is closed by the WiFi        *
+ *  Manager once it connects to the new network, or on the timeout.     *
+ *                                                                      */
+bool pollPortal(void *context) {
+    wifiManager.process();
+    if(!wifiManager.nixie_params.empty()) {
         // If the NixieTap is not connected to WiFi, it will collect the entered parameters and configure the RTC according to them.
+        updateParameters();
+        updateTime();
     }
-    updateParameters();
-    updateTime();
-    movingDot.detach();
-    nixieTap.write(10, 10, 10, 10, 0); // Deletes remaining dot on display.
-    enableSecDot();
+    if(!wifiManager.getConfigPortalActive()) {
+        portalConnect = false;
+        jobScheduler.setEnabled(portalJob, false);
+        LOG_INFO(LOG_MAIN, "Config portal closed.");
+    }
+    return true;
 }
 
 void processSyncEvent(NTPSyncEvent_t ntpEvent) {
-	Serial.println("---------------------------------------------------------------------------------------------");
+    eventLog.record(LOGGED_NTP_SYNC, (uint16_t)ntpEvent);
 	// When syncEventTriggered is triggered, through NTPClient, Nixie checks if NTP time is received.
     // If NTP time is received, Nixie starts synchronization of RTC time with received NTP time and stops NTPClinet from sending new requests.
 
         if(ntpEvent < 0) {
-			Serial.print("Time Sync error: ");
+			const char *reason = "unknown error";
 			if(ntpEvent == noResponse) {
-				Serial.println("NTP server not reachable.");
+				reason = "NTP server not reachable";
 			} else if(ntpEvent == invalidAddress) {
-				Serial.println("Invalid NTP server address.");
+				reason = "invalid NTP server address";
 			} else if (ntpEvent == errorSending) {
-				Serial.println ("Error sending request");
+				reason = "error sending request";
 			} else if (ntpEvent == responseError) {
-				Serial.println ("NTP response error");
+				reason = "NTP response error";
 			}
-			Serial.println("Synchronization will be attempted again after 15 seconds.");
-			Serial.println("If the time is not synced after 2 minutes, please restart Nixie Tap and try again!");
-			Serial.println("If restart does not help. There might be a problem with the NTP server or your WiFi connection. You can set the time manually.");
+			LOG_WARN(LOG_MAIN, "Time sync error: %s. It will be attempted again after 15 seconds.", reason);
+			LOG_WARN(LOG_MAIN, "If the time is not synced after 2 minutes, please restart Nixie Tap and try again!");
+			LOG_WARN(LOG_MAIN, "If that doesn't help, check the NTP server and the WiFi, or set the time manually.");
         } else {
             if(NTP.getLastNTPSync() != 0) {
-				Serial.print("NTP time is obtained: ");
-				Serial.println(NTP.getLastNTPSync());
-                if(!manual_time_flag) {
-					Serial.println("Auto time adjustment started!");
+				LOG_INFO(LOG_MAIN, "NTP time is obtained: %lu", (unsigned long)NTP.getLastNTPSync());
+                if(!config.manual_time_flag) {
+					LOG_INFO(LOG_MAIN, "Auto time adjustment started.");
                     // Collect NTP time, put it in RTC and stop NTP synchronization.
-                    RTC.set(NTP.getLastNTPSync() + offset*60 + enable_DST*60*60);
+                    RTC.set(NTP.getLastNTPSync() + config.offset*60 + config.enable_dst*60*60);
                     NTP.stop();
                     setSyncProvider(RTC.get);
                     wifiFirstConnected = false;
@@ -245,257 +463,121 @@ void processSyncEvent(NTPSyncEvent_t ntpEvent) {
             }
         }
 }
-void readParameters() {
-	Serial.println("Reading saved parameters from EEPROM.");
-    int EEaddress = mem_map["SSID"];
-    EEPROM.get(EEaddress, SSID);
-    Serial.println("SSID IS:"+(String)SSID);
-    EEaddress = mem_map["password"];
-    EEPROM.get(EEaddress, password);
-    Serial.println("PW IS:" + (String)password);
-    EEaddress = mem_map["target_ssid"];
-    EEPROM.get(EEaddress, target_SSID);
-    Serial.println("Target SSID IS:" + (String)target_SSID);
-    EEaddress = mem_map["target_pw"];
-    EEPROM.get(EEaddress, target_pw);
-    Serial.println("Target PW IS:" + (String)target_pw);
-    EEaddress = mem_map["weather_key"];
-    EEPROM.get(EEaddress, weather_key);
-    Serial.println("WEATHER KEY IS:" + (String)weather_key);
-    EEaddress = mem_map["weather_id"];
-    EEPROM.get(EEaddress, weather_id);
-    Serial.println("WEATHER ID IS:" + (String)weather_id);
-    EEaddress = mem_map["weather_format"];
-    EEPROM.get(EEaddress, weather_format);
-    Serial.println("WEATHER FORMAT IS:" + (String)weather_format);
-    EEaddress = mem_map["crypto_key"];
-    EEPROM.get(EEaddress, crypto_key);
-    Serial.println("CRYPTO KEY IS:" + (String)crypto_key);
-    EEaddress = mem_map["crypto_id"];
-    EEPROM.get(EEaddress, crypto_id);
-    Serial.println("CRYPTO ID IS:" + (String)crypto_id);
-    EEaddress = mem_map["manual_time_flag"];
-    EEPROM.get(EEaddress, manual_time_flag);
-    Serial.println("MANUAL TIME FLAG IS:" + (String)manual_time_flag);
-    EEaddress = mem_map["enable_date"];
-    EEPROM.get(EEaddress, enable_date);
-    Serial.println("ENABLE DATE IS:" + (String)enable_date);
-    EEaddress = mem_map["enable_time"];
-    EEPROM.get(EEaddress, enable_time);
-    Serial.println("ENABLE TIME IS:" + (String)enable_time);
-    EEaddress = mem_map["enable_24h"];
-    EEPROM.get(EEaddress, enable_24h);
-    Serial.println("24H IS:" + (String)enable_24h);
-    EEaddress = mem_map["enable_temp"];
-    EEPROM.get(EEaddress, enable_temp);
-    Serial.println("ENABLE TEMP IS:" + (String)enable_temp);
-    EEaddress = mem_map["enable_crypto"];
-    EEPROM.get(EEaddress, enable_crypto);
-    Serial.println("ENABLE CRYPTO IS:" + (String)enable_crypto);
-    EEaddress = mem_map["enable_dst"];
-    EEPROM.get(EEaddress, enable_DST);
-    Serial.println("ENABLE DST IS:" + (String)enable_DST);
-    EEaddress = mem_map["offset"];
-    EEPROM.get(EEaddress, offset);
-    Serial.println("OFFSET IS:" + (String)offset);
-
-    nixieTapAPI.applyKey(weather_key, 4);
+void readParameters(ConfigStatus status) {
+    if(status == CONFIG_MIGRATED) {
+        LOG_INFO(LOG_CONFIG, "Parameters were converted to the new layout.");
+    } else if(status == CONFIG_EMPTY) {
+        LOG_INFO(LOG_CONFIG, "Performing first run initialization...");
+    } else if(status == CONFIG_CORRUPT) {
+        LOG_ERROR(LOG_CONFIG, "Saved parameters are damaged, the defaults are used!");
+    }
+    // The passwords and the keys are only shown as set or not, logs end up in bug reports.
+    LOG_INFO(LOG_CONFIG, "Hotspot: %s, password %s", config.ssid, config.password[0] != '\0' ? "set" : "empty");
+    LOG_INFO(LOG_CONFIG, "Target: %s, password %s", config.target_ssid, config.target_pw[0] != '\0' ? "set" : "empty");
+    LOG_INFO(LOG_CONFIG, "Weather key %s, id: %s, format: %u", config.weather_key[0] != '\0' ? "set" : "empty", config.weather_id,
+        config.weather_format);
+    LOG_INFO(LOG_CONFIG, "Crypto key %s, ids: %s", config.crypto_key[0] != '\0' ? "set" : "empty", config.crypto_id);
+    LOG_INFO(LOG_CONFIG, "Manual time: %u, date: %u, time: %u, 24h: %u, temp: %u, crypto: %u, DST: %u, offset: %d, power save: %u",
+        config.manual_time_flag, config.enable_date, config.enable_time, config.enable_24h, config.enable_temp, config.enable_crypto,
+        config.enable_dst, config.offset, config.power_save);
+    nixieTapAPI.providerPolicy.restoreQuota(config.quota);
+    LOG_INFO(LOG_CONFIG, "ipstack requests this month: %u", nixieTapAPI.providerPolicy.getMonthlyUsage(PROVIDER_IPSTACK));
+    LOG_INFO(LOG_CONFIG, "MQTT broker: %s:%u, topic: %s, remote config: %u", config.mqtt_host, config.mqtt_port, config.mqtt_topic,
+        config.mqtt_config);
+    mqttLink.onConfig(config.mqtt_config ? applyMqttConfig : NULL);
+    mqttLink.configure(config.mqtt_host, config.mqtt_port, config.mqtt_topic);
+
+    nixieTapAPI.applyKey(config.weather_key, 4);
 }
 
-void updateParameters() {
-	Serial.println("---------------------------------------------------------------------------------------------");
-	Serial.println("Synchronization of parameters started.");
-    EEPROM.begin(512); // Number of bytes to allocate for parameters.
-    int EEaddress;
-    Serial.println("Comparing entered keys with the saved ones.");
-    if (wifiManager.nixie_params.count("SSID") == 1){
-        const char * nixie_ssid = wifiManager.nixie_params["SSID"].c_str();
-        if (nixie_ssid != "\0" and SSID != nixie_ssid)
-        {
-            EEaddress = mem_map["SSID"];
-            strcpy(SSID, nixie_ssid);
-            EEPROM.put(EEaddress, SSID);   
-            const char * nixie_pw = wifiManager.nixie_params["hotspot_password"].c_str();
-            if (nixie_pw != "\0" and password != nixie_pw)
-            {
-                EEaddress = mem_map["password"];
-                strcpy(password, nixie_pw);
-                EEPROM.put(EEaddress, password);
-            }
-        }
+/*                                                                      *
+ *  Copies a text entered in the config portal, if it isn't empty,      *
+ *  fits and differs from the saved one. Returns true if it changed.    *
+ *                                                                      */
+bool updateText(char *text, size_t size, const char *key) {
+    if(wifiManager.nixie_params.count(key) == 0) {
+        return false;
     }
-    if (wifiManager.nixie_params.count("target_ssid") == 1){
-        const char * new_target_ssid = wifiManager.nixie_params["target_ssid"].c_str();
-        if (new_target_ssid != "\0" and target_SSID != new_target_ssid)
-        {
-            EEaddress = mem_map["target_ssid"];
-            strcpy(target_SSID, new_target_ssid);
-            EEPROM.put(EEaddress, target_SSID);
-            const char * new_target_pw = wifiManager.nixie_params["target_password"].c_str();
-            if (new_target_pw != "\0" and new_target_pw != target_pw)
-            {
-                EEaddress = mem_map["target_pw"];
-                strcpy(target_pw, new_target_pw);
-                EEPROM.put(EEaddress, target_pw);
-                wifiManager.connectWifi(target_SSID, target_pw);
-            }
-        }
+    const char *value = wifiManager.nixie_params[key].c_str();
+    if(value[0] == '\0' || strlen(value) >= size || strcmp(value, text) == 0) {
+        return false;
     }
-    if (wifiManager.nixie_params.count("weather_api") == 1)
+    strcpy(text, value);
+    return true;
+}
+void updateParameters() {
+    LOG_INFO(LOG_MAIN, "Synchronization of parameters started.");
+    updateText(config.ssid, sizeof(config.ssid), "SSID");
+    updateText(config.password, sizeof(config.password), "hotspot_password");
+    bool targetChanged = updateText(config.target_ssid, sizeof(config.target_ssid), "target_ssid");
+    targetChanged |= updateText(config.target_pw, sizeof(config.target_pw), "target_password");
+    if (targetChanged)
     {
-        const char *new_weather_key = wifiManager.nixie_params["weather_api"].c_str();
-        if (new_weather_key != "\0" and new_weather_key != weather_key)
-        {
-            EEaddress = mem_map["weather_key"];
-            strcpy(weather_key, new_weather_key);
-            EEPROM.put(EEaddress, weather_key);
-            nixieTapAPI.applyKey(weather_key, 4);
-            weatherRefreshFlag = 1;
-        }
+        // Not connectWifi() of the WiFi Manager, it waits for the result and the clock would stop meanwhile.
+        fastConnect.forget();
+        fastConnect.connect();
+        portalConnect = true;
     }
-    if (wifiManager.nixie_params.count("weather_id") == 1)
+    if (updateText(config.weather_key, sizeof(config.weather_key), "weather_api"))
     {
-        const char *new_weather_id = wifiManager.nixie_params["weather_id"].c_str();
-        if (new_weather_id != "\0" and new_weather_id != weather_id)
-        {
-            EEaddress = mem_map["weather_id"];
-            strcpy(weather_id, new_weather_id);
-            EEPROM.put(EEaddress, weather_id);
-            weatherRefreshFlag = 1;
-        }
+        nixieTapAPI.applyKey(config.weather_key, 4);
+        jobScheduler.runNow(weatherSlot.job);
     }
-    if (wifiManager.nixie_params.count("weatherFormat") == 1)
+    if (updateText(config.weather_id, sizeof(config.weather_id), "weather_id"))
     {
-        uint8_t user_input_weather_format = atoi(wifiManager.nixie_params["weatherFormat"].c_str());
-        if (user_input_weather_format != weather_format)
-        {
-            weather_format = user_input_weather_format;
-            EEaddress = mem_map["weather_format"];
-            EEPROM.put(EEaddress, weather_format);
-            weatherRefreshFlag = 1;
-        }
+        jobScheduler.runNow(weatherSlot.job);
     }
-   
-    if (wifiManager.nixie_params.count("cryptoID") == 1)
+    if (wifiManager.nixie_params.count("weatherFormat") == 1)
     {
-        const char *new_crypto_id = wifiManager.nixie_params["cryptoID"].c_str();
-        if (new_crypto_id != "\0" and new_crypto_id != crypto_id)
+        uint8_t user_input_weather_format = atoi(wifiManager.nixie_params["weatherFormat"].c_str());
+        if (user_input_weather_format != config.weather_format)
         {
-            EEaddress = mem_map["crypto_id"];
-            strcpy(crypto_id, new_crypto_id);
-            EEPROM.put(EEaddress, crypto_id);
+            config.weather_format = user_input_weather_format;
+            jobScheduler.runNow(weatherSlot.job);
         }
     }
-    uint8_t new_enable_date = (uint8_t)wifiManager.nixie_params.count("enableDate");
-    if (new_enable_date != enable_date){
-        EEaddress = mem_map["enable_date"];
-        enable_date = new_enable_date;
-        EEPROM.put(EEaddress, enable_date);
-    }
-    uint8_t new_enable_time = (uint8_t)wifiManager.nixie_params.count("enableTime");
-    if (new_enable_time != enable_time)
-    {
-        EEaddress = mem_map["enable_time"];
-        enable_time = new_enable_time;
-        EEPROM.put(EEaddress, new_enable_time);
-    }
-    uint8_t new_enable_24h = (uint8_t)wifiManager.nixie_params.count("enable24h");
-    if (enable_24h != new_enable_24h)
-    {
-        EEaddress = mem_map["enable_24h"];
-        enable_24h = new_enable_24h;
-        EEPROM.put(EEaddress, enable_24h);
-    }
-    uint8_t new_enable_temp = (uint8_t)wifiManager.nixie_params.count("enableTemp");
-    if (new_enable_temp != enable_temp)
-    {
-        EEaddress = mem_map["enable_temp"];
-        enable_temp = new_enable_temp;
-        EEPROM.put(EEaddress, enable_temp);
-    }
-    uint8_t new_enable_crypto = (uint8_t)wifiManager.nixie_params.count("enableCrypto");
-    if (new_enable_crypto != enable_crypto)
-    {
-        EEaddress = mem_map["enable_crypto"];
-        enable_crypto = new_enable_crypto;
-        EEPROM.put(EEaddress, enable_crypto);
-    }
-    uint8_t new_enable_dst = (uint8_t)wifiManager.nixie_params.count("dst");
-    if (new_enable_dst != enable_DST)
+    if (updateText(config.crypto_id, sizeof(config.crypto_id), "cryptoID"))
     {
-        EEaddress = mem_map["enable_dst"];
-        enable_DST = new_enable_dst;
-        EEPROM.put(EEaddress, enable_DST);
+        jobScheduler.runNow(cryptoSlot.job);
     }
+    config.enable_date = (uint8_t)wifiManager.nixie_params.count("enableDate");
+    config.enable_time = (uint8_t)wifiManager.nixie_params.count("enableTime");
+    config.enable_24h = (uint8_t)wifiManager.nixie_params.count("enable24h");
+    config.enable_temp = (uint8_t)wifiManager.nixie_params.count("enableTemp");
+    config.enable_crypto = (uint8_t)wifiManager.nixie_params.count("enableCrypto");
+    config.enable_dst = (uint8_t)wifiManager.nixie_params.count("dst");
     if (wifiManager.nixie_params.count("setTimeManuallyFlag") == 1)
     {
         uint8_t new_manual_time_flag = atoi(wifiManager.nixie_params["setTimeManuallyFlag"].c_str());
-        if (new_manual_time_flag != manual_time_flag){
-            EEaddress = mem_map["manual_time_flag"];
-            uint8_t temp_time_flag = new_manual_time_flag;
-            EEPROM.put(EEaddress, temp_time_flag);
-        }
-        manual_time_flag = new_manual_time_flag;
+        config.manual_time_flag = new_manual_time_flag;
         timeRefreshFlag = 1;
     }
     if (wifiManager.nixie_params.count("offset") == 1)
     {
-        int16_t new_offset = atoi(wifiManager.nixie_params["offset"].c_str());
-        if (new_offset != offset){
-            EEaddress = mem_map["offset"];
-            offset = new_offset;
-            EEPROM.put(EEaddress, offset);
-        }
+        config.offset = atoi(wifiManager.nixie_params["offset"].c_str());
     }
-    if (wifiManager.nixie_params.count("time") == 1)
+    if (updateText(_time, sizeof(_time), "time"))
     {
-        const char * new_time = wifiManager.nixie_params["time"].c_str();
-        if (new_time != "\0" and new_time != _time)
-        {
-            strcpy(_time, new_time);
-            timeRefreshFlag = 1;
-        }
+        timeRefreshFlag = 1;
     }
-    if (wifiManager.nixie_params.count("date") == 1)
+    if (updateText(date, sizeof(date), "date"))
     {
-        const char * new_date = wifiManager.nixie_params["date"].c_str();
-        if (new_date != "\0" and new_date != date)
-        {
-            strcpy(date, new_date);
-            timeRefreshFlag = 1;
-        }
+        timeRefreshFlag = 1;
     }
-
-    if (wifiManager.nixie_params.count("stackKey") == 1)
+    if (updateText(config.crypto_key, sizeof(config.crypto_key), "stackKey"))
     {
-        const char *new_crypto_key = wifiManager.nixie_params["stackKey"].c_str();
-        if (new_crypto_key != "\0" and new_crypto_key != crypto_key)
-        {
-            EEaddress = mem_map["crypto_key"];
-            strcpy(crypto_key, new_crypto_key);
-            EEPROM.put(EEaddress, crypto_key);
-        }
+        jobScheduler.runNow(cryptoSlot.job);
     }
-    // Setting the "non initialized" flag to 0
-    EEaddress = mem_map["non_init"];
-    EEPROM.put(EEaddress, 0);
-
-    EEPROM.commit();
-    if(enable_crypto) {
-        priceRefresh.attach(300, cryptoRefresh); // This will refresh the cryptocurrency price every 5min.
-    } else 
-        priceRefresh.detach();
-    if(enable_temp) {
-        temperatureRefresh.attach(3600, weatherRefresh);
-    } else
-        temperatureRefresh.detach();
+    // Only the bytes that changed reach the flash, so this is cheap if nothing did.
+    config.save();
+    slotRegistry.updateJobs();
     wifiManager.nixie_params.clear();
-    Serial.println("Synchronization of parameters completed!");
+    LOG_INFO(LOG_MAIN, "Synchronization of parameters completed.");
 }
 
 void updateTime() {
     if (timeRefreshFlag){
-        if(manual_time_flag) { // I need feedback from the WiFiManager API that this option has been selected.
+        if(config.manual_time_flag) { // I need feedback from the WiFiManager API that this option has been selected.
             NTP.stop();     // NTP sync is disableded to avoid sync errors.
             int hours = -1;
             int minutes = -1;
@@ -529,14 +611,14 @@ void updateTime() {
             t = now();
             RTC.set(t);
             setSyncProvider(RTC.get);
-            Serial.println("Manually entered date and time saved!");
+            LOG_INFO(LOG_MAIN, "Manually entered date and time saved.");
         }else if (WiFi.status() == WL_CONNECTED){
-            Serial.println("NixieTap is auto and connected, setting time to NTP!");
+            LOG_INFO(LOG_MAIN, "NixieTap is auto and connected, setting the time from NTP.");
             NTP.onNTPSyncEvent([](NTPSyncEvent_t event) {ntpEvent = event; syncEventTriggered = true;});
             NTP.begin();
             wifiFirstConnected = false;
         }else{
-            Serial.println("NixieTap not connected to WiFi, cannot auto sync time via NTP!");
+            LOG_WARN(LOG_MAIN, "NixieTap is not connected to WiFi, can't sync the time over NTP!");
         }
         timeRefreshFlag = 0;
     }
@@ -551,134 +633,586 @@ void enableSecDot() {
         RTC.setIRQ(1);  // Configures the 512Hz interrupt from RTC.
         attachInterrupt(digitalPinToInterrupt(RTC_IRQ_PIN), irq_1Hz_int, FALLING);
         secDotDef = true;
-        stopDef = false;
-    }
-}
-/*                                                *
- * Disaling the dots function on nixie display.   *
- *                                                */
-void disableSecDot() {
-    if(stopDef == false) {
-        detachInterrupt(RTC_IRQ_PIN);
-        RTC.setIRQ(0);              // Configures the interrupt from RTC.
-        dotPosition = 0b10;         // Restast dot position.
-        stopDef = true;
-        secDotDef = false;
     }
 }
-/*                                                                                       *
- * An interrupt function that changes the state and position of the dots on the display. *
- *                                                                                       */
-void scrollDots() {
-    if(dotPosition == 0b100000) dotPosition = 0b10;
-    nixieTap.write(11, 11, 11, 11, dotPosition);
-    dotPosition = dotPosition << 1;
-}
 /*                                                                  *
- * An interrupt function for changing the dot state every 1 second. *
+ *  The interrupt functions may run while the flash is busy, e.g.   *
+ *  the config portal saving the WiFi credentials, so they only     *
+ *  queue an event and the rest is left to handleEvents().          *
  *                                                                  */
 void irq_1Hz_int() {
-    dot_state = !dot_state;
+    eventQueue.push(EVENT_RTC_TICK);
 }
-/*                                                                *
- * An interrupt function for the touch sensor when it is touched. *
- *                                                                */
 void touchButtonPressed() {
-    state++;
-	nixieTap.setAnimation(true);
+    eventQueue.push(EVENT_TOUCH, GPIP(TOUCH_BUTTON));
 }
-void cryptoRefresh() {
-    enable_crypto = 1;
+/*                                                                      *
+ *  Handles the events queued by the interrupts, in the order they      *
+ *  fired. Each RTC tick flips the second dot, so no tick is lost when  *
+ *  the loop was busy. A touch moves to the next slot.                  *
+ *                                                                      */
+void handleEvents() {
+    Event event;
+    while(eventQueue.pop(event)) {
+        if(event.type == EVENT_RTC_TICK) {
+            dot_state = !dot_state;
+            updatePower();
+        } else if(event.type == EVENT_TOUCH) {
+            LOG_DEBUG(LOG_MAIN, "Touch edge %lu %u", (unsigned long)event.time, event.data);    // A line of a trace for test/traces.
+            touchGestures.edge(event.data, event.time);
+            powerManager.wake(WAKE_TOUCH);
+        }
+    }
 }
-void weatherRefresh() {
-    enable_temp = 1;
+/*                                                                      *
+ *  Touch button: a tap moves to the next slot, a double tap goes back  *
+ *  to the time, holding it steps through the slots. Holding the        *
+ *  config button opens the config portal.                              *
+ *                                                                      */
+void handleGestures() {
+    uint32_t now = micros();
+    touchGestures.update(now);
+    configGestures.update(now);
+    Gesture gesture;
+    while((gesture = touchGestures.takeGesture()) != GESTURE_NONE) {
+        if(gesture == GESTURE_TAP) {
+            state++;
+            nixieTap.setAnimation(true);
+        } else if(gesture == GESTURE_DOUBLE_TAP) {
+            state = 0;
+        } else {
+            state++;    // Long press and its repeats, without the animation so they can follow each other quickly.
+        }
+    }
+    while((gesture = configGestures.takeGesture()) != GESTURE_NONE) {
+        if(gesture == GESTURE_LONG_PRESS) {
+            startPortalManually();
+        }
+    }
 }
+/*                                                                      *
+ *  Saves a setting to EEPROM and applies it, so a change takes effect  *
+ *  without a restart.                                                  *
+ *                                                                      */
+void saveSetting(const Setting &setting) {
+    config.save();
+    if(setting.changed != NULL) {
+        setting.changed();
+    }
+    slotRegistry.updateJobs();
+}
+void weatherChanged() {
+    nixieTapAPI.applyKey(config.weather_key, 4);
+    jobScheduler.runNow(weatherSlot.job);
+}
+void cryptoChanged() {
+    jobScheduler.runNow(cryptoSlot.job);
+}
+void mqttChanged() {
+    mqttLink.onConfig(config.mqtt_config ? applyMqttConfig : NULL);
+    mqttLink.configure(config.mqtt_host, config.mqtt_port, config.mqtt_topic);
+    updateMqttJobs();
+}
+void powerChanged() {
+    powerManager.setEnabled(config.power_save);
+}
+// The serial commands that need the rest of the firmware, the others and the tables are in Shell.cpp.
+void shellStats(Print &out, uint8_t argc, char **argv) {
+    out.println("Job        runs  overruns  missed  prefetches  latency(last/max ms)  duration(last/max us)  load(%)  due in(ms)");
+    for(uint8_t i = 0; i < jobScheduler.getJobCount(); i++) {
+        const JobStats &stats = jobScheduler.getStats(i);
+        uint16_t load = jobScheduler.getLoad(i);
+        out.printf("%-10s %5u %9u %7u %11u %10u/%-10u %10u/%-10u %4u.%u  %s\n", jobScheduler.getName(i), stats.runs, stats.overruns,
+            stats.missed, stats.prefetches, stats.lastLatency, stats.maxLatency, stats.lastDuration, stats.maxDuration, load / 10, load % 10,
+            jobScheduler.isEnabled(i) ? String(jobScheduler.getTimeUntilDue(i)).c_str() : "disabled");
+    }
+    out.println("Slot       renders  render(last/max us)  refreshes  refresh(last/max ms)");
+    for(uint8_t i = 0; i < slotRegistry.getSlotCount(); i++) {
+        DisplaySlot *slot = slotRegistry.getSlot(i);
+        out.printf("%-10s %7u %9u/%-9u %10u %10u/%-9u\n", slot->name, slot->stats.renders, slot->stats.lastRenderTime, slot->stats.maxRenderTime,
+            slot->stats.refreshes, slot->stats.lastRefreshTime, slot->stats.maxRefreshTime);
+    }
+    const PushStats &pushStats = pushServer.getStats();
+    out.printf("Push requests: %u, rejected: %u, parse time(last/max us): %u/%u\n", pushStats.requests, pushStats.rejected,
+        pushStats.lastParseTime, pushStats.maxParseTime);
+    const FrameStats &frameStats = frameReceiver.getStats();
+    out.printf("UDP frames received: %u, applied: %u, superseded: %u, out of order: %u, lost: %u, malformed: %u\n",
+        frameStats.received, frameStats.applied, frameStats.superseded, frameStats.outOfOrder, frameStats.lost, frameStats.malformed);
+    const MqttStats &mqttStats = mqttLink.getStats();
+    out.printf("MQTT %s, connects: %u, failed: %u, messages: %u, rejected: %u, published: %u\n", mqttLink.connected() ? "connected" : "disconnected",
+        mqttStats.connects, mqttStats.connectFailures, mqttStats.messages, mqttStats.rejected, mqttStats.published);
+    const LiveViewStats &liveStats = liveView.getStats();
+    out.printf("Live view frames: %u, overwritten: %u, batches: %u, dropped: %u\n", liveStats.frames, liveStats.overwritten,
+        liveStats.batches, liveStats.dropped);
+    const SerialLinkStats &serialStats = serialLink.getStats();
+    out.printf("Serial frames: %u, CRC errors: %u, framing errors: %u, lines: %u, too long: %u\n", serialStats.frames, serialStats.crcErrors,
+        serialStats.framingErrors, serialStats.lines, serialStats.overflows);
+    EventQueueStats eventStats = eventQueue.getStats();
+    out.printf("Events: %u, waiting: %u, most waiting: %u, dropped touch/tick: %u/%u\n", eventStats.pushed, eventQueue.getDepth(),
+        eventStats.maxDepth, eventStats.dropped[EVENT_TOUCH], eventStats.dropped[EVENT_RTC_TICK]);
+    out.printf("Boot: time shown after %u ms, setup done after %u ms, ", bootTimes.firstFrame / 1000, bootTimes.setupDone / 1000);
+    if(bootTimes.networkReady != 0) {
+        out.printf("network ready after %u ms\n", bootTimes.networkReady);
+    } else {
+        out.println("network not ready");
+    }
+    const FastConnectStats &wifiStats = fastConnect.getStats();
+    out.printf("WiFi fast connects: %u, fell back: %u, full connects: %u, failed: %u, disconnects: %u, last connect: %u ms\n",
+        wifiStats.fastAttempts, wifiStats.fastFailures, wifiStats.fullAttempts, wifiStats.fullFailures, wifiStats.disconnects,
+        wifiStats.lastConnectTime);
+    out.printf("WiFi leases due at connect: %u, renewed while connected: %u\n", wifiStats.expired, wifiStats.renewals);
+    out.println("Connect time(ms)  <250  <500 <1000 <2000 <4000 <8000 more");
+    out.print("fast           ");
+    for(uint8_t i = 0; i < FAST_CONNECT_BUCKETS; i++) out.printf(" %5u", wifiStats.fastTimes[i]);
+    out.print("\nfull           ");
+    for(uint8_t i = 0; i < FAST_CONNECT_BUCKETS; i++) out.printf(" %5u", wifiStats.fullTimes[i]);
+    out.println();
+    const PowerStats &powerStats = powerManager.getStats();
+    out.printf("Radio: %s, power saving %s, on %u s of %u s (%u.%u%%), sleeps: %u, last sleep: %u s\n",
+        powerManager.isRadioOn() ? "on" : "off", config.power_save ? "on" : "off", (uint32_t)(powerStats.radioOnTime / 1000),
+        (uint32_t)(powerStats.totalTime / 1000), powerManager.getDutyCycle() / 10, powerManager.getDutyCycle() % 10, powerStats.sleeps,
+        powerStats.lastSleepTime / 1000);
+    out.printf("Radio wakes, scheduled: %u (late: %u), touch: %u, needed: %u\n", powerStats.wakes[WAKE_SCHEDULE], powerStats.late,
+        powerStats.wakes[WAKE_TOUCH], powerStats.wakes[WAKE_NEEDED]);
+    const LogStats &loggerStats = logger.getStats();
+    out.printf("Log records: %u, stalls: %u, truncated: %u, queued: %u bytes (max %u), write cycles(avg/last/max): %u/%u/%u\n",
+        loggerStats.records, loggerStats.stalls, loggerStats.truncated, logger.getDepth(), loggerStats.maxDepth,
+        loggerStats.records > 0 ? (uint32_t)(loggerStats.totalWriteCycles / loggerStats.records) : 0, loggerStats.lastWriteCycles, loggerStats.maxWriteCycles);
+    const MetricsStats &metricsStats = metrics.getStats();
+    out.printf("Metrics: %u, scrapes: %u, bytes: %u, rejected: %u\n", metrics.getCount(), metricsStats.scrapes, metricsStats.bytes,
+        metricsStats.rejected);
+    const ShellStats &shellStats = serialShell.getStats();
+    out.printf("Commands: %u, unknown: %u, rejected: %u, run time(last/max us): %u/%u\n", shellStats.commands, shellStats.unknown,
+        shellStats.rejected, shellStats.lastRunTime, shellStats.maxRunTime);
+    const ConfigLogStats &logStats = configLog.getStats();
+    out.printf("Config saves: %u, writes: %u, unchanged: %u, records: %u, bytes: %u, compactions: %u, erases: %u, damaged: %u\n",
+        logStats.saves, logStats.writes, logStats.unchanged, logStats.records, logStats.bytes, logStats.compactions, logStats.erases,
+        logStats.damaged);
+    if(configLog.isAvailable()) {
+        out.print("Config sector erases:");
+        for(uint8_t i = 0; i < CONFIG_LOG_SECTORS; i++) {
+            out.printf(" %u", configLog.getEraseCount(i));
+        }
+        out.println();
+    }
+}
+void shellTime(Print &out, uint8_t argc, char **argv) {
+    if(argc > 1) {
+        // time hh:mm yyyy-mm-dd, sets the RTC like the manual mode of the config portal.
+        int hours, minutes, year, month, day;
+        char extra;
+        if(argc < 3 || sscanf(argv[1], "%d:%d%c", &hours, &minutes, &extra) != 2 || sscanf(argv[2], "%d-%d-%d%c", &year, &month, &day, &extra) != 3
+            || hours < 0 || hours > 23 || minutes < 0 || minutes > 59 || year < 2000 || year > 2099 || month < 1 || month > 12 || day < 1 || day > 31) {
+            out.println("Usage: time hh:mm yyyy-mm-dd");
+            return;
+        }
+        setTime(hours, minutes, 0, day, month, year);
+        RTC.set(now());
+        setSyncProvider(RTC.get);
+    }
+    time_t current = now();
+    out.printf("%04d-%02d-%02d %02d:%02d:%02d, %s, %s time\n", year(current), month(current), day(current), hour(current), minute(current),
+        second(current), timeStatus() == timeSet ? "synced with the RTC" : "not synced", config.manual_time_flag ? "manual" : "automatic");
+    if(!config.manual_time_flag) {
+        out.printf("Last NTP sync: %lu\n", (unsigned long)NTP.getLastNTPSync());
+    }
+}
+/*                                                                      *
+ *  Times the hot paths: rendering of the current slot, and decoding    *
+ *  of a display frame received over the serial port.                   *
+ *                                                                      */
+void shellBench(Print &out, uint8_t argc, char **argv) {
+    uint16_t count = argc > 1 ? constrain(atoi(argv[1]), 1, 1000) : 100;
+    DisplaySlot *slot = slotRegistry.getSlot(slotRegistry.getCurrent());
+    uint32_t total = 0, longest = 0;
+    for(uint16_t i = 0; i < count; i++) {
+        uint32_t start = micros();
+        slotRegistry.render(now());
+        uint32_t duration = micros() - start;
+        total += duration;
+        longest = max(longest, duration);
+        yield();
+    }
+    out.printf("Render of %s: %u us on average, %u us at most, %u runs\n", slot != NULL ? slot->name : "none", total / count, longest, count);
 
-void readAndParseSerial() {
-
-	if(Serial.available()) {
-		serialCommand = Serial.readStringUntil('\n');
-
-		if(serialCommand.equals("init\r")) {
-			Serial.println("Writing factory defaults to EEPROM...");
-			Serial.println("Hotspot SSID: NixieTap");
-			Serial.println("Hotspot password: NixieTap");
-			Serial.println("Time format: 24h");
-			Serial.println("Enabled display modes: time and date");
-			Serial.println("Disabled display modes: other");
-			Serial.println("Operation mode: semi-auto");
-			Serial.println("DST: 0");
-			Serial.println("Time zone offset: 120min");
-			resetEepromToDefault();
-		}	
-		else {
-			Serial.println("Unknown command.");
-		}
+    uint8_t raw[FRAME_PACKET_SIZE + 3] = {SERIAL_FRAME_DISPLAY, FRAME_MAGIC, FRAME_VERSION, 0, 0, 0x12, 0x34};
+    uint8_t encoded[sizeof(raw) + 1], decoded[sizeof(raw)];
+    SerialLink::cobsEncode(raw, sizeof(raw), encoded);
+    uint32_t start = micros();
+    for(uint16_t i = 0; i < count; i++) {
+        size_t length = SerialLink::cobsDecode(encoded, sizeof(encoded), decoded);
+        SerialLink::crc16(decoded, length - 2);
+    }
+    out.printf("Serial frame decode: %u ns on average\n", (micros() - start) * 1000 / count);
 
-	}
- 
+    // A typical line of the API, the way it was printed before the Logger: built with String, then written blocking.
+    start = ESP.getCycleCount();
+    size_t lineLength = 0;
+    for(uint16_t i = 0; i < count; i++) {
+        String line = "hedgedGet: " + String("api.ipify.org") + " answered first after " + String(millis() - start) + " ms.";
+        lineLength = line.length() + 2;
+    }
+    uint32_t stringCycles = (ESP.getCycleCount() - start) / count;
+    const LogStats &logStats = logger.getStats();
+    out.printf("Log line with String: %u cycles and %u us blocked in the UART, with the Logger: %u cycles on average\n", stringCycles,
+        (uint32_t)(lineLength * 10 * 1000000ULL / SERIAL_BAUD), logStats.records > 0 ? (uint32_t)(logStats.totalWriteCycles / logStats.records) : 0);
+    out.printf("Free heap: %u bytes\n", ESP.getFreeHeap());
+}
+void shellInit(Print &out, uint8_t argc, char **argv) {
+    out.println("Writing factory defaults to EEPROM...");
+    out.println("Hotspot SSID: NixieTap");
+    out.println("Hotspot password: NixieTap");
+    out.println("Time format: 24h");
+    out.println("Enabled display modes: time and date");
+    out.println("Disabled display modes: other");
+    out.println("Operation mode: semi-auto");
+    out.println("DST: 0");
+    out.println("Time zone offset: 120min");
+    resetEepromToDefault();
+}
+void shellReboot(Print &out, uint8_t argc, char **argv) {
+    config.flush(true);
+    eventLog.record(LOGGED_RESTART);
+    out.println("Rebooting...");
+    logger.flush();
+    ESP.restart();
+}
+/*                                                                      *
+ *  Shows the reason of the last reset and the last events. With dump,  *
+ *  prints the raw event log as hex for tools/event_log.py, the empty   *
+ *  (erased) lines are left out.                                        *
+ *                                                                      */
+void shellEvents(Print &out, uint8_t argc, char **argv) {
+    if(argc == 2 && strcmp(argv[1], "dump") != 0) {
+        out.println("Usage: events [dump]");
+        return;
+    }
+    if(argc == 2) {
+        eventLog.flush(true);
+        out.printf("size %u\n", eventLog.getSize());
+        uint8_t line[32];
+        for(uint32_t offset = 0; offset < eventLog.getSize(); offset += sizeof(line)) {
+            size_t length = eventLog.read(offset, line, sizeof(line));
+            bool erased = true;
+            for(size_t i = 0; i < length; i++) {
+                erased = erased && line[i] == 0xFF;
+            }
+            if(erased) {
+                continue;
+            }
+            out.printf("%05x ", offset);
+            for(size_t i = 0; i < length; i++) {
+                out.printf("%02x", line[i]);
+            }
+            out.println();
+        }
+        out.println("end");
+        return;
+    }
+    const EventLogReset &reset = eventLog.getReset();
+    out.printf("Boot %u, reset: %s, previous run %u s%s\n", eventLog.getBoot(), EventLog::getReasonName(reset.reason), reset.uptime,
+        reset.flags & EVENT_LOG_RTC_INTACT ? "" : ", RTC memory lost");
+    if(eventLog.wasCrash()) {
+        out.printf("Exception %u, epc1 0x%08x, epc2 0x%08x, epc3 0x%08x, excvaddr 0x%08x, depc 0x%08x\n", reset.exccause, reset.epc1,
+            reset.epc2, reset.epc3, reset.excvaddr, reset.depc);
+    }
+    if(reset.flags & EVENT_LOG_STACK_SAVED) {
+        out.print("Stack:");
+        for(uint8_t i = 0; i < EVENT_LOG_STACK_DEPTH && reset.stack[i] != 0; i++) {
+            out.printf(" 0x%08x", reset.stack[i]);
+        }
+        out.println();
+    }
+    LoggedEventRecord events[EVENT_LOG_RTC_EVENTS];
+    uint8_t count = eventLog.getEvents(events, EVENT_LOG_RTC_EVENTS);
+    for(uint8_t i = 0; i < count; i++) {
+        // RSSI and the NTP errors are negative, as in tools/event_log.py.
+        bool isSigned = events[i].code == LOGGED_WIFI_UP || events[i].code == LOGGED_NTP_SYNC;
+        out.printf("%8lu.%03lu  %-14s %d\n", (unsigned long)(events[i].time / 1000), (unsigned long)(events[i].time % 1000),
+            EventLog::getEventName(events[i].code), isSigned ? (int)(int16_t)events[i].value : (int)events[i].value);
+    }
+    const EventLogStats &stats = eventLog.getStats();
+    if(eventLog.isAvailable()) {
+        out.printf("Flash: %u of %u bytes of the sector used, %u flushes, %u bytes, %u erases, %u damaged\n", eventLog.getUsed(),
+            EVENT_LOG_SECTOR_SIZE, stats.flushes, stats.bytes, stats.erases, stats.damaged);
+    } else {
+        out.println("Flash: no filesystem region, the events are only kept in the RTC memory.");
+    }
+    out.printf("Events: %u recorded, %u lost, record() %u cycles (max %u)\n", stats.events, stats.lost, stats.lastRecordCycles,
+        stats.maxRecordCycles);
+}
+/*                                                                      *
+ *  Handles a binary frame received over the serial port. Display       *
+ *  frames take the same path as the ones received over UDP.            *
+ *                                                                      */
+void handleSerialFrame(uint8_t type, const uint8_t *payload, size_t length) {
+    if(type == SERIAL_FRAME_DISPLAY) {
+        frameReceiver.receive(payload, length);
+    } else if(type == SERIAL_FRAME_COMMAND) {
+        serialShell.execute((const char *)payload, length, Serial);
+    } else if(type == SERIAL_FRAME_STATS) {
+        // Counters of the frames, so the host can compare the rate it sends with the rate that is shown.
+        const FrameStats &frameStats = frameReceiver.getStats();
+        uint32_t counters[] = {(uint32_t)millis(), frameStats.received, frameStats.applied, frameStats.superseded, frameStats.outOfOrder,
+            frameStats.lost, frameStats.malformed, serialLink.getStats().crcErrors, serialLink.getStats().framingErrors};
+        serialLink.sendFrame(SERIAL_FRAME_STATS, (const uint8_t *)counters, sizeof(counters));
+    }
 }
 
 
 void resetEepromToDefault() {
-	EEPROM.begin(512);
-    int EEaddress = mem_map["SSID"];
-    EEPROM.put(EEaddress, "NixieTap");
-    EEaddress = mem_map["password"];
-    EEPROM.put(EEaddress, "NixieTap");
-    EEaddress = mem_map["target_ssid"];
-    EEPROM.put(EEaddress, "");
-    EEaddress = mem_map["target_pw"];
-    EEPROM.put(EEaddress, "");
-    EEaddress = mem_map["weather_key"];
-    EEPROM.put(EEaddress, "");
-    EEaddress = mem_map["weather_id"];
-    EEPROM.put(EEaddress, "");
-    EEaddress = mem_map["weather_format"];
-    EEPROM.put(EEaddress, 0);
-    EEaddress = mem_map["crypto_key"];
-    EEPROM.put(EEaddress, "");
-    EEaddress = mem_map["crypto_id"];
-    EEPROM.put(EEaddress, "");
-    EEaddress = mem_map["manual_time_flag"];
-    EEPROM.put(EEaddress, 1);
-    EEaddress = mem_map["enable_date"];
-    EEPROM.put(EEaddress, 1);
-    EEaddress = mem_map["enable_time"];
-    EEPROM.put(EEaddress, 1);
-    EEaddress = mem_map["enable_temp"];
-    EEPROM.put(EEaddress, 0);
-    EEaddress = mem_map["enable_crypto"];
-    EEPROM.put(EEaddress, 0);
-    EEaddress = mem_map["enable_dst"];
-    EEPROM.put(EEaddress, 0);
-    EEaddress = mem_map["enable_24h"];
-    EEPROM.put(EEaddress, 0);
-    EEaddress = mem_map["offset"];
-    EEPROM.put(EEaddress, 0);
-    EEPROM.commit();
+    config.setDefaults();
+    config.save();
+    config.flush(true);
 }
 
+/*                                                                      *
+ *  The config button is on GPIO16, which has no interrupt, so it is    *
+ *  sampled by the input job and its edges are timed from there.        *
+ *                                                                      */
 void readButton() {
-    configButton = digitalRead(CONFIG_BUTTON);
-    if(configButton) {
-		buttonCounter++;
-		if (buttonCounter==5) {
-			buttonCounter=0;
-			startPortalManually();
-		}	    
-    }
-}
-
-
-void firstRunInit() {
-	bool notInitialized=1;
-	EEPROM.begin(512);
-    EEPROM.get(mem_map["non_init"], notInitialized);
-	if(notInitialized) {
-		Serial.println("------------------------------------------");
-		Serial.println("Performing first run initialization...");
-		Serial.println("------------------------------------------");
-		resetEepromToDefault();
-	}
+    bool level = digitalRead(CONFIG_BUTTON);
+    if(level != configButton) {
+        configButton = level;
+        configGestures.edge(level, micros());
+    }
+}
+
+/*                                                                      *
+ *  Saves the monthly API request counters, if they have changed,       *
+ *  so the quotas are still respected after NixieTap is restarted.      *
+ *                                                                      */
+bool saveApiQuota(void *context) {
+    if(nixieTapAPI.providerPolicy.isQuotaDirty()) {
+        config.quota = nixieTapAPI.providerPolicy.getQuota();
+        config.save();
+        nixieTapAPI.providerPolicy.clearQuotaDirty();
+    }
+    return true;
+}
+// Prints the queued log lines that fit into the UART, the lines are formatted here and not where they were logged.
+bool drainLog(void *context) {
+    logger.drain();
+    return true;
+}
+/*                                                                      *
+ *  Records what changed since the last second into the event log: the  *
+ *  connections, the radio, the portal, job overruns and a low heap.    *
+ *  These are what is looked at after a crash, next to the reset.       *
+ *                                                                      */
+bool watchEvents(void *context) {
+    static bool wifiUp = false, mqttUp = false, radioOn = true, portalOpen = false, heapLow = false;
+    static uint32_t overruns[MAX_JOBS] = {};
+    bool connected = WiFi.status() == WL_CONNECTED;
+    if(connected != wifiUp) {
+        wifiUp = connected;
+        eventLog.record(connected ? LOGGED_WIFI_UP : LOGGED_WIFI_DOWN, connected ? (uint16_t)WiFi.RSSI() : 0);
+    }
+    if(mqttLink.connected() != mqttUp) {
+        mqttUp = !mqttUp;
+        eventLog.record(mqttUp ? LOGGED_MQTT_UP : LOGGED_MQTT_DOWN);
+    }
+    if(powerManager.isRadioOn() != radioOn) {
+        radioOn = !radioOn;
+        eventLog.record(radioOn ? LOGGED_RADIO_ON : LOGGED_RADIO_OFF);
+    }
+    if(wifiManager.getConfigPortalActive() != portalOpen) {
+        portalOpen = !portalOpen;
+        eventLog.record(portalOpen ? LOGGED_PORTAL_OPEN : LOGGED_PORTAL_CLOSED);
+    }
+    for(uint8_t i = 0; i < jobScheduler.getJobCount(); i++) {
+        if(jobScheduler.getStats(i).overruns != overruns[i]) {
+            overruns[i] = jobScheduler.getStats(i).overruns;
+            eventLog.record(LOGGED_OVERRUN, i);
+        }
+    }
+    uint32_t heap = ESP.getFreeHeap();
+    if((heap < EVENT_LOW_HEAP) != heapLow) {
+        heapLow = !heapLow;
+        if(heapLow) {
+            eventLog.record(LOGGED_LOW_HEAP, heap);
+        }
+    }
+    eventLog.tick();
+    return true;
+}
+/*                                                                      *
+ *  Registers the metrics that /metrics exports. The libraries count    *
+ *  into the ids they are given, the gauges are sampled on a scrape.    *
+ *                                                                      */
+void registerMetrics() {
+    metricIds.loopTime = metrics.addHistogram("nixietap_loop_seconds", "Duration of a pass of loop(), the jobs that were due included.",
+        loopTimeBounds, sizeof(loopTimeBounds) / sizeof(loopTimeBounds[0]), 1000000);
+    nixieTap.setFrameMetric(metrics.add(METRIC_COUNTER, "nixietap_spi_frames_total", "Frames sent to the tubes over SPI."));
+    int8_t transactions = metrics.add(METRIC_COUNTER, "nixietap_i2c_transactions_total", "I2C transactions with the RTC.");
+    RTC.setMetrics(transactions, metrics.add(METRIC_COUNTER, "nixietap_i2c_errors_total", "I2C transactions with the RTC that failed."));
+    // One histogram per provider, registered one after the other as ProviderPolicy expects.
+    int8_t firstProvider = -1;
+    for(uint8_t i = 0; i < PROVIDER_COUNT; i++) {
+        int8_t id = metrics.addHistogram("nixietap_http_request_seconds", "Duration of the requests to the API services.",
+            requestTimeBounds, sizeof(requestTimeBounds) / sizeof(requestTimeBounds[0]), 1000, "provider", ProviderPolicy::getName((ApiProvider)i));
+        if(i == 0) firstProvider = id;
+    }
+    if(firstProvider >= 0 && firstProvider + PROVIDER_COUNT == metrics.getCount()) {
+        nixieTapAPI.providerPolicy.setLatencyMetric(firstProvider);
+    }
+    TimedTlsClient::setMetric(metrics.addHistogram("nixietap_tls_handshake_seconds", "Duration of the TLS connects, the TCP connect included.",
+        requestTimeBounds, sizeof(requestTimeBounds) / sizeof(requestTimeBounds[0]), 1000));
+    metricIds.heapFree = metrics.add(METRIC_GAUGE, "nixietap_heap_free_bytes", "Free heap.");
+    metricIds.heapFragmentation = metrics.add(METRIC_GAUGE, "nixietap_heap_fragmentation_percent", "Fragmentation of the free heap.");
+    metricIds.heapMaxBlock = metrics.add(METRIC_GAUGE, "nixietap_heap_max_block_bytes", "Largest block that can be allocated.");
+    metricIds.rssi = metrics.add(METRIC_GAUGE, "nixietap_wifi_rssi_dbm", "Signal strength of the access point, the last one while disconnected.");
+    metricIds.wifiConnected = metrics.add(METRIC_GAUGE, "nixietap_wifi_connected", "1 while connected to the access point.");
+    metricIds.uptime = metrics.add(METRIC_GAUGE, "nixietap_uptime_seconds", "Time since the boot.");
+    metricIds.radioDuty = metrics.add(METRIC_GAUGE, "nixietap_radio_duty_ratio", "Share of the time the radio was on.", 1000);
+    metricIds.overruns = metrics.add(METRIC_COUNTER, "nixietap_job_overruns_total", "Jobs that ran past their deadline.");
+    metrics.onCollect(collectMetrics);
+}
+// Samples the gauges, right before /metrics is rendered.
+void collectMetrics() {
+    metrics.set(metricIds.heapFree, ESP.getFreeHeap());
+    metrics.set(metricIds.heapFragmentation, ESP.getHeapFragmentation());
+    metrics.set(metricIds.heapMaxBlock, ESP.getMaxFreeBlockSize());
+    bool connected = WiFi.status() == WL_CONNECTED;
+    if(connected) {
+        metrics.set(metricIds.rssi, WiFi.RSSI());
+    }
+    metrics.set(metricIds.wifiConnected, connected);
+    metrics.set(metricIds.uptime, millis() / 1000);
+    metrics.set(metricIds.radioDuty, powerManager.getDutyCycle());
+    uint32_t overruns = 0;
+    for(uint8_t i = 0; i < jobScheduler.getJobCount(); i++) {
+        overruns += jobScheduler.getStats(i).overruns;
+    }
+    metrics.set(metricIds.overruns, overruns);
+}
+/*                                                                      *
+ *  Writes the config once the saves of the last few seconds have       *
+ *  settled. When idle, a log sector that is getting full is compacted, *
+ *  so a later save doesn't have to wait for the erase.                 *
+ *                                                                      */
+bool flushConfig(void *context) {
+    if(config.flush()) {
+        eventLog.record(LOGGED_CONFIG_WRITE);
+    } else if(configLog.needsCompaction()) {
+        configLog.compact();
+    }
+    return true;
+}
+/*                                                                      *
+ *  Keeps the WiFi connected, the config portal does it while it is     *
+ *  open, unless a new network was entered there. A new lease of the    *
+ *  connection is saved with the config.                                *
+ *                                                                      */
+bool pollWifi(void *context) {
+    if(wifiManager.getConfigPortalActive() && !portalConnect) {
+        return true;
+    }
+    fastConnect.poll();
+    if(fastConnect.takeLeaseChanged()) {
+        config.save();
+    }
+    return true;
+}
+/*                                                                      *
+ *  Called on every tick of the RTC. The radio is kept on while MQTT,   *
+ *  the live view or the config portal need it and until the time was  *
+ *  synced over NTP. Pushed values and frames keep it on a bit longer,  *
+ *  more of them are likely to follow.                                  *
+ *                                                                      */
+void updatePower() {
+    static uint32_t pushes = 0, frames = 0;
+    if(pushServer.getStats().requests != pushes || frameReceiver.getStats().received != frames) {
+        pushes = pushServer.getStats().requests;
+        frames = frameReceiver.getStats().received;
+        powerManager.keepAwake();
+    }
+    bool needed = mqttLink.isConfigured() || liveView.hasClients() || wifiManager.getConfigPortalActive()
+        || (config.manual_time_flag == 0 && NTP.getLastNTPSync() == 0);
+    powerManager.tick(jobScheduler.getTimeUntilHeavy(), needed);
+}
+/*                                                                      *
+ *  Background job that keeps the MQTT connection up. Failed attempts   *
+ *  are retried later and later, so a broker that is down isn't         *
+ *  hammered and loop() isn't blocked by a connection timeout often.    *
+ *                                                                      */
+bool mqttConnect(void *context) {
+    if(WiFi.status() != WL_CONNECTED) {
+        return false;
+    }
+    mqttLink.connect();
+    jobScheduler.runIn(mqttJob, mqttLink.getRetryDelay());
+    return true;
+}
+/*                                                                      *
+ *  Publishes the health of NixieTap, retained, on <base>/health.       *
+ *                                                                      */
+bool publishHealth(void *context) {
+    if(!mqttLink.connected()) {
+        return false;
+    }
+    uint32_t overruns = 0;
+    for(uint8_t i = 0; i < jobScheduler.getJobCount(); i++) {
+        overruns += jobScheduler.getStats(i).overruns;
+    }
+    DisplaySlot *slot = slotRegistry.getSlot(slotRegistry.getCurrent());
+    char health[208];
+    snprintf(health, sizeof(health), "{\"uptime\":%lu,\"heap\":%u,\"rssi\":%d,\"slot\":\"%s\",\"overruns\":%u,\"time\":%s,\"radio_duty\":%u}",
+        millis() / 1000, ESP.getFreeHeap(), WiFi.RSSI(), slot != NULL ? slot->name : "", overruns, timeStatus() == timeSet ? "true" : "false",
+        powerManager.getDutyCycle());
+    mqttLink.publish("health", health, true);
+    return true;
+}
+/*                                                                      *
+ *  Applies a parameter received on <base>/config/<name>. MQTT has      *
+ *  no authentication here, anyone who can publish to the broker could  *
+ *  send it, so the topics are only subscribed with mqtt_config set.    *
+ *  Only the parameters that are safe to change remotely are accepted,  *
+ *  the keys and the WiFi credentials can only be set in the config     *
+ *  portal, or over the serial port.                                    *
+ *                                                                      */
+void applyMqttConfig(const char *name, const char *value) {
+    const Setting *setting = findSetting(name);
+    if(setting == NULL || !setting->remote) {
+        LOG_WARN(LOG_NET, "MQTT: Unknown parameter %s!", name);
+    } else if(parseSetting(*setting, value)) {
+        saveSetting(*setting);
+    } else {
+        LOG_WARN(LOG_NET, "MQTT: Invalid value of %s!", name);
+    }
+}
+/*                                                          *
+ *  MQTT jobs only run if a broker has been configured.     *
+ *                                                          */
+void updateMqttJobs() {
+    jobScheduler.setEnabled(mqttJob, mqttLink.isConfigured());
+    jobScheduler.setEnabled(healthJob, mqttLink.isConfigured());
+}
+bool sendLiveFrames(void *context) {
+    liveView.sendFrames();
+    return true;
+}
+/*                                                                      *
+ *  Sends the counters of NixieTap to the live view, as deltas since    *
+ *  the last second.                                                    *
+ *                                                                      */
+bool sendLiveMetrics(void *context) {
+    static const char *const names[] = {
+        "free_heap", "job_runs", "job_overruns", "push_requests", "udp_frames", "udp_lost",
+        "mqtt_messages", "display_frames", "live_overwritten", "live_dropped"
+    };
+    if(!liveView.hasClients()) {
+        return true;
+    }
+    uint32_t runs = 0, overruns = 0;
+    for(uint8_t i = 0; i < jobScheduler.getJobCount(); i++) {
+        runs += jobScheduler.getStats(i).runs;
+        overruns += jobScheduler.getStats(i).overruns;
+    }
+    uint32_t values[] = {
+        ESP.getFreeHeap(), runs, overruns, pushServer.getStats().requests, frameReceiver.getStats().received, frameReceiver.getStats().lost,
+        mqttLink.getStats().messages, liveView.getStats().frames, liveView.getStats().overwritten, liveView.getStats().dropped
+    };
+    liveView.sendMetrics(names, values, sizeof(values) / sizeof(values[0]));
+    return true;
 }
@@ -0,0 +1,145 @@
+#include "Shell.h"
+#include <Config.h>
+
+const Setting settings[] = {
+    {"ssid", SETTING_TEXT, config.ssid, 0, sizeof(config.ssid), false, NULL},
+    {"password", SETTING_TEXT, config.password, 0, sizeof(config.password), false, NULL},
+    {"target_ssid", SETTING_TEXT, config.target_ssid, 0, sizeof(config.target_ssid), false, NULL},
+    {"target_pw", SETTING_TEXT, config.target_pw, 0, sizeof(config.target_pw), false, NULL},
+    {"weather_key", SETTING_TEXT, config.weather_key, 0, sizeof(config.weather_key), false, weatherChanged},
+    {"weather_id", SETTING_TEXT, config.weather_id, 0, sizeof(config.weather_id), true, weatherChanged},
+    {"weather_format", SETTING_UINT8, &config.weather_format, 0, 1, false, weatherChanged},
+    {"crypto_key", SETTING_TEXT, config.crypto_key, 0, sizeof(config.crypto_key), false, cryptoChanged},
+    {"crypto_id", SETTING_TEXT, config.crypto_id, 0, sizeof(config.crypto_id), true, cryptoChanged},
+    {"manual_time_flag", SETTING_UINT8, &config.manual_time_flag, 0, 1, false, NULL},
+    {"enable_time", SETTING_UINT8, &config.enable_time, 0, 1, true, NULL},
+    {"enable_date", SETTING_UINT8, &config.enable_date, 0, 1, true, NULL},
+    {"enable_crypto", SETTING_UINT8, &config.enable_crypto, 0, 1, true, NULL},
+    {"enable_temp", SETTING_UINT8, &config.enable_temp, 0, 1, true, NULL},
+    {"enable_24h", SETTING_UINT8, &config.enable_24h, 0, 1, true, NULL},
+    {"enable_dst", SETTING_UINT8, &config.enable_dst, 0, 1, false, NULL},
+    {"offset", SETTING_INT16, &config.offset, -720, 840, false, NULL},
+    {"mqtt_host", SETTING_TEXT, config.mqtt_host, 0, sizeof(config.mqtt_host), false, mqttChanged},
+    {"mqtt_port", SETTING_UINT16, &config.mqtt_port, 1, 65535, false, mqttChanged},
+    {"mqtt_topic", SETTING_TEXT, config.mqtt_topic, 0, sizeof(config.mqtt_topic), false, mqttChanged},
+    {"mqtt_config", SETTING_UINT8, &config.mqtt_config, 0, 1, false, mqttChanged},
+    {"power_save", SETTING_UINT8, &config.power_save, 0, 1, true, powerChanged}
+};
+const uint8_t settingCount = sizeof(settings) / sizeof(settings[0]);
+
+// Serial commands, help lists them in this order.
+const ShellCommand shellCommands[] = {
+    {"help", "", "Lists the commands.", 0, 0, shellHelp},
+    {"get", "[setting]", "Shows one or all of the settings.", 0, 1, shellGet},
+    {"set", "<setting> [value]", "Saves a setting, a text without a value is cleared.", 1, 2, shellSet},
+    {"stats", "", "Shows the statistics of the jobs, slots and links.", 0, 0, shellStats},
+    {"time", "[hh:mm yyyy-mm-dd]", "Shows the time, or sets the RTC.", 0, 2, shellTime},
+    {"bench", "[count]", "Times the rendering and the serial frames.", 0, 1, shellBench},
+    {"mqtt", "<host|off> [port] [topic]", "Sets the MQTT broker.", 1, 3, shellMqtt},
+    {"events", "[dump]", "Shows the last reset and events, or dumps the event log.", 0, 1, shellEvents},
+    {"init", "", "Writes the factory defaults to EEPROM.", 0, 0, shellInit},
+    {"reboot", "", "Restarts NixieTap.", 0, 0, shellReboot}
+};
+const uint8_t shellCommandCount = sizeof(shellCommands) / sizeof(shellCommands[0]);
+
+void beginShell() {
+    serialShell.begin(shellCommands);
+}
+/*                                                                      *
+ *  Parses and stores a new value of a setting. Returns false if the    *
+ *  value is out of range or too long, the setting is left as it was.  *
+ *                                                                      */
+bool parseSetting(const Setting &setting, const char *text) {
+    if(setting.type == SETTING_TEXT) {
+        if(strlen(text) >= (size_t)setting.max) {
+            return false;
+        }
+        strcpy((char *)setting.value, text);
+        return true;
+    }
+    char *end;
+    long number = strtol(text, &end, 10);
+    if(*text == '\0' || *end != '\0' || number < setting.min || number > setting.max) {
+        return false;
+    }
+    if(setting.type == SETTING_UINT8) {
+        *(uint8_t *)setting.value = number;
+    } else if(setting.type == SETTING_INT16) {
+        *(int16_t *)setting.value = number;
+    } else {
+        *(uint16_t *)setting.value = number;
+    }
+    return true;
+}
+void printSetting(Print &out, const Setting &setting) {
+    if(setting.type == SETTING_TEXT) {
+        out.printf("%s = %s\n", setting.name, (const char *)setting.value);
+    } else if(setting.type == SETTING_UINT8) {
+        out.printf("%s = %u\n", setting.name, *(uint8_t *)setting.value);
+    } else if(setting.type == SETTING_INT16) {
+        out.printf("%s = %d\n", setting.name, *(int16_t *)setting.value);
+    } else {
+        out.printf("%s = %u\n", setting.name, *(uint16_t *)setting.value);
+    }
+}
+const Setting *findSetting(const char *name) {
+    for(uint8_t i = 0; i < settingCount; i++) {
+        if(strcmp(name, settings[i].name) == 0) {
+            return &settings[i];
+        }
+    }
+    return NULL;
+}
+/*                                                                      *
+ *  Serial commands. They only print to out, so they can be run from    *
+ *  a text line, a command frame, or a test on host.                    *
+ *                                                                      */
+void shellHelp(Print &out, uint8_t argc, char **argv) {
+    serialShell.printHelp(out);
+}
+void shellGet(Print &out, uint8_t argc, char **argv) {
+    if(argc == 1) {
+        for(uint8_t i = 0; i < settingCount; i++) {
+            printSetting(out, settings[i]);
+        }
+        return;
+    }
+    const Setting *setting = findSetting(argv[1]);
+    if(setting == NULL) {
+        out.printf("Unknown setting %s, type get for the list of settings.\n", argv[1]);
+        return;
+    }
+    printSetting(out, *setting);
+}
+void shellSet(Print &out, uint8_t argc, char **argv) {
+    const Setting *setting = findSetting(argv[1]);
+    if(setting == NULL) {
+        out.printf("Unknown setting %s, type get for the list of settings.\n", argv[1]);
+        return;
+    }
+    if(!parseSetting(*setting, argc > 2 ? argv[2] : "")) {
+        if(setting->type == SETTING_TEXT) {
+            out.printf("%s can be at most %ld characters long.\n", setting->name, setting->max - 1);
+        } else {
+            out.printf("%s must be a number from %ld to %ld.\n", setting->name, setting->min, setting->max);
+        }
+        return;
+    }
+    saveSetting(*setting);
+    printSetting(out, *setting);
+}
+void shellMqtt(Print &out, uint8_t argc, char **argv) {
+    char *end;
+    unsigned long port = argc > 2 ? strtoul(argv[2], &end, 10) : MQTT_DEFAULT_PORT;
+    const char *host = strcmp(argv[1], "off") == 0 ? "" : argv[1];
+    const char *topic = argc > 3 ? argv[3] : "nixietap";
+    if(strlen(host) >= sizeof(config.mqtt_host) || strlen(topic) >= sizeof(config.mqtt_topic) || (argc > 2 && *end != '\0') || port == 0 || port > 65535) {
+        out.println("Usage: mqtt <host|off> [port] [topic]");
+        return;
+    }
+    strcpy(config.mqtt_host, host);
+    config.mqtt_port = port;
+    strcpy(config.mqtt_topic, topic);
+    saveSetting(*findSetting("mqtt_host"));
+    out.println(config.mqtt_host[0] != '\0' ? "MQTT broker saved." : "MQTT turned off.");
+}
@@ -0,0 +1,56 @@
+#ifndef _SHELL_h   /* Include guard */
+#define _SHELL_h
+
+#include <Arduino.h>
+#include <SerialShell.h>
+
+#define SETTING_TEXT 0
+#define SETTING_UINT8 1
+#define SETTING_INT16 2
+#define SETTING_UINT16 3
+
+/*                                                                      *
+ *  Settings that can be read and changed with the serial commands get  *
+ *  and set. Those marked as remote can also be changed over MQTT, the  *
+ *  keys and the WiFi credentials can't. The names are the same as the  *
+ *  fields of the Config.                                               *
+ *                                                                      */
+struct Setting {
+    const char *name;
+    uint8_t type;
+    void *value;
+    long min;
+    long max;               // Largest value, or the size of the buffer of a text.
+    bool remote;
+    void (*changed)();      // Applies the new value, called after it is saved.
+};
+
+// The tables are in Shell.cpp, next to the commands that only need the Config.
+extern const Setting settings[];
+extern const uint8_t settingCount;
+extern const ShellCommand shellCommands[];
+extern const uint8_t shellCommandCount;
+
+void beginShell();
+bool parseSetting(const Setting &setting, const char *text);
+void printSetting(Print &out, const Setting &setting);
+const Setting *findSetting(const char *name);
+void shellHelp(Print &out, uint8_t argc, char **argv);
+void shellGet(Print &out, uint8_t argc, char **argv);
+void shellSet(Print &out, uint8_t argc, char **argv);
+void shellMqtt(Print &out, uint8_t argc, char **argv);
+
+// Defined in NixieTap.cpp, they need the rest of the firmware.
+void saveSetting(const Setting &setting);
+void weatherChanged();
+void cryptoChanged();
+void mqttChanged();
+void powerChanged();
+void shellStats(Print &out, uint8_t argc, char **argv);
+void shellTime(Print &out, uint8_t argc, char **argv);
+void shellBench(Print &out, uint8_t argc, char **argv);
+void shellInit(Print &out, uint8_t argc, char **argv);
+void shellReboot(Print &out, uint8_t argc, char **argv);
+void shellEvents(Print &out, uint8_t argc, char **argv);
+
+#endif // _SHELL_h
@@ -0,0 +1,104 @@
+#ifndef _ARDUINO_STUB_h   /* Include guard */
+#define _ARDUINO_STUB_h
+
+/*                                                                          *
+ *  Just enough of the ESP8266 Arduino core to compile the libraries on    *
+ *  the host. millis() returns fakeMillis, a test moves the time itself.    *
+ *                                                                          */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <algorithm>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define PGM_P const char *
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define snprintf_P snprintf
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define ICACHE_RAM_ATTR
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D8 15
+
+using std::min;
+using std::max;
+
+extern uint32_t fakeMillis;
+
+inline uint32_t millis() {
+    return fakeMillis;
+}
+inline uint32_t micros() {
+    return fakeMillis * 1000;
+}
+inline void yield() {
+}
+inline void noInterrupts() {
+}
+inline void interrupts() {
+}
+
+// Only what the commands use, a test writes into a string.
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const char *text) {
+        size_t length = strlen(text);
+        for(size_t i = 0; i < length; i++) write((uint8_t)text[i]);
+        return length;
+    }
+    size_t print(const char *text) { return write(text); }
+    size_t println(const char *text = "") { return write(text) + write("\n"); }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        return write(buffer);
+    }
+};
+
+// The bytes a test puts into input are read back, the written ones collect in output.
+class HardwareSerial : public Print {
+public:
+    std::string input;
+    std::string output;
+    void begin(unsigned long baud) {}
+    size_t setRxBufferSize(size_t size) { return size; }
+    int available() { return input.size(); }
+    int read() {
+        if(input.empty()) return -1;
+        uint8_t c = input[0];
+        input.erase(0, 1);
+        return c;
+    }
+    size_t write(uint8_t c) override { output += (char)c; return 1; }
+    size_t write(const uint8_t *data, size_t length) { output.append((const char *)data, length); return length; }
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+class String {
+    std::string text;
+public:
+    String(const char *text = "") : text(text) {}
+    const char *c_str() const { return text.c_str(); }
+    unsigned int length() const { return text.size(); }
+    bool operator==(const String &other) const { return text == other.text; }
+    bool operator!=(const String &other) const { return text != other.text; }
+};
+
+#endif // _ARDUINO_STUB_h
@@ -0,0 +1,12 @@
+#ifndef _ESP8266WIFI_STUB_h   /* Include guard */
+#define _ESP8266WIFI_STUB_h
+
+#include <Arduino.h>
+
+// Only the types that the headers of the libraries need.
+class WiFiClient {
+};
+
+typedef void *WiFiEventHandler;
+
+#endif // _ESP8266WIFI_STUB_h
@@ -0,0 +1,82 @@
+#ifndef _ESPASYNCTCP_STUB_h   /* Include guard */
+#define _ESPASYNCTCP_STUB_h
+
+#include <Arduino.h>
+#include <functional>
+
+#define ASYNC_SEND_BUFFER 2920      // TCP_SND_BUF of the ESP8266 lwIP, two segments.
+
+class AsyncClient;
+
+typedef std::function<void(void *, AsyncClient *)> AcConnectHandler;
+typedef std::function<void(void *, AsyncClient *, void *data, size_t len)> AcDataHandler;
+typedef std::function<void(void *, AsyncClient *, size_t len, uint32_t time)> AcAckHandler;
+
+/*                                                                          *
+ *  A connection that the test drives. receive() delivers a segment from    *
+ *  the peer, the bytes sent to it collect in output and take space until   *
+ *  ack(). Like the real one, a closed client gets no more data.            *
+ *                                                                          */
+class AsyncClient {
+    AcDataHandler dataHandler;
+    AcConnectHandler disconnectHandler;
+    AcAckHandler ackHandler;
+    void *dataArg = NULL;
+    void *disconnectArg = NULL;
+    void *ackArg = NULL;
+    size_t unacked = 0;
+public:
+    std::string output;
+    bool closed = false;
+    uint32_t rxTimeout = 0;
+
+    void onData(AcDataHandler handler, void *arg = NULL) { dataHandler = handler; dataArg = arg; }
+    void onDisconnect(AcConnectHandler handler, void *arg = NULL) { disconnectHandler = handler; disconnectArg = arg; }
+    void onAck(AcAckHandler handler, void *arg = NULL) { ackHandler = handler; ackArg = arg; }
+    void setRxTimeout(uint32_t timeout) { rxTimeout = timeout; }
+    void setNoDelay(bool noDelay) {}
+    size_t space() { return closed ? 0 : ASYNC_SEND_BUFFER - unacked; }
+    size_t add(const char *data, size_t size) {
+        size = min(size, space());
+        output.append(data, size);
+        unacked += size;
+        return size;
+    }
+    bool send() { return !closed; }
+    size_t write(const char *data, size_t size) { return add(data, size); }
+    void close(bool now = false) { closed = true; }
+
+    void receive(const char *data) {
+        if(!closed && dataHandler) dataHandler(dataArg, this, (void *)data, strlen(data));
+    }
+    void ack() {
+        size_t acked = unacked;
+        unacked = 0;
+        if(ackHandler) ackHandler(ackArg, this, acked, 0);
+    }
+    // The client is deleted by the handler, as on the device.
+    void disconnect() {
+        if(disconnectHandler) disconnectHandler(disconnectArg, this);
+    }
+};
+
+class AsyncServer {
+    AcConnectHandler clientHandler;
+    void *clientArg = NULL;
+public:
+    AsyncServer(uint16_t port) {}
+    void onClient(AcConnectHandler handler, void *arg) { clientHandler = handler; clientArg = arg; }
+    void begin() { listening() = this; }
+    // A new connection to the server that was started last.
+    static AsyncClient *connect() {
+        AsyncClient *client = new AsyncClient();
+        listening()->clientHandler(listening()->clientArg, client);
+        return client;
+    }
+    static AsyncServer *&listening() {
+        static AsyncServer *server = NULL;
+        return server;
+    }
+};
+
+#endif // _ESPASYNCTCP_STUB_h
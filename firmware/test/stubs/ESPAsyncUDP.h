@@ -0,0 +1,21 @@
+#ifndef _ESPASYNCUDP_STUB_h   /* Include guard */
+#define _ESPASYNCUDP_STUB_h
+
+#include <Arduino.h>
+
+// No network on the host, the tests call receive() with the packets.
+class AsyncUDPPacket {
+public:
+    uint8_t *data() { return NULL; }
+    size_t length() { return 0; }
+};
+
+typedef void (*AuPacketHandlerFunctionWithArg)(void *arg, AsyncUDPPacket &packet);
+
+class AsyncUDP {
+public:
+    bool listen(uint16_t port) { return false; }
+    void onPacket(AuPacketHandlerFunctionWithArg handler, void *arg = NULL) {}
+};
+
+#endif // _ESPASYNCUDP_STUB_h
@@ -0,0 +1,22 @@
+#ifndef _LOGGER_h   /* Include guard */
+#define _LOGGER_h
+
+#include <Arduino.h>
+
+// The tests check the counters, not the log, every message compiles to nothing.
+enum LogModule : uint8_t {
+    LOG_MAIN = 0,
+    LOG_API,
+    LOG_DISPLAY,
+    LOG_NET,
+    LOG_JOBS,
+    LOG_CONFIG,
+    LOG_MODULES_COUNT
+};
+
+#define LOG_ERROR(module, format, ...) do {} while(0)
+#define LOG_WARN(module, format, ...) do {} while(0)
+#define LOG_INFO(module, format, ...) do {} while(0)
+#define LOG_DEBUG(module, format, ...) do {} while(0)
+
+#endif // _LOGGER_h
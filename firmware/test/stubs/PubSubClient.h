@@ -0,0 +1,11 @@
+#ifndef _PUBSUBCLIENT_STUB_h   /* Include guard */
+#define _PUBSUBCLIENT_STUB_h
+
+#include <ESP8266WiFi.h>
+
+class PubSubClient {
+public:
+    PubSubClient(WiFiClient &client) {}
+};
+
+#endif // _PUBSUBCLIENT_STUB_h
@@ -0,0 +1,6 @@
+#ifndef _SPI_STUB_h   /* Include guard */
+#define _SPI_STUB_h
+
+#include <Arduino.h>
+
+#endif // _SPI_STUB_h
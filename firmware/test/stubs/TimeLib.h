@@ -0,0 +1,11 @@
+#ifndef _TIMELIB_STUB_h   /* Include guard */
+#define _TIMELIB_STUB_h
+
+#include <Arduino.h>
+#include <time.h>
+
+typedef struct {
+    uint8_t Second, Minute, Hour, Wday, Day, Month, Year;
+} tmElements_t;
+
+#endif // _TIMELIB_STUB_h
@@ -0,0 +1,32 @@
+#ifndef _TEST_h   /* Include guard */
+#define _TEST_h
+
+#include <stdio.h>
+
+/*                                                                          *
+ *  The smallest test harness that works: CHECK() prints the failed         *
+ *  condition with its line and the test goes on, main() returns the        *
+ *  number of failures so ctest sees them.                                  *
+ *                                                                          */
+extern int testFailures;
+
+#define CHECK(condition) do { \
+        if(!(condition)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            testFailures++; \
+        } \
+    } while(0)
+#define CHECK_EQUAL(expected, actual) do { \
+        long long _expected = (long long)(expected), _actual = (long long)(actual); \
+        if(_expected != _actual) { \
+            printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _actual, _expected); \
+            testFailures++; \
+        } \
+    } while(0)
+#define RUN_TEST(test) do { \
+        int _before = testFailures; \
+        test(); \
+        printf("%-40s %s\n", #test, testFailures == _before ? "ok" : "FAILED"); \
+    } while(0)
+
+#endif // _TEST_h
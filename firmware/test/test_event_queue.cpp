@@ -0,0 +1,94 @@
+#include "test.h"
+#include <EventQueue.h>
+
+int testFailures = 0;
+
+static void testEmptyQueue() {
+    EventQueue queue;
+    Event event;
+    CHECK(!queue.pop(event));
+    CHECK_EQUAL(0, queue.getDepth());
+    CHECK_EQUAL(0, queue.getStats().pushed);
+}
+
+static void testKeepsTheOrderOfAllSources() {
+    EventQueue queue;
+    // No type jumps ahead, a touch between two ticks stays between them.
+    fakeMillis = 1;
+    CHECK(queue.push(EVENT_RTC_TICK));
+    fakeMillis = 2;
+    CHECK(queue.push(EVENT_TOUCH, 1));
+    fakeMillis = 3;
+    CHECK(queue.push(EVENT_TOUCH, 0));
+    fakeMillis = 4;
+    CHECK(queue.push(EVENT_RTC_TICK));
+    CHECK_EQUAL(4, queue.getDepth());
+
+    EventType types[] = {EVENT_RTC_TICK, EVENT_TOUCH, EVENT_TOUCH, EVENT_RTC_TICK};
+    uint8_t data[] = {0, 1, 0, 0};
+    Event event;
+    for(uint8_t i = 0; i < 4; i++) {
+        CHECK(queue.pop(event));
+        CHECK_EQUAL(types[i], event.type);
+        CHECK_EQUAL(data[i], event.data);
+        CHECK_EQUAL((i + 1) * 1000, event.time);
+    }
+    CHECK(!queue.pop(event));
+    fakeMillis = 0;
+}
+
+static void testWrapsAround() {
+    EventQueue queue;
+    Event event;
+    // Interleaved like an interrupt between two passes of loop(), the indexes wrap several times.
+    for(uint16_t i = 0; i < EVENT_QUEUE_SIZE * 5; i++) {
+        CHECK(queue.push(EVENT_TOUCH, i & 0xFF));
+        CHECK(queue.push(EVENT_RTC_TICK, (i + 1) & 0xFF));
+        CHECK(queue.pop(event));
+        CHECK_EQUAL(i & 0xFF, event.data);
+        CHECK(queue.pop(event));
+        CHECK_EQUAL((i + 1) & 0xFF, event.data);
+    }
+    CHECK_EQUAL(0, queue.getDepth());
+    CHECK_EQUAL(EVENT_QUEUE_SIZE * 10, queue.getStats().pushed);
+    CHECK_EQUAL(2, queue.getStats().maxDepth);
+}
+
+static void testFullQueueDropsTheNewEvents() {
+    EventQueue queue;
+    // One entry is left free to tell a full queue from an empty one.
+    for(uint8_t i = 0; i < EVENT_QUEUE_SIZE - 1; i++) {
+        CHECK(queue.push(EVENT_RTC_TICK, i));
+    }
+    CHECK(!queue.push(EVENT_TOUCH, 100));
+    CHECK(!queue.push(EVENT_TOUCH, 101));
+    CHECK(!queue.push(EVENT_RTC_TICK, 102));
+    EventQueueStats stats = queue.getStats();
+    CHECK_EQUAL(EVENT_QUEUE_SIZE - 1, stats.pushed);
+    CHECK_EQUAL(2, stats.dropped[EVENT_TOUCH]);
+    CHECK_EQUAL(1, stats.dropped[EVENT_RTC_TICK]);
+    CHECK_EQUAL(EVENT_QUEUE_SIZE - 1, stats.maxDepth);
+    CHECK_EQUAL(EVENT_QUEUE_SIZE - 1, queue.getDepth());
+
+    // The older events are kept, and there is room again once one is taken.
+    Event event;
+    CHECK(queue.pop(event));
+    CHECK_EQUAL(0, event.data);
+    CHECK(queue.push(EVENT_TOUCH, 103));
+    for(uint8_t i = 1; i < EVENT_QUEUE_SIZE - 1; i++) {
+        CHECK(queue.pop(event));
+        CHECK_EQUAL(i, event.data);
+    }
+    CHECK(queue.pop(event));
+    CHECK_EQUAL(EVENT_TOUCH, event.type);
+    CHECK_EQUAL(103, event.data);
+    CHECK(!queue.pop(event));
+}
+
+int main() {
+    RUN_TEST(testEmptyQueue);
+    RUN_TEST(testKeepsTheOrderOfAllSources);
+    RUN_TEST(testWrapsAround);
+    RUN_TEST(testFullQueueDropsTheNewEvents);
+    return testFailures != 0;
+}
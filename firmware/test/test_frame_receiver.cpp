@@ -0,0 +1,206 @@
+#include "test.h"
+#include <FrameReceiver.h>
+
+#define INPUT_INTERVAL 10       // ms, the input job of NixieTap.cpp takes the frames this often.
+
+int testFailures = 0;
+
+// Same layout as encode() in tools/frame_sender.py.
+static void send(FrameReceiver &receiver, uint16_t sequence, uint8_t flags = 0, const char *value = "1234",
+        uint8_t dots = 0, uint8_t transition = NIXIE_TRANSITION_CUT) {
+    uint8_t digits[4];
+    for(int i = 0; i < 4; i++) {
+        digits[i] = value[i] >= '0' && value[i] <= '9' ? value[i] - '0' : 0xA;
+    }
+    uint8_t packet[FRAME_PACKET_SIZE] = {
+        FRAME_MAGIC, FRAME_VERSION, (uint8_t)(sequence >> 8), (uint8_t)sequence,
+        (uint8_t)(digits[0] << 4 | digits[1]), (uint8_t)(digits[2] << 4 | digits[3]),
+        dots, 0, transition, flags
+    };
+    receiver.receive(packet, sizeof(packet));
+}
+
+static void testDecodesTheFrame() {
+    FrameReceiver receiver;
+    NixieFrame frame;
+    CHECK(!receiver.takeFrame(frame));
+    send(receiver, 7, 0, "9 05", 0x12, NIXIE_TRANSITION_ROLL);
+    CHECK(receiver.takeFrame(frame));
+    CHECK_EQUAL(9, frame.digits[0]);
+    CHECK_EQUAL(0xA, frame.digits[1]);
+    CHECK_EQUAL(0, frame.digits[2]);
+    CHECK_EQUAL(5, frame.digits[3]);
+    CHECK_EQUAL(0x12, frame.dots);
+    CHECK_EQUAL(NIXIE_TRANSITION_ROLL, frame.transition);
+    CHECK(!receiver.takeFrame(frame));
+    CHECK_EQUAL(1, receiver.getStats().received);
+}
+
+static void testRejectsMalformedPackets() {
+    FrameReceiver receiver;
+    uint8_t packet[FRAME_PACKET_SIZE + 1] = {FRAME_MAGIC, FRAME_VERSION};
+    receiver.receive(packet, FRAME_PACKET_SIZE - 1);
+    receiver.receive(packet, FRAME_PACKET_SIZE + 1);
+    packet[0] = 'X';
+    receiver.receive(packet, FRAME_PACKET_SIZE);
+    packet[0] = FRAME_MAGIC;
+    packet[1] = FRAME_VERSION + 1;
+    receiver.receive(packet, FRAME_PACKET_SIZE);
+    NixieFrame frame;
+    CHECK(!receiver.takeFrame(frame));
+    CHECK_EQUAL(4, receiver.getStats().malformed);
+    CHECK_EQUAL(0, receiver.getStats().received);
+}
+
+static void testCountsGapsAsLost() {
+    FrameReceiver receiver;
+    send(receiver, 1);
+    send(receiver, 2);
+    send(receiver, 5);
+    send(receiver, 6);
+    CHECK_EQUAL(4, receiver.getStats().received);
+    CHECK_EQUAL(2, receiver.getStats().lost);
+    CHECK_EQUAL(0, receiver.getStats().outOfOrder);
+}
+
+static void testDropsOldAndRepeatedFrames() {
+    FrameReceiver receiver;
+    send(receiver, 10);
+    send(receiver, 12);
+    send(receiver, 11);     // Late, its gap was already counted as lost.
+    send(receiver, 12);     // Repeated.
+    send(receiver, 13);
+    CHECK_EQUAL(3, receiver.getStats().received);
+    CHECK_EQUAL(2, receiver.getStats().outOfOrder);
+    CHECK_EQUAL(1, receiver.getStats().lost);
+}
+
+static void testSequenceWrapsAround() {
+    FrameReceiver receiver;
+    send(receiver, 0xFFFE);
+    send(receiver, 0xFFFF);
+    send(receiver, 0);
+    send(receiver, 2);
+    send(receiver, 0xFFFF);  // Three behind, not 0xFFFC ahead.
+    CHECK_EQUAL(4, receiver.getStats().received);
+    CHECK_EQUAL(1, receiver.getStats().lost);
+    CHECK_EQUAL(1, receiver.getStats().outOfOrder);
+}
+
+static void testResetFlagRestartsTheSequence() {
+    FrameReceiver receiver;
+    send(receiver, 500);
+    send(receiver, 0, FRAME_FLAG_RESET);
+    send(receiver, 1);
+    CHECK_EQUAL(3, receiver.getStats().received);
+    CHECK_EQUAL(0, receiver.getStats().lost);
+    CHECK_EQUAL(0, receiver.getStats().outOfOrder);
+}
+
+static void testTimeoutRestartsTheSequence() {
+    FrameReceiver receiver;
+    fakeMillis = 1000;
+    send(receiver, 500);
+    fakeMillis += FRAME_SEQUENCE_TIMEOUT;
+    send(receiver, 3);      // Not long enough yet, still older than 500.
+    CHECK_EQUAL(1, receiver.getStats().outOfOrder);
+    fakeMillis += 1;
+    send(receiver, 3);      // The sender restarted without the flag.
+    send(receiver, 4);
+    CHECK_EQUAL(3, receiver.getStats().received);
+    CHECK_EQUAL(1, receiver.getStats().outOfOrder);
+    CHECK_EQUAL(0, receiver.getStats().lost);
+    fakeMillis = 0;
+}
+
+static void testKeepsOnlyTheNewestFrame() {
+    FrameReceiver receiver;
+    send(receiver, 1, 0, "1111");
+    send(receiver, 2, 0, "2222");
+    send(receiver, 3, 0, "3333");
+    NixieFrame frame;
+    CHECK(receiver.takeFrame(frame));
+    CHECK_EQUAL(3, frame.digits[0]);
+    CHECK(!receiver.takeFrame(frame));
+    CHECK_EQUAL(2, receiver.getStats().superseded);
+    receiver.countApplied();
+    CHECK_EQUAL(1, receiver.getStats().applied);
+}
+
+/*                                                                          *
+ *  A sender at a fixed rate, with the stub clock, while the input job      *
+ *  takes a frame every INPUT_INTERVAL ms, as in the firmware. Some frames  *
+ *  are dropped, swapped with the next one or damaged on the way. Every     *
+ *  packet must show up in exactly one counter.                             *
+ *                                                                          */
+static void testSustainedRate() {
+    const uint32_t rate = 1000, seconds = 10;
+    FrameReceiver receiver;
+    fakeMillis = 1000;
+    uint32_t sent = 0, dropped = 0, swapped = 0, damaged = 0, taken = 0;
+    uint16_t sequence = 0;
+    uint32_t random = 1;
+    bool holding = false;       // A frame held back, it is sent after the next one.
+    uint16_t held = 0;
+    for(uint32_t tick = 0; tick < rate * seconds; tick++) {
+        fakeMillis = 1000 + tick * 1000 / rate;
+        random = random * 1103515245 + 12345;
+        uint8_t fate = (random >> 16) % 100;
+        sequence++;
+        if(fate == 0) {
+            dropped++;
+        } else if(fate == 1) {
+            uint8_t packet[FRAME_PACKET_SIZE] = {FRAME_MAGIC, FRAME_VERSION + 1};
+            receiver.receive(packet, sizeof(packet));
+            damaged++;
+            sent++;
+        } else if(fate == 2 && !holding) {
+            holding = true;
+            held = sequence;
+        } else {
+            send(receiver, sequence);
+            sent++;
+            if(holding) {
+                send(receiver, held);
+                holding = false;
+                swapped++;
+                sent++;
+            }
+        }
+        NixieFrame frame;
+        if(tick % (INPUT_INTERVAL * rate / 1000) == 0 && receiver.takeFrame(frame)) {
+            receiver.countApplied();
+            taken++;
+        }
+    }
+    NixieFrame frame;
+    bool pending = receiver.takeFrame(frame);
+    const FrameStats &stats = receiver.getStats();
+    printf("%u packets/s for %u s: %u applied (%u/s), %u superseded, %u out of order, %u lost, %u malformed\n", rate, seconds,
+        stats.applied, stats.applied / seconds, stats.superseded, stats.outOfOrder, stats.lost, stats.malformed);
+    CHECK_EQUAL(sent, stats.received + stats.outOfOrder + stats.malformed);
+    CHECK_EQUAL(stats.received, stats.applied + stats.superseded + pending);
+    CHECK_EQUAL(sent, stats.applied + stats.superseded + pending + stats.outOfOrder + stats.malformed);
+    CHECK_EQUAL(damaged, stats.malformed);
+    CHECK_EQUAL(swapped, stats.outOfOrder);
+    // A held back frame left a gap when the next one arrived, it is counted as lost before it comes late.
+    // The sequence number of a damaged frame is a gap too.
+    CHECK_EQUAL(dropped + swapped + damaged, stats.lost);
+    // The tubes get a frame on every pass of the input job, the rest is superseded.
+    CHECK_EQUAL(taken, stats.applied);
+    CHECK_EQUAL(seconds * 1000 / INPUT_INTERVAL, stats.applied);
+    fakeMillis = 0;
+}
+
+int main() {
+    RUN_TEST(testDecodesTheFrame);
+    RUN_TEST(testRejectsMalformedPackets);
+    RUN_TEST(testCountsGapsAsLost);
+    RUN_TEST(testDropsOldAndRepeatedFrames);
+    RUN_TEST(testSequenceWrapsAround);
+    RUN_TEST(testResetFlagRestartsTheSequence);
+    RUN_TEST(testTimeoutRestartsTheSequence);
+    RUN_TEST(testKeepsOnlyTheNewestFrame);
+    RUN_TEST(testSustainedRate);
+    return testFailures != 0;
+}
@@ -0,0 +1,89 @@
+#include "test.h"
+#include <GestureRecognizer.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+
+/*                                                                          *
+ *  Replays the edge traces in traces/ through GestureRecognizer, the way   *
+ *  the firmware feeds it: every edge with its own timestamp, update()      *
+ *  every 10 ms like pollInput(). A trace is a text file, '#' starts a      *
+ *  comment, "expect" lists the gestures, separated by commas, and every    *
+ *  other line is an edge, "<micros> <level>" with 1 for pressed. A debug   *
+ *  build (LOG_LEVEL=4) logs every touch edge as "Touch edge <micros>       *
+ *  <level>", the ends of those lines make a trace.                         *
+ *                                                                          */
+#define POLL_INTERVAL 10000     // us, INPUT_INTERVAL of NixieTap.cpp.
+#define TRACE_TAIL 2000000      // Polled this long after the last edge, for the timeouts.
+
+int testFailures = 0;
+
+static void poll(GestureRecognizer &recognizer, uint32_t now, std::string &gestures) {
+    recognizer.update(now);
+    Gesture gesture;
+    while((gesture = recognizer.takeGesture()) != GESTURE_NONE) {
+        gestures += gestures.empty() ? "" : ", ";
+        gestures += GestureRecognizer::getName(gesture);
+    }
+}
+
+static void replay(const char *path) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        printf("%s: can't open\n", path);
+        testFailures++;
+        return;
+    }
+    GestureRecognizer recognizer;
+    std::string expected, gestures;
+    bool started = false;
+    uint32_t now = 0;
+    char line[128];
+    while(fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '#' || line[0] == '\0') {
+            continue;
+        }
+        if(strncmp(line, "expect ", 7) == 0) {
+            expected = strcmp(line + 7, "none") == 0 ? "" : line + 7;
+            continue;
+        }
+        char *end;
+        uint32_t time = strtoul(line, &end, 10);
+        bool pressed = strtoul(end, NULL, 10) != 0;
+        if(!started) {
+            started = true;
+            now = time - POLL_INTERVAL * 10;
+            recognizer.begin(false, now);
+        }
+        // Polled up to the edge, then the edge arrives from the interrupt.
+        while((int32_t)(time - (now + POLL_INTERVAL)) >= 0) {
+            now += POLL_INTERVAL;
+            poll(recognizer, now, gestures);
+        }
+        recognizer.edge(pressed, time);
+    }
+    fclose(file);
+    for(uint32_t tail = 0; tail < TRACE_TAIL; tail += POLL_INTERVAL) {
+        now += POLL_INTERVAL;
+        poll(recognizer, now, gestures);
+    }
+    const char *name = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+    if(gestures != expected) {
+        printf("%s: got \"%s\", expected \"%s\"\n", name, gestures.c_str(), expected.c_str());
+        testFailures++;
+    } else {
+        printf("%-40s ok\n", name);
+    }
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        printf("Usage: test_gestures <trace>...\n");
+        return 1;
+    }
+    for(int i = 1; i < argc; i++) {
+        replay(argv[i]);
+    }
+    return testFailures != 0;
+}
@@ -0,0 +1,219 @@
+#include "test.h"
+#include <PushServer.h>
+#include <chrono>
+
+int testFailures = 0;
+
+// nixie.cpp needs the tubes, the pushed values here are plain digits or plainly not numbers.
+bool Nixie::isNumber(const char *text, size_t length) {
+    for(size_t i = 0; i < length; i++) {
+        if(!isdigit((unsigned char)text[i])) return false;
+    }
+    return length > 0;
+}
+
+static bool startsWith(const std::string &text, const char *start) {
+    return text.compare(0, strlen(start), start) == 0;
+}
+
+// One request on a new connection, returns the status line and the headers of the answer.
+static std::string request(const char *text) {
+    AsyncClient *client = AsyncServer::connect();
+    client->receive(text);
+    std::string output = client->output;
+    CHECK(client->closed);
+    client->disconnect();
+    return output;
+}
+
+static void testValue() {
+    PushServer server;
+    server.begin();
+    CHECK(!server.hasValue());
+    CHECK(startsWith(request("GET /value?v=42 HTTP/1.1\r\nHost: tap\r\n\r\n"), "HTTP/1.1 200 OK"));
+    CHECK(server.takeValue());
+    CHECK(!server.takeValue());
+    CHECK(strcmp(server.getValue(), "42") == 0);
+    CHECK(startsWith(request("POST /value?x=1&v=7&y=2 HTTP/1.1\r\n\r\n"), "HTTP/1.1 200 OK"));
+    CHECK(strcmp(server.getValue(), "7") == 0);
+    CHECK_EQUAL(2, server.getStats().requests);
+    CHECK_EQUAL(0, server.getStats().rejected);
+}
+
+static void testBadValues() {
+    PushServer server;
+    server.begin();
+    const char *bad[] = {
+        "GET /value HTTP/1.1\r\n\r\n",
+        "GET /value?v= HTTP/1.1\r\n\r\n",
+        "GET /value?vv=1 HTTP/1.1\r\n\r\n",       // Only the whole name matches.
+        "GET /value?xv=1 HTTP/1.1\r\n\r\n",
+        "GET /value?v=12a HTTP/1.1\r\n\r\n",
+        "GET /value?v=1234567890123456 HTTP/1.1\r\n\r\n",
+        "GET /slot?n=1a HTTP/1.1\r\n\r\n",
+        "GET /slot?n=123 HTTP/1.1\r\n\r\n",
+        "GET /animation?v=2 HTTP/1.1\r\n\r\n",
+        "PUT /value?v=1 HTTP/1.1\r\n\r\n",
+        "GET /value?v=1\r\n\r\n",                 // No version, the target never ends.
+        "\r\n",
+    };
+    for(const char *text : bad) {
+        CHECK(startsWith(request(text), "HTTP/1.1 400 Bad Request"));
+    }
+    CHECK(!server.takeValue());
+    CHECK_EQUAL(12, server.getStats().requests);
+    CHECK_EQUAL(12, server.getStats().rejected);
+}
+
+static void testSlotAnimationAndBrightness() {
+    PushServer server;
+    server.begin();
+    CHECK_EQUAL(-1, server.takeSlot());
+    CHECK(startsWith(request("GET /slot?n=12 HTTP/1.1\r\n\r\n"), "HTTP/1.1 200 OK"));
+    CHECK_EQUAL(12, server.takeSlot());
+    CHECK_EQUAL(-1, server.takeSlot());
+    CHECK(startsWith(request("POST /slot?n=3 HTTP/1.0\r\n\r\n"), "HTTP/1.1 200 OK"));
+    CHECK_EQUAL(3, server.takeSlot());
+    CHECK(startsWith(request("GET /animation?v=1 HTTP/1.1\r\n\r\n"), "HTTP/1.1 200 OK"));
+    CHECK_EQUAL(1, server.takeAnimation());
+    CHECK_EQUAL(-1, server.takeAnimation());
+    CHECK(startsWith(request("GET /brightness?v=5 HTTP/1.1\r\n\r\n"), "HTTP/1.1 501 Not Implemented"));
+    CHECK(startsWith(request("GET /nope HTTP/1.1\r\n\r\n"), "HTTP/1.1 404 Not Found"));
+    CHECK(startsWith(request("GET /value/more?v=1 HTTP/1.1\r\n\r\n"), "HTTP/1.1 404 Not Found"));
+    CHECK_EQUAL(2, server.getStats().rejected);
+}
+
+static void testSplitRequestLine() {
+    PushServer server;
+    server.begin();
+    // Each segment used to be parsed as a request, the first one got a 400.
+    AsyncClient *client = AsyncServer::connect();
+    client->receive("GE");
+    client->receive("T /value?v=");
+    CHECK(client->output.empty());
+    client->receive("99 HTTP/1.1\r\nHost: tap\r\n");
+    CHECK(startsWith(client->output, "HTTP/1.1 200 OK"));
+    client->receive("Accept: */*\r\n\r\n");   // After the answer, the connection is closed.
+    client->disconnect();
+    CHECK(strcmp(server.getValue(), "99") == 0);
+    CHECK_EQUAL(1, server.getStats().requests);
+    CHECK_EQUAL(0, server.getStats().rejected);
+}
+
+static void testPendingLines() {
+    PushServer server;
+    server.begin();
+    AsyncClient *clients[PUSH_PENDING + 1];
+    for(uint8_t i = 0; i < PUSH_PENDING; i++) {
+        clients[i] = AsyncServer::connect();
+        clients[i]->receive("GET /slot?n=");
+    }
+    // No room for another split line.
+    clients[PUSH_PENDING] = AsyncServer::connect();
+    clients[PUSH_PENDING]->receive("GET /sl");
+    CHECK(startsWith(clients[PUSH_PENDING]->output, "HTTP/1.1 503"));
+    clients[PUSH_PENDING]->disconnect();
+    // A client that goes away frees its entry.
+    clients[0]->disconnect();
+    clients[0] = AsyncServer::connect();
+    clients[0]->receive("GET /slot?n=");
+    for(uint8_t i = 0; i < PUSH_PENDING; i++) {
+        char rest[32];
+        snprintf(rest, sizeof(rest), "%u HTTP/1.1\r\n", i);
+        clients[i]->receive(rest);
+        CHECK(startsWith(clients[i]->output, "HTTP/1.1 200 OK"));
+        CHECK_EQUAL(i, server.takeSlot());
+        clients[i]->disconnect();
+    }
+    // A line that never ends is cut off.
+    AsyncClient *client = AsyncServer::connect();
+    std::string line = "GET /value?v=1";
+    while(line.size() <= PUSH_LINE_LENGTH) line += "&x=1";
+    client->receive(line.c_str());
+    CHECK(startsWith(client->output, "HTTP/1.1 400 Bad Request"));
+    client->disconnect();
+    CHECK_EQUAL(PUSH_PENDING, server.getStats().requests);
+    CHECK_EQUAL(2, server.getStats().rejected);
+}
+
+static char downloadData[5000];
+
+static size_t readDownload(uint32_t offset, uint8_t *buffer, size_t length) {
+    length = min(length, sizeof(downloadData) - min((size_t)offset, sizeof(downloadData)));
+    memcpy(buffer, downloadData + offset, length);
+    return length;
+}
+
+static void testDownload() {
+    for(size_t i = 0; i < sizeof(downloadData); i++) {
+        downloadData[i] = 'a' + i % 26;
+    }
+    PushServer server;
+    server.begin();
+    CHECK(server.addDownload("/events", "application/octet-stream", readDownload));
+    CHECK(server.addDownload("/metrics", "text/plain", readDownload));
+    CHECK(!server.addDownload("/more", "text/plain", readDownload));
+
+    AsyncClient *client = AsyncServer::connect();
+    client->receive("GET /metrics HTTP/1.1\r\n");
+    // The headers come after the download started, they must not end up in it as a 400.
+    client->receive("Host: tap\r\nAccept: */*\r\n\r\n");
+    CHECK(!client->closed);
+    AsyncClient *second = AsyncServer::connect();
+    second->receive("GET /events HTTP/1.1\r\n\r\n");
+    CHECK(startsWith(second->output, "HTTP/1.1 503"));
+    second->disconnect();
+    for(uint8_t i = 0; i < 10 && !client->closed; i++) {
+        client->ack();
+    }
+    CHECK(client->closed);
+    const char *header = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n";
+    CHECK(startsWith(client->output, header));
+    CHECK(client->output.substr(strlen(header)) == std::string(downloadData, sizeof(downloadData)));
+    client->disconnect();
+    CHECK_EQUAL(1, server.getStats().downloads);
+    CHECK_EQUAL(sizeof(downloadData), server.getStats().downloadedBytes);
+    CHECK_EQUAL(2, server.getStats().requests);
+
+    // The next download starts from the beginning.
+    client = AsyncServer::connect();
+    client->receive("GET /events HTTP/1.1\r\n\r\n");
+    while(!client->closed) client->ack();
+    CHECK_EQUAL(strlen("HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nConnection: close\r\n\r\n")
+        + sizeof(downloadData), client->output.size());
+    client->disconnect();
+}
+
+static void testBurst() {
+    PushServer server;
+    server.begin();
+    // Every request is answered in its own callback, nothing waits for loop(). The host time is only a rough bound.
+    const int count = 1000;
+    auto start = std::chrono::steady_clock::now();
+    int answered = 0;
+    for(int i = 0; i < count; i++) {
+        char text[64];
+        snprintf(text, sizeof(text), "GET /value?v=%d HTTP/1.1\r\nHost: tap\r\n\r\n", i);
+        AsyncClient *client = AsyncServer::connect();
+        client->receive(text);
+        answered += startsWith(client->output, "HTTP/1.1 200 OK");
+        client->disconnect();
+    }
+    double perRequest = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / count;
+    printf("%d requests, %.2f us each on the host\n", count, perRequest);
+    CHECK_EQUAL(count, answered);
+    CHECK_EQUAL(count, server.getStats().requests);
+    CHECK(strcmp(server.getValue(), "999") == 0);
+    CHECK(perRequest < 100);
+}
+
+int main() {
+    RUN_TEST(testValue);
+    RUN_TEST(testBadValues);
+    RUN_TEST(testSlotAnimationAndBrightness);
+    RUN_TEST(testSplitRequestLine);
+    RUN_TEST(testPendingLines);
+    RUN_TEST(testDownload);
+    RUN_TEST(testBurst);
+    return testFailures != 0;
+}
@@ -0,0 +1,117 @@
+#include "test.h"
+#include <SerialLink.h>
+#include <vector>
+
+int testFailures = 0;
+
+static std::vector<std::string> frames;
+static std::vector<std::string> lines;
+
+static void onFrame(uint8_t type, const uint8_t *payload, size_t length) {
+    frames.push_back(std::string(1, (char)type) + std::string((const char *)payload, length));
+}
+
+static void onLine(const char *line) {
+    lines.push_back(line);
+}
+
+static SerialLink &freshLink() {
+    static SerialLink link;
+    frames.clear();
+    lines.clear();
+    link = SerialLink();
+    link.onFrame(onFrame);
+    link.onLine(onLine);
+    Serial.input.clear();
+    return link;
+}
+
+// Same framing as frame() in tools/serial_stream.py, without any delimiter.
+static std::string encode(char type, const char *payload) {
+    uint8_t body[SERIAL_FRAME_LENGTH];
+    size_t length = strlen(payload);
+    body[0] = type;
+    memcpy(body + 1, payload, length);
+    uint16_t crc = SerialLink::crc16(body, length + 1);
+    body[length + 1] = crc;
+    body[length + 2] = crc >> 8;
+    uint8_t encoded[SERIAL_FRAME_LENGTH + 2];
+    return std::string((const char *)encoded, SerialLink::cobsEncode(body, length + 3, encoded));
+}
+
+static void testOneDelimiterBetweenFrames() {
+    SerialLink &serial = freshLink();
+    Serial.input = std::string(1, '\0');
+    for(int i = 0; i < 10; i++) {
+        char payload[8];
+        snprintf(payload, sizeof(payload), "%d", i);
+        Serial.input += encode(SERIAL_FRAME_DISPLAY, payload) + std::string(1, '\0');
+    }
+    serial.poll();
+    // Every other frame used to be taken for a line of text.
+    CHECK_EQUAL(10, frames.size());
+    CHECK(frames.size() == 10 && frames[9] == "F9");
+    CHECK_EQUAL(0, lines.size());
+    CHECK_EQUAL(10, serial.getStats().frames);
+    CHECK_EQUAL(0, serial.getStats().framingErrors);
+}
+
+static void testTwoDelimitersBetweenFrames() {
+    SerialLink &serial = freshLink();
+    for(int i = 0; i < 10; i++) {
+        Serial.input += std::string(1, '\0') + encode(SERIAL_FRAME_COMMAND, "stats") + std::string(1, '\0');
+    }
+    serial.poll();
+    CHECK_EQUAL(10, frames.size());
+    CHECK(frames.size() == 10 && frames[0] == "Cstats");
+    CHECK_EQUAL(0, serial.getStats().framingErrors);
+}
+
+static void testTextAfterFrames() {
+    SerialLink &serial = freshLink();
+    Serial.input = std::string(1, '\0') + encode(SERIAL_FRAME_DISPLAY, "1") + std::string(1, '\0') + "help\r\n";
+    fakeMillis = 1000;
+    serial.poll();
+    CHECK_EQUAL(1, frames.size());
+    CHECK_EQUAL(0, lines.size());
+    // No 0x00 came, the bytes after the frame were typed.
+    fakeMillis += SERIAL_TEXT_TIMEOUT - 1;
+    serial.poll();
+    CHECK_EQUAL(0, lines.size());
+    fakeMillis += 1;
+    serial.poll();
+    CHECK(lines.size() == 1 && lines[0] == "help");
+    // The link is back in text mode.
+    Serial.input = "stats\n";
+    serial.poll();
+    CHECK(lines.size() == 2 && lines[1] == "stats");
+    CHECK_EQUAL(0, serial.getStats().framingErrors);
+}
+
+static void testTextWithoutFrames() {
+    SerialLink &serial = freshLink();
+    Serial.input = "led on\x7F\x7F\n\x1B[Aoff\n";
+    serial.poll();
+    CHECK(lines.size() == 2 && lines[0] == "led " && lines[1] == "off");
+    CHECK_EQUAL(0, frames.size());
+}
+
+static void testDamagedFrame() {
+    SerialLink &serial = freshLink();
+    std::string damaged = encode(SERIAL_FRAME_DISPLAY, "12");
+    damaged[2] ^= 0x01;
+    Serial.input = std::string(1, '\0') + damaged + std::string(1, '\0') + encode(SERIAL_FRAME_DISPLAY, "3") + std::string(1, '\0');
+    serial.poll();
+    // Only the damaged frame is lost, the delimiter after it still starts the next one.
+    CHECK(frames.size() == 1 && frames[0] == "F3");
+    CHECK_EQUAL(1, serial.getStats().crcErrors);
+}
+
+int main() {
+    RUN_TEST(testOneDelimiterBetweenFrames);
+    RUN_TEST(testTwoDelimitersBetweenFrames);
+    RUN_TEST(testTextAfterFrames);
+    RUN_TEST(testTextWithoutFrames);
+    RUN_TEST(testDamagedFrame);
+    return testFailures != 0;
+}
@@ -0,0 +1,215 @@
+#include "test.h"
+#include <Shell.h>
+#include <Config.h>
+
+int testFailures = 0;
+
+// Config.cpp needs the flash, only the fields are used here.
+Config config;
+
+// The parts of NixieTap.cpp the commands call, they only count here.
+const Setting *savedSetting = NULL;
+uint8_t mqttChanges = 0;
+
+void saveSetting(const Setting &setting) {
+    savedSetting = &setting;
+    if(setting.changed != NULL) {
+        setting.changed();
+    }
+}
+void weatherChanged() {
+}
+void cryptoChanged() {
+}
+void mqttChanged() {
+    mqttChanges++;
+}
+void powerChanged() {
+}
+void shellStats(Print &out, uint8_t argc, char **argv) {
+    out.println("stats");
+}
+void shellTime(Print &out, uint8_t argc, char **argv) {
+}
+void shellBench(Print &out, uint8_t argc, char **argv) {
+}
+void shellInit(Print &out, uint8_t argc, char **argv) {
+}
+void shellReboot(Print &out, uint8_t argc, char **argv) {
+}
+void shellEvents(Print &out, uint8_t argc, char **argv) {
+}
+
+class Output : public Print {
+public:
+    std::string text;
+    size_t write(uint8_t c) {
+        text += (char)c;
+        return 1;
+    }
+};
+
+static std::string run(const char *line) {
+    Output out;
+    serialShell.execute(line, strlen(line), out);
+    return out.text;
+}
+
+static size_t countLines(const std::string &text) {
+    size_t lines = 0;
+    for(char c : text) {
+        lines += c == '\n';
+    }
+    return lines;
+}
+
+static void testSettingNamesAreUnique() {
+    for(uint8_t i = 0; i < settingCount; i++) {
+        CHECK(findSetting(settings[i].name) == &settings[i]);
+    }
+    CHECK(findSetting("nope") == NULL);
+}
+
+static void testSettingsStayInsideTheConfig() {
+    const uint8_t *start = (const uint8_t *)&config + CONFIG_HEADER_SIZE;
+    const uint8_t *end = (const uint8_t *)&config + sizeof(Config);
+    for(uint8_t i = 0; i < settingCount; i++) {
+        const Setting &setting = settings[i];
+        const uint8_t *value = (const uint8_t *)setting.value;
+        size_t size = setting.type == SETTING_TEXT ? setting.max : setting.type == SETTING_UINT8 ? 1 : 2;
+        CHECK(value >= start && value + size <= end);
+        CHECK(setting.min <= setting.max);
+        if(setting.type == SETTING_UINT8) {
+            CHECK(setting.min >= 0 && setting.max <= 255);
+        } else if(setting.type == SETTING_INT16) {
+            CHECK(setting.min >= -32768 && setting.max <= 32767);
+        } else if(setting.type == SETTING_UINT16) {
+            CHECK(setting.min >= 0 && setting.max <= 65535);
+        }
+    }
+    CHECK_EQUAL(sizeof(config.mqtt_host), findSetting("mqtt_host")->max);
+    CHECK_EQUAL(sizeof(config.crypto_id), findSetting("crypto_id")->max);
+}
+
+static void testSecretsAreNotRemote() {
+    const char *local[] = {"ssid", "password", "target_ssid", "target_pw", "weather_key", "crypto_key", "mqtt_host", "mqtt_port",
+        "mqtt_topic", "mqtt_config"};
+    for(const char *name : local) {
+        const Setting *setting = findSetting(name);
+        CHECK(setting != NULL && !setting->remote);
+    }
+}
+
+static void testCommandTable() {
+    for(uint8_t i = 0; i < shellCommandCount; i++) {
+        const ShellCommand &command = shellCommands[i];
+        for(uint8_t j = 0; j < i; j++) {
+            CHECK(strcmp(command.name, shellCommands[j].name) != 0);
+        }
+        CHECK(command.minArgs <= command.maxArgs);
+        CHECK(command.maxArgs < SHELL_MAX_ARGS);
+        // help prints the name and the usage in a column of 32 characters.
+        CHECK(strlen(command.name) + 1 + strlen(command.usage) <= 32);
+        CHECK(command.run != NULL);
+    }
+}
+
+static void testHelpListsEveryCommand() {
+    beginShell();
+    std::string help = run("help");
+    CHECK_EQUAL(shellCommandCount, countLines(help));
+    for(uint8_t i = 0; i < shellCommandCount; i++) {
+        CHECK(help.find(shellCommands[i].help) != std::string::npos);
+    }
+}
+
+static void testGet() {
+    beginShell();
+    config.offset = -60;
+    CHECK_EQUAL(settingCount, countLines(run("get")));
+    CHECK(run("get offset") == "offset = -60\n");
+    CHECK(run("get nope") == "Unknown setting nope, type get for the list of settings.\n");
+    // The last argument keeps the rest of the line.
+    CHECK(run("get offset extra") == "Unknown setting offset extra, type get for the list of settings.\n");
+}
+
+static void testSetNumbers() {
+    beginShell();
+    config.enable_date = 1;
+    savedSetting = NULL;
+    CHECK(run("set enable_date 0") == "enable_date = 0\n");
+    CHECK_EQUAL(0, config.enable_date);
+    CHECK(savedSetting == findSetting("enable_date"));
+
+    savedSetting = NULL;
+    config.offset = 120;
+    CHECK(run("set offset -721") == "offset must be a number from -720 to 840.\n");
+    CHECK(run("set offset 12x") == "offset must be a number from -720 to 840.\n");
+    CHECK(run("set offset") == "offset must be a number from -720 to 840.\n");
+    CHECK_EQUAL(120, config.offset);
+    CHECK(savedSetting == NULL);
+    CHECK(run("set offset -720") == "offset = -720\n");
+    CHECK_EQUAL(-720, config.offset);
+
+    mqttChanges = 0;
+    CHECK(run("set mqtt_port 65535") == "mqtt_port = 65535\n");
+    CHECK_EQUAL(65535, config.mqtt_port);
+    CHECK_EQUAL(1, mqttChanges);
+}
+
+static void testSetTexts() {
+    beginShell();
+    CHECK(run("set weather_id 2643743") == "weather_id = 2643743\n");
+    CHECK(strcmp(config.weather_id, "2643743") == 0);
+    CHECK(run("set crypto_id bitcoin, ethereum") == "crypto_id = bitcoin, ethereum\n");
+    CHECK(run("set weather_id") == "weather_id = \n");
+    CHECK(config.weather_id[0] == '\0');
+
+    char line[SHELL_LINE_LENGTH];
+    snprintf(line, sizeof(line), "set crypto_id %0*d", CONFIG_CRYPTO_ID_LENGTH, 0);
+    strcpy(config.crypto_id, "bitcoin");
+    CHECK(run(line) == "crypto_id can be at most 29 characters long.\n");
+    CHECK(strcmp(config.crypto_id, "bitcoin") == 0);
+    CHECK(run("set nope 1") == "Unknown setting nope, type get for the list of settings.\n");
+}
+
+static void testMqtt() {
+    beginShell();
+    mqttChanges = 0;
+    CHECK(run("mqtt broker.local 1884 home/tap") == "MQTT broker saved.\n");
+    CHECK(strcmp(config.mqtt_host, "broker.local") == 0);
+    CHECK(strcmp(config.mqtt_topic, "home/tap") == 0);
+    CHECK_EQUAL(1884, config.mqtt_port);
+    CHECK_EQUAL(1, mqttChanges);
+    CHECK(run("mqtt off") == "MQTT turned off.\n");
+    CHECK(config.mqtt_host[0] == '\0');
+    CHECK(strcmp(config.mqtt_topic, "nixietap") == 0);
+    CHECK_EQUAL(MQTT_DEFAULT_PORT, config.mqtt_port);
+    CHECK(run("mqtt broker.local 0") == "Usage: mqtt <host|off> [port] [topic]\n");
+    CHECK(run("mqtt broker.local 65536") == "Usage: mqtt <host|off> [port] [topic]\n");
+    CHECK(run("mqtt broker.local 1883x") == "Usage: mqtt <host|off> [port] [topic]\n");
+    CHECK(run("mqtt") == "Usage: mqtt <host|off> [port] [topic]\n");
+    CHECK_EQUAL(2, mqttChanges);
+}
+
+static void testUnknownCommands() {
+    beginShell();
+    CHECK(run("stats") == "stats\n");
+    CHECK(run("stats now") == "Usage: stats \n");
+    CHECK(run("nope") == "Unknown command, type help for the list of commands.\n");
+    CHECK(run("").empty());
+}
+
+int main() {
+    RUN_TEST(testSettingNamesAreUnique);
+    RUN_TEST(testSettingsStayInsideTheConfig);
+    RUN_TEST(testSecretsAreNotRemote);
+    RUN_TEST(testCommandTable);
+    RUN_TEST(testHelpListsEveryCommand);
+    RUN_TEST(testGet);
+    RUN_TEST(testSetNumbers);
+    RUN_TEST(testSetTexts);
+    RUN_TEST(testMqtt);
+    RUN_TEST(testUnknownCommands);
+    return testFailures != 0;
+}
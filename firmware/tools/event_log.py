@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+"""Downloads and decodes the event log of NixieTap.
+
+    python3 event_log.py http://192.168.1.50:8080/events
+    python3 event_log.py /dev/ttyUSB0 --elf .pio/build/nixietap/firmware.elf
+    python3 event_log.py events.bin --save copy.bin
+
+The source is the URL of the push server, a serial port (the events dump
+command is sent and its hex lines are read back, it needs pyserial) or a
+file with a download. Every boot is printed with the reason of its reset,
+the exception frame after a crash and the events of the run before it,
+the events that were only in the RTC memory last. With --elf, the code
+addresses are looked up with addr2line. The format is described in
+lib/EventLog/EventLog.h.
+"""
+import argparse
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import time
+import urllib.request
+import zlib
+
+SECTORS, SECTOR_SIZE = 4, 4096
+LOG_MAGIC, RTC_MAGIC = 0x474C454E, 0x52474C4E
+RTC_EVENTS = 24
+RTC_SIZE = (14 + RTC_EVENTS * 2) * 4
+RECORD_RESET, RECORD_EVENTS = 1, 2
+RTC_INTACT, STACK_SAVED = 0x01, 0x02
+
+EVENTS = ["wifi_up", "wifi_down", "radio_off", "radio_on", "ntp_sync", "mqtt_up", "mqtt_down",
+          "portal_open", "portal_closed", "config_write", "overrun", "low_heap", "restart"]
+REASONS = ["power on", "hardware WDT", "exception", "software WDT", "restart", "deep sleep wake", "external reset"]
+CAUSES = {0: "IllegalInstruction", 1: "Syscall", 2: "InstructionFetchError", 3: "LoadStoreError",
+          4: "Level1Interrupt", 5: "Alloca", 6: "IntegerDivideByZero", 8: "Privileged", 9: "LoadStoreAlignment",
+          12: "InstrPIFDataError", 13: "LoadStorePIFDataError", 14: "InstrPIFAddrError", 15: "LoadStorePIFAddrError",
+          16: "InstTLBMiss", 17: "InstTLBMultiHit", 18: "InstFetchPrivilege", 20: "InstFetchProhibited",
+          24: "LoadStoreTLBMiss", 25: "LoadStoreTLBMultiHit", 26: "LoadStorePrivilege", 28: "LoadProhibited",
+          29: "StoreProhibited"}
+CRASHES = (1, 2, 3)
+
+
+def download_http(url):
+    with urllib.request.urlopen(url, timeout=10) as response:
+        return response.read()
+
+
+def download_serial(port, baud):
+    import serial
+    data, size = {}, 0
+    with serial.Serial(port, baud, timeout=1) as link:
+        link.reset_input_buffer()
+        link.write(b"events dump\n")
+        deadline = time.time() + 30
+        while time.time() < deadline:
+            line = link.readline().decode("ascii", "replace").strip()
+            if line == "end":
+                break
+            if line.startswith("size "):
+                size = int(line[5:])
+            match = re.fullmatch(r"([0-9a-f]{5}) ([0-9a-f]+)", line)
+            if match:
+                offset, chunk = int(match.group(1), 16), bytes.fromhex(match.group(2))
+                data[offset] = chunk
+        else:
+            sys.exit("No end of the dump, is the events command there?")
+    # The lines that were left out are erased flash.
+    image = bytearray(b"\xff" * size)
+    for offset, chunk in data.items():
+        image[offset:offset + len(chunk)] = chunk
+    return bytes(image)
+
+
+def read_records(sector):
+    """Yields (boot, type, payload) of the valid records of a sector, up to the first erased or damaged one."""
+    offset = 16
+    while offset + 8 <= SECTOR_SIZE:
+        crc, boot, kind, length = struct.unpack_from("<IHBB", sector, offset)
+        if sector[offset:offset + 8] == b"\xff" * 8:
+            return
+        padded = (length + 3) & ~3
+        if length == 0 or offset + 8 + padded > SECTOR_SIZE:
+            print("  (damaged record at 0x%03x)" % offset)
+            return
+        if zlib.crc32(sector[offset + 4:offset + 8 + length]) != crc:
+            print("  (record at 0x%03x fails its CRC)" % offset)
+            return
+        yield boot, kind, sector[offset + 8:offset + 8 + length]
+        offset += 8 + padded
+
+
+def sectors_in_order(flash):
+    found = []
+    for i in range(len(flash) // SECTOR_SIZE):
+        sector = flash[i * SECTOR_SIZE:(i + 1) * SECTOR_SIZE]
+        magic, sequence, first_boot, crc = struct.unpack_from("<IIII", sector)
+        if magic == LOG_MAGIC and zlib.crc32(sector[:12]) == crc:
+            found.append((sequence, sector))
+    return [sector for _, sector in sorted(found)]
+
+
+def lookup(elf, addresses):
+    tool = shutil.which("xtensa-lx106-elf-addr2line")
+    if elf is None or tool is None or not addresses:
+        return {}
+    output = subprocess.run([tool, "-pfiaC", "-e", elf] + ["0x%08x" % a for a in addresses],
+                            capture_output=True, text=True).stdout
+    lines = {}
+    for line in output.splitlines():
+        match = re.match(r"0x([0-9a-f]+): (.*)", line)
+        if match:
+            lines[int(match.group(1), 16)] = match.group(2)
+    return lines
+
+
+def print_reset(boot, payload, elf):
+    words = struct.unpack_from("<%dI" % (len(payload) // 4), payload)
+    reason, cause, epc1, epc2, epc3, excvaddr, depc, uptime, version, flags = words[:10]
+    stack = words[10:]
+    name = REASONS[reason] if reason < len(REASONS) else "reason %u" % reason
+    if reason == 0 and flags & RTC_INTACT:
+        name += ", the RTC memory survived: brownout?"
+    previous = "after %u s" % uptime if flags & RTC_INTACT else "previous run unknown"
+    print("== boot %u: %s, %s, firmware %u" % (boot, name, previous, version))
+    if reason in CRASHES:
+        print("   exception %u (%s), epc1 0x%08x, epc2 0x%08x, epc3 0x%08x, excvaddr 0x%08x, depc 0x%08x"
+              % (cause, CAUSES.get(cause, "?"), epc1, epc2, epc3, excvaddr, depc))
+    addresses = [a for a in (epc1, epc2, epc3, depc) if a] if reason in CRASHES else []
+    if flags & STACK_SAVED:
+        print("   stack: " + " ".join("0x%08x" % a for a in stack))
+        addresses += list(stack)
+    for address, line in lookup(elf, addresses).items():
+        print("   0x%08x %s" % (address, line))
+
+
+def print_events(payload):
+    for i in range(0, len(payload) - 7, 8):
+        ms, code, value = struct.unpack_from("<IHH", payload, i)
+        name = EVENTS[code - 1] if 1 <= code <= len(EVENTS) else "event %u" % code
+        if code in (1, 5):
+            value = struct.unpack("<h", struct.pack("<H", value))[0]     # RSSI and NTP errors are negative.
+        print("   %8u.%03u  %-14s %d" % (ms // 1000, ms % 1000, name, value))
+
+
+def decode(data, elf):
+    flash, rtc = data[:-RTC_SIZE], data[-RTC_SIZE:]
+    sectors = sectors_in_order(flash)
+    if not sectors:
+        print("No event log in the flash.")
+    current = None
+    for sector in sectors:
+        for boot, kind, payload in read_records(sector):
+            if kind == RECORD_RESET:
+                print_reset(boot, payload, elf)
+                current = boot
+            elif kind == RECORD_EVENTS:
+                if boot != current:
+                    print("== boot %u (its reset was overwritten)" % boot)
+                    current = boot
+                print_events(payload)
+
+    magic, boot, head, pending, uptime, crc = struct.unpack_from("<IHBBII", rtc)
+    if magic != RTC_MAGIC or zlib.crc32(rtc[:12]) != crc or head >= RTC_EVENTS or pending > RTC_EVENTS:
+        print("No events in the RTC memory.")
+        return
+    ring = [rtc[56 + 8 * i:64 + 8 * i] for i in range(RTC_EVENTS)]
+    unflushed = [ring[(head - pending + i) % RTC_EVENTS] for i in range(pending)]
+    print("== boot %u, running for %u s, %u events not flushed yet" % (boot, uptime, pending))
+    print_events(b"".join(unflushed))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source", help="http://<host>:8080/events, a serial port or a file")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--elf", help="firmware.elf of the build, to look up the code addresses")
+    parser.add_argument("--save", help="also write the raw log to this file")
+    args = parser.parse_args()
+
+    if args.source.startswith("http://"):
+        data = download_http(args.source)
+    elif args.source.startswith("/dev/") or args.source.upper().startswith("COM"):
+        data = download_serial(args.source, args.baud)
+    else:
+        with open(args.source, "rb") as f:
+            data = f.read()
+    if len(data) < RTC_SIZE:
+        sys.exit("Only %u bytes, not an event log." % len(data))
+    if args.save:
+        with open(args.save, "wb") as f:
+            f.write(data)
+    decode(data, args.elf)
+
+
+if __name__ == "__main__":
+    main()
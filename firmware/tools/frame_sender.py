@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Streams frames to NixieTap with the binary UDP protocol.
+
+    python3 frame_sender.py 192.168.1.50 --value 1234
+    python3 frame_sender.py 192.168.1.50 --counter --rate 50 --count 1000
+    python3 frame_sender.py 192.168.1.50 --counter --rate 200 --count 5000 --reorder 0.01 --drop 0.01
+
+The packet layout is described in lib/FrameReceiver/FrameReceiver.h.
+This is only a sender. --drop and --reorder leave out or swap frames on
+purpose and print the counters the device should show afterwards (the
+"stats" shell command). The sequence rules of the receiver, including
+FRAME_SEQUENCE_TIMEOUT, are tested on the host against the real
+FrameReceiver, see test/test_frame_receiver.cpp.
+"""
+import argparse
+import random
+import socket
+import struct
+import time
+
+PORT = 8266
+MAGIC = ord("N")
+VERSION = 1
+FLAG_RESET = 0x01
+DIGIT_OFF = 0xA
+
+
+def encode(sequence, value, dots=0, brightness=0, transition=0, flags=0):
+    """Packs a 4 character value ("12", "0042", " 7 1") into a 10 byte frame."""
+    text = value[-4:].rjust(4)
+    digits = [int(c) if c.isdigit() else DIGIT_OFF for c in text]
+    return struct.pack(">BBHBBBBBB", MAGIC, VERSION, sequence & 0xFFFF,
+                       digits[0] << 4 | digits[1], digits[2] << 4 | digits[3],
+                       dots, brightness, transition, flags)
+
+
+def send(sock, address, args):
+    interval = 1.0 / args.rate if args.rate else 0
+    held, dropped, reordered = None, 0, 0
+    start = next_send = time.perf_counter()
+    for i in range(args.count):
+        value = str(i % 10000) if args.counter else args.value
+        packet = encode(i, value, transition=args.transition, flags=FLAG_RESET if i == 0 else 0)
+        # The first and the last frame are always sent, a receiver can only see a gap between two frames.
+        middle = 0 < i < args.count - 1
+        if middle and random.random() < args.drop:
+            dropped += 1
+        elif middle and held is None and random.random() < args.reorder:
+            held = packet       # Sent after the next frame, so it arrives out of order.
+        else:
+            sock.sendto(packet, address)
+            if held is not None:
+                sock.sendto(held, address)
+                held, reordered = None, reordered + 1
+        if interval:
+            next_send += interval
+            delay = next_send - time.perf_counter()
+            if delay > 0:
+                time.sleep(delay)
+    elapsed = time.perf_counter() - start
+    print("sent %d frames in %.2f s, %.0f frames/s" % (args.count, elapsed, args.count / elapsed))
+    return dropped, reordered
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", nargs="?", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=PORT)
+    parser.add_argument("--value", default="0", help="value to send, up to 4 digits")
+    parser.add_argument("--counter", action="store_true", help="send 0, 1, 2... instead of --value")
+    parser.add_argument("--count", type=int, default=1)
+    parser.add_argument("--rate", type=float, default=20, help="frames per second, 0 is as fast as possible")
+    parser.add_argument("--transition", type=int, default=0, help="0 cut, 1 roll")
+    parser.add_argument("--drop", type=float, default=0, help="share of frames that are not sent")
+    parser.add_argument("--reorder", type=float, default=0, help="share of frames sent out of order")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    dropped, reordered = send(sock, (args.host, args.port), args)
+    if dropped or reordered:
+        # A reordered frame is counted once as lost (the gap) and once as out of order (when it arrives late).
+        print("expected on the device, if the network lost nothing: received %d, outOfOrder %d, lost %d"
+              % (args.count - dropped - reordered, reordered, dropped + reordered))
+
+
+if __name__ == "__main__":
+    main()
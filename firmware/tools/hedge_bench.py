@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""Measures the tail latency of hedged requests against local stand-in servers.
+
+    python3 hedge_bench.py
+    python3 hedge_bench.py --count 500 --stall 0.05 --seed 3
+    python3 hedge_bench.py --primary 300 --backup 120 --tail 0.1
+
+Two HTTP servers on localhost stand in for the primary and the backup
+service (e.g. ipify and seeip). Each answers after a random time, drawn
+from a log-normal around its median, with a long tail (--tail). Before a
+request reaches a server, the client may stall for 1 or 3 s, like a lost
+DNS answer or SYN (--stall).
+
+Every request is sent three ways:
+  single    the primary only
+  blocking  hedged, but the backup can't start before the connect of the
+            primary returned, as with a blocking WiFiClient::connect()
+  hedged    hedgedGet() in lib/NixieAPI: the connects don't block, the
+            backup is sent after the running median of the primary
+            (ProviderPolicy's estimate), at least HEDGE_MIN_DELAY ms
+and the latency percentiles of the three are printed.
+"""
+import argparse
+import asyncio
+import random
+import statistics
+import time
+
+HEDGE_MIN_DELAY = 150           # ms, as in NixieAPI.h
+MAX_CONNECTION_TIMEOUT = 5000
+HEALTH_INITIAL_LATENCY_MS = 1000
+
+
+class Median:
+    """The running median estimate of ProviderPolicy::updateHealth()."""
+
+    def __init__(self):
+        self.value = HEALTH_INITIAL_LATENCY_MS
+
+    def update(self, elapsed):
+        step = self.value // 8 + 1
+        if elapsed > self.value:
+            self.value += min(elapsed - self.value, step)
+        elif elapsed < self.value:
+            self.value -= min(self.value - elapsed, step)
+
+
+class StandIn:
+    def __init__(self, median, tail, rng):
+        self.median = median
+        self.tail = tail
+        self.rng = rng
+        self.port = 0
+
+    async def start(self):
+        server = await asyncio.start_server(self.serve, "127.0.0.1", 0)
+        self.port = server.sockets[0].getsockname()[1]
+        return server
+
+    async def serve(self, reader, writer):
+        try:
+            await reader.readuntil(b"\r\n\r\n")
+            delay = self.median * self.rng.lognormvariate(0, 0.3)
+            if self.rng.random() < self.tail:
+                delay *= self.rng.uniform(5, 20)
+            await asyncio.sleep(delay / 1000)
+            writer.write(b"HTTP/1.0 200 OK\r\nContent-Type: application/json\r\n\r\n{\"ip\":\"192.0.2.1\"}")
+            await writer.drain()
+        except (asyncio.IncompleteReadError, asyncio.CancelledError, ConnectionError):
+            pass
+        finally:
+            writer.close()
+
+
+async def get(port, stall):
+    """One request, the stall is spent before the connect like a DNS or SYN retry."""
+    await asyncio.sleep(stall / 1000)
+    reader, writer = await asyncio.open_connection("127.0.0.1", port)
+    try:
+        writer.write(b"GET / HTTP/1.0\r\nHost: stand-in\r\nConnection: close\r\n\r\n")
+        response = await reader.read()
+    finally:
+        writer.close()
+    if not response.startswith(b"HTTP/1.0 200"):
+        raise ConnectionError("bad answer")
+
+
+async def timed(coroutine):
+    start = time.perf_counter()
+    try:
+        await asyncio.wait_for(coroutine, MAX_CONNECTION_TIMEOUT / 1000)
+    except (asyncio.TimeoutError, OSError):
+        return None
+    return (time.perf_counter() - start) * 1000
+
+
+async def hedged(ports, stalls, median, blocking):
+    start = time.perf_counter()
+    delay = min(max(median.value, HEDGE_MIN_DELAY), MAX_CONNECTION_TIMEOUT) / 1000
+    primary = asyncio.ensure_future(get(ports[0], stalls[0]))
+    if blocking:
+        # The loop of the old hedgedGet() was stuck in connect() for the stall.
+        await asyncio.sleep(stalls[0] / 1000)
+    done, _ = await asyncio.wait([primary], timeout=max(0, delay - (time.perf_counter() - start)))
+    tasks = [primary]
+    if not done or primary.exception() is not None:
+        tasks.append(asyncio.ensure_future(get(ports[1], stalls[1])))
+    winner = None
+    deadline = start + MAX_CONNECTION_TIMEOUT / 1000
+    pending = set(tasks)
+    while pending and winner is None:
+        done, pending = await asyncio.wait(pending, timeout=max(0, deadline - time.perf_counter()),
+                                           return_when=asyncio.FIRST_COMPLETED)
+        if not done:
+            break
+        for task in done:
+            if task.exception() is None and winner is None:
+                winner = task
+    for task in pending:
+        task.cancel()
+    elapsed = (time.perf_counter() - start) * 1000
+    if winner is primary:
+        median.update(int(elapsed))
+    return elapsed if winner is not None else None
+
+
+def percentiles(name, latencies, count):
+    ok = sorted(x for x in latencies if x is not None)
+    if not ok:
+        print("%-9s all %d failed" % (name, count))
+        return
+    p = lambda q: ok[min(int(len(ok) * q), len(ok) - 1)]
+    print("%-9s p50 %6.0f  p90 %6.0f  p99 %6.0f  max %6.0f  failed %d" % (
+        name, statistics.median(ok), p(0.9), p(0.99), ok[-1], count - len(ok)))
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--count", type=int, default=200)
+    parser.add_argument("--primary", type=float, default=80, help="median ms of the primary")
+    parser.add_argument("--backup", type=float, default=120, help="median ms of the backup")
+    parser.add_argument("--tail", type=float, default=0.05, help="share of the answers that take 5-20 times longer")
+    parser.add_argument("--stall", type=float, default=0.03, help="share of the requests that stall 1 or 3 s before connecting")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    servers = [StandIn(args.primary, args.tail, rng), StandIn(args.backup, args.tail, rng)]
+    listening = [await server.start() for server in servers]
+    ports = [server.port for server in servers]
+    results = {"single": [], "blocking": [], "hedged": []}
+    medians = {"blocking": Median(), "hedged": Median()}
+    for _ in range(args.count):
+        stalls = [rng.choice((1000, 3000)) if rng.random() < args.stall else 0 for _ in range(2)]
+        results["single"].append(await timed(get(ports[0], stalls[0])))
+        results["blocking"].append(await hedged(ports, stalls, medians["blocking"], True))
+        results["hedged"].append(await hedged(ports, stalls, medians["hedged"], False))
+    for server in listening:
+        server.close()
+
+    print("%d requests, primary %.0f ms, backup %.0f ms, tail %.0f%%, stalls %.0f%%, latency in ms"
+          % (args.count, args.primary, args.backup, args.tail * 100, args.stall * 100))
+    for name, latencies in results.items():
+        percentiles(name, latencies, args.count)
+    print("hedge delay after the run: %d ms" % medians["hedged"].value)
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Mirrors the NixieTap tubes in the terminal, from the live view WebSocket.
+
+    python3 live_view.py 192.168.1.50
+    python3 live_view.py 192.168.1.50 --metrics
+
+Frames arrive in batches, they are replayed with the timing they had on
+the device. The message format is described in lib/LiveView/LiveView.h.
+"""
+import argparse
+import base64
+import os
+import socket
+import struct
+import sys
+import time
+
+
+def connect(host, port, path):
+    sock = socket.create_connection((host, port), timeout=10)
+    key = base64.b64encode(os.urandom(16)).decode()
+    sock.sendall(("GET %s HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                  "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n" % (path, host, port, key)).encode())
+    response = b""
+    while b"\r\n\r\n" not in response:
+        chunk = sock.recv(1024)
+        if not chunk:
+            raise ConnectionError("connection closed during the handshake")
+        response += chunk
+    if b" 101 " not in response.split(b"\r\n")[0]:
+        raise ConnectionError(response.split(b"\r\n")[0].decode())
+    sock.settimeout(None)
+    return sock, response.split(b"\r\n\r\n", 1)[1]
+
+
+def read_exact(sock, buffer, length):
+    while len(buffer) < length:
+        chunk = sock.recv(4096)
+        if not chunk:
+            raise ConnectionError("connection closed")
+        buffer += chunk
+    return buffer[:length], buffer[length:]
+
+
+def messages(sock, buffer):
+    """Yields the payloads of the WebSocket messages, the server never masks them."""
+    while True:
+        header, buffer = read_exact(sock, buffer, 2)
+        opcode, length = header[0] & 0x0F, header[1] & 0x7F
+        if length == 126:
+            extended, buffer = read_exact(sock, buffer, 2)
+            length = struct.unpack(">H", extended)[0]
+        elif length == 127:
+            extended, buffer = read_exact(sock, buffer, 8)
+            length = struct.unpack(">Q", extended)[0]
+        payload, buffer = read_exact(sock, buffer, length)
+        if opcode == 0x8:
+            return
+        if opcode == 0x9:   # Ping, answered with a masked pong.
+            sock.sendall(bytes([0x8A, 0x80 | len(payload)]) + b"\0\0\0\0" + payload)
+        elif opcode == 0x2:
+            yield payload
+
+
+def show(digits, dots):
+    text = "".join(str(d) if d <= 9 else " " for d in digits)
+    dot_text = "".join("." if dots & (0b10 << i) else " " for i in range(4))
+    sys.stdout.write("\r[ %s ]  dots [%s]   " % ("  ".join(text), dot_text))
+    sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=81)
+    parser.add_argument("--metrics", action="store_true", help="print the metrics instead of the tubes")
+    args = parser.parse_args()
+
+    sock, buffer = connect(args.host, args.port, "/live")
+    names, values = [], []
+    for message in messages(sock, buffer):
+        kind, count = chr(message[0]), message[1]
+        if kind == "F" and not args.metrics:
+            records = [struct.unpack("<IBBBB", message[2 + i * 8:10 + i * 8]) for i in range(count)]
+            start_device, start_host = records[0][0], time.monotonic()
+            for stamp, first, second, dots, _ in records:
+                delay = (stamp - start_device) / 1000.0 - (time.monotonic() - start_host)
+                if delay > 0:
+                    time.sleep(delay)
+                show([first >> 4, first & 0x0F, second >> 4, second & 0x0F], dots)
+        elif kind == "N":
+            names, values, offset = [], [], 2
+            for _ in range(count):
+                values.append(struct.unpack("<I", message[offset:offset + 4])[0])
+                end = message.index(b"\0", offset + 4)
+                names.append(message[offset + 4:end].decode())
+                offset = end + 1
+        elif kind == "M" and names:
+            for i in range(count):
+                index, delta = struct.unpack("<Bi", message[2 + i * 5:7 + i * 5])
+                values[index] = (values[index] + delta) & 0xFFFFFFFF
+            if args.metrics:
+                print("  ".join("%s=%d" % pair for pair in zip(names, values)))
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except KeyboardInterrupt:
+        print()
@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+"""Minimal MQTT 3.1.1 broker for testing NixieTap without mosquitto.
+
+    python3 mqtt_standin.py --port 1883
+
+Accepts any number of clients and supports what NixieTap uses: CONNECT
+with a last will, SUBSCRIBE with + and # wildcards, QoS 0 PUBLISH,
+retained messages, PINGREQ and DISCONNECT. Every packet is logged.
+Lines typed on stdin are published to the subscribers:
+
+    nixietap/value 1234
+    nixietap/config/enable_date 0
+    drop                        (closes all connections, to test reconnects)
+
+The config topics are only subscribed after "set mqtt_config 1" on the
+serial shell.
+"""
+import argparse
+import socket
+import struct
+import sys
+import threading
+
+CONNECT, CONNACK, PUBLISH, SUBSCRIBE, SUBACK, PINGREQ, PINGRESP, DISCONNECT = 1, 2, 3, 8, 9, 12, 13, 14
+
+
+def encode_length(length):
+    encoded = bytearray()
+    while True:
+        byte, length = length % 128, length // 128
+        encoded.append(byte | (0x80 if length else 0))
+        if not length:
+            return bytes(encoded)
+
+
+def encode_string(text):
+    data = text.encode()
+    return struct.pack(">H", len(data)) + data
+
+
+def packet(kind, flags, body):
+    return bytes([kind << 4 | flags]) + encode_length(len(body)) + body
+
+
+def matches(pattern, topic):
+    pattern, topic = pattern.split("/"), topic.split("/")
+    for i, level in enumerate(pattern):
+        if level == "#":
+            return True
+        if i >= len(topic) or (level != "+" and level != topic[i]):
+            return False
+    return len(pattern) == len(topic)
+
+
+class Broker:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.clients = {}       # socket -> list of subscribed patterns
+        self.retained = {}
+
+    def publish(self, topic, payload, retain=False):
+        print("PUBLISH %s %r%s" % (topic, payload, " (retained)" if retain else ""))
+        with self.lock:
+            if retain:
+                self.retained[topic] = payload
+            targets = [s for s, patterns in self.clients.items() if any(matches(p, topic) for p in patterns)]
+        data = packet(PUBLISH, 0, encode_string(topic) + payload)
+        for sock in targets:
+            try:
+                sock.sendall(data)
+            except OSError:
+                pass
+
+    def drop_all(self):
+        with self.lock:
+            sockets = list(self.clients)
+        for sock in sockets:
+            sock.close()
+
+    def serve(self, sock, address):
+        will, client_id = None, "?"
+        with self.lock:
+            self.clients[sock] = []
+        try:
+            stream = sock.makefile("rb")
+            while True:
+                header = stream.read(1)
+                if not header:
+                    break
+                kind, flags = header[0] >> 4, header[0] & 0x0F
+                length, shift = 0, 0
+                while True:
+                    byte = stream.read(1)[0]
+                    length |= (byte & 0x7F) << shift
+                    shift += 7
+                    if not byte & 0x80:
+                        break
+                body = stream.read(length)
+                if kind == CONNECT:
+                    name_length = struct.unpack(">H", body[:2])[0]
+                    level, connect_flags = body[2 + name_length], body[3 + name_length]
+                    offset = 6 + name_length
+                    id_length = struct.unpack(">H", body[offset:offset + 2])[0]
+                    client_id = body[offset + 2:offset + 2 + id_length].decode()
+                    offset += 2 + id_length
+                    if connect_flags & 0x04:
+                        topic_length = struct.unpack(">H", body[offset:offset + 2])[0]
+                        topic = body[offset + 2:offset + 2 + topic_length].decode()
+                        offset += 2 + topic_length
+                        message_length = struct.unpack(">H", body[offset:offset + 2])[0]
+                        will = (topic, body[offset + 2:offset + 2 + message_length], bool(connect_flags & 0x20))
+                    print("CONNECT %s from %s:%d, protocol level %d, will %s" % (client_id, address[0], address[1], level, will))
+                    sock.sendall(packet(CONNACK, 0, b"\x00\x00"))
+                elif kind == SUBSCRIBE:
+                    packet_id, offset, granted, patterns = body[:2], 2, b"", []
+                    while offset < len(body):
+                        topic_length = struct.unpack(">H", body[offset:offset + 2])[0]
+                        patterns.append(body[offset + 2:offset + 2 + topic_length].decode())
+                        offset += 3 + topic_length
+                        granted += b"\x00"
+                    print("SUBSCRIBE %s %s" % (client_id, patterns))
+                    with self.lock:
+                        self.clients[sock].extend(patterns)
+                        retained = [(t, p) for t, p in self.retained.items() if any(matches(x, t) for x in patterns)]
+                    sock.sendall(packet(SUBACK, 0, packet_id + granted))
+                    for topic, payload in retained:
+                        sock.sendall(packet(PUBLISH, 1, encode_string(topic) + payload))
+                elif kind == PUBLISH:
+                    topic_length = struct.unpack(">H", body[:2])[0]
+                    topic = body[2:2 + topic_length].decode()
+                    offset = 2 + topic_length + (2 if flags & 0x06 else 0)
+                    self.publish(topic, body[offset:], bool(flags & 0x01))
+                elif kind == PINGREQ:
+                    sock.sendall(packet(PINGRESP, 0, b""))
+                elif kind == DISCONNECT:
+                    will = None
+                    break
+        except (OSError, IndexError):
+            pass
+        finally:
+            with self.lock:
+                self.clients.pop(sock, None)
+            sock.close()
+            print("DISCONNECT %s" % client_id)
+            if will:
+                self.publish(*will)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=1883)
+    args = parser.parse_args()
+
+    broker = Broker()
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(("0.0.0.0", args.port))
+    server.listen()
+    print("Listening on port %d" % args.port)
+
+    def accept():
+        while True:
+            sock, address = server.accept()
+            threading.Thread(target=broker.serve, args=(sock, address), daemon=True).start()
+
+    threading.Thread(target=accept, daemon=True).start()
+    for line in sys.stdin:
+        line = line.strip()
+        if line == "drop":
+            broker.drop_all()
+        elif line:
+            topic, _, payload = line.partition(" ")
+            broker.publish(topic, payload.encode())
+
+
+if __name__ == "__main__":
+    main()
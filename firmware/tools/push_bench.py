@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Drives the NixieTap push API and measures the request latency.
+
+Sends a burst of /value requests (or any other endpoint) to the PushServer
+on port 8080 and prints the latency percentiles of the answers.
+
+    python3 push_bench.py 192.168.1.50 --count 200
+    python3 push_bench.py 192.168.1.50 --path "/slot?n=0" --count 10
+"""
+import argparse
+import socket
+import statistics
+import time
+
+
+def request(host, port, path, timeout):
+    start = time.perf_counter()
+    with socket.create_connection((host, port), timeout=timeout) as sock:
+        sock.sendall(("GET %s HTTP/1.1\r\nHost: %s\r\n\r\n" % (path, host)).encode())
+        response = b""
+        while True:
+            chunk = sock.recv(256)
+            if not chunk:
+                break
+            response += chunk
+    elapsed = (time.perf_counter() - start) * 1000
+    status = response.split(b" ", 2)[1].decode() if response.startswith(b"HTTP/") else "???"
+    return elapsed, status
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--path", help="fixed request path, by default /value?v=<counter>")
+    parser.add_argument("--count", type=int, default=100)
+    parser.add_argument("--interval", type=float, default=0, help="pause between requests (s)")
+    parser.add_argument("--timeout", type=float, default=2)
+    args = parser.parse_args()
+
+    latencies, failures = [], 0
+    for i in range(args.count):
+        path = args.path or "/value?v=%d" % (i % 10000)
+        try:
+            elapsed, status = request(args.host, args.port, path, args.timeout)
+        except OSError as error:
+            print("request %d failed: %s" % (i, error))
+            failures += 1
+            continue
+        if status != "200":
+            print("request %d answered %s" % (i, status))
+            failures += 1
+        latencies.append(elapsed)
+        if args.interval:
+            time.sleep(args.interval)
+
+    if not latencies:
+        return
+    latencies.sort()
+    print("requests: %d, failed: %d" % (args.count, failures))
+    print("latency ms  min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f" % (
+        latencies[0], statistics.median(latencies), latencies[int(len(latencies) * 0.9)],
+        latencies[min(int(len(latencies) * 0.99), len(latencies) - 1)], latencies[-1]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""Reports the RAM use of a firmware build from its linker map.
+
+    python3 ram_report.py firmware.map
+    python3 ram_report.py before.map after.map
+    python3 ram_report.py --top 20 firmware.map
+
+platformio.ini links with -Wl,-Map,firmware.map, so every build leaves
+the map in the project directory. Copy it aside, build the other commit
+and pass both maps to see what moved. On the ESP8266 .data, .rodata and
+.bss all live in the 80 KB of DRAM, string literals that aren't PROGMEM
+included. What is left after them, up to the end of the user DRAM, is the
+heap at boot, before the SDK and the WiFi stack take their share. The
+heap after setup() is printed by the device ("Boot: ..." in the log and
+"Free heap" in the stats command).
+
+The objects with the most bytes in each RAM section are listed, with two
+maps the ones that changed the most.
+"""
+import argparse
+import collections
+import re
+
+DRAM_SECTIONS = [".data", ".rodata", ".bss"]
+OTHER_SECTIONS = [".text", ".irom0.text"]   # IRAM and flash, listed for completeness.
+DRAM_END = 0x3FFFC000                       # End of the user DRAM, the SDK keeps the rest.
+
+OUTPUT_SECTION = re.compile(r"^(\.\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)")
+INPUT_SECTION = re.compile(r"^ (\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+HEAP_START = re.compile(r"^\s+0x([0-9a-f]+)\s+_heap_start\b")
+
+
+class Map:
+    def __init__(self, path):
+        self.path = path
+        self.sections = {}
+        self.objects = collections.defaultdict(collections.Counter)
+        self.heap_start = None
+        self.parse(path)
+
+    def parse(self, path):
+        started = False
+        section = None
+        with open(path, errors="replace") as lines:
+            for line in lines:
+                line = line.rstrip("\n")
+                if not started:
+                    started = line.startswith("Linker script and memory map")
+                    continue
+                match = OUTPUT_SECTION.match(line)
+                if match:
+                    section = match.group(1)
+                    self.sections[section] = int(match.group(3), 16)
+                    continue
+                match = HEAP_START.match(line)
+                if match:
+                    self.heap_start = int(match.group(1), 16)
+                    continue
+                match = INPUT_SECTION.match(line)
+                if match and section is not None and not line.startswith(" *"):
+                    # A long input section name is on the line before, the size and the object follow alone.
+                    self.objects[section][short_name(match.group(4))] += int(match.group(3), 16)
+
+    def dram(self):
+        return sum(self.sections.get(name, 0) for name in DRAM_SECTIONS)
+
+    def heap(self):
+        return DRAM_END - self.heap_start if self.heap_start is not None else None
+
+
+def short_name(path):
+    """libFrameworkArduino.a(core_esp8266_main.cpp.o) or src/NixieTap.cpp.o, without the build directory."""
+    match = re.search(r"([^/\\]+\.a)\(([^)]+)\)$", path)
+    if match:
+        return "%s(%s)" % (match.group(1), match.group(2))
+    return re.split(r"[/\\]", path)[-1]
+
+
+def report(build, top):
+    print(build.path)
+    for name in DRAM_SECTIONS + OTHER_SECTIONS:
+        print("  %-12s %8d bytes" % (name, build.sections.get(name, 0)))
+    print("  DRAM used    %8d bytes" % build.dram())
+    if build.heap() is not None:
+        print("  heap at boot %8d bytes, before the SDK and WiFi" % build.heap())
+    for name in DRAM_SECTIONS:
+        print("\nLargest in %s:" % name)
+        for obj, size in build.objects[name].most_common(top):
+            print("  %8d  %s" % (size, obj))
+
+
+def compare(before, after, top):
+    print("%-12s %10s %10s %8s" % ("", "before", "after", "change"))
+    for name in DRAM_SECTIONS + OTHER_SECTIONS:
+        old, new = before.sections.get(name, 0), after.sections.get(name, 0)
+        print("%-12s %10d %10d %+8d" % (name, old, new, new - old))
+    print("%-12s %10d %10d %+8d" % ("DRAM used", before.dram(), after.dram(), after.dram() - before.dram()))
+    if before.heap() is not None and after.heap() is not None:
+        print("%-12s %10d %10d %+8d" % ("heap at boot", before.heap(), after.heap(), after.heap() - before.heap()))
+    for name in DRAM_SECTIONS:
+        changes = collections.Counter(after.objects[name])
+        changes.subtract(before.objects[name])
+        moved = sorted((obj for obj in changes if changes[obj] != 0), key=lambda obj: -abs(changes[obj]))[:top]
+        if moved:
+            print("\nChanged in %s:" % name)
+            for obj in moved:
+                print("  %+8d  %s" % (changes[obj], obj))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("maps", nargs="+", help="one map to report, or two to compare")
+    parser.add_argument("--top", type=int, default=10, help="objects listed per section")
+    args = parser.parse_args()
+    if len(args.maps) > 2:
+        parser.error("at most two maps")
+    builds = [Map(path) for path in args.maps]
+    for build in builds:
+        if not build.sections:
+            parser.error("%s has no memory map, is it a linker map?" % build.path)
+    if len(builds) == 1:
+        report(builds[0], args.top)
+    else:
+        compare(builds[0], builds[1], args.top)
+
+
+if __name__ == "__main__":
+    main()
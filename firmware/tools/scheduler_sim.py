@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""Simulates the job scheduler of NixieTap on the host.
+
+    python3 scheduler_sim.py
+    python3 scheduler_sim.py --duration 3600 --seed 7
+    python3 scheduler_sim.py --network-scale 4 --animation-rate 0.5
+
+The scheduling rules are the ones of JobScheduler::run() and runJob() in
+lib/JobScheduler: light jobs earliest deadline first, one heavy (network)
+job per pass, heavy jobs coalesced within JOB_COALESCE_WINDOW without
+moving their later runs, fixed rate jobs that keep their phase and skip
+the periods they missed. The job
+table and the run times below are rough measurements of the firmware,
+scale them to see how much room the fixed rate jobs have left. The report
+has the same columns as the stats command on the device.
+"""
+import argparse
+import random
+
+COALESCE_WINDOW = 5000
+YIELD_TIME = 0.05       # WiFi stack run between two jobs (ms).
+
+
+class Job:
+    def __init__(self, name, interval, deadline, duration, heavy=False, fixed_rate=False):
+        self.name = name
+        self.interval = interval
+        self.deadline = deadline
+        self.duration = duration    # Function returning the run time of one run (ms).
+        self.heavy = heavy
+        self.fixed_rate = fixed_rate
+        self.next_run = 0.0
+        self.planned_run = None     # Set while a run is pulled forward, the runs after it keep that phase.
+        self.runs = 0
+        self.overruns = 0
+        self.missed = 0
+        self.max_latency = 0.0
+        self.latencies = []
+        self.max_duration = 0.0
+        self.total_time = 0.0
+
+
+def firmware_jobs(rng, args):
+    """The jobs of setup(), with run times in ms."""
+    net = args.network_scale
+
+    def display():
+        # A touch starts the slot machine animation, ten digits 25 ms apart.
+        return 250.0 if rng.random() < args.animation_rate * 0.02 else rng.uniform(0.3, 0.8)
+
+    def config():
+        # Mostly nothing to write, sometimes a record, rarely a sector erase.
+        r = rng.random()
+        return 45.0 if r < 0.002 else 1.5 if r < 0.05 else 0.02
+
+    def events():
+        # The RTC memory is written every second, a flush every few minutes, an erase every few days.
+        r = rng.random()
+        return 45.0 if r < 0.00001 else 1.0 if r < 0.005 else 0.03
+
+    return [
+        Job("input", 10, 10, lambda: rng.uniform(0.05, 0.4), fixed_rate=True),
+        Job("display", 20, 20, display, fixed_rate=True),
+        Job("prefetch", 1000, 1000, lambda: 0.05),
+        Job("crypto", 900000, 10000, lambda: net * rng.uniform(300, 1200), heavy=True),     # While the clock is shown.
+        Job("weather", 300000, 300000, lambda: net * rng.uniform(200, 900), heavy=True),
+        Job("quota", 3600000, 60000, lambda: 0.1),
+        Job("mqtt", 5000, 10000, lambda: net * rng.uniform(1, 30), heavy=True),
+        Job("health", 60000, 10000, lambda: 2.0),
+        Job("liveframe", 50, 50, lambda: rng.uniform(0.05, 0.3)),
+        Job("livemetric", 1000, 1000, lambda: 0.8),
+        Job("config", 1000, 1000, config),
+        Job("log", 10, 1000, lambda: rng.uniform(0.02, 0.3)),
+        Job("events", 1000, 10000, events),
+    ]
+
+
+def run_job(job, now):
+    latency = now - job.next_run
+    job.latencies.append(latency)
+    job.max_latency = max(job.max_latency, latency)
+    if latency > job.deadline:
+        job.overruns += 1
+    if job.fixed_rate:
+        skipped = int(latency // job.interval)
+        job.missed += skipped
+        job.next_run += (skipped + 1) * job.interval
+    elif job.planned_run is not None and job.planned_run > now:
+        job.next_run = job.planned_run + job.interval
+    else:
+        job.next_run = now + job.interval
+    job.planned_run = None
+    duration = job.duration()
+    job.max_duration = max(job.max_duration, duration)
+    job.total_time += duration
+    job.runs += 1
+    return now + duration + YIELD_TIME
+
+
+def scheduler_pass(jobs, now):
+    """One call of JobScheduler::run(), returns the time it ends."""
+    done = set()
+    heavy = None
+    while True:
+        due = [j for j in jobs if j not in done and now >= j.next_run]
+        light = [j for j in due if not j.heavy]
+        heavy_due = [j for j in due if j.heavy]
+        heavy = min(heavy_due, key=lambda j: j.next_run + j.deadline - now) if heavy_due else None
+        if not light:
+            break
+        job = min(light, key=lambda j: j.next_run + j.deadline - now)
+        done.add(job)
+        now = run_job(job, now)
+    if heavy is None:
+        return now
+    now = run_job(heavy, now)
+    for job in jobs:
+        if job is not heavy and job.heavy and 0 < job.next_run - now <= COALESCE_WINDOW:
+            if job.planned_run is None:
+                job.planned_run = job.next_run
+            job.next_run = now
+    return now
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))] if values else 0.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--duration", type=float, default=600, help="simulated time (s)")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--network-scale", type=float, default=1.0, help="multiplies the run time of the network jobs")
+    parser.add_argument("--animation-rate", type=float, default=0.1, help="touches per second that start an animation")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    jobs = firmware_jobs(rng, args)
+    end = args.duration * 1000
+    now = 0.0
+    while now < end:
+        after = scheduler_pass(jobs, now)
+        # Nothing was due, skip the empty loop() passes up to the next job.
+        now = after if after > now else max(now, min(job.next_run for job in jobs))
+
+    print("Job        runs  overruns  missed  latency(p99/max ms)  duration(max ms)  load(%)")
+    for job in jobs:
+        print("%-10s %6d %9d %7d %9.1f/%-9.1f %16.1f %8.2f" % (job.name, job.runs, job.overruns, job.missed,
+              percentile(job.latencies, 0.99), job.max_latency, job.max_duration, 100 * job.total_time / end))
+    busy = sum(job.total_time for job in jobs)
+    print("CPU busy: %.1f%% of %.0f s" % (100 * busy / end, args.duration))
+    fixed = [job for job in jobs if job.fixed_rate]
+    if any(job.missed for job in fixed):
+        print("Fixed rate jobs missed %d periods." % sum(job.missed for job in fixed))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""Streams display frames to NixieTap over the serial port.
+
+    seq 0 9999 | python3 serial_stream.py /dev/ttyUSB0 --fps 100
+    python3 serial_stream.py /dev/ttyUSB0 --counter 5000 --fps 0
+    python3 serial_stream.py /dev/ttyUSB0 --command stats
+
+Every line on stdin is one frame: up to 4 digits (a space turns a tube
+off), optionally followed by the dots as a number ("1234 6"). Once per
+second the device is asked for its frame counters, and the rate that was
+sent is printed next to the rate the tubes actually showed. The framing
+is described in lib/SerialLink/SerialLink.h, it needs pyserial.
+"""
+import argparse
+import struct
+import sys
+import threading
+import time
+
+import serial
+
+from frame_sender import encode, FLAG_RESET
+
+FRAME_DISPLAY, FRAME_COMMAND, FRAME_STATS = b"F", b"C", b"S"
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    output, block = bytearray(), bytearray()
+    for byte in data:
+        if byte == 0:
+            output += bytes([len(block) + 1]) + block
+            block = bytearray()
+        else:
+            block.append(byte)
+            if len(block) == 254:
+                output += b"\xff" + block
+                block = bytearray()
+    return bytes(output + bytes([len(block) + 1]) + block)
+
+
+def cobs_decode(data):
+    output, i = bytearray(), 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        output += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(data):
+            output.append(0)
+    return bytes(output)
+
+
+def frame(kind, payload=b""):
+    """Only the delimiter after the frame, the one before is the end of the last frame."""
+    body = kind + payload
+    return cobs_encode(body + struct.pack("<H", crc16(body))) + b"\0"
+
+
+class Reader(threading.Thread):
+    """Prints the text the device sends and keeps the last stats frame."""
+
+    def __init__(self, port):
+        super().__init__(daemon=True)
+        self.port = port
+        self.stats = None
+        self.updated = threading.Event()
+
+    def run(self):
+        buffer, in_frame = bytearray(), False
+        while True:
+            for byte in self.port.read(self.port.in_waiting or 1):
+                if byte == 0:
+                    if in_frame and buffer:
+                        self.receive(bytes(buffer))
+                        in_frame = False
+                    else:
+                        in_frame = True
+                    buffer = bytearray()
+                elif in_frame:
+                    buffer.append(byte)
+                elif byte == ord("\n"):
+                    sys.stderr.write("device: %s\n" % buffer.decode(errors="replace").rstrip("\r"))
+                    buffer = bytearray()
+                else:
+                    buffer.append(byte)
+
+    def receive(self, data):
+        decoded = cobs_decode(data)
+        if not decoded or len(decoded) < 3 or struct.unpack("<H", decoded[-2:])[0] != crc16(decoded[:-2]):
+            sys.stderr.write("device: damaged frame\n")
+        elif decoded[:1] == FRAME_STATS:
+            names = ("millis", "received", "applied", "superseded", "outOfOrder", "lost", "malformed", "crcErrors", "framingErrors")
+            self.stats = dict(zip(names, struct.unpack("<9I", decoded[1:-2])))
+            self.updated.set()
+
+
+def request_stats(port, reader):
+    reader.updated.clear()
+    port.write(frame(FRAME_STATS))
+    return reader.stats if reader.updated.wait(1) else None
+
+
+def values(args):
+    if args.counter:
+        for i in range(args.counter):
+            yield "%04d" % (i % 10000), 0
+        return
+    for line in sys.stdin:
+        parts = line.rstrip("\n").split(" ", 1) if line.strip() else []
+        if parts:
+            yield parts[0], int(parts[1]) if len(parts) > 1 and parts[1].strip() else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--fps", type=float, default=100, help="frames per second, 0 is as fast as possible")
+    parser.add_argument("--counter", type=int, default=0, help="send this many counting frames instead of reading stdin")
+    parser.add_argument("--transition", type=int, default=0, help="0 cut, 1 roll")
+    parser.add_argument("--command", help="send one text command as a frame and exit")
+    args = parser.parse_args()
+
+    port = serial.Serial(args.port, args.baud, timeout=0.1)
+    port.write(b"\0")   # Starts the first frame, a half typed line is dropped.
+    reader = Reader(port)
+    reader.start()
+    if args.command:
+        port.write(frame(FRAME_COMMAND, args.command.encode()))
+        time.sleep(1)
+        return
+
+    interval = 1.0 / args.fps if args.fps else 0
+    start = next_send = last_report = time.perf_counter()
+    last_stats, sent, last_sent = request_stats(port, reader), 0, 0
+    for sequence, (value, dots) in enumerate(values(args)):
+        port.write(frame(FRAME_DISPLAY, encode(sequence, value, dots, 0, args.transition, FLAG_RESET if sequence == 0 else 0)))
+        sent += 1
+        if interval:
+            next_send += interval
+            delay = next_send - time.perf_counter()
+            if delay > 0:
+                time.sleep(delay)
+        now = time.perf_counter()
+        if now - last_report >= 1:
+            stats = request_stats(port, reader)
+            if stats and last_stats:
+                elapsed = (stats["millis"] - last_stats["millis"]) / 1000.0
+                print("sent %.0f fps, shown %.0f fps, superseded %d, lost %d, damaged %d" % (
+                    (sent - last_sent) / (now - last_report), (stats["applied"] - last_stats["applied"]) / elapsed,
+                    stats["superseded"] - last_stats["superseded"], stats["lost"] - last_stats["lost"],
+                    stats["crcErrors"] + stats["framingErrors"] - last_stats["crcErrors"] - last_stats["framingErrors"]))
+            last_stats, last_sent, last_report = stats or last_stats, sent, now
+    elapsed = time.perf_counter() - start
+    print("%d frames in %.1f s, %.0f fps" % (sent, elapsed, sent / elapsed if elapsed else 0))
+    stats = request_stats(port, reader)
+    if stats:
+        print("device: %s" % stats)
+
+
+if __name__ == "__main__":
+    main()